@@ -106,10 +106,13 @@ void LcdCommand(u8 u8Command_)
   /* Queue the command to the IC application */
   TwiWriteData(U8_LCD_ADDRESS, sizeof(au8LCDWriteCommand), &au8LCDWriteCommand[0], TWI_STOP);
 
-  /* Add a delay during initialization to let the command send properly */
-  if(G_u32SystemFlags & _SYSTEM_INITIALIZING )
+  /* During initialization the TWI manual mode has already sent the command, so only the 
+  slow commands need time to execute before the next one arrives */
+  if( (G_u32SystemFlags & _SYSTEM_INITIALIZING) &&
+      ( (u8Command_ == LCD_CLEAR_CMD) || (u8Command_ == LCD_HOME_CMD) ) )
   {
-    for(u32 i = 0; i < 100000; i++);
+    Lcd_u32Timer = G_u32SystemTime1ms;
+    while( !IsTimeUp(&Lcd_u32Timer, U8_LCD_CLEAR_HOME_DELAY_MS) );
   }
   
 } /* end LcdCommand() */
@@ -233,6 +236,9 @@ void LcdInitialize(void)
   Lcd_u32Timer = G_u32SystemTime1ms;
   while( !IsTimeUp(&Lcd_u32Timer, U8_LCD_STARTUP_DELAY_MS) );
   
+  /* The LCD controller supports fast mode so text updates run at 400 kHz */
+  TwiSetSlaveSpeed(U8_LCD_ADDRESS, U32_TWI_SPEED_400KHZ);
+  
   /* Send Control Command */
   u8Byte = LCD_CONTROL_COMMAND;
   TwiWriteData(U8_LCD_ADDRESS, 1, &u8Byte, TWI_NO_STOP);
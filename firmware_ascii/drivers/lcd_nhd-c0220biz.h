@@ -68,6 +68,7 @@ Constants / Definitions
 /*! @cond DOXYGEN_EXCLUDE */
 #define U8_LCD_STARTUP_DELAY_MS           (u8)40     /* Time in ms to wait for LCD startup */
 #define U8_LCD_CONTROL_COMMAND_DELAY_MS   (u8)200    /* Time in ms to wait for LCD Command Instructions */
+#define U8_LCD_CLEAR_HOME_DELAY_MS        (u8)2      /* Time in ms for LCD_CLEAR_CMD and LCD_HOME_CMD to execute (1.08ms max) */
 
 #define U8_LCD_MESSAGE_OVERHEAD_SIZE      (u8)1      /* Number of header bytes for an LCD message */
 
@@ -55,6 +55,7 @@ Variable names shall start with "Bladelsm6dsl_<type>" and be declared as static.
 ***********************************************************************************************************************/
 static fnCode_type Bladelsm6dsl_pfStateMachine;           /*!< @brief The state machine function pointer */
 static u32 Bladelsm6dsl_u32Timeout;                       /*!< @brief Timeout counter used across states */
+static u32 Bladelsm6dsl_u32ReadToken;                     /*!< @brief Status token of the data read in progress */
 
 
 /**********************************************************************************************************************
@@ -129,6 +130,9 @@ void Bladelsm6dslInitialize(void)
     DebugPrintf("LSM6DSL Blade pin resources allocated\n\r"); 
   }
   
+  /* The LSM6DSL supports fast mode so its burst reads run at 400 kHz whatever the bus speed is */
+  TwiSetSlaveSpeed(U8_LSM6DSL_I2C_ADDRESS, U32_TWI_SPEED_400KHZ);
+  
   /* Ping the accelerometer to check it's responding by reading its ID byte */
   TwiWriteReadData(U8_LSM6DSL_I2C_ADDRESS, U8_WHO_AM_I, &u8RxMessage, 1);
   if(u8RxMessage != U8_LSM6DSL_ID)
@@ -188,70 +192,133 @@ void Bladelsm6dslRunActiveState(void)
 /*--------------------------------------------------------------------------------------------------------------------*/
 
 
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void Bladelsm6dslReportData(void)
+
+@brief Sends the values in G_u32Bladelsm6dslData out the debug port on one line.
+
+Currently this makes no attempt to format or process the values.  The line is formatted straight 
+into a debug message slot; if none is free this line is skipped.
+
+Requires:
+- G_u32Bladelsm6dslData holds a complete read from the IMU
+
+Promises:
+- The 7 values are queued to the debug port as 5-digit numbers
+
+*/
+static void Bladelsm6dslReportData(void)
+{
+  MessageType* psOutputMessage;
+  u32 u32Number;
+  u8 au8NumberString[11];
+  u8* pu8NumberIndex;
+  u8* pu8NumberParser;
+  u8* pu8StringParser;
+  u8  u8Digits;
+  
+  pu8StringParser = DebugReserve(U8_OUTPUT_MESSAGE_LENGTH, &psOutputMessage);
+  if(pu8StringParser == NULL)
+  {
+    return;
+  }
+  pu8NumberIndex = &G_u32Bladelsm6dslData.u8TempL;
+  
+  for(u8 i = 0; i < 7; i++)
+  {
+    u32Number = 0;
+    u32Number |= (u32)*pu8NumberIndex;
+    pu8NumberIndex++;
+    u32Number |= ((u32)(*pu8NumberIndex << 8)) & 0x0000FF00;
+    pu8NumberIndex++;
+    u8Digits = NumberToAscii(u32Number, au8NumberString);
+    pu8NumberParser = au8NumberString;
+    
+    /* Copy ASCII number into result string including leading 0s */
+    u8Digits = 5 - u8Digits;
+    for(u8 j= 0; j < u8Digits; j++)
+    {
+      *pu8StringParser = '0';
+      pu8StringParser++;
+    }
+    u8Digits = 5 - u8Digits;
+    for(u8 j = 0; j < u8Digits; j++)
+    {
+      *pu8StringParser = *pu8NumberParser;
+      pu8StringParser++;
+      pu8NumberParser++;
+    }
+    
+    /* Separate the values and end the line after the last one */
+    if(i < 6)
+    {
+      *pu8StringParser = ' ';
+      pu8StringParser++;
+    }
+  } /* end for(u8 i = 0; i < 7; i++) */
+  
+  *pu8StringParser = ASCII_LINEFEED;
+  pu8StringParser++;
+  *pu8StringParser = ASCII_CARRIAGE_RETURN;
+  DebugCommit(psOutputMessage, U8_OUTPUT_MESSAGE_LENGTH);
+  
+} /* end Bladelsm6dslReportData() */
+
+
 /**********************************************************************************************************************
 State Machine Function Definitions
 **********************************************************************************************************************/
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Read the IMU every U32_MEASUREMENT_RATE_MS and send out the values on the debug port.
-Currently this makes no attempt to format or process the values.
+/* Read the IMU every U32_MEASUREMENT_RATE_MS.
 Be careful with data processing -- if you refresh the IMU at too fast an interval, the TWI message system
 will be overwhelmed.  Similarily, if you send the results out the debug port (or to the LCD) too quickly,
 the messaging system will get overwhelmed.  */
 static void Bladelsm6dslSM_Idle(void)
 {
-  static u8 au8Outputmessage[] = "00000 00000 00000 00000 00000 00000 00000\n\r";
-  u32 u32Number;
-  u8 au8NumberString[11];
-  u8* pu8NumberIndex;
-  u8* pu8NumberParser;
-  u8* pu8StringParser;
-  u8  u8Digits;
-  
   /* Read the latest IMU data if it's time */
   if( IsTimeUp(&Bladelsm6dsl_u32Timeout, U32_MEASUREMENT_RATE_MS) )
   {
     Bladelsm6dsl_u32Timeout = G_u32SystemTime1ms;
-    TwiWriteReadData(U8_LSM6DSL_I2C_ADDRESS, U8_OUT_TEMP_L, &G_u32Bladelsm6dslData.u8TempL, 14);
+    Bladelsm6dsl_u32ReadToken = TwiWriteReadData(U8_LSM6DSL_I2C_ADDRESS, U8_OUT_TEMP_L, &G_u32Bladelsm6dslData.u8TempL, 14);
     
-    /* Write data to debug this will be 1 write behind newest data since the command will not yet be queued */
-    pu8NumberIndex = &G_u32Bladelsm6dslData.u8TempL;
-    pu8StringParser = au8Outputmessage;
-    
-    for(u8 i = 0; i < 7; i++)
+    /* If the read could not be queued, try again next period */
+    if(Bladelsm6dsl_u32ReadToken != 0)
     {
-      u32Number = 0;
-      u32Number |= (u32)*pu8NumberIndex;
-      pu8NumberIndex++;
-      u32Number |= ((u32)(*pu8NumberIndex << 8)) & 0x0000FF00;
-      pu8NumberIndex++;
-      u8Digits = NumberToAscii(u32Number, au8NumberString);
-      pu8NumberParser = au8NumberString;
-      
-      /* Copy ASCII number into result string including leading 0s */
-      u8Digits = 5 - u8Digits;
-      for(u8 j= 0; j < u8Digits; j++)
-      {
-        *pu8StringParser = '0';
-        pu8StringParser++;
-      }
-      u8Digits = 5 - u8Digits;
-      for(u8 j = 0; j < u8Digits; j++)
-      {
-        *pu8StringParser = *pu8NumberParser;
-        pu8StringParser++;
-        pu8NumberParser++;
-      }
-      
-      /* Skip the space */
-      pu8StringParser++;
-    } /* end for(u8 i = 0; i < 7; i++) */
-    
-    DebugPrintf(au8Outputmessage);
-  } /* end if( IsTimeUp(&Bladelsm6dsl_u32Timeout, U32_MEASUREMENT_RATE_MS) ) */
+      Bladelsm6dsl_pfStateMachine = Bladelsm6dslSM_WaitData;
+    }
+  }
   
 } /* end Bladelsm6dslSM_Idle() */
      
 
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Wait for the read to finish so the data sent out is the data just read */
+static void Bladelsm6dslSM_WaitData(void)
+{
+  MessageStateType eReadStatus;
+  
+  eReadStatus = QueryMessageStatus(Bladelsm6dsl_u32ReadToken);
+  
+  /* The TWI driver times out a stalled read, so the token always ends up final */
+  if( (eReadStatus == WAITING) || (eReadStatus == SENDING) )
+  {
+    return;
+  }
+  
+  if(eReadStatus == COMPLETE)
+  {
+    Bladelsm6dslReportData();
+  }
+  else
+  {
+    DebugPrintf("LSM6DSL read failed\n\r");
+  }
+  
+  Bladelsm6dsl_pfStateMachine = Bladelsm6dslSM_Idle;
+  
+} /* end Bladelsm6dslSM_WaitData() */
+
+
 /*-------------------------------------------------------------------------------------------------------------------*/
 /* Handle an error */
 static void Bladelsm6dslSM_Error(void)          
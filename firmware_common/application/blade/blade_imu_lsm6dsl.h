@@ -52,12 +52,14 @@ void Bladelsm6dslRunActiveState(void);
 /*------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
+static void Bladelsm6dslReportData(void);
 
 
 /***********************************************************************************************************************
 State Machine Declarations
 ***********************************************************************************************************************/
 static void Bladelsm6dslSM_Idle(void);    
+static void Bladelsm6dslSM_WaitData(void);
 static void Bladelsm6dslSM_Error(void);         
 
 
@@ -66,6 +68,7 @@ static void Bladelsm6dslSM_Error(void);
 Constants / Definitions
 **********************************************************************************************************************/
 #define U32_MEASUREMENT_RATE_MS               (u32)100  /*!< @brief Rate at which IMU data is updated to G_u32Bladelsm6dslData*/
+#define U8_OUTPUT_MESSAGE_LENGTH              (u8)43    /*!< @brief Debug line of 7 five-digit values, 6 spaces and \n\r */
 
 #define U8_LSM6DSL_I2C_ADDRESS                (u8)0x6b  /*!< @brief I2C address (assumes SDO tied high) */
 #define U8_LSM6DSL_ID                         (u8)0x6a  /*!< @brief Expected Who I am returned ID */     
@@ -2,11 +2,13 @@
 @file debug.c 
 @brief Debugging functions and state machine. 
 
-*** Note that there is a maximum of 32 message slots for all system messaging, 
-and every call to DebugPrintf takes one of those slots.  It tends to be easy 
+*** Note that all system messaging shares one pool of message slots, 
+and every call to DebugPrintf takes at least one of those slots.  It tends to be easy 
 to queue 10-20 DebugPrintf messages in a single function before any of them
-get processed through the system.  In this case, you end up with unexpected
-behavior. ****
+get processed through the system.  Debug output is queued at MSG_PRIORITY_LOW 
+with a quota of DEBUG_TX_SLOT_QUOTA slots, so in this case the oldest waiting
+debug messages are dropped (ABANDONED) to make room for the newest ones instead 
+of starving other peripherals. ****
 
 Provides the terminal interface and also a local command-driven debugging
 system for teh system.
@@ -47,6 +49,9 @@ PUBLIC FUNCTIONS
 - u32 DebugPrintf(u8* u8String_)
 - void DebugLineFeed(void)
 - void DebugPrintNumber(u32 u32Number_)
+- u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_)
+- u8* DebugReserve(u32 u32Size_, MessageType** ppsHandle_)
+- u32 DebugCommit(MessageType* psHandle_, u32 u32Size_)
 - u8 DebugScanf(u8* pu8Buffer_)
 - void DebugSetPassthrough(void)
 - void DebugClearPassthrough(void)
@@ -73,6 +78,7 @@ extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c *
 extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+extern u32 G_u32BootTime1ms;                           /*!< @brief From main.c */
 
 extern const u8 G_aau8AppShortNames[NUMBER_APPLICATIONS][MAX_TASK_NAME_SIZE]; /*!< @brief From main.c */
 
@@ -101,6 +107,12 @@ static u8 *Debug_pu8CmdBufferNextChar;                   /*!< @brief Pointer to
 static u16 Debug_u16CommandSize;                         /*!< @brief Number of characters in the command buffer */
 static u8 Debug_u8Command;                               /*!< @brief A validated command number */
 
+static u8 Debug_au8Report[DEBUG_REPORT_BUFFER_SIZE];     /*!< @brief Space to build the messaging statistics report */
+static u16 Debug_u16ReportLength;                        /*!< @brief Number of characters in Debug_au8Report */
+static bool Debug_bReportInFlight;                       /*!< @brief TRUE from queuing the report until it is finished with Debug_au8Report */
+static u32 Debug_u32ReportToken;                         /*!< @brief Token of a report sent without a completion callback; 0 otherwise */
+static u32 Debug_u32ReportTime;                          /*!< @brief G_u32SystemTime1ms when that report was queued */
+
 /*! @brief Add commands by updating debug.h in the Command-Specific Definitions section, then update this list
 with the function name to call for the corresponding command: */
 #ifdef EIE_ASCII
@@ -109,7 +121,7 @@ DebugCommandType Debug_au8Commands[DEBUG_COMMANDS] =
   {DEBUG_CMD_NAME01, DebugCommandLedTestToggle},
   {DEBUG_CMD_NAME02, DebugCommandSysTimeToggle},
   {DEBUG_CMD_NAME03, DebugCommandDummy},
-  {DEBUG_CMD_NAME04, DebugCommandDummy},
+  {DEBUG_CMD_NAME04, DebugCommandMessagingStats},
   {DEBUG_CMD_NAME05, DebugCommandDummy},
   {DEBUG_CMD_NAME06, DebugCommandDummy},
   {DEBUG_CMD_NAME07, DebugCommandDummy} 
@@ -124,7 +136,7 @@ DebugCommandType Debug_au8Commands[DEBUG_COMMANDS] =
   {DEBUG_CMD_NAME01, DebugCommandLedTestToggle},
   {DEBUG_CMD_NAME02, DebugCommandSysTimeToggle},
   {DEBUG_CMD_NAME03, DebugCommandCaptouchValuesToggle},
-  {DEBUG_CMD_NAME04, DebugCommandDummy},
+  {DEBUG_CMD_NAME04, DebugCommandMessagingStats},
   {DEBUG_CMD_NAME05, DebugCommandDummy},
   {DEBUG_CMD_NAME06, DebugCommandDummy},
   {DEBUG_CMD_NAME07, DebugCommandDummy} 
@@ -222,7 +234,7 @@ DebugPrintNumber(u32Number);
 
 
 Requires:
-- Enough space is available on the heap to temporarily store the number array
+- NONE
 
 @param u32Number_ is the number to print.
 
@@ -232,56 +244,111 @@ Promises:
 */
 void DebugPrintNumber(u32 u32Number_)
 {
-  bool bFoundDigit = FALSE;
-  u8 au8AsciiNumber[10];
-  u8 u8CharCount = 0;
-  u32 u32Temp, u32Divider = 1000000000;
-  u8 *pu8Data;
-  
-  /* Parse out all the digits, start counting after leading zeros */
-  for(u8 index = 0; index < 10; index++)
-  {
-    /* Get the digit and add offset to get ASCII character */
-    au8AsciiNumber[index] = (u32Number_ / u32Divider) + NUMBER_ASCII_TO_DEC;
-    if(au8AsciiNumber[index] != '0')
-    {
-      bFoundDigit = TRUE;
-    }
-    if(bFoundDigit)
-    {
-      u8CharCount++;
-    }
-    u32Number_ %= u32Divider;
-    u32Divider /= 10;
-  }
+  MessageType* psHandle;
+  u8* pu8Digits;
   
-  /* Handle special case where u32Number == 0 */
-  if(!bFoundDigit)
+  /* The digits are written straight into the message slot (with room for the terminating NULL) */
+  pu8Digits = DebugReserve(U8_DEBUG_NUMBER_LENGTH, &psHandle);
+  if(pu8Digits != NULL)
   {
-    u8CharCount = 1;
+    DebugCommit(psHandle, NumberToAscii(u32Number_, pu8Digits));
   }
   
-  /* Allocate memory for the number and copy the array */
-  pu8Data = malloc(u8CharCount);
-  if (pu8Data == NULL)
-  {
-    Debug_u8ErrorCode = DEBUG_ERROR_MALLOC;
-    Debug_pfnStateMachine = DebugSM_Error;
-  }
-  
-  u32Temp = 9;
-  for(u8 index = u8CharCount; index != 0; index--)
-  {
-    pu8Data[index - 1] = au8AsciiNumber[u32Temp--];
-  }
-    
-  /* Print the ascii string and free the memory */
-  UartWriteData(Debug_Uart, u8CharCount, pu8Data);
-  free(pu8Data);
-  
 } /* end DebugDebugPrintNumber() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_)
+
+@brief Queues several pieces of text to the Debug port as one message.  
+
+This is the way to print a line that is built from constant strings and values 
+since it takes one token and the pieces are sent back-to-back.  Constant strings 
+should have bCopy = FALSE so they are not copied at all.
+
+Example:
+u8 au8Number[11];
+MessageFragmentType asLine[] = { {"Count: ", 7, FALSE}, {au8Number, 0, TRUE}, {"\n\r", 2, FALSE} };
+
+asLine[1].u32Size = NumberToAscii(u32Count, au8Number);
+DebugPrintFragments(asLine, 3);
+
+Requires:
+- The debug UART resource has been setup for the debug application.
+- See QueueTxMessageFragments() for the rules on fragment data
+
+@param psFragments_ points to the list of fragments in the order they are printed
+@param u8Fragments_ is the number of fragments in the list
+
+Promises:
+- The fragments are queued to the debug UART.
+- The message token is returned
+
+*/
+u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_)
+{
+  return( UartWriteFragments(Debug_Uart, psFragments_, u8Fragments_) );
+ 
+} /* end DebugPrintFragments() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u8* DebugReserve(u32 u32Size_, MessageType** ppsHandle_)
+
+@brief Reserves a message slot on the Debug port so output can be formatted directly into it.  
+
+This avoids building a line in a local buffer that DebugPrintf() would then copy.  Write 
+up to u32Size_ bytes into the returned buffer and pass the number written to DebugCommit().  
+Output that is not needed after all is discarded with MessageAbort(psHandle).
+
+Example:
+MessageType* psHandle;
+u8* pu8Line = DebugReserve(16, &psHandle);
+
+if(pu8Line != NULL)
+{
+  u8Length = ...format into pu8Line...
+  DebugCommit(psHandle, u8Length);
+}
+
+Requires:
+- The debug UART resource has been setup for the debug application.
+
+@param u32Size_ is the most bytes that will be written (1 to U16_MAX_TX_MESSAGE_LENGTH)
+@param ppsHandle_ receives the handle for DebugCommit()
+
+Promises:
+- Returns the buffer to write in, or NULL if no slot is available
+
+*/
+u8* DebugReserve(u32 u32Size_, MessageType** ppsHandle_)
+{
+  return( UartReserveData(Debug_Uart, u32Size_, ppsHandle_) );
+ 
+} /* end DebugReserve() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 DebugCommit(MessageType* psHandle_, u32 u32Size_)
+
+@brief Queues output that was written in place after DebugReserve().  
+
+Requires:
+@param psHandle_ is the handle from DebugReserve()
+@param u32Size_ is the number of bytes written
+
+Promises:
+- The output is queued to the debug UART.
+- The message token is returned
+
+*/
+u32 DebugCommit(MessageType* psHandle_, u32 u32Size_)
+{
+  return( UartCommitData(psHandle_, u32Size_) );
+ 
+} /* end DebugCommit() */
+
+
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn u8 DebugScanf(u8* pu8Buffer_)
 
@@ -403,12 +470,14 @@ Requires:
 Promises:
 - Prints out messages for any system test that failed
 - Prints out overall good message if all tests passed
+- Prints the boot time
 - Prints instructions to access the Debug menu
 
 */
 void SystemStatusReport(void)
 {
   u8 au8SystemPassed[] = "No failed tasks.\n\r";
+  u8 au8BootTime[] = "Boot time (ms): ";
   u8 au8SystemReady[] = "\n\rInitialization complete. Type en+c00 for debug menu.  Failed tasks:\n\r";
   u32 u32TaskFlagMaskBit = (u32)0x01;
   bool bNoFailedTasks = TRUE;
@@ -434,6 +503,11 @@ void SystemStatusReport(void)
     DebugPrintf(au8SystemPassed);
   }
   
+  /* G_u32BootTime1ms starts at SysTickSetup(), so it leaves out only the clock and GPIO setup */
+  DebugPrintf(au8BootTime);
+  DebugPrintNumber(G_u32BootTime1ms);
+  DebugLineFeed();
+  
   DebugLineFeed();
   
 } /* end SystemStatusReport() */
@@ -492,6 +566,8 @@ void DebugInitialize(void)
   sUartConfig.pu8RxNextByte      = &Debug_pu8RxBufferNextChar;
   sUartConfig.u16RxBufferSize    = DEBUG_RX_BUFFER_SIZE;
   sUartConfig.fnRxCallback       = DebugRxCallback;
+  sUartConfig.fnRxBytesCallback  = DebugRxBytesCallback;
+  sUartConfig.u16RxBlockSize     = DEBUG_RX_BLOCK_SIZE;
   
   Debug_Uart = UartRequest(&sUartConfig);
   
@@ -504,6 +580,15 @@ void DebugInitialize(void)
   /* Otherwise send the first message, set "good" flag and head to Idle */
   else
   {
+    /* Debug output gives way to real-time traffic when message slots run low */
+    MessageQueueSetPriority(&Debug_Uart->sTransmitQueue, MSG_PRIORITY_LOW, DEBUG_TX_SLOT_QUOTA);
+    
+    /* A slow or disconnected terminal loses stale output rather than the latest */
+    MessageQueueSetOverflow(&Debug_Uart->sTransmitQueue, MSG_OVERFLOW_DROP_OLDEST);
+    
+    /* Echoed characters and short strings from one main loop go out as one transfer */
+    UartSetCoalescing(Debug_Uart, TRUE);
+    
     DebugPrintf(Debug_au8StartupMsg);   
     DebugPrintf(au8FirmwareVersion);
     
@@ -559,6 +644,30 @@ void DebugRxCallback(void)
 } /* end DebugRxCallback() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void DebugRxBytesCallback(u16 u16Bytes_)
+
+@brief Callback function used when the UART receives a block of characters.
+
+Requires:
+@param u16Bytes_ is the number of characters received (less than DEBUG_RX_BUFFER_SIZE)
+
+Promises:
+@param Debug_pu8RxBufferNextChar is advanced safely by u16Bytes_
+
+*/
+void DebugRxBytesCallback(u16 u16Bytes_)
+{
+  /* Safely advance the NextChar pointer */
+  Debug_pu8RxBufferNextChar += u16Bytes_;
+  if(Debug_pu8RxBufferNextChar >= &Debug_au8RxBuffer[DEBUG_RX_BUFFER_SIZE])
+  {
+    Debug_pu8RxBufferNextChar -= DEBUG_RX_BUFFER_SIZE;
+  }
+  
+} /* end DebugRxBytesCallback() */
+
+
 /*------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -937,6 +1046,228 @@ static void DebugCommandSysTimeToggle(void)
   
 } /* end DebugCommandSysTimeToggle() */
 
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandMessagingStats(void)
+
+@brief Prints the messaging statistics: pool high-water marks, message outcomes, throttling,
+latency histograms and the usage of each peripheral transmit queue.
+
+The report is built in Debug_au8Report and sent by reference so it takes a single message 
+slot however long it is.  Histogram columns are labelled with the upper bound in ms.
+
+Debug_au8Report cannot be rebuilt while the UART's PDC may still be reading it.  The status of the
+report's token is not enough to know that since the status entry can be reused (NOT_FOUND) before 
+the report is out, so Debug_bReportInFlight is set when the report is queued and only 
+DebugReportCallback() clears it, when the report reaches a final state.  If no callback can be 
+attached, a report that has not started is cancelled and sent as a copy instead; one that has 
+started is given DEBUG_UART_TIMEOUT to finish.
+
+Requires:
+- NONE
+
+Promises:
+- The report is queued to the debug UART, unless the previous report is still being sent
+
+*/
+static void DebugCommandMessagingStats(void)
+{
+  static u8* apu8PriorityNames[U8_MSG_PRIORITY_LEVELS] = {"low", "normal", "high"};
+  MessagingStatsType sStats;
+  MessageQueueStatsType sQueue;
+  MessageThrottleCountType sThrottle;
+  u32 u32Token;
+  u32* apu32Histograms[] = {sStats.au32WaitTime, sStats.au32CompleteTime};
+  
+  /* The report is sent straight from Debug_au8Report so it cannot be rebuilt until it is out */
+  if(Debug_bReportInFlight)
+  {
+    if( (Debug_u32ReportToken == 0) || !IsTimeUp(&Debug_u32ReportTime, DEBUG_UART_TIMEOUT) )
+    {
+      DebugPrintf("\n\rMessaging report is still being sent\n\r");
+      return;
+    }
+    
+    Debug_bReportInFlight = FALSE;
+  }
+  
+  QueryMessagingStats(&sStats);
+  Debug_u16ReportLength = 0;
+  
+  DebugReportText("\n\r*** Messaging statistics ***\n\rSlots in use: ");
+  DebugReportNumber(sStats.u8SlotsUsed);
+  DebugReportText(" High-water: ");
+  DebugReportNumber(sStats.u8SlotsHighWater);
+  DebugReportText(" of ");
+  DebugReportNumber(U8_TX_QUEUE_SIZE);
+  DebugReportText("\n\rClass high-water (small to large, reference):");
+  for(u8 i = 0; i <= U8_MSG_SIZE_CLASSES; i++)
+  {
+    DebugReportText(" ");
+    DebugReportNumber(sStats.au8ClassHighWater[i]);
+  }
+  
+  DebugReportText("\n\rQueued: ");
+  DebugReportNumber(sStats.u32MessagesQueued);
+  DebugReportText(" Queue full: ");
+  DebugReportNumber(sStats.u32QueueFullCount);
+  DebugReportText("\n\rComplete: ");
+  DebugReportNumber(sStats.u32Completed);
+  DebugReportText(" Timeout: ");
+  DebugReportNumber(sStats.u32TimedOut);
+  DebugReportText(" Abandoned: ");
+  DebugReportNumber(sStats.u32Abandoned);
+  DebugReportText(" Failed: ");
+  DebugReportNumber(sStats.u32Failed);
+  DebugReportText("\n\rStatuses expired: ");
+  DebugReportNumber(sStats.u32StatusesExpired);
+  DebugReportText(" Stuck messages reclaimed: ");
+  DebugReportNumber(sStats.u32MessagesReclaimed);
+  
+  DebugReportText("\n\rThrottled (refused/dropped):");
+  for(u8 i = 0; i < U8_MSG_PRIORITY_LEVELS; i++)
+  {
+    QueryMessageThrottleCounts((MessagePriorityType)i, &sThrottle);
+    DebugReportText(" ");
+    DebugReportText(apu8PriorityNames[i]);
+    DebugReportText(" ");
+    DebugReportNumber(sThrottle.u32Refused);
+    DebugReportText("/");
+    DebugReportNumber(sThrottle.u32Dropped);
+  }
+
+  /* Bin n counts times under 2^n ms and the last bin counts everything longer */
+  for(u8 i = 0; i < 2; i++)
+  {
+    DebugReportText( (i == 0) ? "\n\rQueued to sending ms:" : "\n\rQueued to complete ms:" );
+    for(u8 j = 0; j < U8_MSG_LATENCY_BINS; j++)
+    {
+      if(j == (U8_MSG_LATENCY_BINS - 1))
+      {
+        DebugReportText(" >=");
+        DebugReportNumber((u32)1 << (j - 1));
+      }
+      else
+      {
+        DebugReportText(" <");
+        DebugReportNumber((u32)1 << j);
+      }
+      DebugReportText(":");
+      DebugReportNumber(apu32Histograms[i][j]);
+    }
+  }
+
+  DebugReportText("\n\rQueue: messages, slots used/high-water/quota, priority");
+  for(u8 i = 0; QueryMessageQueueStats(i, &sQueue); i++)
+  {
+    DebugReportText("\n\r  ");
+    DebugReportText(sQueue.pu8Name);
+    DebugReportText(": ");
+    DebugReportNumber(sQueue.u32MessagesQueued);
+    DebugReportText(", ");
+    DebugReportNumber(sQueue.u8SlotsUsed);
+    DebugReportText("/");
+    DebugReportNumber(sQueue.u8SlotsHighWater);
+    DebugReportText("/");
+    DebugReportNumber(sQueue.u8Quota);
+    DebugReportText(", ");
+    DebugReportText(apu8PriorityNames[sQueue.u8Priority]);
+  }
+  DebugReportText("\n\r\n\r");
+  
+  u32Token = UartWriteDataReference(Debug_Uart, Debug_u16ReportLength, Debug_au8Report);
+  if(u32Token == 0)
+  {
+    return;
+  }
+  
+  Debug_bReportInFlight = TRUE;
+  Debug_u32ReportToken = 0;
+  if(!MessageSetCallback(u32Token, DebugReportCallback, NULL, MSG_CALLBACK_DEFERRED))
+  {
+    /* Nothing will say when the report is out: take it back if it has not started */
+    if(CancelMessage(u32Token))
+    {
+      Debug_bReportInFlight = FALSE;
+      UartWriteData(Debug_Uart, Debug_u16ReportLength, Debug_au8Report);
+    }
+    else
+    {
+      Debug_u32ReportToken = u32Token;
+      Debug_u32ReportTime = G_u32SystemTime1ms;
+    }
+  }
+  
+} /* end DebugCommandMessagingStats() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugReportCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_)
+
+@brief Message callback that runs from the messaging task when the messaging report is finished.
+
+Requires:
+@param u32Token_ is the token of the report
+@param eState_ is the final state of the report (the UART is done with it whatever the state)
+@param pvContext_ is not used
+
+Promises:
+- Debug_bReportInFlight is cleared so the next report can be built
+
+*/
+static void DebugReportCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_)
+{
+  Debug_bReportInFlight = FALSE;
+  
+} /* end DebugReportCallback() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugReportText(u8* pu8Text_)
+
+@brief Adds a string to the report in Debug_au8Report.
+
+Requires:
+@param pu8Text_ is a null-terminated string
+
+Promises:
+- The string is copied to the end of Debug_au8Report (truncated if the buffer is full) and 
+  Debug_u16ReportLength is updated
+
+*/
+static void DebugReportText(u8* pu8Text_)
+{
+  while( (*pu8Text_ != '\0') && (Debug_u16ReportLength < DEBUG_REPORT_BUFFER_SIZE) )
+  {
+    Debug_au8Report[Debug_u16ReportLength] = *pu8Text_;
+    Debug_u16ReportLength++;
+    pu8Text_++;
+  }
+  
+} /* end DebugReportText() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugReportNumber(u32 u32Number_)
+
+@brief Adds a number in decimal to the report in Debug_au8Report.
+
+Requires:
+@param u32Number_ is the number to add
+
+Promises:
+- The digits are copied to the end of Debug_au8Report as with DebugReportText()
+
+*/
+static void DebugReportNumber(u32 u32Number_)
+{
+  u8 au8Number[11];
+  
+  NumberToAscii(u32Number_, au8Number);
+  DebugReportText(au8Number);
+  
+} /* end DebugReportNumber() */
+
 /* EIE_DOTMATRIX only tests */
 #ifdef EIE_DOTMATRIX 
 /*!----------------------------------------------------------------------------------------------------------------------
@@ -1009,6 +1340,7 @@ void DebugSM_Idle(void)
   bool bCommandFound = FALSE;
   u8 u8CurrentByte;
   u8 u8Counter;
+  MessageStateType eMsgStatus;
   static u8 au8BackspaceSequence[] = {ASCII_BACKSPACE, ' ', ASCII_BACKSPACE};
   static u8 au8CommandOverflow[] = "\r\n*** Command too long ***\r\n\n";
   
@@ -1121,13 +1453,18 @@ void DebugSM_Idle(void)
     
   } /* end while */
   
-  /* Clear out any completed messages (Query automatically removes if complete ) */
-  u8Counter = 0;
-  while ( (u8Counter < DEBUG_TOKEN_ARRAY_SIZE) &&
-          (Debug_au32MsgTokens[u8Counter] != 0) )
+  /* Clear out any completed messages (Query automatically removes if complete ) and forget
+  the tokens that have resolved so only messages still in flight are checked next time */
+  for(u8Counter = 0; u8Counter < DEBUG_TOKEN_ARRAY_SIZE; u8Counter++)
   {
-    QueryMessageStatus(Debug_au32MsgTokens[u8Counter]);
-    u8Counter++;
+    if(Debug_au32MsgTokens[u8Counter] != 0)
+    {
+      eMsgStatus = QueryMessageStatus(Debug_au32MsgTokens[u8Counter]);
+      if( (eMsgStatus != WAITING) && (eMsgStatus != SENDING) )
+      {
+        Debug_au32MsgTokens[u8Counter] = 0;
+      }
+    }
   }
     
 } /* end DebugSM_Idle() */
@@ -32,6 +32,9 @@ typedef struct
 u32 DebugPrintf(u8* u8String_);
 void DebugLineFeed(void);
 void DebugPrintNumber(u32 u32Number_);
+u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_);
+u8* DebugReserve(u32 u32Size_, MessageType** ppsHandle_);
+u32 DebugCommit(MessageType* psHandle_, u32 u32Size_);
 
 u8 DebugScanf(u8* pu8Buffer_);
 
@@ -48,6 +51,7 @@ void DebugInitialize(void);
 void DebugRunActiveState(void);
 
 void DebugRxCallback(void);
+void DebugRxBytesCallback(u16 u16Bytes_);
 
 
 /*------------------------------------------------------------------------------------------------------------------*/
@@ -61,6 +65,10 @@ static void DebugCommandDummy(void);
 static void DebugCommandLedTestToggle(void);
 static void DebugLedTestCharacter(u8 u8Char_);
 static void DebugCommandSysTimeToggle(void);
+static void DebugCommandMessagingStats(void);
+static void DebugReportCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_);
+static void DebugReportText(u8* pu8Text_);
+static void DebugReportNumber(u32 u32Number_);
 
 #ifdef EIE_ASCII /* EIE_ASCII-specific debug functions */
 #endif /* EIE_ASCII */
@@ -84,9 +92,13 @@ static void DebugSM_Error(void);
 * Constants / Definitions
 ***********************************************************************************************************************/
 #define DEBUG_RX_BUFFER_SIZE           (u16)128             /*!< @brief Size of debug buffer for incoming messages */
+#define DEBUG_RX_BLOCK_SIZE            (u16)16              /*!< @brief Bytes per UART receive PDC block (DEBUG_RX_BUFFER_SIZE must be a multiple) */
 #define DEBUG_CMD_BUFFER_SIZE          (u8)64               /*!< @brief Size of debug buffer for a command */
 #define DEBUG_SCANF_BUFFER_SIZE        (u8)128              /*!< @brief Size of buffer for scanf messages */
 #define DEBUG_TOKEN_ARRAY_SIZE         (u8)16               /*!< @brief Number of cached tokens */
+#define DEBUG_TX_SLOT_QUOTA            (u8)24               /*!< @brief Max message slots the debug output can hold at once */
+#define U8_DEBUG_NUMBER_LENGTH         (u8)11               /*!< @brief Digits in the largest u32 plus the NULL written by NumberToAscii() */
+#define DEBUG_REPORT_BUFFER_SIZE       (u16)1024            /*!< @brief Size of the buffer that the messaging statistics report is built in */
 
 
 /* G_u32DebugFlags */
@@ -129,7 +141,7 @@ static void DebugSM_Error(void);
 #define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
 #define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
 #define DEBUG_CMD_NAME03        "Dummy3                          "  /* Command 3: */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
+#define DEBUG_CMD_NAME04        "Show messaging statistics       "  /* Command 4: Prints pool usage, message latency and per-queue counts */
 #define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
 #define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
 #define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
@@ -142,7 +154,7 @@ static void DebugSM_Error(void);
 #define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
 #define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
 #define DEBUG_CMD_NAME03        "Toggle Captouch value display   "  /* Command 2: Test that shows Captouch sense values on debug port */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
+#define DEBUG_CMD_NAME04        "Show messaging statistics       "  /* Command 4: Prints pool usage, message latency and per-queue counts */
 #define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
 #define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
 #define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
@@ -217,7 +217,7 @@ Includes
 /* EiE I2C (TWI0) */
 #define TWI0_CR_INIT                EIE_TWI_CR_INIT
 #define TWI0_MMR_INIT               EIE_TWI_MMR_INIT
-#define TWI0_CWGR_INIT              EIE_TWI_CWGR_INIT
+#define TWI0_BUS_SPEED_INIT         EIE_TWI_BUS_SPEED_INIT
 #define TWI0_IER_INIT               EIE_TWI_IER_INIT
 
 #define TWI0_IRQHandler             Twi0_IrqHandler
@@ -1258,6 +1258,10 @@ Dot Matrix: Blade and R01 EIE_DOTMATRIX accelerometer
 
 /* Clock Wave Generator Register */
 /* 
+    TWI_CWGR is calculated from MCK by the TWI driver (TwiCalculateCwgr()) for the bus speed
+    in Hz given here, so only the speed is configured.  TwiSetBusSpeed() and TwiSetSlaveSpeed()
+    change it at run time.
+
     Calculation:
         T_low = ((CLDIV * (2^CKDIV))+4) * T_MCK
         T_high = ((CHDIV * (2^CKDIV))+4) * T_MCK
@@ -1265,48 +1269,13 @@ Dot Matrix: Blade and R01 EIE_DOTMATRIX accelerometer
         T_MCK - period of master clock = 1/(48 MHz)
         T_low/T_high - period of the low and high signals
         
-        CKDIV = 2, CHDIV and CLDIV = 59
-        T_low/T_high = 2.5 microseconds
-
         Data frequency - 
         f = ((T_low + T_high)^-1)
-        f = 200000 Hz 0r 200 kHz
-
-    Additional Rates:
-        50 kHz - 0x00027777
-       100 kHz - 0x00023B3B
-       200 kHz - 0x00021D1D
-       400 kHz - 0x00030707  *Maximum rate*
-*/
-#define EIE_TWI_CWGR_INIT (u32)0x00021D1D
-/*
-    31-20 [0] Reserved
-    
-    19 [0] Reserved
-    18 [0] CKDIV
-    17 [1] "
-    16 [0] "
 
-    15 [0] CHDIV
-    14 [0] "
-    13 [0] "
-    12 [1] "
-
-    11 [1] "
-    10 [1] "
-    09 [0] "
-    08 [1] "
-
-    07 [0] CLDIV - Clock Low Divider
-    06 [0] "
-    05 [0] "
-    04 [1] "
-
-    03 [1] "
-    02 [1] "
-    01 [0] "
-    00 [1] "
+    Above 100 kHz, T_low is stretched to at least the 1.3 us fast-mode minimum and T_high
+    gets the rest of the period.  400 kHz is the maximum rate.
 */
+#define EIE_TWI_BUS_SPEED_INIT (u32)200000
 
 /*Interrupt Enable Register*/
 #define EIE_TWI_IER_INIT (u32)0x00000100
@@ -690,7 +690,8 @@ static bool AntTxMessage(u8 *pu8AntTxMessage_)
 @brief Completely receive a message from ANT to the Host.  
 
 Incoming bytes are deposited directly into the receive buffer from the SSP ISR 
-which should be extremely fast and complete in a maximum of 500us.  
+which should be extremely fast and complete in a maximum of 500us.  Every byte is 
+received with SRDY flow control: the nRF51422 sends one byte per SRDY pulse.
 
 Requires:
 - _SSP_CS_ASSERTED is set indicating a message is ready to come in 
@@ -768,7 +769,7 @@ static void AntRxMessage(void)
   Proceed to test it and receive the rest of the message */
   if (*Ant_pu8AntRxBufferCurrentChar == MESG_TX_SYNC)                     
   {
-    /* Flag that a reception is in progress */
+    /* Flag that a reception is in progress so each byte toggles SRDY */
     G_u32AntFlags |= _ANT_FLAGS_RX_IN_PROGRESS;
     
     /* Cycle SRDY to get the next byte (length) */
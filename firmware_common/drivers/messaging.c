@@ -18,6 +18,40 @@ message statuses can be lost eventually.  If a task waits too long and received
 because they have waited too long, the task should increase the frequency at which it queries the 
 message status.
 
+Tokens are issued sequentially, so the low bits of a token (U32_STATUS_INDEX_MASK) select its entry 
+in the status array and the remaining high bits act as a generation count.  Status lookups and 
+updates therefore go straight to one entry; if that entry holds a different token then the 
+requested token's status has been overwritten and it is reported as NOT_FOUND.
+
+Every U32_MSG_STATUS_CLEANING_TIME ms the messaging task sweeps the status array, checking 
+U8_MSG_CLEAN_PER_TICK entries per pass.  Final statuses nobody has collected are cleared once they 
+are older than U32_MSG_STATUS_COMPLETE_TIME (U32_MSG_STATUS_TIMEOUT_TIME for TIMEOUT).  A message 
+still WAITING after U32_MSG_STATUS_WAITING_TIME is stuck behind a peripheral that is not making 
+progress, so it is removed from its queue, its slot goes back to the pool and its status becomes 
+TIMEOUT.  The message a peripheral is sending (the head of its queue) is never touched.  Stuck 
+messages are reported on the debug port and flagged with _MESSAGING_STUCK_MESSAGES.
+
+Instead of polling QueryMessageStatus(), a client can attach a completion callback to a token with
+MessageSetCallback().  The callback runs once when the message reaches COMPLETE, TIMEOUT, ABANDONED 
+or FAILED, either straight from the peripheral ISR that finishes the message (MSG_CALLBACK_ISR) or 
+from the messaging task on the next main loop pass (MSG_CALLBACK_DEFERRED).  Only the peripheral 
+finishing a message runs an ISR callback inline.  A callback attached to a message that has already
+finished, or that ends because the task cancelled, dropped or timed out the message, always runs 
+from the messaging task.  If a message is still unfinished when its status entry is reused by a 
+newer token, its callback gets ABANDONED then (also from the messaging task).
+
+The per-message paths (taking and freeing slots, issuing tokens and posting statuses, attaching 
+callbacks, linking a message onto a queue and removing it from the head) never disable interrupts.  
+They use the Cortex-M3 exclusive access instructions instead: a value is read with LDREX and written 
+back with STREX, and the store fails if anything else stored to it in between.  The core also clears 
+the exclusive monitor on every exception entry and return, so if an ISR runs between the LDREX and 
+STREX of the task, the STREX fails and the task simply tries again with fresh values.  Messages are 
+queued from task context (never from an ISR) and removed by the peripheral that sends them, from its 
+ISR or with its interrupts off.  Whichever side swaps a status entry's callback index out with 
+LDREXB/STREXB owns signalling that callback, so it runs exactly once.  Only rare maintenance (the 
+cleaning sweep, and cancelling or dropping a waiting message, which must unlink it from the middle 
+of a queue) runs with interrupts off for a few instructions.
+
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
 - NONE
@@ -28,14 +62,42 @@ CONSTANTS
 TYPES
 - MessageStateType {EMPTY, WAITING, SENDING, COMPLETE, 
                     TIMEOUT, ABANDONED, NOT_FOUND}
+- MessageQueueType
+- MessageFragmentType
+- MessageCallbackModeType {MSG_CALLBACK_DEFERRED, MSG_CALLBACK_ISR}
+- MessageCallbackType
+- MessagePriorityType {MSG_PRIORITY_LOW, MSG_PRIORITY_NORMAL, MSG_PRIORITY_HIGH}
+- MessageOverflowType {MSG_OVERFLOW_DROP_LOWEST_PRIORITY, MSG_OVERFLOW_REJECT_NEW, MSG_OVERFLOW_DROP_OLDEST}
+- MessageThrottleCountType
+- MessagingStatsType
+- MessageQueueStatsType
 
 PUBLIC FUNCTIONS
 - MessageStateType QueryMessageStatus(u32 u32Token_)
+- bool MessageSetCallback(u32 u32Token_, fnMessageCallback_type pfnCallback_, void* pvContext_, MessageCallbackModeType eMode_)
+- void MessageQueueSetPriority(MessageQueueType* psQueue_, MessagePriorityType ePriority_, u8 u8Quota_)
+- void MessageQueueSetOverflow(MessageQueueType* psQueue_, MessageOverflowType eOverflow_)
+- bool CancelMessage(u32 u32Token_)
+- void QueryMessageThrottleCounts(MessagePriorityType ePriority_, MessageThrottleCountType* psCounts_)
+- void QueryMessagingStats(MessagingStatsType* psStats_)
+- bool QueryMessageQueueStats(u8 u8Index_, MessageQueueStatsType* psStats_)
+- void MessageAbort(MessageType* psHandle_)
 
 PROTECTED FUNCTIONS
 - void MessagingInitialize(void)
 - u32 QueueMessage(MessageType** ppsTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_)
 - void DeQueueMessage(MessageType** pTargetQueue_)
+- void MessageQueueInitialize(MessageQueueType* psQueue_, u8* pu8Name_)
+- void MessageQueueSetPendingFlag(MessageQueueType* psQueue_, u32* pu32Flags_, u32 u32Flag_)
+- u32 QueueTxMessage(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
+- u32 QueueTxMessageReference(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
+- u32 QueueTxMessageFragments(MessageQueueType* psQueue_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+- u8* MessageReserve(MessageQueueType* psQueue_, u32 u32Size_, MessageType** ppsHandle_)
+- u32 MessageCommit(MessageType* psHandle_, u32 u32Size_)
+- u32 MessageIssueToken(MessageType* psHandle_)
+- u32 MessageIssueTransferToken(void)
+- void DeQueueTxMessage(MessageQueueType* psQueue_)
+- MessageType* FinishTxMessage(MessageQueueType* psQueue_, MessageStateType eState_)
 - void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
 
 
@@ -67,14 +129,24 @@ static fnCode_type Messaging_pfnStateMachine;          /*!< @brief The state mac
 
 static u32 Msg_u32Token;                               /*!< @brief Incrementing message token used for all external communications */
 
-static MessageSlotType Msg_asPool[U8_TX_QUEUE_SIZE];   /*!< @brief Array of MessageSlotType used for the transmit queue */
+static MessageSlotType Msg_asPool[U8_TX_QUEUE_SIZE];   /*!< @brief Array of MessageSlotType used for the transmit queue (class 0 slots first) */
+static u8 Msg_au8PayloadPool[U16_MSG_PAYLOAD_POOL_SIZE]; /*!< @brief Payload storage carved up between the slots of each size class */
+static MessageSizeClassType Msg_asSizeClasses[U8_MSG_SIZE_CLASSES + 1]; /*!< @brief Size class table, smallest first, then the reference class */
 static u8 Msg_u8QueuedMessageCount;                    /*!< @brief Number of messages slots currently occupied */
 
 /* A separate status queue needs to be maintained since the message information in Msg_asPool will be lost when the message
 has been dequeued.  Applications must be able to query to determine the status of their message, particularly if
 it has been sent. */
-static MessageStatusType  Msg_asStatusQueue[U8_STATUS_QUEUE_SIZE]; /*!< @brief Array of MessageStatusType used to monitor message status */
-static MessageStatusType* Msg_psNextStatus;                        /*!< @brief Pointer to next available message status */
+static MessageStatusType  Msg_asStatusQueue[U8_STATUS_QUEUE_SIZE]; /*!< @brief Array of MessageStatusType used to monitor message status (indexed by token) */
+
+static MessageCallbackType Msg_asCallbacks[U8_MSG_CALLBACK_SLOTS]; /*!< @brief Registered completion callbacks */
+static u32 Msg_u32FreeCallbacks;                       /*!< @brief Bit n is set when Msg_asCallbacks[n] is free */
+static u32 Msg_u32PendingCallbacks;                    /*!< @brief Bit n is set when Msg_asCallbacks[n] is waiting for the messaging task to run it */
+
+static MessageQueueType* Msg_psQueues;                 /*!< @brief List of peripheral transmit queues set up with MessageQueueInitialize() */
+static u16 Msg_u16CleaningIndex;                       /*!< @brief Next status entry to check in the current sweep; U8_STATUS_QUEUE_SIZE when no sweep is running */
+static MessagingStatsType Msg_sStats;                  /*!< @brief Usage and timing information (u8SlotsUsed is filled in when queried) */
+static MessageThrottleCountType Msg_asThrottleCounts[U8_MSG_PRIORITY_LEVELS]; /*!< @brief Throttle counts of each MessagePriorityType */
 
 
 
@@ -93,8 +165,7 @@ Function Definitions
 
 If the state is COMPLETE, TIMEOUT or ABANDONED, calling this function
 forces the associated status to be cleared from the message queue.
-Since the queue is quite short, most of the time it will hold very little entries.  
-New entries are always filled at the front, using a simple linear search starting at index 0.
+The status entry is addressed directly by the token so no search is required.
 
 Requires:
 @param u32Token_ is the token (ID) of the message of interest
@@ -108,28 +179,20 @@ the queue and time-stamped for debugging purposes.
 MessageStateType QueryMessageStatus(u32 u32Token_)
 {
   MessageStateType eStatus = NOT_FOUND;
-  MessageStatusType* pListParser = &Msg_asStatusQueue[0];
+  MessageStatusType* psStatus = &Msg_asStatusQueue[u32Token_ & U32_STATUS_INDEX_MASK];
   
-  /* Brute force search for the token - the queue will never be large enough on this system to require a more
-  intelligent search algorithm */
-  while( (pListParser->u32Token != u32Token_) && 
-         (pListParser != &Msg_asStatusQueue[U8_STATUS_QUEUE_SIZE]) )
-  {
-    pListParser++;
-  }
-
-  /* If the token was found pListParser is pointing at it, take appropriate action */
-  if(pListParser != &Msg_asStatusQueue[U8_STATUS_QUEUE_SIZE])
+  /* The entry only belongs to this token if the generation bits match too; token 0 is never issued */
+  if( (u32Token_ != 0) && (psStatus->u32Token == u32Token_) )
   {
     /* Save the status */
-    eStatus = pListParser->eState;
+    eStatus = psStatus->eState;
 
     /* Release the slot if the message state is final (the client must deal with it now) */
     if( (eStatus == COMPLETE) || (eStatus == TIMEOUT) || (eStatus == ABANDONED) )
     {
-      pListParser->u32Token = 0;
-      pListParser->eState = EMPTY;
-      pListParser->u32Timestamp = G_u32SystemTime1ms;
+      psStatus->u32Token = 0;
+      psStatus->eState = EMPTY;
+      psStatus->u32Timestamp = G_u32SystemTime1ms;
     }
   }
 
@@ -139,6 +202,322 @@ MessageStateType QueryMessageStatus(u32 u32Token_)
 } /* end QueryMessageStatus() */
 
 
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn bool MessageSetCallback(u32 u32Token_, fnMessageCallback_type pfnCallback_, void* pvContext_, MessageCallbackModeType eMode_)
+
+@brief Attaches a completion callback to a queued message so the client does not have to poll its status.
+
+The callback runs once when the message state becomes COMPLETE, TIMEOUT, ABANDONED or FAILED.
+MSG_CALLBACK_ISR callbacks run inside the peripheral ISR that finishes the message, so they must be 
+short (set a flag, advance a state) and must not queue messages.  MSG_CALLBACK_DEFERRED callbacks run 
+from the messaging task in the main loop and may do anything a task can do.  If the message has
+already finished when the callback is attached, the callback runs on the next messaging task pass 
+whatever its mode.
+
+The status of the message can still be queried.  Registering a second callback on the same token 
+replaces the first.
+
+Example:
+u32Token = SspWriteDataReference(psSsp, u32Size, au8Data);
+MessageSetCallback(u32Token, MyTaskTransferDone, NULL, MSG_CALLBACK_DEFERRED);
+
+Requires:
+@param u32Token_ is the token returned when the message was queued
+@param pfnCallback_ is the function to call
+@param pvContext_ is passed back to pfnCallback_
+@param eMode_ selects where the callback runs
+
+Promises:
+- Returns TRUE if the callback is attached 
+- Returns FALSE if the token's status cannot be found (it may already have been cleared by
+  QueryMessageStatus()), pfnCallback_ is NULL, or all U8_MSG_CALLBACK_SLOTS are in use
+
+*/
+bool MessageSetCallback(u32 u32Token_, fnMessageCallback_type pfnCallback_, void* pvContext_, MessageCallbackModeType eMode_)
+{
+  MessageStatusType* psStatus = &Msg_asStatusQueue[u32Token_ & U32_STATUS_INDEX_MASK];
+  MessageCallbackType* psCallback;
+  u8 u8Callback;
+  
+  if(pfnCallback_ == NULL)
+  {
+    return(FALSE);
+  }
+
+  /* Only the task reuses status entries, so the token cannot change under this function */
+  if( (u32Token_ == 0) || (psStatus->u32Token != u32Token_) )
+  {
+    return(FALSE);
+  }
+  
+  /* Take back a callback that is already attached so the peripheral cannot signal it while it 
+  is changed, otherwise take a free one */
+  u8Callback = AtomicSwapByte(&psStatus->u8Callback, U8_MSG_NO_CALLBACK);
+  if(u8Callback == U8_MSG_NO_CALLBACK)
+  {
+    u8Callback = TakeCallbackSlot();
+    if(u8Callback == U8_MSG_NO_CALLBACK)
+    {
+      return(FALSE);
+    }
+  }
+
+  psCallback = &Msg_asCallbacks[u8Callback];
+  psCallback->pfnCallback = pfnCallback_;
+  psCallback->pvContext   = pvContext_;
+  psCallback->u32Token    = u32Token_;
+  psCallback->eMode       = eMode_;
+  
+  /* Publish it, then look at the state.  A peripheral that finishes the message after the 
+  store takes the callback itself; if the message was already done, it is deferred here. */
+  AtomicSwapByte(&psStatus->u8Callback, u8Callback);
+  if(IsMessageStateFinal(psStatus->eState))
+  {
+    SignalMessageCallback(psStatus, FALSE);
+  }
+  
+  return(TRUE);
+  
+} /* end MessageSetCallback() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void MessageQueueSetPriority(MessageQueueType* psQueue_, MessagePriorityType ePriority_, u8 u8Quota_)
+
+@brief Sets the priority of the traffic on a transmit queue and optionally caps the slots it can hold.
+
+When the pool runs low, lower priority traffic is refused first.  MSG_PRIORITY_LOW messages 
+must leave a quarter (U8_MSG_LOW_RESERVE_SHIFT) of each size class free and MSG_PRIORITY_NORMAL
+messages must leave U8_MSG_NORMAL_RESERVE_SLOTS free, so MSG_PRIORITY_HIGH traffic finds a slot.  
+If a message still does not fit, the queue's overflow policy decides what happens (see 
+MessageQueueSetOverflow()); by default queued messages of lower priority queues are dropped.  
+A quota stops one busy producer from filling the pool on its own.
+
+The setting stays with the queue until it is changed; peripheral drivers return their queues to
+MSG_PRIORITY_NORMAL with no quota when the peripheral is released.
+
+Example:
+MessageQueueSetPriority(&psUart->sTransmitQueue, MSG_PRIORITY_LOW, 24);
+
+Requires:
+@param psQueue_ is the transmit queue (usually the sTransmitQueue of a requested peripheral)
+@param ePriority_ is the priority of the queue's traffic
+@param u8Quota_ is the most slots the queue's messages can hold at once; 0 for no limit
+
+Promises:
+- psQueue_ priority and quota are updated; messages already queued are not affected
+
+*/
+void MessageQueueSetPriority(MessageQueueType* psQueue_, MessagePriorityType ePriority_, u8 u8Quota_)
+{
+  psQueue_->u8Priority = (u8)ePriority_;
+  psQueue_->u8Quota = u8Quota_;
+  
+} /* end MessageQueueSetPriority() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void MessageQueueSetOverflow(MessageQueueType* psQueue_, MessageOverflowType eOverflow_)
+
+@brief Chooses what a transmit queue does when a new message does not fit.
+
+- MSG_OVERFLOW_DROP_LOWEST_PRIORITY (default): messages waiting on queues of lower priority than 
+  psQueue_ are dropped, lowest priority and newest first.  A queue at its quota refuses the message.
+- MSG_OVERFLOW_REJECT_NEW: the new message is refused and nothing is dropped.
+- MSG_OVERFLOW_DROP_OLDEST: the oldest messages waiting on psQueue_ itself are dropped, so the
+  newest output always gets through.  This suits status and debug output where only the latest
+  information matters.
+
+The message being sent is never dropped.  A dropped message gets the status ABANDONED (its 
+callback runs) and is counted in the dropped throttle count of its queue's priority.  Peripheral
+drivers return their queues to the default when the peripheral is released.
+
+Requires:
+@param psQueue_ is the transmit queue (usually the sTransmitQueue of a requested peripheral)
+@param eOverflow_ is the policy to use
+
+Promises:
+- psQueue_ overflow policy is updated
+
+*/
+void MessageQueueSetOverflow(MessageQueueType* psQueue_, MessageOverflowType eOverflow_)
+{
+  psQueue_->u8Overflow = (u8)eOverflow_;
+  
+} /* end MessageQueueSetOverflow() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn bool CancelMessage(u32 u32Token_)
+
+@brief Removes a message that is waiting in a transmit queue so it is never sent.
+
+Use this for output that is no longer wanted, like a screen update that has been replaced.  
+A message that the peripheral has started sending cannot be cancelled.
+
+Requires:
+- Called from task context
+@param u32Token_ is the token of the message
+
+Promises:
+- If the message is waiting, it is removed from its queue, its slots are freed, its status is 
+  set to ABANDONED (which runs its callback) and TRUE is returned
+- Returns FALSE if the message is being sent, has finished or is unknown
+
+*/
+bool CancelMessage(u32 u32Token_)
+{
+  MessageType* psCancelled;
+  
+  __disable_irq();
+  psCancelled = UnlinkQueuedMessage(u32Token_);
+  if(psCancelled != NULL)
+  {
+    PostMessageStatus(u32Token_, ABANDONED, FALSE);
+  }
+  __enable_irq();
+  
+  if(psCancelled == NULL)
+  {
+    return(FALSE);
+  }
+  
+  /* Slots are returned with interrupts back on */
+  FreeMessageChain(psCancelled);
+  
+  return(TRUE);
+  
+} /* end CancelMessage() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void QueryMessageThrottleCounts(MessagePriorityType ePriority_, MessageThrottleCountType* psCounts_)
+
+@brief Reports how often the traffic of a priority level has been throttled since startup.
+
+Requires:
+@param ePriority_ is the priority level of interest
+@param psCounts_ points to where the counts are written
+
+Promises:
+- psCounts_ holds the number of messages of ePriority_ that were refused and that were dropped
+
+*/
+void QueryMessageThrottleCounts(MessagePriorityType ePriority_, MessageThrottleCountType* psCounts_)
+{
+  __disable_irq();
+  *psCounts_ = Msg_asThrottleCounts[ePriority_];
+  __enable_irq();
+  
+} /* end QueryMessageThrottleCounts() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void QueryMessagingStats(MessagingStatsType* psStats_)
+
+@brief Reports how the message pool has been used since startup.
+
+The slot high-water marks show how close each size class has come to running out, and the
+histograms show how long messages wait before their peripheral starts them (SENDING) and how 
+long they take to finish (COMPLETE).  Bin n of a histogram counts the messages that took less 
+than 2^n ms (bin 0 is under 1 ms) and the last bin counts everything longer.  Peripherals that
+never post SENDING do not show up in the wait histogram.
+
+Requires:
+@param psStats_ points to where the statistics are written
+
+Promises:
+- psStats_ holds a snapshot of the statistics
+
+*/
+void QueryMessagingStats(MessagingStatsType* psStats_)
+{
+  __disable_irq();
+  Msg_sStats.u8SlotsUsed = Msg_u8QueuedMessageCount;
+  *psStats_ = Msg_sStats;
+  __enable_irq();
+  
+} /* end QueryMessagingStats() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn bool QueryMessageQueueStats(u8 u8Index_, MessageQueueStatsType* psStats_)
+
+@brief Reports the usage of one of the peripheral transmit queues.
+
+Queues are numbered from 0 in the reverse order they were initialized.  Call with increasing
+u8Index_ until FALSE is returned to visit every queue.
+
+Requires:
+@param u8Index_ is the number of the queue
+@param psStats_ points to where the queue's information is written
+
+Promises:
+- Returns TRUE with psStats_ filled in if queue u8Index_ exists
+- Returns FALSE if there is no queue u8Index_
+
+*/
+bool QueryMessageQueueStats(u8 u8Index_, MessageQueueStatsType* psStats_)
+{
+  MessageQueueType* psQueue = Msg_psQueues;
+  
+  while( (psQueue != NULL) && (u8Index_ != 0) )
+  {
+    psQueue = psQueue->psNextQueue;
+    u8Index_--;
+  }
+  
+  if(psQueue == NULL)
+  {
+    return(FALSE);
+  }
+  
+  __disable_irq();
+  psStats_->pu8Name           = psQueue->pu8Name;
+  psStats_->u32MessagesQueued = psQueue->u32MessagesQueued;
+  psStats_->u8Priority        = psQueue->u8Priority;
+  psStats_->u8Quota           = psQueue->u8Quota;
+  psStats_->u8SlotsUsed       = psQueue->u8SlotsUsed;
+  psStats_->u8SlotsHighWater  = psQueue->u8SlotsHighWater;
+  __enable_irq();
+  
+  return(TRUE);
+  
+} /* end QueryMessageQueueStats() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void MessageAbort(MessageType* psHandle_)
+
+@brief Gives back a slot reserved with MessageReserve() without sending anything.
+
+Requires:
+@param psHandle_ is the handle from MessageReserve() that has not been committed
+
+Promises:
+- The slot is returned to the pool
+- If the message was already given a token (MessageIssueToken()), its status is set to ABANDONED
+- Nothing happens if psHandle_ is NULL or is not a reserved slot
+
+*/
+void MessageAbort(MessageType* psHandle_)
+{
+  if( (psHandle_ == NULL) || !IsPoolMessage(psHandle_) || !(psHandle_->u8Flags & _MSG_RESERVED) )
+  {
+    return;
+  }
+  
+  if(psHandle_->u8Flags & _MSG_TOKEN_ISSUED)
+  {
+    PostMessageStatus(psHandle_->u32Token, ABANDONED, FALSE);
+  }
+  
+  psHandle_->u8Flags = 0;
+  FreeMessageSlot(psHandle_);
+  
+} /* end MessageAbort() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -160,25 +539,48 @@ Promises:
 */
 void MessagingInitialize(void)
 {
+  static const u16 au16ClassLengths[U8_MSG_SIZE_CLASSES + 1] = {U16_MSG_CLASS0_LENGTH, U16_MSG_CLASS1_LENGTH, U16_MSG_CLASS2_LENGTH, 0};
+  static const u8 au8ClassSlots[U8_MSG_SIZE_CLASSES + 1] = {U8_MSG_CLASS0_SLOTS, U8_MSG_CLASS1_SLOTS, U8_MSG_CLASS2_SLOTS, U8_MSG_REFERENCE_SLOTS};
+  u8* pu8Payload = &Msg_au8PayloadPool[0];
+  u8 u8SlotIndex = 0;
+  
   /* Initialize variables */
   Msg_u8QueuedMessageCount = 0;
   Msg_u32Token = 1;
 
-  /* Ensure all message slots are deallocated and the message status queue is empty */
-  for(u8 i = 0; i < U8_TX_QUEUE_SIZE; i++)
+  /* Clear the payload storage */
+  for(u16 i = 0; i < U16_MSG_PAYLOAD_POOL_SIZE; i++)
   {
-    /* Clear the Slot value */
-    Msg_asPool[i].bFree = TRUE;
-    
-    /* Clear the slot's message values */
-    Msg_asPool[i].Message.u32Token = 0;
-    Msg_asPool[i].Message.u32Size = 0;
-    Msg_asPool[i].Message.psNextMessage = NULL;
+    Msg_au8PayloadPool[i] = 0;
+  }
+
+  /* Set up each size class and ensure all of its message slots are deallocated.  Slots in the 
+  reference class have no storage of their own so they are left pointing at NULL until used. */
+  for(u8 i = 0; i <= U8_MSG_REFERENCE_CLASS; i++)
+  {
+    Msg_asSizeClasses[i].u16Length = au16ClassLengths[i];
+    Msg_asSizeClasses[i].u8FirstSlot = u8SlotIndex;
+    Msg_asSizeClasses[i].u8Slots = au8ClassSlots[i];
+    Msg_asSizeClasses[i].u32FreeSlots = (u32)0xFFFFFFFF >> (32 - au8ClassSlots[i]);
+    Msg_asSizeClasses[i].u8SlotsUsed = 0;
     
-    /* Clear the slot's message's contents */
-    for(u16 j = 0; j < U16_MAX_TX_MESSAGE_LENGTH; j++)
+    for(u8 j = 0; j < au8ClassSlots[i]; j++)
     {
-      *(Msg_asPool[i].Message.pu8Message + j) = 0;
+      /* Clear the Slot value */
+      Msg_asPool[u8SlotIndex].bFree = TRUE;
+      Msg_asPool[u8SlotIndex].psOwner = NULL;
+      
+      /* Clear the slot's message values and give it its payload storage */
+      Msg_asPool[u8SlotIndex].Message.u32Token = 0;
+      Msg_asPool[u8SlotIndex].Message.u32Size = 0;
+      Msg_asPool[u8SlotIndex].Message.pu8Message = (au16ClassLengths[i] != 0) ? pu8Payload : NULL;
+      Msg_asPool[u8SlotIndex].Message.psNextMessage = NULL;
+      Msg_asPool[u8SlotIndex].Message.u8SlotIndex = u8SlotIndex;
+      Msg_asPool[u8SlotIndex].Message.u8SizeClass = i;
+      Msg_asPool[u8SlotIndex].Message.u8Flags = 0;
+      
+      pu8Payload += au16ClassLengths[i];
+      u8SlotIndex++;
     }
   }
 
@@ -187,10 +589,30 @@ void MessagingInitialize(void)
   {
     Msg_asStatusQueue[i].u32Token = 0;
     Msg_asStatusQueue[i].eState = EMPTY;
+    Msg_asStatusQueue[i].u8Callback = U8_MSG_NO_CALLBACK;
     Msg_asStatusQueue[i].u32Timestamp = 0;
   }
 
-  Msg_psNextStatus = &Msg_asStatusQueue[0];
+  /* No callbacks are registered */
+  for(u8 i = 0; i < U8_MSG_CALLBACK_SLOTS; i++)
+  {
+    Msg_asCallbacks[i].pfnCallback = NULL;
+    Msg_asCallbacks[i].pvContext = NULL;
+    Msg_asCallbacks[i].u32Token = 0;
+  }
+  Msg_u32FreeCallbacks = (u32)0xFFFFFFFF >> (32 - U8_MSG_CALLBACK_SLOTS);
+  Msg_u32PendingCallbacks = 0;
+
+  /* No queues yet and no cleaning sweep running */
+  Msg_psQueues = NULL;
+  Msg_u16CleaningIndex = U8_STATUS_QUEUE_SIZE;
+  memset(&Msg_sStats, 0, sizeof(Msg_sStats));
+  
+  for(u8 i = 0; i < U8_MSG_PRIORITY_LEVELS; i++)
+  {
+    Msg_asThrottleCounts[i].u32Refused = 0;
+    Msg_asThrottleCounts[i].u32Dropped = 0;
+  }
 
   G_u32MessagingFlags = 0;
   Messaging_pfnStateMachine = MessagingSM_Idle;
@@ -223,7 +645,9 @@ void MessagingRunActiveState(void)
 /*!--------------------------------------------------------------------------------------------------------------------
 @fn u32 QueueMessage(MessageType** ppsTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_)
 
-@brief Allocates one of the positions in the message queue to the calling function's send queue.
+@brief Compatibility version of QueueTxMessage() for transmit buffers that are plain linked lists.
+
+This walks the list to find the end, so new code should keep a MessageQueueType and use QueueTxMessage().
 
 Requires:
 - Msg_asPool should not be full 
@@ -239,130 +663,45 @@ Promises:
 */
 u32 QueueMessage(MessageType** ppsTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_)
 {
-  MessageSlotType *psSlotParser;
-  MessageType *psNewMessage;
+  MessageType *psFirstMessage;
+  MessageType *psLastMessage;
   MessageType *psListParser;
-  u8  u8SlotsRequired;
-  u32 u32BytesRemaining = u32MessageSize_;
-  u32 u32CurrentMessageSize = 0;
-  u32 u32MaxTxMessageLength = (u32)(U16_MAX_TX_MESSAGE_LENGTH) & 0x0000FFFF;
   
-  /* Check for empty message */
-  if(u32MessageSize_ == 0)
+  /* Build the message in the pool */
+  if(!CreateMessageChain(NULL, u32MessageSize_, pu8MessageData_, &psFirstMessage, &psLastMessage))
   {
     return(0);
   }
 
-  /* Carefully check for available space in the message pool */
-  u8SlotsRequired = (u8)(u32MessageSize_ / u32MaxTxMessageLength);
-  if( (u32MessageSize_ % u32MaxTxMessageLength) != 0 )
-  {
-    u8SlotsRequired++;
-  }
-
-  if( (Msg_u8QueuedMessageCount + u8SlotsRequired) > U8_TX_QUEUE_SIZE)
+  /* Link the new message into the client's transmit buffer.  This must happen
+  with interrupts off since other functions can operate on the transmit buffer. */
+  __disable_irq();
+  
+  /* Handle an empty list */
+  if(*ppsTargetTxBuffer_ == NULL)
   {
-    G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
-    return(0);
+    *ppsTargetTxBuffer_ = psFirstMessage;
   }
 
-  /* Space available, so proceed with allocation.  Though only one message is queued at a time, we
-  use a while loop to handle messages that are too big and must be split into different slots.  The slots
-  are always sequential and the message processor will send the bytes continuously across slots */
-  while(u32BytesRemaining)
+  /* Add the message to the end of the list */
+  else
   {
-    /* Increment the message count.  Interrupts are disabled here since this global
-    can be accessed by an interrupt. */
-    __disable_irq();
-    Msg_u8QueuedMessageCount++;
-    __enable_irq();
-  
-    /* Flag if we're above the high watermark */
-    if(Msg_u8QueuedMessageCount >= U8_TX_QUEUE_WATERMARK)
-    {
-      G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_ALMOST_FULL;
-    }
-    else
-    {
-      G_u32MessagingFlags &= ~_MESSAGING_TX_QUEUE_ALMOST_FULL;
-    }
-
-    /* Find an empty slot: this is non-circular and there must be at least one free slot if we're here */
-    psSlotParser = &Msg_asPool[0];
-    while(!psSlotParser->bFree)
-    {
-      psSlotParser++;
-    }
-    
-    /* Allocate the slot and set the message pointer */
-    psSlotParser->bFree = FALSE;
-    psNewMessage = &(psSlotParser->Message);
-  
-    /* Check the message size and split the message up if necessary */
-    if(u32BytesRemaining > u32MaxTxMessageLength)
-    {
-      u32CurrentMessageSize = u32MaxTxMessageLength;
-      u32BytesRemaining -= u32MaxTxMessageLength;
-    }
-    else
-    {
-      u32CurrentMessageSize = u32BytesRemaining;
-      u32BytesRemaining = 0;
-    }
-    
-    /* Copy all the data to the allocated message structure */
-    psNewMessage->u32Token      = Msg_u32Token;
-    psNewMessage->u32Size       = u32CurrentMessageSize;
-    psNewMessage->psNextMessage = NULL;
-    
-    /* Add the data into the payload */
-    for(u32 i = 0; i < psNewMessage->u32Size; i++)
+    /* Find the last node */
+    psListParser = *ppsTargetTxBuffer_;
+    while(psListParser->psNextMessage != NULL)
     {
-      *(psNewMessage->pu8Message + i) = *pu8MessageData_;
-      pu8MessageData_++;
-    }
-  
-    /* Link the new message into the client's transmit buffer.  This must happen
-    with interrupts off since other functions can operate on the transmit buffer. */
-    __disable_irq();
-    
-    /* Handle an empty list */
-    if(*ppsTargetTxBuffer_ == NULL)
-    {
-      *ppsTargetTxBuffer_ = psNewMessage;
-    }
-
-    /* Add the message to the end of the list */
-    else
-    {
-      /* Find the last node */
-      psListParser = *ppsTargetTxBuffer_;
-      while(psListParser->psNextMessage != NULL)
-      {
-        psListParser = psListParser->psNextMessage;
-      }
-     
-      /* Found the end: add the new node */
-      psListParser->psNextMessage = psNewMessage;
+      psListParser = psListParser->psNextMessage;
     }
+   
+    /* Found the end: add the new node */
+    psListParser->psNextMessage = psFirstMessage;
+  }
 
-    /* Safe to re-enable interrupts */
-    __enable_irq();
-
-    /* Update the Public status of the message in the status queue */
-    AddNewMessageStatus(Msg_u32Token);
-  
-    /* Increment message token and catch the rollover every 4 billion messages... Token 0 is not allowed. */
-    Msg_u32Token++;
-    if(Msg_u32Token == 0)
-    {
-      Msg_u32Token = 1;
-    }
-      
-  } /* end while */
+  /* Safe to re-enable interrupts */
+  __enable_irq();
 
   /* Return only the current (and highest) message token, as it will be the last portion to be sent if the message was split up */
-  return(psNewMessage->u32Token);
+  return(psLastMessage->u32Token);
   
 } /* end QueueMessage() */
 
@@ -370,7 +709,7 @@ u32 QueueMessage(MessageType** ppsTargetTxBuffer_, u32 u32MessageSize_, u8* pu8M
 /*!--------------------------------------------------------------------------------------------------------------------
 @fn void DeQueueMessage(MessageType** pTargetQueue_)
 
-@brief Removes a message from a message queue and adds it back to the pool.
+@brief Compatibility version of DeQueueTxMessage() for transmit buffers that are plain linked lists.
 
 Requires:
 - The message to be removed has been completely sent and is no longer in use
@@ -385,7 +724,7 @@ Promises:
 */
 void DeQueueMessage(MessageType** pTargetQueue_)
 {
-  MessageSlotType *psSlotParser;
+  MessageType *psMessage;
       
   /* Make sure there is a message to kill */
   if(*pTargetQueue_ == NULL)
@@ -394,65 +733,1292 @@ void DeQueueMessage(MessageType** pTargetQueue_)
     return;
   }
   
-  /* Find the message's slot: this message pool is non-circular and the message must be one of the slots */
-  psSlotParser = &Msg_asPool[0];
-  while( (&psSlotParser->Message != *pTargetQueue_) && 
-         (psSlotParser != &Msg_asPool[U8_TX_QUEUE_SIZE]) )
-  {
-    psSlotParser++;
-  }
-
-  /* Make sure the message has been found */
-  if(psSlotParser == &Msg_asPool[U8_TX_QUEUE_SIZE])
+  /* Unhook the message from the current owner's queue and put it back in the pool */
+  psMessage = *pTargetQueue_;
+  if(IsPoolMessage(psMessage))
   {
-    G_u32MessagingFlags |= _DEQUEUE_MSG_NOT_FOUND;
-    return;
+    *pTargetQueue_ = psMessage->psNextMessage;
+    FreeMessageSlot(psMessage);
   }
-
-  /* Unhook the message from the current owner's queue and put it back in the pool */
-  *pTargetQueue_ = (*pTargetQueue_)->psNextMessage;
-  psSlotParser->bFree = TRUE;
-  Msg_u8QueuedMessageCount--;
   
 } /* end DeQueueMessage() */
 
 
 /*!--------------------------------------------------------------------------------------------------------------------
-@fn void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
+@fn void MessageQueueInitialize(MessageQueueType* psQueue_, u8* pu8Name_)
 
-@brief Changes the status of a message in the statue queue.
+@brief Sets up an empty peripheral transmit queue.
+
+The queue is also added to the list of queues that the cleaning sweep searches for stuck messages
+and that QueryMessageQueueStats() reports on.
 
 Requires:
-@param u32Token_ is message that should be in the status queue
-@param eNewState_ is the desired status setting for the message
+- MessagingInitialize() has run
+- psQueue_ is a static descriptor that exists for the life of the program
+
+@param psQueue_ points to the queue descriptor owned by the peripheral
+@param pu8Name_ is a short constant string naming the peripheral (e.g. "USART0")
 
 Promises:
-- if the token is found, the eState of the message is set to eNewState_
+- psQueue_ head and tail are NULL
+- psQueue_ carries MSG_PRIORITY_NORMAL traffic with no quota and no pending-work flag
+- psQueue_ is in the Msg_psQueues list (once, even if initialized again)
 
 */
-void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
+void MessageQueueInitialize(MessageQueueType* psQueue_, u8* pu8Name_)
 {
-  MessageStatusType* pListParser = &Msg_asStatusQueue[0];
+  MessageQueueType* psQueue = Msg_psQueues;
   
-  /* Search for the token */
-  while( (pListParser->u32Token != u32Token_) && (pListParser != &Msg_asStatusQueue[U8_STATUS_QUEUE_SIZE]) )
+  psQueue_->psHead = NULL;
+  psQueue_->psTail = NULL;
+  psQueue_->pu8Name = pu8Name_;
+  psQueue_->pu32PendingFlags = NULL;
+  psQueue_->u32PendingFlag = 0;
+  psQueue_->u32MessagesQueued = 0;
+  psQueue_->u8SlotsHighWater = 0;
+  psQueue_->u8Priority = MSG_PRIORITY_NORMAL;
+  psQueue_->u8Quota = 0;
+  psQueue_->u8Overflow = MSG_OVERFLOW_DROP_LOWEST_PRIORITY;
+  psQueue_->u8SlotsUsed = 0;
+  
+  /* Add the queue to the list if it is not already there */
+  while( (psQueue != NULL) && (psQueue != psQueue_) )
   {
-    pListParser++;
+    psQueue = psQueue->psNextQueue;
   }
-
-  /* If the token was found, change the status */
-  if(pListParser != &Msg_asStatusQueue[U8_STATUS_QUEUE_SIZE])
+  
+  if(psQueue == NULL)
   {
-    pListParser->eState = eNewState_;
+    psQueue_->psNextQueue = Msg_psQueues;
+    Msg_psQueues = psQueue_;
   }
   
-} /* end UpdateMessageStatus() */
+} /* end MessageQueueInitialize() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void MessageQueueSetPendingFlag(MessageQueueType* psQueue_, u32* pu32Flags_, u32 u32Flag_)
+
+@brief Makes a transmit queue flag its owner whenever a message is queued on it.
+
+A driver with several peripherals can keep one pending-work bitmap with a bit per queue and 
+service only the peripherals whose bit is set, instead of polling each queue in turn.  The 
+bit is set with an exclusive store after the message is linked in, so a driver that clears 
+the bitmap (e.g. by swapping in 0 with __LDREXW/__STREXW) never misses a message.
+
+Requires:
+@param psQueue_ has been initialized with MessageQueueInitialize()
+@param pu32Flags_ points to the driver's bitmap (NULL to stop flagging)
+@param u32Flag_ is the bit to set for psQueue_
+
+Promises:
+- Every message queued on psQueue_ from now on sets u32Flag_ in *pu32Flags_
+
+*/
+void MessageQueueSetPendingFlag(MessageQueueType* psQueue_, u32* pu32Flags_, u32 u32Flag_)
+{
+  psQueue_->pu32PendingFlags = pu32Flags_;
+  psQueue_->u32PendingFlag = u32Flag_;
+  
+} /* end MessageQueueSetPendingFlag() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 QueueTxMessage(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
+
+@brief Allocates one of the positions in the message queue and appends it to a peripheral's transmit queue.
+
+Messages that are too big for one slot are split and chained before they are linked, so
+the complete message is appended in one step using the queue's tail pointer, without 
+disabling interrupts.  The time this takes does not depend on how many messages are already queued.
+
+Requires:
+- Msg_asPool should not be full 
+
+@param  psQueue_ is the peripheral transmit queue where the message will be queued
+@param  u32MessageSize_ is the size of the message data array in bytes
+@param  pu8MessageData_ points to the message data array
+
+Promises:
+- The message is inserted at the end of psQueue_ and assigned a token
+- If the message is created successfully, the message token is returned; otherwise, 0 is returned
+
+*/
+u32 QueueTxMessage(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
+{
+  MessageType *psFirstMessage;
+  MessageType *psLastMessage;
+  
+  /* Build the message in the pool */
+  if(!CreateMessageChain(psQueue_, u32MessageSize_, pu8MessageData_, &psFirstMessage, &psLastMessage))
+  {
+    return(0);
+  }
+
+  AppendMessageChain(psQueue_, psFirstMessage, psLastMessage);
+
+  /* Return only the current (and highest) message token, as it will be the last portion to be sent if the message was split up */
+  return(psLastMessage->u32Token);
+  
+} /* end QueueTxMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 QueueTxMessageReference(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
+
+@brief Queues caller-owned data on a peripheral's transmit queue without copying it.
+
+Only a descriptor slot is taken from the pool and the peripheral transfers straight from 
+pu8MessageData_.  The caller keeps ownership of the data but must not change or reuse it 
+until the message status shows the transfer is finished (COMPLETE, TIMEOUT, ABANDONED or 
+FAILED) or the message is NOT_FOUND.  This suits constant strings and buffers that the 
+caller already holds until completion.
+
+Requires:
+- A reference slot is available
+- pu8MessageData_ remains valid and unchanged until the message is finished
+
+@param  psQueue_ is the peripheral transmit queue where the message will be queued
+@param  u32MessageSize_ is the size of the message data array in bytes (max U32_MSG_MAX_REFERENCE_LENGTH)
+@param  pu8MessageData_ points to the message data array
+
+Promises:
+- The message is inserted at the end of psQueue_ and assigned a token
+- If the message is created successfully, the message token is returned; otherwise, 0 is returned
+
+*/
+u32 QueueTxMessageReference(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
+{
+  MessageType *psNewMessage;
+
+  /* The data must fit in a single peripheral DMA transfer since it cannot be split */
+  if( (u32MessageSize_ == 0) || (u32MessageSize_ > U32_MSG_MAX_REFERENCE_LENGTH) )
+  {
+    return(0);
+  }
+
+  psNewMessage = AllocateMessageSlot(psQueue_, U8_MSG_REFERENCE_CLASS, 0);
+  if(psNewMessage == NULL)
+  {
+    G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
+    AtomicAddWord(&Msg_sStats.u32QueueFullCount, 1);
+    return(0);
+  }
+
+  /* Point the descriptor at the caller's data */
+  psNewMessage->u32Size       = u32MessageSize_;
+  psNewMessage->pu8Message    = pu8MessageData_;
+  psNewMessage->psNextMessage = NULL;
+
+  IssueMessageTokens(psNewMessage);
+  AppendMessageChain(psQueue_, psNewMessage, psNewMessage);
+
+  return(psNewMessage->u32Token);
+  
+} /* end QueueTxMessageReference() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 QueueTxMessageFragments(MessageQueueType* psQueue_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+
+@brief Queues a list of fragments that are sent back-to-back as one logical message.
+
+Each fragment takes its own slot but all of them share one token, so the message has a single 
+status that becomes COMPLETE only when the last fragment has been sent.  Fragments with bCopy 
+set are copied into a pool slot (max U16_MAX_TX_MESSAGE_LENGTH bytes) so their source can be 
+temporary.  Other fragments are sent straight from the caller's data with the same rules as 
+QueueTxMessageReference().  Peripherals that support it chain the fragments in their DMA so 
+there is no gap between them.
+
+Example:
+u8 au8Number[11];
+MessageFragmentType asLine[] = { {"Count: ", 7, FALSE}, {au8Number, 0, TRUE}, {"\n\r", 2, FALSE} };
+
+asLine[1].u32Size = NumberToAscii(u32Count, au8Number);
+u32Token = QueueTxMessageFragments(&psPeripheral->sTransmitQueue, asLine, 3);
+
+Requires:
+- Enough slots are available for every fragment
+- Referenced fragment data remains valid and unchanged until the message is finished
+
+@param  psQueue_ is the peripheral transmit queue where the message will be queued
+@param  psFragments_ points to the list of fragments in the order they are sent
+@param  u8Fragments_ is the number of fragments in the list (1 to U8_MSG_MAX_FRAGMENTS)
+
+Promises:
+- All fragments are inserted at the end of psQueue_ under one token with a WAITING status
+- If the message is created successfully, the message token is returned; otherwise, 0 is 
+returned and no slots are used
+
+*/
+u32 QueueTxMessageFragments(MessageQueueType* psQueue_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+{
+  MessageType *psNewMessage;
+  MessageType *psFirstMessage = NULL;
+  MessageType *psLastMessage = NULL;
+
+  if( (u8Fragments_ == 0) || (u8Fragments_ > U8_MSG_MAX_FRAGMENTS) )
+  {
+    return(0);
+  }
+
+  for(u8 i = 0; i < u8Fragments_; i++, psFragments_++)
+  {
+    /* Each fragment must be non-empty and fit in one slot or one DMA transfer */
+    psNewMessage = NULL;
+    if( (psFragments_->u32Size != 0) && 
+        (psFragments_->u32Size <= (psFragments_->bCopy ? (u32)U16_MAX_TX_MESSAGE_LENGTH : U32_MSG_MAX_REFERENCE_LENGTH)) )
+    {
+      if(psFragments_->bCopy)
+      {
+        psNewMessage = AllocateMessageSlot(psQueue_, 0, psFragments_->u32Size);
+        if(psNewMessage != NULL)
+        {
+          for(u32 j = 0; j < psFragments_->u32Size; j++)
+          {
+            psNewMessage->pu8Message[j] = psFragments_->pu8Data[j];
+          }
+        }
+      }
+      else
+      {
+        psNewMessage = AllocateMessageSlot(psQueue_, U8_MSG_REFERENCE_CLASS, 0);
+        if(psNewMessage != NULL)
+        {
+          psNewMessage->pu8Message = psFragments_->pu8Data;
+        }
+      }
+      
+      if(psNewMessage == NULL)
+      {
+        G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
+        AtomicAddWord(&Msg_sStats.u32QueueFullCount, 1);
+      }
+    }
+
+    /* Give back any fragments already claimed if this one could not be built */
+    if(psNewMessage == NULL)
+    {
+      FreeMessageChain(psFirstMessage);
+      return(0);
+    }
+
+    psNewMessage->u32Size       = psFragments_->u32Size;
+    psNewMessage->psNextMessage = NULL;
+
+    /* Chain it to the previous fragment, which is not visible to any peripheral yet */
+    if(psLastMessage == NULL)
+    {
+      psFirstMessage = psNewMessage;
+    }
+    else
+    {
+      psLastMessage->u8Flags |= _MSG_MORE_FRAGMENTS;
+      psLastMessage->psNextMessage = psNewMessage;
+    }
+    psLastMessage = psNewMessage;
+  }
+
+  IssueMessageTokens(psFirstMessage);
+  AppendMessageChain(psQueue_, psFirstMessage, psLastMessage);
+
+  return(psLastMessage->u32Token);
+  
+} /* end QueueTxMessageFragments() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u8* MessageReserve(MessageQueueType* psQueue_, u32 u32Size_, MessageType** ppsHandle_)
+
+@brief Reserves a pool slot for a message so the caller can write the data straight into it.
+
+This is the first half of a two-phase write that saves the copy QueueTxMessage() makes: 
+reserve a slot big enough for the longest possible message, format the data into the 
+returned buffer, then call MessageCommit() with the number of bytes actually written.
+MessageAbort() gives the slot back if nothing is to be sent.  The slot is charged to 
+psQueue_ for its quota and priority as soon as it is reserved, but it is not in the 
+queue and has no token until it is committed.  Every reservation must be committed or 
+aborted, and quickly, since the slot is not available to anything else until then.
+
+Example:
+MessageType* psHandle;
+u8* pu8Buffer = MessageReserve(&psPeripheral->sTransmitQueue, 11, &psHandle);
+
+if(pu8Buffer != NULL)
+{
+  u32Token = MessageCommit(psHandle, NumberToAscii(u32Count, pu8Buffer));
+}
+
+Requires:
+@param psQueue_ is the peripheral transmit queue the message will be sent on
+@param u32Size_ is the most bytes that will be written (1 to U16_MAX_TX_MESSAGE_LENGTH)
+@param ppsHandle_ receives the handle to pass to MessageCommit() or MessageAbort()
+
+Promises:
+- Returns a buffer of at least u32Size_ bytes in the reserved slot, with *ppsHandle_ set
+- Returns NULL if no slot is available (with _MESSAGING_TX_QUEUE_FULL set) or u32Size_ is invalid
+
+*/
+u8* MessageReserve(MessageQueueType* psQueue_, u32 u32Size_, MessageType** ppsHandle_)
+{
+  MessageType* psNewMessage;
+  
+  /* A reserved message must fit in one slot since it is written in place */
+  if( (u32Size_ == 0) || (u32Size_ > (u32)U16_MAX_TX_MESSAGE_LENGTH) )
+  {
+    return(NULL);
+  }
+  
+  psNewMessage = AllocateMessageSlot(psQueue_, 0, u32Size_);
+  if(psNewMessage == NULL)
+  {
+    G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
+    AtomicAddWord(&Msg_sStats.u32QueueFullCount, 1);
+    return(NULL);
+  }
+  
+  psNewMessage->u32Size = u32Size_;
+  psNewMessage->psNextMessage = NULL;
+  psNewMessage->u8Flags = _MSG_RESERVED;
+  *ppsHandle_ = psNewMessage;
+  
+  return(psNewMessage->pu8Message);
+  
+} /* end MessageReserve() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 MessageCommit(MessageType* psHandle_, u32 u32Size_)
+
+@brief Queues a message that was written in place after MessageReserve().
+
+The message is appended to the queue it was reserved for.  Peripheral drivers wrap this so 
+they can start the transfer (e.g. UartCommitData()).
+
+Requires:
+@param psHandle_ is the handle from MessageReserve() that has not been committed or aborted
+@param u32Size_ is the number of bytes written, no more than the size reserved
+
+Promises:
+- The message is inserted at the end of its queue with a new token (or the one from 
+  MessageIssueToken()), which is returned
+- If u32Size_ is 0 or larger than the reservation, the slot is given back as with 
+  MessageAbort() and 0 is returned
+- Returns 0 if psHandle_ is not a reserved slot
+
+*/
+u32 MessageCommit(MessageType* psHandle_, u32 u32Size_)
+{
+  MessageQueueType* psQueue;
+  
+  if( (psHandle_ == NULL) || !IsPoolMessage(psHandle_) || !(psHandle_->u8Flags & _MSG_RESERVED) )
+  {
+    return(0);
+  }
+  
+  psQueue = Msg_asPool[psHandle_->u8SlotIndex].psOwner;
+  if( (u32Size_ == 0) || (u32Size_ > psHandle_->u32Size) || (psQueue == NULL) )
+  {
+    MessageAbort(psHandle_);
+    return(0);
+  }
+  
+  psHandle_->u32Size = u32Size_;
+  if( !(psHandle_->u8Flags & _MSG_TOKEN_ISSUED) )
+  {
+    IssueMessageTokens(psHandle_);
+  }
+  psHandle_->u8Flags = 0;
+  
+  AppendMessageChain(psQueue, psHandle_, psHandle_);
+  
+  return(psHandle_->u32Token);
+  
+} /* end MessageCommit() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 MessageIssueToken(MessageType* psHandle_)
+
+@brief Gives a reserved message its token before it is committed.
+
+This lets a driver hand out the token while it is still filling the slot, e.g. when it merges 
+several small writes into one message.  The token is WAITING until the message is committed 
+and sent, or ABANDONED if the reservation is aborted.
+
+Requires:
+@param psHandle_ is the handle from MessageReserve() that has not been committed or aborted
+
+Promises:
+- Returns the token of the reserved message, issuing it first if needed
+- Returns 0 if psHandle_ is not a reserved slot
+
+*/
+u32 MessageIssueToken(MessageType* psHandle_)
+{
+  if( (psHandle_ == NULL) || !IsPoolMessage(psHandle_) || !(psHandle_->u8Flags & _MSG_RESERVED) )
+  {
+    return(0);
+  }
+  
+  if( !(psHandle_->u8Flags & _MSG_TOKEN_ISSUED) )
+  {
+    IssueMessageTokens(psHandle_);
+    psHandle_->u8Flags |= _MSG_TOKEN_ISSUED;
+  }
+  
+  return(psHandle_->u32Token);
+  
+} /* end MessageIssueToken() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 MessageIssueTransferToken(void)
+
+@brief Issues a token for a peripheral transfer that does not go through a message queue.
+
+Reads from a device are queued by the peripheral driver itself (e.g. TwiReadData()), but the 
+client still needs a token to query or to attach a callback to.  The driver owns the status: 
+it moves it to SENDING, then to a final state with UpdateMessageStatus() when the transfer ends.
+
+Requires:
+- Called from task context like the other queueing functions
+
+Promises:
+- Returns a new, non-zero token with a WAITING status
+
+*/
+u32 MessageIssueTransferToken(void)
+{
+  u32 u32Token = Msg_u32Token;
+  
+  AddNewMessageStatus(u32Token);
+  
+  Msg_u32Token++;
+  if(Msg_u32Token == 0)
+  {
+    Msg_u32Token = 1;
+  }
+  
+  return(u32Token);
+  
+} /* end MessageIssueTransferToken() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void DeQueueTxMessage(MessageQueueType* psQueue_)
+
+@brief Removes the message at the head of a peripheral transmit queue and adds it back to the pool.
+
+Requires:
+- The message to be removed has been completely sent and is no longer in use
+- Called from the peripheral ISR or with the peripheral's interrupts off
+
+@param  psQueue_ is the queue where the message that needs to be killed is at the front
+
+Promises:
+- The first message in the queue is deleted; the tail is cleared if the queue is now empty
+- The message space is added back to the available message queue
+
+*/
+void DeQueueTxMessage(MessageQueueType* psQueue_)
+{
+  MessageType *psMessage = psQueue_->psHead;
+  MessageType *psNextMessage;
+      
+  /* Make sure there is a message to kill */
+  if(psMessage == NULL)
+  {
+    G_u32MessagingFlags |= _DEQUEUE_GOT_NULL;
+    return;
+  }
+  
+  /* Unhook the message from the queue and put it back in the pool.  If it is the last message,
+  its link is closed so a message being appended from the task cannot be linked to it. */
+  if(IsPoolMessage(psMessage))
+  {
+    do
+    {
+      psNextMessage = (MessageType*)__LDREXW((volatile uint32_t*)&psMessage->psNextMessage);
+      if(psNextMessage != NULL)
+      {
+        __CLREX();
+        break;
+      }
+    } while(__STREXW((u32)P_MSG_CLOSED_LINK, (volatile uint32_t*)&psMessage->psNextMessage) != 0);
+    
+    psQueue_->psHead = psNextMessage;
+    if(psNextMessage == NULL)
+    {
+      psQueue_->psTail = NULL;
+    }
+    
+    FreeMessageSlot(psMessage);
+  }
+  
+} /* end DeQueueTxMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn MessageType* FinishTxMessage(MessageQueueType* psQueue_, MessageStateType eState_)
+
+@brief Retires the message at the head of a peripheral transmit queue and posts its status.
+
+For a fragment that is followed by more fragments of the same message, a COMPLETE state is 
+not posted since the message is not finished yet.  Any other state ends the whole message, 
+so the fragments that follow are removed too.
+
+Requires:
+- The head message is no longer in use by the peripheral
+- Called from the peripheral ISR or with the peripheral's interrupts off
+
+@param  psQueue_ is the queue where the message to retire is at the front
+@param  eState_ is the final state of the message (COMPLETE, ABANDONED, FAILED, etc.)
+
+Promises:
+- The head message is dequeued and its status is updated as described above
+- Returns the new head message if it is the next fragment of the same message, otherwise NULL
+
+*/
+MessageType* FinishTxMessage(MessageQueueType* psQueue_, MessageStateType eState_)
+{
+  MessageType *psMessage = psQueue_->psHead;
+  bool bMoreFragments;
+  
+  if(psMessage == NULL)
+  {
+    G_u32MessagingFlags |= _DEQUEUE_GOT_NULL;
+    return(NULL);
+  }
+
+  bMoreFragments = (psMessage->u8Flags & _MSG_MORE_FRAGMENTS) ? TRUE : FALSE;
+  if( (eState_ != COMPLETE) || !bMoreFragments )
+  {
+    UpdateMessageStatus(psMessage->u32Token, eState_);
+  }
+  DeQueueTxMessage(psQueue_);
+  
+  /* An unsuccessful fragment ends its message so drop the rest of it */
+  while( (eState_ != COMPLETE) && bMoreFragments && (psQueue_->psHead != NULL) )
+  {
+    bMoreFragments = (psQueue_->psHead->u8Flags & _MSG_MORE_FRAGMENTS) ? TRUE : FALSE;
+    DeQueueTxMessage(psQueue_);
+  }
+
+  return(bMoreFragments ? psQueue_->psHead : NULL);
+  
+} /* end FinishTxMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
+
+@brief Changes the status of a message in the statue queue.
+
+This is how a peripheral reports the progress of a message it sends.
+
+Requires:
+- Called by the peripheral that owns the message (normally from its ISR)
+@param u32Token_ is message that should be in the status queue
+@param eNewState_ is the desired status setting for the message
+
+Promises:
+- The status is posted as described for PostMessageStatus(); a final state runs an 
+  MSG_CALLBACK_ISR callback right here
+
+*/
+void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
+{
+  PostMessageStatus(u32Token_, eNewState_, TRUE);
+  
+} /* end UpdateMessageStatus() */
+
+
 
 
 /*------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static bool CreateMessageChain(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_, MessageType** ppsFirst_, MessageType** ppsLast_)
+
+@brief Copies data into as many pool slots as needed and links them into a chain that is ready to queue.
+
+Messages longer than U16_MAX_TX_MESSAGE_LENGTH are split across several slots.  All slots 
+are claimed before any token is issued so a message that does not fit is rejected without
+side effects.
+
+Requires:
+@param  psQueue_ is the queue the message is for (NULL for plain linked lists)
+@param  u32MessageSize_ is the size of the message data array in bytes
+@param  pu8MessageData_ points to the message data array
+@param  ppsFirst_ receives the first message of the chain
+@param  ppsLast_ receives the last message of the chain
+
+Promises:
+- If there is room in the pool, returns TRUE with the chain built, each part tokenized 
+and its status set to WAITING 
+- Otherwise returns FALSE and _MESSAGING_TX_QUEUE_FULL is set if the pool was full
+
+*/
+static bool CreateMessageChain(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_, MessageType** ppsFirst_, MessageType** ppsLast_)
+{
+  MessageType *psNewMessage;
+  MessageType *psPreviousMessage = NULL;
+  u32 u32BytesRemaining = u32MessageSize_;
+  u32 u32CurrentMessageSize = 0;
+  u32 u32MaxTxMessageLength = (u32)(U16_MAX_TX_MESSAGE_LENGTH) & 0x0000FFFF;
+  
+  /* Check for empty message */
+  if(u32MessageSize_ == 0)
+  {
+    return(FALSE);
+  }
+
+  /* Though only one message is queued at a time, we use a while loop to handle messages that 
+  are too big and must be split into different slots.  The message processor will send the bytes 
+  continuously across slots */
+  while(u32BytesRemaining)
+  {
+    /* Check the message size and split the message up if necessary */
+    if(u32BytesRemaining > u32MaxTxMessageLength)
+    {
+      u32CurrentMessageSize = u32MaxTxMessageLength;
+    }
+    else
+    {
+      u32CurrentMessageSize = u32BytesRemaining;
+    }
+    
+    /* Take a slot from the smallest class that fits */
+    psNewMessage = AllocateMessageSlot(psQueue_, 0, u32CurrentMessageSize);
+    if(psNewMessage == NULL)
+    {
+      /* Give back any parts already claimed */
+      if(psPreviousMessage != NULL)
+      {
+        FreeMessageChain(*ppsFirst_);
+      }
+      
+      G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
+      AtomicAddWord(&Msg_sStats.u32QueueFullCount, 1);
+      return(FALSE);
+    }
+    
+    /* Copy all the data to the allocated message structure */
+    psNewMessage->u32Size       = u32CurrentMessageSize;
+    psNewMessage->psNextMessage = NULL;
+    u32BytesRemaining -= u32CurrentMessageSize;
+    
+    /* Add the data into the payload */
+    for(u32 i = 0; i < psNewMessage->u32Size; i++)
+    {
+      *(psNewMessage->pu8Message + i) = *pu8MessageData_;
+      pu8MessageData_++;
+    }
+
+    /* Chain it to the previous part, which is not visible to any peripheral yet */
+    if(psPreviousMessage == NULL)
+    {
+      *ppsFirst_ = psNewMessage;
+    }
+    else
+    {
+      psPreviousMessage->psNextMessage = psNewMessage;
+    }
+    psPreviousMessage = psNewMessage;
+      
+  } /* end while */
+
+  *ppsLast_ = psNewMessage;
+
+  /* Every part has a slot so tokens can be issued */
+  IssueMessageTokens(*ppsFirst_);
+  
+  return(TRUE);
+  
+} /* end CreateMessageChain() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void FreeMessageChain(MessageType* psFirst_)
+
+@brief Returns every slot of a chain that is not in a queue back to the pool.
+
+Requires:
+@param psFirst_ is the first message of a NULL-terminated chain that is not in any queue (may be NULL)
+
+Promises:
+- All slots in the chain are free
+
+*/
+static void FreeMessageChain(MessageType* psFirst_)
+{
+  MessageType* psNextMessage;
+  
+  while(psFirst_ != NULL)
+  {
+    psNextMessage = psFirst_->psNextMessage;
+    FreeMessageSlot(psFirst_);
+    psFirst_ = psNextMessage;
+  }
+  
+} /* end FreeMessageChain() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void IssueMessageTokens(MessageType* psFirst_)
+
+@brief Assigns a new token to each message in a chain and posts its WAITING status.
+
+Fragments flagged with _MSG_MORE_FRAGMENTS share the token of the fragment that follows them.
+
+Requires:
+@param psFirst_ is the first message of a NULL-terminated chain that is not yet in any queue
+
+Promises:
+- Each message in the chain has a unique, non-zero token with a WAITING status
+- Msg_u32Token is advanced past the tokens used
+
+*/
+static void IssueMessageTokens(MessageType* psFirst_)
+{
+  for(MessageType* psMessage = psFirst_; psMessage != NULL; psMessage = psMessage->psNextMessage)
+  {
+    psMessage->u32Token = Msg_u32Token;
+    
+    /* The token is finished at the last fragment of a message */
+    if(psMessage->u8Flags & _MSG_MORE_FRAGMENTS)
+    {
+      continue;
+    }
+    
+    /* Update the Public status of the message in the status queue */
+    AddNewMessageStatus(Msg_u32Token);
+  
+    /* Increment message token and catch the rollover every 4 billion messages... Token 0 is not allowed. */
+    Msg_u32Token++;
+    if(Msg_u32Token == 0)
+    {
+      Msg_u32Token = 1;
+    }
+  }
+  
+} /* end IssueMessageTokens() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void AppendMessageChain(MessageQueueType* psQueue_, MessageType* psFirst_, MessageType* psLast_)
+
+@brief Links a chain of messages onto the end of a peripheral transmit queue.
+
+The chain is linked with one exclusive store, either to the psNextMessage of the tail or to the 
+head of an empty queue.  The peripheral never writes a link that the task could be storing to 
+except to mark a finished last message with P_MSG_CLOSED_LINK, and when it does that the 
+exclusive store here fails (the peripheral ran in an ISR) so the link is tried again.
+
+Requires:
+- Called from task context: queue producers never preempt each other
+@param psQueue_ is the target queue
+@param psFirst_ is the first message of the chain
+@param psLast_ is the last message of the chain and its psNextMessage is NULL
+
+Promises:
+- The chain is at the end of psQueue_ and psQueue_->psTail is psLast_
+- The message is counted for psQueue_ and in Msg_sStats
+
+*/
+static void AppendMessageChain(MessageQueueType* psQueue_, MessageType* psFirst_, MessageType* psLast_)
+{
+  MessageType* psTail;
+  u32 u32Linked;
+  
+  /* Link the new message after the tail if the tail is still open, otherwise at the head of the
+  empty queue.  The peripheral only ever clears the tail when it has closed it. */
+  do
+  {
+    psTail = psQueue_->psTail;
+    if(psTail != NULL)
+    {
+      if(__LDREXW((volatile uint32_t*)&psTail->psNextMessage) != 0)
+      {
+        /* The peripheral is closing this tail: wait for it to clear psTail */
+        __CLREX();
+        u32Linked = 1;
+        continue;
+      }
+      u32Linked = __STREXW((u32)psFirst_, (volatile uint32_t*)&psTail->psNextMessage);
+    }
+    else
+    {
+      __LDREXW((volatile uint32_t*)&psQueue_->psHead);
+      u32Linked = __STREXW((u32)psFirst_, (volatile uint32_t*)&psQueue_->psHead);
+    }
+  } while(u32Linked != 0);
+  
+  /* The peripheral may have sent the whole chain already, in which case the queue is empty */
+  do
+  {
+    __LDREXW((volatile uint32_t*)&psQueue_->psTail);
+    psTail = (psLast_->psNextMessage == P_MSG_CLOSED_LINK) ? NULL : psLast_;
+  } while(__STREXW((u32)psTail, (volatile uint32_t*)&psQueue_->psTail) != 0);
+  
+  AtomicAddWord(&psQueue_->u32MessagesQueued, 1);
+  AtomicAddWord(&Msg_sStats.u32MessagesQueued, 1);
+  
+  /* Tell the owner there is work now that the chain is visible */
+  if(psQueue_->pu32PendingFlags != NULL)
+  {
+    AtomicSetBits(psQueue_->pu32PendingFlags, psQueue_->u32PendingFlag);
+  }
+
+} /* end AppendMessageChain() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static MessageType* AllocateMessageSlot(MessageQueueType* psQueue_, u8 u8FirstClass_, u32 u32Size_)
+
+@brief Claims a free slot for a message on psQueue_ after applying the queue's quota, priority
+and overflow policy.
+
+Once a queue's messages hold u8Quota slots, a new message is refused unless the queue drops its 
+own oldest messages (MSG_OVERFLOW_DROP_OLDEST).  Otherwise a slot is taken with TakeMessageSlot().  
+If that fails, messages are dropped as the overflow policy allows until the slot can be taken or 
+there is nothing left to drop.
+
+Requires:
+@param psQueue_ is the queue the message is for (NULL for plain linked lists, which are treated 
+as MSG_PRIORITY_NORMAL with no quota)
+@param u8FirstClass_ is the first class to try: 0 for payload slots or U8_MSG_REFERENCE_CLASS
+@param u32Size_ is the number of payload bytes needed (no more than U16_MAX_TX_MESSAGE_LENGTH)
+
+Promises:
+- Returns a pointer to the slot's message with the slot marked in use
+- Returns NULL if the message is refused; the refusal is counted in Msg_asThrottleCounts
+
+*/
+static MessageType* AllocateMessageSlot(MessageQueueType* psQueue_, u8 u8FirstClass_, u32 u32Size_)
+{
+  MessagePriorityType ePriority = MSG_PRIORITY_NORMAL;
+  MessageOverflowType eOverflow = MSG_OVERFLOW_DROP_LOWEST_PRIORITY;
+  MessageType* psMessage;
+  bool bDropped;
+  
+  if(psQueue_ != NULL)
+  {
+    ePriority = (MessagePriorityType)psQueue_->u8Priority;
+    eOverflow = (MessageOverflowType)psQueue_->u8Overflow;
+    
+    /* Only the queue's own messages can make room under its quota */
+    while( (psQueue_->u8Quota != 0) && (psQueue_->u8SlotsUsed >= psQueue_->u8Quota) )
+    {
+      if( (eOverflow != MSG_OVERFLOW_DROP_OLDEST) || !DropQueuedMessage(psQueue_, TRUE) )
+      {
+        AtomicAddWord(&Msg_asThrottleCounts[ePriority].u32Refused, 1);
+        return(NULL);
+      }
+    }
+  }
+  
+  psMessage = TakeMessageSlot(psQueue_, u8FirstClass_, u32Size_);
+  
+  /* Make room as the overflow policy allows */
+  while(psMessage == NULL)
+  {
+    switch(eOverflow)
+    {
+      case MSG_OVERFLOW_DROP_OLDEST:
+        bDropped = DropQueuedMessage(psQueue_, TRUE);
+        break;
+        
+      case MSG_OVERFLOW_DROP_LOWEST_PRIORITY:
+        bDropped = DropLowestPriorityMessage(ePriority);
+        break;
+        
+      default:
+        bDropped = FALSE;
+        break;
+    } /* end switch */
+    
+    if(!bDropped)
+    {
+      break;
+    }
+    
+    psMessage = TakeMessageSlot(psQueue_, u8FirstClass_, u32Size_);
+  }
+  
+  if(psMessage == NULL)
+  {
+    AtomicAddWord(&Msg_asThrottleCounts[ePriority].u32Refused, 1);
+  }
+  
+  return(psMessage);
+  
+} /* end AllocateMessageSlot() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static MessageType* TakeMessageSlot(MessageQueueType* psQueue_, u8 u8FirstClass_, u32 u32Size_)
+
+@brief Claims a free slot from the smallest size class that can hold u32Size_ bytes.
+
+If the best fitting class is exhausted, the next larger class is used.  Free slots in each 
+class are tracked in a bitmap so a slot is found with a single count-leading-zeros instruction.
+The reference class has no payload storage and is only used when it is u8FirstClass_.
+
+MSG_PRIORITY_LOW traffic cannot take the last (u8Slots >> U8_MSG_LOW_RESERVE_SHIFT) free slots 
+of a class and MSG_PRIORITY_NORMAL traffic cannot take the last U8_MSG_NORMAL_RESERVE_SLOTS, 
+which keeps slots available for higher priority traffic.
+
+Requires:
+@param psQueue_ is the queue the message is for, or NULL
+@param u8FirstClass_ is the first class to try: 0 for payload slots or U8_MSG_REFERENCE_CLASS
+@param u32Size_ is the number of payload bytes needed (no more than U16_MAX_TX_MESSAGE_LENGTH)
+
+Promises:
+- Returns a pointer to the slot's message with the slot marked in use and owned by psQueue_, 
+and Msg_u8QueuedMessageCount and psQueue_->u8SlotsUsed incremented
+- Returns NULL if no class that fits has a free slot the queue's priority may use
+
+*/
+static MessageType* TakeMessageSlot(MessageQueueType* psQueue_, u8 u8FirstClass_, u32 u32Size_)
+{
+  MessagePriorityType ePriority = MSG_PRIORITY_NORMAL;
+  MessageSizeClassType* psClass;
+  MessageSlotType* psSlot = NULL;
+  u32 u32FreeSlots;
+  u32 u32Usable;
+  u8 u8Reserve;
+  u8 u8SlotIndex;
+  u8 u8QueuedCount;
+  
+  if(psQueue_ != NULL)
+  {
+    ePriority = (MessagePriorityType)psQueue_->u8Priority;
+  }
+  
+  for(psClass = &Msg_asSizeClasses[u8FirstClass_]; psClass <= &Msg_asSizeClasses[U8_MSG_REFERENCE_CLASS]; psClass++)
+  {
+    if(psClass->u16Length < u32Size_)
+    {
+      continue;
+    }
+    
+    /* Lower priority traffic must leave the class's reserve free */
+    u8Reserve = 0;
+    if(ePriority == MSG_PRIORITY_LOW)
+    {
+      u8Reserve = psClass->u8Slots >> U8_MSG_LOW_RESERVE_SHIFT;
+    }
+    else if(ePriority == MSG_PRIORITY_NORMAL)
+    {
+      u8Reserve = U8_MSG_NORMAL_RESERVE_SLOTS;
+    }
+    
+    /* Claim a bit with an exclusive load/store pair.  A peripheral ISR that frees a slot 
+    in between makes the STREX fail and the claim is simply tried again. */
+    do
+    {
+      u32FreeSlots = __LDREXW((volatile uint32_t*)&psClass->u32FreeSlots);
+      
+      /* Clear the lowest free bit for each reserved slot to see if any are left over */
+      u32Usable = u32FreeSlots;
+      for(u8 i = u8Reserve; (i != 0) && (u32Usable != 0); i--)
+      {
+        u32Usable &= (u32Usable - 1);
+      }
+      
+      if(u32Usable == 0)
+      {
+        __CLREX();
+        break;
+      }
+      
+      u8SlotIndex = (u8)(31 - __CLZ(u32FreeSlots));
+    } while(__STREXW(u32FreeSlots & ~((u32)1 << u8SlotIndex), (volatile uint32_t*)&psClass->u32FreeSlots) != 0);
+    
+    if(u32Usable != 0)
+    {
+      psSlot = &Msg_asPool[psClass->u8FirstSlot + u8SlotIndex];
+      break;
+    }
+  }
+  
+  if(psSlot == NULL)
+  {
+    return(NULL);
+  }
+  
+  /* The slot is ours; the counters are shared with ISRs that free slots */
+  u8QueuedCount = AtomicAddByte(&Msg_u8QueuedMessageCount, 1);
+  psSlot->psOwner = psQueue_;
+  if(psQueue_ != NULL)
+  {
+    AtomicRaiseByte(&psQueue_->u8SlotsHighWater, AtomicAddByte(&psQueue_->u8SlotsUsed, 1));
+  }
+  
+  /* Track the high-water marks used to size the pool */
+  AtomicRaiseByte(&Msg_sStats.au8ClassHighWater[psClass - &Msg_asSizeClasses[0]], AtomicAddByte(&psClass->u8SlotsUsed, 1));
+  AtomicRaiseByte(&Msg_sStats.u8SlotsHighWater, u8QueuedCount);
+  
+  /* Flag if we're above the high watermark */
+  if(u8QueuedCount >= U8_TX_QUEUE_WATERMARK)
+  {
+    G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_ALMOST_FULL;
+  }
+  else
+  {
+    G_u32MessagingFlags &= ~_MESSAGING_TX_QUEUE_ALMOST_FULL;
+  }
+
+  psSlot->bFree = FALSE;
+  psSlot->Message.u8Flags = 0;
+  return(&psSlot->Message);
+  
+} /* end TakeMessageSlot() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static bool DropLowestPriorityMessage(MessagePriorityType ePriority_)
+
+@brief Drops one waiting message from the lowest priority queue below ePriority_ that has one.
+
+Within a queue the newest message goes first, so output that is partly sent stays intact.
+
+Requires:
+@param ePriority_ is the priority of the traffic that needs room
+
+Promises:
+- If a message was dropped (see DropQueuedMessage()), returns TRUE
+- Otherwise returns FALSE
+
+*/
+static bool DropLowestPriorityMessage(MessagePriorityType ePriority_)
+{
+  MessageQueueType* psQueue;
+  
+  for(u8 u8Priority = MSG_PRIORITY_LOW; u8Priority < (u8)ePriority_; u8Priority++)
+  {
+    for(psQueue = Msg_psQueues; psQueue != NULL; psQueue = psQueue->psNextQueue)
+    {
+      if( (psQueue->u8Priority == u8Priority) && DropQueuedMessage(psQueue, FALSE) )
+      {
+        return(TRUE);
+      }
+    }
+  }
+  
+  return(FALSE);
+  
+} /* end DropLowestPriorityMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static bool DropQueuedMessage(MessageQueueType* psQueue_, bool bOldest_)
+
+@brief Drops the oldest or newest message waiting on a queue to free its slots.
+
+The message at the head of a queue may be loaded in the peripheral so it is never dropped,
+nor is a message a driver has preloaded behind it (_MSG_LOADED).
+
+Requires:
+- Called from task context
+@param psQueue_ is the queue to drop from
+@param bOldest_ is TRUE to drop the message after the one being sent, FALSE to drop the last one
+
+Promises:
+- If a message was found, it is removed from its queue, its slots are freed, its status is 
+set to ABANDONED, the drop is counted and TRUE is returned
+- Otherwise returns FALSE
+
+*/
+static bool DropQueuedMessage(MessageQueueType* psQueue_, bool bOldest_)
+{
+  MessageType* psMessage;
+  MessageType* psDropped = NULL;
+  u32 u32BusyToken;
+  u32 u32Token;
+  
+  __disable_irq();
+  psMessage = psQueue_->psHead;
+  if(psMessage != NULL)
+  {
+    /* Skip the fragments of the messages in the hardware to find the oldest one waiting */
+    u32BusyToken = psMessage->u32Token;
+    u32Token = psQueue_->psTail->u32Token;
+    if(bOldest_)
+    {
+      while( (psMessage != NULL) && 
+             ((psMessage->u32Token == u32BusyToken) || (psMessage->u8Flags & _MSG_LOADED)) )
+      {
+        u32BusyToken = psMessage->u32Token;
+        psMessage = psMessage->psNextMessage;
+      }
+      u32Token = (psMessage != NULL) ? psMessage->u32Token : u32BusyToken;
+    }
+    
+    if(u32Token != u32BusyToken)
+    {
+      psDropped = UnlinkQueuedMessage(u32Token);
+      if(psDropped != NULL)
+      {
+        PostMessageStatus(u32Token, ABANDONED, FALSE);
+      }
+    }
+  }
+  __enable_irq();
+  
+  if(psDropped == NULL)
+  {
+    return(FALSE);
+  }
+  
+  /* Slots are returned with interrupts back on */
+  AtomicAddWord(&Msg_asThrottleCounts[psQueue_->u8Priority].u32Dropped, 1);
+  FreeMessageChain(psDropped);
+  
+  return(TRUE);
+  
+} /* end DropQueuedMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static bool IsPoolMessage(MessageType* psMessage_)
+
+@brief Checks that a message really belongs to Msg_asPool.
+
+Requires:
+@param psMessage_ is the message to check
+
+Promises:
+- Returns TRUE if psMessage_ is the message of the slot it claims to be in
+- Otherwise sets _DEQUEUE_MSG_NOT_FOUND and returns FALSE
+
+*/
+static bool IsPoolMessage(MessageType* psMessage_)
+{
+  u8 u8SlotIndex = psMessage_->u8SlotIndex;
+
+  if( (u8SlotIndex >= U8_TX_QUEUE_SIZE) ||
+      (&Msg_asPool[u8SlotIndex].Message != psMessage_) )
+  {
+    G_u32MessagingFlags |= _DEQUEUE_MSG_NOT_FOUND;
+    return(FALSE);
+  }
+
+  return(TRUE);
+  
+} /* end IsPoolMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void FreeMessageSlot(MessageType* psMessage_)
+
+@brief Returns a message's slot to the pool.
+
+The owning slot and size class are taken from the message so no search is required.
+
+Requires:
+@param psMessage_ is a pool message that has been unlinked from its queue
+
+Promises:
+- The slot is marked free in its size class bitmap and the queued message count is decremented
+- The slot no longer counts against the queue it was allocated for
+
+*/
+static void FreeMessageSlot(MessageType* psMessage_)
+{
+  MessageSizeClassType* psClass = &Msg_asSizeClasses[psMessage_->u8SizeClass];
+  MessageSlotType* psSlot = &Msg_asPool[psMessage_->u8SlotIndex];
+  
+  psSlot->bFree = TRUE;
+  if(psSlot->psOwner != NULL)
+  {
+    AtomicAddByte(&psSlot->psOwner->u8SlotsUsed, -1);
+    psSlot->psOwner = NULL;
+  }
+  AtomicAddByte(&psClass->u8SlotsUsed, -1);
+  AtomicAddByte(&Msg_u8QueuedMessageCount, -1);
+  
+  /* The slot can be taken again as soon as its bit is set so this is done last */
+  AtomicSetBits(&psClass->u32FreeSlots, (u32)1 << (psMessage_->u8SlotIndex - psClass->u8FirstSlot));
+  
+} /* end FreeMessageSlot() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void PostMessageStatus(u32 u32Token_, MessageStateType eNewState_, bool bRunIsrCallback_)
+
+@brief Changes the status of a message in the status queue and signals its callback if it is finished.
+
+Requires:
+@param u32Token_ is message that should be in the status queue
+@param eNewState_ is the desired status setting for the message
+@param bRunIsrCallback_ is TRUE when the peripheral posts the state, so an MSG_CALLBACK_ISR callback 
+may run inline; the task's own paths (cancel, drop, abort, cleaning sweep) pass FALSE
+
+Promises:
+- if the token is found, the eState of the message is set to eNewState_
+- the first SENDING and the final state of a message are counted in Msg_sStats, and the time a 
+  message becomes final is saved in its status
+- if eNewState_ is final and a callback is attached, the callback is signalled (see 
+  SignalMessageCallback())
+
+*/
+static void PostMessageStatus(u32 u32Token_, MessageStateType eNewState_, bool bRunIsrCallback_)
+{
+  MessageStatusType* psStatus = &Msg_asStatusQueue[u32Token_ & U32_STATUS_INDEX_MASK];
+  u32 u32Elapsed;
+  
+  /* If the entry still belongs to the token, change the status */
+  if( (u32Token_ != 0) && (psStatus->u32Token == u32Token_) )
+  {
+    /* Until the message is final, the timestamp is the time it was queued */
+    u32Elapsed = G_u32SystemTime1ms - psStatus->u32Timestamp;
+    if( (eNewState_ == SENDING) && (psStatus->eState == WAITING) )
+    {
+      CountMessageTime(Msg_sStats.au32WaitTime, u32Elapsed);
+    }
+    
+    /* Peripheral ISRs of different priorities post statuses so the counters are updated atomically */
+    if( IsMessageStateFinal(eNewState_) && !IsMessageStateFinal(psStatus->eState) )
+    {
+      switch(eNewState_)
+      {
+        case COMPLETE:
+          AtomicAddWord(&Msg_sStats.u32Completed, 1);
+          CountMessageTime(Msg_sStats.au32CompleteTime, u32Elapsed);
+          break;
+          
+        case TIMEOUT:
+          AtomicAddWord(&Msg_sStats.u32TimedOut, 1);
+          break;
+          
+        case ABANDONED:
+          AtomicAddWord(&Msg_sStats.u32Abandoned, 1);
+          break;
+          
+        default:
+          AtomicAddWord(&Msg_sStats.u32Failed, 1);
+          break;
+      } /* end switch */
+      
+      psStatus->u32Timestamp = G_u32SystemTime1ms;
+    }
+    
+    psStatus->eState = eNewState_;
+    
+    if(IsMessageStateFinal(eNewState_))
+    {
+      SignalMessageCallback(psStatus, bRunIsrCallback_);
+    }
+  }
+  
+} /* end PostMessageStatus() */
+
+
 /*!--------------------------------------------------------------------------------------------------------------------
 @fn static void AddNewMessageStatus(u32 u32Token_)
 
@@ -460,33 +2026,549 @@ void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
 
 Due to the tendency of applications to forget that they wrote a message here, 
 this buffer is circular and will overwrite the oldest message if it needs space for a 
-new message.
+new message.  Since tokens are sequential, the entry used is simply the one selected 
+by the token's low bits, which is always the oldest entry.
 
-Requires:
-- Msg_psNextStatus points to the next status location
+The pool limits how many messages are alive at once, not how old a token can get: a message 
+waiting on a slow queue can still be unfinished when U8_STATUS_QUEUE_SIZE newer tokens have been 
+issued, so the old entry may belong to a message that a peripheral ISR is about to finish.
+
+The entry is taken over without disabling interrupts.  The new token is stored first, so from 
+then on a peripheral finishing the old message no longer matches the entry and leaves it alone.  
+A peripheral that finished the old message before that has already taken its callback.
 
+Requires:
+- Called from task context
 @param u32Token_ is the token of the message of interest
 
 Promises:
-- A new status is created at Msg_psNextStatus indexed by u32Token_
+- A new WAITING status is created at the entry indexed by u32Token_
+- If the old message is not finished and has a callback attached, the callback gets ABANDONED 
+  from the messaging task since that message can no longer be tracked
 
 */
 static void AddNewMessageStatus(u32 u32Token_)
 {
-  /* Install the new message */
-  Msg_psNextStatus->u32Token = u32Token_;
-  Msg_psNextStatus->eState = WAITING;
-  Msg_psNextStatus->u32Timestamp = G_u32SystemTime1ms;
+  MessageStatusType* psStatus = &Msg_asStatusQueue[u32Token_ & U32_STATUS_INDEX_MASK];
+  u8 u8Callback;
+
+  psStatus->u32Token = u32Token_;
+  psStatus->eState = WAITING;
+  psStatus->u32Timestamp = G_u32SystemTime1ms;
   
-  /* Safely advance the pointer */
-  Msg_psNextStatus++;
-  if(Msg_psNextStatus == &Msg_asStatusQueue[U8_STATUS_QUEUE_SIZE])
+  /* A callback is only still attached if the old message has not finished */
+  u8Callback = AtomicSwapByte(&psStatus->u8Callback, U8_MSG_NO_CALLBACK);
+  if(u8Callback != U8_MSG_NO_CALLBACK)
   {
-    Msg_psNextStatus = &Msg_asStatusQueue[0];
+    Msg_asCallbacks[u8Callback].eState = ABANDONED;
+    AtomicSetBits(&Msg_u32PendingCallbacks, (u32)1 << u8Callback);
   }
   
 } /* end AddNewMessageStatus() */
 
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static bool IsMessageStateFinal(MessageStateType eState_)
+
+@brief Checks if a message state can no longer change.
+
+Requires:
+@param eState_ is the state to check
+
+Promises:
+- Returns TRUE for COMPLETE, TIMEOUT, ABANDONED and FAILED
+
+*/
+static bool IsMessageStateFinal(MessageStateType eState_)
+{
+  return( (eState_ == COMPLETE) || (eState_ == TIMEOUT) || 
+          (eState_ == ABANDONED) || (eState_ == FAILED) );
+  
+} /* end IsMessageStateFinal() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void SignalMessageCallback(MessageStatusType* psStatus_, bool bRunIsrCallback_)
+
+@brief Detaches the callback from a finished message and runs or schedules it.
+
+The callback index is swapped out of the status entry with LDREXB/STREXB, so if the task and a 
+peripheral both try to signal the same callback only the one that gets the index does.
+
+Requires:
+@param psStatus_ is the status entry of a finished message
+@param bRunIsrCallback_ is TRUE if an MSG_CALLBACK_ISR callback may run now (the peripheral is 
+finishing the message)
+
+Promises:
+- If a callback was attached, it is detached from psStatus_ and holds the final state
+- An MSG_CALLBACK_ISR callback is run now and its slot is freed when bRunIsrCallback_ is TRUE
+- Any other callback is flagged in Msg_u32PendingCallbacks for the messaging task
+
+*/
+static void SignalMessageCallback(MessageStatusType* psStatus_, bool bRunIsrCallback_)
+{
+  u8 u8Callback = AtomicSwapByte(&psStatus_->u8Callback, U8_MSG_NO_CALLBACK);
+  MessageCallbackType* psCallback;
+  
+  if(u8Callback == U8_MSG_NO_CALLBACK)
+  {
+    return;
+  }
+  
+  psCallback = &Msg_asCallbacks[u8Callback];
+  psCallback->eState = psStatus_->eState;
+  
+  if(bRunIsrCallback_ && (psCallback->eMode == MSG_CALLBACK_ISR))
+  {
+    AtomicSetBits(&Msg_u32FreeCallbacks, (u32)1 << u8Callback);
+    psCallback->pfnCallback(psCallback->u32Token, psCallback->eState, psCallback->pvContext);
+  }
+  else
+  {
+    AtomicSetBits(&Msg_u32PendingCallbacks, (u32)1 << u8Callback);
+  }
+  
+} /* end SignalMessageCallback() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u8 TakeCallbackSlot(void)
+
+@brief Claims a free entry of Msg_asCallbacks.
+
+Peripheral ISRs free entries when they run a callback, so the bitmap is claimed with LDREX/STREX.
+
+Requires:
+- Called from task context
+
+Promises:
+- Returns the index of the claimed entry, or U8_MSG_NO_CALLBACK if all are in use
+
+*/
+static u8 TakeCallbackSlot(void)
+{
+  u32 u32Free;
+  u8 u8Callback;
+  
+  do
+  {
+    u32Free = __LDREXW((volatile uint32_t*)&Msg_u32FreeCallbacks);
+    if(u32Free == 0)
+    {
+      __CLREX();
+      return(U8_MSG_NO_CALLBACK);
+    }
+    
+    u8Callback = (u8)(31 - __CLZ(u32Free));
+  } while(__STREXW(u32Free & ~((u32)1 << u8Callback), (volatile uint32_t*)&Msg_u32FreeCallbacks) != 0);
+  
+  return(u8Callback);
+  
+} /* end TakeCallbackSlot() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void DispatchMessageCallbacks(void)
+
+@brief Runs the deferred callbacks of messages that have finished.
+
+Requires:
+- Called from the messaging task
+
+Promises:
+- Every callback flagged in Msg_u32PendingCallbacks has been run once and its slot is free
+
+*/
+static void DispatchMessageCallbacks(void)
+{
+  u32 u32Pending;
+  u8 u8Callback;
+  MessageCallbackType sCallback;
+  
+  u32Pending = AtomicSwapWord(&Msg_u32PendingCallbacks, 0);
+  
+  while(u32Pending != 0)
+  {
+    u8Callback = (u8)(31 - __CLZ(u32Pending));
+    u32Pending &= ~((u32)1 << u8Callback);
+
+    /* Copy the callback and free its slot first so the callback can register a new one */
+    sCallback = Msg_asCallbacks[u8Callback];
+    AtomicSetBits(&Msg_u32FreeCallbacks, (u32)1 << u8Callback);
+
+    sCallback.pfnCallback(sCallback.u32Token, sCallback.eState, sCallback.pvContext);
+  }
+  
+} /* end DispatchMessageCallbacks() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void CleanMessageStatuses(void)
+
+@brief Checks the next U8_MSG_CLEAN_PER_TICK entries of the status queue for the current cleaning sweep.
+
+Requires:
+- Msg_u16CleaningIndex < U8_STATUS_QUEUE_SIZE
+
+Promises:
+- COMPLETE, ABANDONED and FAILED statuses older than U32_MSG_STATUS_COMPLETE_TIME and TIMEOUT
+  statuses older than U32_MSG_STATUS_TIMEOUT_TIME are cleared; Msg_sStats.u32StatusesExpired counts them
+- A message WAITING longer than U32_MSG_STATUS_WAITING_TIME that is not at the head of its
+  queue is removed from the queue, its slots are freed and its status is set to TIMEOUT;
+  Msg_sStats.u32MessagesReclaimed counts them
+- Msg_u16CleaningIndex is advanced
+
+*/
+static void CleanMessageStatuses(void)
+{
+  MessageStatusType* psStatus;
+  MessageType* psStuckMessage;
+  u32 u32Age;
+  
+  for(u8 i = 0; (i < U8_MSG_CLEAN_PER_TICK) && (Msg_u16CleaningIndex < U8_STATUS_QUEUE_SIZE); i++)
+  {
+    psStatus = &Msg_asStatusQueue[Msg_u16CleaningIndex];
+    Msg_u16CleaningIndex++;
+    psStuckMessage = NULL;
+    
+    /* Peripheral ISRs update statuses and queues so each entry is handled with interrupts off */
+    __disable_irq();
+    u32Age = G_u32SystemTime1ms - psStatus->u32Timestamp;
+    
+    if(psStatus->u32Token != 0)
+    {
+      switch(psStatus->eState)
+      {
+        case WAITING:
+        {
+          if(u32Age > U32_MSG_STATUS_WAITING_TIME)
+          {
+            psStuckMessage = UnlinkQueuedMessage(psStatus->u32Token);
+            if(psStuckMessage != NULL)
+            {
+              PostMessageStatus(psStatus->u32Token, TIMEOUT, FALSE);
+              AtomicAddWord(&Msg_sStats.u32MessagesReclaimed, 1);
+            }
+          }
+          break;
+        }
+        
+        case COMPLETE:
+        case ABANDONED:
+        case FAILED:
+        case TIMEOUT:
+        {
+          if( u32Age > ( (psStatus->eState == TIMEOUT) ? U32_MSG_STATUS_TIMEOUT_TIME : U32_MSG_STATUS_COMPLETE_TIME ) )
+          {
+            psStatus->u32Token = 0;
+            psStatus->eState = EMPTY;
+            psStatus->u32Timestamp = G_u32SystemTime1ms;
+            AtomicAddWord(&Msg_sStats.u32StatusesExpired, 1);
+          }
+          break;
+        }
+
+        default:
+        {
+          /* SENDING belongs to the peripheral */
+          break;
+        }
+      } /* end switch */
+    }
+    __enable_irq();
+
+    /* Slots are returned with interrupts back on */
+    FreeMessageChain(psStuckMessage);
+  }
+  
+} /* end CleanMessageStatuses() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static MessageType* UnlinkQueuedMessage(u32 u32Token_)
+
+@brief Finds the parts of a queued message in the registered transmit queues and unlinks them.
+
+The message at the head of a queue may be loaded in the peripheral, as may the rest of its 
+fragments, so a message sharing the head's token is left alone.  So is a message that a driver
+has preloaded behind the head (_MSG_LOADED).
+
+Requires:
+- Interrupts are off
+@param u32Token_ is the token of the message
+
+Promises:
+- Returns the parts of the message as a NULL-terminated chain that is no longer in any queue
+- Returns NULL if the message is not queued or is being sent
+
+*/
+static MessageType* UnlinkQueuedMessage(u32 u32Token_)
+{
+  MessageQueueType* psQueue;
+  MessageType* psPrevious;
+  MessageType* psFirst;
+  MessageType* psLast;
+  
+  for(psQueue = Msg_psQueues; psQueue != NULL; psQueue = psQueue->psNextQueue)
+  {
+    psPrevious = psQueue->psHead;
+    if( (psPrevious != NULL) && (psPrevious->u32Token != u32Token_) )
+    {
+      /* Find the first part of the message */
+      while( (psPrevious->psNextMessage != NULL) && 
+             (((MessageType*)psPrevious->psNextMessage)->u32Token != u32Token_) )
+      {
+        psPrevious = psPrevious->psNextMessage;
+      }
+      
+      /* The parts of a message are always queued together */
+      psFirst = psPrevious->psNextMessage;
+      if( (psFirst != NULL) && (psFirst->u8Flags & _MSG_LOADED) )
+      {
+        return(NULL);
+      }
+      
+      if(psFirst != NULL)
+      {
+        psLast = psFirst;
+        while( (psLast->psNextMessage != NULL) && 
+               (((MessageType*)psLast->psNextMessage)->u32Token == u32Token_) )
+        {
+          psLast = psLast->psNextMessage;
+        }
+        
+        psPrevious->psNextMessage = psLast->psNextMessage;
+        if(psQueue->psTail == psLast)
+        {
+          psQueue->psTail = psPrevious;
+        }
+        psLast->psNextMessage = NULL;
+        
+        return(psFirst);
+      }
+    }
+  }
+  
+  return(NULL);
+  
+} /* end UnlinkQueuedMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void ReportStuckMessages(u32 u32Messages_)
+
+@brief Reports the stuck messages removed by a cleaning sweep.
+
+Requires:
+@param u32Messages_ is the number of messages removed in the sweep
+
+Promises:
+- _MESSAGING_STUCK_MESSAGES is set in G_u32MessagingFlags
+- A warning is queued to the debug port (if there is room for it)
+
+*/
+static void ReportStuckMessages(u32 u32Messages_)
+{
+  static u8 au8Count[11];
+  static MessageFragmentType asWarning[] = 
+  { {"\n\r*** Stuck messages timed out: ", 32, FALSE},
+    {au8Count, 0, TRUE},
+    {"\n\r", 2, FALSE} };
+  
+  G_u32MessagingFlags |= _MESSAGING_STUCK_MESSAGES;
+  
+  asWarning[1].u32Size = NumberToAscii(u32Messages_, au8Count);
+  DebugPrintFragments(asWarning, 3);
+  
+} /* end ReportStuckMessages() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void CountMessageTime(u32* pau32Histogram_, u32 u32Time_)
+
+@brief Adds a message time to a latency histogram.
+
+Requires:
+@param pau32Histogram_ is a histogram of U8_MSG_LATENCY_BINS bins
+@param u32Time_ is the time in ms
+
+Promises:
+- The bin for u32Time_ is incremented: bin n holds times under 2^n ms and the last bin 
+  holds all longer times
+
+*/
+static void CountMessageTime(u32* pau32Histogram_, u32 u32Time_)
+{
+  u8 u8Bin = (u8)(32 - __CLZ(u32Time_));
+  
+  if(u8Bin >= U8_MSG_LATENCY_BINS)
+  {
+    u8Bin = U8_MSG_LATENCY_BINS - 1;
+  }
+  AtomicAddWord(&pau32Histogram_[u8Bin], 1);
+  
+} /* end CountMessageTime() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void AtomicAddWord(u32* pu32Value_, u32 u32Amount_)
+
+@brief Adds to a word shared between the task and ISRs without disabling interrupts.
+
+Requires:
+@param pu32Value_ points to the word
+@param u32Amount_ is the amount to add
+
+Promises:
+- *pu32Value_ is increased by u32Amount_ even if an ISR updates it at the same time
+
+*/
+static void AtomicAddWord(u32* pu32Value_, u32 u32Amount_)
+{
+  u32 u32Value;
+  
+  /* The STREX fails if anything else stored to the word (or an ISR ran) since the LDREX */
+  do
+  {
+    u32Value = __LDREXW((volatile uint32_t*)pu32Value_) + u32Amount_;
+  } while(__STREXW(u32Value, (volatile uint32_t*)pu32Value_) != 0);
+  
+} /* end AtomicAddWord() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u8 AtomicAddByte(u8* pu8Value_, s8 s8Amount_)
+
+@brief Adds to a byte counter shared between the task and ISRs without disabling interrupts.
+
+Requires:
+@param pu8Value_ points to the counter
+@param s8Amount_ is the amount to add (negative to subtract)
+
+Promises:
+- *pu8Value_ is changed by s8Amount_ and the new value is returned
+
+*/
+static u8 AtomicAddByte(u8* pu8Value_, s8 s8Amount_)
+{
+  u8 u8Value;
+  
+  do
+  {
+    u8Value = (u8)(__LDREXB((volatile uint8_t*)pu8Value_) + s8Amount_);
+  } while(__STREXB(u8Value, (volatile uint8_t*)pu8Value_) != 0);
+  
+  return(u8Value);
+  
+} /* end AtomicAddByte() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void AtomicRaiseByte(u8* pu8Mark_, u8 u8Value_)
+
+@brief Raises a high-water mark shared between the task and ISRs without disabling interrupts.
+
+Requires:
+@param pu8Mark_ points to the high-water mark
+@param u8Value_ is the latest value
+
+Promises:
+- *pu8Mark_ is the larger of its current value and u8Value_
+
+*/
+static void AtomicRaiseByte(u8* pu8Mark_, u8 u8Value_)
+{
+  do
+  {
+    if(__LDREXB((volatile uint8_t*)pu8Mark_) >= u8Value_)
+    {
+      __CLREX();
+      return;
+    }
+  } while(__STREXB(u8Value_, (volatile uint8_t*)pu8Mark_) != 0);
+  
+} /* end AtomicRaiseByte() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void AtomicSetBits(u32* pu32Value_, u32 u32Bits_)
+
+@brief Sets bits in a bitmap shared between the task and ISRs without disabling interrupts.
+
+Requires:
+@param pu32Value_ points to the bitmap
+@param u32Bits_ are the bits to set
+
+Promises:
+- u32Bits_ are set in *pu32Value_ and no other bits are changed
+
+*/
+static void AtomicSetBits(u32* pu32Value_, u32 u32Bits_)
+{
+  u32 u32Value;
+  
+  do
+  {
+    u32Value = __LDREXW((volatile uint32_t*)pu32Value_) | u32Bits_;
+  } while(__STREXW(u32Value, (volatile uint32_t*)pu32Value_) != 0);
+  
+} /* end AtomicSetBits() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u32 AtomicSwapWord(u32* pu32Value_, u32 u32NewValue_)
+
+@brief Replaces a word shared between the task and ISRs and returns what it held.
+
+Requires:
+@param pu32Value_ points to the word
+@param u32NewValue_ is the value to store
+
+Promises:
+- *pu32Value_ is u32NewValue_ and the value it held just before is returned
+
+*/
+static u32 AtomicSwapWord(u32* pu32Value_, u32 u32NewValue_)
+{
+  u32 u32OldValue;
+  
+  do
+  {
+    u32OldValue = __LDREXW((volatile uint32_t*)pu32Value_);
+  } while(__STREXW(u32NewValue_, (volatile uint32_t*)pu32Value_) != 0);
+  
+  return(u32OldValue);
+  
+} /* end AtomicSwapWord() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u8 AtomicSwapByte(u8* pu8Value_, u8 u8NewValue_)
+
+@brief Replaces a byte shared between the task and ISRs and returns what it held.
+
+Requires:
+@param pu8Value_ points to the byte
+@param u8NewValue_ is the value to store
+
+Promises:
+- *pu8Value_ is u8NewValue_ and the value it held just before is returned
+
+*/
+static u8 AtomicSwapByte(u8* pu8Value_, u8 u8NewValue_)
+{
+  u8 u8OldValue;
+  
+  do
+  {
+    u8OldValue = __LDREXB((volatile uint8_t*)pu8Value_);
+  } while(__STREXB(u8NewValue_, (volatile uint8_t*)pu8Value_) != 0);
+  
+  return(u8OldValue);
+  
+} /* end AtomicSwapByte() */
+
 /**********************************************************************************************************************
 State Machine Function Definitions
 **********************************************************************************************************************/
@@ -494,18 +2576,38 @@ State Machine Function Definitions
 /*!-------------------------------------------------------------------------------------------------------------------
 @fn static void MessagingSM_Idle(void)
 
-@brief Right now this doesn't do anything 
+@brief Runs the deferred completion callbacks of finished messages and the periodic cleaning sweep
+of stale statuses and stuck messages.
 */
 static void MessagingSM_Idle(void)
 {
-  static u32 u32CleaningTime = U32_MSG_STATUS_CLEANING_TIME;
+  static u32 u32CleaningTimer = 0;
+  static u32 u32ReclaimedBeforeSweep = 0;
+  
+  if(Msg_u32PendingCallbacks != 0)
+  {
+    DispatchMessageCallbacks();
+  }
+  
+  /* Periodically start a sweep for stale messages */
+  if(IsTimeUp(&u32CleaningTimer, U32_MSG_STATUS_CLEANING_TIME))
+  {
+    u32CleaningTimer = G_u32SystemTime1ms;
+    
+    Msg_u16CleaningIndex = 0;
+    u32ReclaimedBeforeSweep = Msg_sStats.u32MessagesReclaimed;
+  }
   
-  /* Periodically check for stale messages */
-  if(--u32CleaningTime == 0)
+  /* The sweep checks a few entries each pass to stay inside the 1ms budget */
+  if(Msg_u16CleaningIndex < U8_STATUS_QUEUE_SIZE)
   {
-    u32CleaningTime = U32_MSG_STATUS_CLEANING_TIME;
+    CleanMessageStatuses();
     
-    /* ??? Probably should add clean of the main message queue to detect any messages that have become stuck */
+    if( (Msg_u16CleaningIndex == U8_STATUS_QUEUE_SIZE) &&
+        (Msg_sStats.u32MessagesReclaimed != u32ReclaimedBeforeSweep) )
+    {
+      ReportStuckMessages(Msg_sStats.u32MessagesReclaimed - u32ReclaimedBeforeSweep);
+    }
   }
     
 } /* end MessagingSM_Idle() */
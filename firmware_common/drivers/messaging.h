@@ -15,24 +15,57 @@ Constants / Definitions
 #define _MESSAGING_TX_QUEUE_ALMOST_FULL (u32)0x00000002
 #define _DEQUEUE_GOT_NULL               (u32)0x00000004
 #define _DEQUEUE_MSG_NOT_FOUND          (u32)0x00000008
+#define _MESSAGING_STUCK_MESSAGES       (u32)0x00000010 /*!< @brief Set when the cleaning sweep timed out stuck messages; cleared by the application */
 /* end G_u32MessagingFlags */
 
 
 /* Tx buffer allocation: be aware of RAM usage when selecting the parameters below.
-Queue size in bytes is U8_TX_QUEUE_SIZE x U16_MAX_TX_MESSAGE_LENGTH */
-#define U16_MAX_TX_MESSAGE_LENGTH       (u16)128       /*!< @brief Max bytes in message payload */
-#define U8_TX_QUEUE_SIZE                (u8)32         /*!< @brief Number of messages allowed in the queue */
+The message pool is divided into size classes and a message takes a slot from the smallest class
+that fits it.  Payload RAM in bytes is the sum of U16_MSG_CLASSn_LENGTH x U8_MSG_CLASSn_SLOTS.
+Classes must be listed smallest first and each class can have at most 32 slots. */
+#define U8_MSG_SIZE_CLASSES             (u8)3          /*!< @brief Number of message size classes */
+#define U16_MSG_CLASS0_LENGTH           (u16)16        /*!< @brief Payload bytes of a class 0 (small) slot */
+#define U8_MSG_CLASS0_SLOTS             (u8)32         /*!< @brief Number of class 0 slots */
+#define U16_MSG_CLASS1_LENGTH           (u16)64        /*!< @brief Payload bytes of a class 1 (medium) slot */
+#define U8_MSG_CLASS1_SLOTS             (u8)16         /*!< @brief Number of class 1 slots */
+#define U16_MSG_CLASS2_LENGTH           (u16)256       /*!< @brief Payload bytes of a class 2 (large) slot */
+#define U8_MSG_CLASS2_SLOTS             (u8)8          /*!< @brief Number of class 2 slots */
+#define U8_MSG_REFERENCE_SLOTS          (u8)8          /*!< @brief Number of descriptor-only slots for messages that reference caller-owned data */
+
+#define U16_MAX_TX_MESSAGE_LENGTH       U16_MSG_CLASS2_LENGTH /*!< @brief Max bytes in message payload; longer messages are split */
+#define U8_MSG_REFERENCE_CLASS          U8_MSG_SIZE_CLASSES /*!< @brief Index of the reference class, which follows the size classes */
+#define U32_MSG_MAX_REFERENCE_LENGTH    (u32)0xFFFF    /*!< @brief Largest referenced message: one PDC transfer */
+#define U8_MSG_MAX_FRAGMENTS            (u8)8          /*!< @brief Max fragments in one scatter-gather message */
+#define U8_TX_QUEUE_SIZE                (u8)(U8_MSG_CLASS0_SLOTS + U8_MSG_CLASS1_SLOTS + U8_MSG_CLASS2_SLOTS + U8_MSG_REFERENCE_SLOTS) /*!< @brief Number of messages allowed in the queue */
+#define U16_MSG_PAYLOAD_POOL_SIZE       (u16)( (U16_MSG_CLASS0_LENGTH * U8_MSG_CLASS0_SLOTS) + \
+                                               (U16_MSG_CLASS1_LENGTH * U8_MSG_CLASS1_SLOTS) + \
+                                               (U16_MSG_CLASS2_LENGTH * U8_MSG_CLASS2_SLOTS) ) /*!< @brief Total payload bytes */
 #define U8_TX_QUEUE_WATERMARK           (u8)(U8_TX_QUEUE_SIZE - 3) /*!< @brief Number of messages in the queue that will trigger a warning flag */
-#define U8_STATUS_QUEUE_SIZE            (u8)(2 * U8_TX_QUEUE_SIZE) /*!< @brief Number of message statuses to maintain */
+#define U8_MSG_PRIORITY_LEVELS          (u8)3          /*!< @brief Number of MessagePriorityType levels */
+#define U8_MSG_LOW_RESERVE_SHIFT        (u8)2          /*!< @brief MSG_PRIORITY_LOW traffic must leave (slots in class >> this) slots of each class free */
+#define U8_MSG_NORMAL_RESERVE_SLOTS     (u8)1          /*!< @brief MSG_PRIORITY_NORMAL traffic must leave this many slots of each class free */
+#define U8_MSG_LATENCY_BINS             (u8)12         /*!< @brief Latency histogram bins: bin n counts times under 2^n ms and the last bin counts the rest */
+#define U8_MSG_CALLBACK_SLOTS           (u8)16         /*!< @brief Number of messages that can have a completion callback at one time (max 32) */
+#define U8_MSG_NO_CALLBACK              (u8)0xFF       /*!< @brief MessageStatusType u8Callback value when no callback is attached */
+#define U8_STATUS_QUEUE_SIZE            (u8)128        /*!< @brief Number of message statuses to maintain (must be a power of 2 and at least 2 x U8_TX_QUEUE_SIZE) */
+#define U32_STATUS_INDEX_MASK           (u32)(U8_STATUS_QUEUE_SIZE - 1) /*!< @brief AND with a token to get its index in Msg_asStatusQueue */
+
+
+/* u8Flags in MessageType */
+#define _MSG_MORE_FRAGMENTS             (u8)0x01       /*!< @brief Set when the next message in the queue is another fragment of this message */
+#define _MSG_RESERVED                   (u8)0x02       /*!< @brief Set while a slot is reserved with MessageReserve() and not yet committed */
+#define _MSG_LOADED                     (u8)0x04       /*!< @brief Set by a driver that has loaded a message behind the queue head into the hardware; it can no longer be dropped or cancelled */
+#define _MSG_TOKEN_ISSUED               (u8)0x08       /*!< @brief Set when a reserved message was given its token before being committed (MessageIssueToken()) */
+#define P_MSG_CLOSED_LINK               ((void*)0x00000001) /*!< @brief psNextMessage of a last message that has been sent; nothing can be linked after it */
+/* end u8Flags */
 
 
-/*! @cond DOXYGEN_EXCLUDE */
-/* Future: possible time-to-live constants for messages in the queue */
-#define U32_MSG_STATUS_COMPLETE_TIME    (u32)1000      /* Max time in ms that a message status can sit in the status queue in a COMPLETE state */
-#define U32_MSG_STATUS_WAITING_TIME     (u32)3000      /* Max time in ms that a message can sit in the queue in a WAITING state */
-#define U32_MSG_STATUS_TIMEOUT_TIME     (u32)5000      /* Max time in ms that a message status can sit in the status queue in a TIMEOUT state */
-#define U32_MSG_STATUS_CLEANING_TIME    (u32)10000     /* Time in ms between cleaning the message queue */
-/*! @endcond */
+/* Time-to-live of messages and statuses enforced by the cleaning sweep in MessagingSM_Idle */
+#define U32_MSG_STATUS_COMPLETE_TIME    (u32)1000      /*!< @brief Max time in ms that a message status can sit in the status queue in a COMPLETE, ABANDONED or FAILED state */
+#define U32_MSG_STATUS_WAITING_TIME     (u32)3000      /*!< @brief Max time in ms that a message can sit in the queue in a WAITING state */
+#define U32_MSG_STATUS_TIMEOUT_TIME     (u32)5000      /*!< @brief Max time in ms that a message status can sit in the status queue in a TIMEOUT state */
+#define U32_MSG_STATUS_CLEANING_TIME    (u32)1000      /*!< @brief Time in ms between the start of each cleaning sweep */
+#define U8_MSG_CLEAN_PER_TICK           (u8)4          /*!< @brief Status entries checked per messaging task pass during a cleaning sweep */
 
 
 /**********************************************************************************************************************
@@ -44,6 +77,27 @@ Type Definitions
 */
 typedef enum {EMPTY = 0, WAITING, SENDING, COMPLETE, TIMEOUT, ABANDONED, FAILED, NOT_FOUND = 0xff} MessageStateType;
 
+/*! 
+@enum MessagePriorityType
+@brief Priority of the traffic on a transmit queue.  Lower priority traffic is refused first when the pool runs low.
+*/
+typedef enum {MSG_PRIORITY_LOW = 0, MSG_PRIORITY_NORMAL, MSG_PRIORITY_HIGH} MessagePriorityType;
+
+/*! 
+@enum MessageOverflowType
+@brief What a transmit queue does when a new message does not fit in its quota or in the pool.  Dropped messages become ABANDONED.
+*/
+typedef enum {MSG_OVERFLOW_DROP_LOWEST_PRIORITY = 0, MSG_OVERFLOW_REJECT_NEW, MSG_OVERFLOW_DROP_OLDEST} MessageOverflowType;
+
+/*! 
+@enum MessageCallbackModeType
+@brief Context that a message completion callback runs in. 
+*/
+typedef enum {MSG_CALLBACK_DEFERRED = 0, MSG_CALLBACK_ISR} MessageCallbackModeType;
+
+/*! @brief Message completion callback: called with the message token, its final state and the registered context */
+typedef void(*fnMessageCallback_type)(u32 u32Token_, MessageStateType eState_, void* pvContext_);
+
 /*! 
 @enum MessageType
 @brief Message struct for data messages 
@@ -52,10 +106,60 @@ typedef struct
 {
   u32 u32Token;                             /*!< @brief Unique token for this message */
   u32 u32Size;                              /*!< @brief Size of the data payload in bytes */
-  u8 pu8Message[U16_MAX_TX_MESSAGE_LENGTH]; /*!< @brief Data payload array */
+  u8* pu8Message;                           /*!< @brief Data payload (slot storage, or the caller's data for the reference class) */
   void* psNextMessage;                      /*!< @brief Pointer to next message */
+  u8 u8SlotIndex;                           /*!< @brief Index of the Msg_asPool slot that holds this message */
+  u8 u8SizeClass;                           /*!< @brief Size class of the slot */
+  u8 u8Flags;                               /*!< @brief Message flags (_MSG_MORE_FRAGMENTS, _MSG_RESERVED) */
+  u8 u8Pad;                                 /*!< @brief Preserve 4-byte alignment */
 } MessageType;
 
+/*! 
+@struct MessageFragmentType
+@brief One piece of a scatter-gather message 
+*/
+typedef struct
+{
+  u8* pu8Data;                              /*!< @brief Start of the fragment's data */
+  u32 u32Size;                              /*!< @brief Number of bytes in the fragment */
+  bool bCopy;                               /*!< @brief TRUE to copy the data into the pool; FALSE to send it from pu8Data */
+} MessageFragmentType;
+
+/*! 
+@struct MessageQueueType
+@brief Peripheral transmit queue descriptor.  Messages are sent from the head and new messages are added at the tail.
+*/
+typedef struct
+{
+  MessageType* psHead;                      /*!< @brief First message in the queue; this is the message being sent */
+  MessageType* psTail;                      /*!< @brief Last message in the queue; only valid when psHead is not NULL */
+  void* psNextQueue;                        /*!< @brief Next queue in the list of queues checked for stuck messages */
+  u8* pu8Name;                              /*!< @brief Name of the peripheral that owns the queue */
+  u32* pu32PendingFlags;                    /*!< @brief Owner's pending-work bitmap that is flagged when messages are queued (NULL for none) */
+  u32 u32PendingFlag;                       /*!< @brief Bit set in *pu32PendingFlags */
+  u32 u32MessagesQueued;                    /*!< @brief Number of messages queued since startup */
+  u8 u8Priority;                            /*!< @brief MessagePriorityType of the queue's traffic */
+  u8 u8Quota;                               /*!< @brief Max slots the queue's messages can hold at once; 0 for no limit */
+  u8 u8SlotsUsed;                           /*!< @brief Slots currently held by the queue's messages */
+  u8 u8SlotsHighWater;                      /*!< @brief Most slots the queue's messages have held at once */
+  u8 u8Overflow;                            /*!< @brief MessageOverflowType of the queue */
+  u8 au8Pad[3];                             /*!< @brief Preserve 4-byte alignment */
+} MessageQueueType;
+
+/*! 
+@struct MessageQueueStatsType
+@brief Usage information of one peripheral transmit queue 
+*/
+typedef struct
+{
+  u8* pu8Name;                              /*!< @brief Name of the peripheral that owns the queue */
+  u32 u32MessagesQueued;                    /*!< @brief Number of messages queued since startup */
+  u8 u8Priority;                            /*!< @brief MessagePriorityType of the queue's traffic */
+  u8 u8Quota;                               /*!< @brief Max slots the queue's messages can hold at once; 0 for no limit */
+  u8 u8SlotsUsed;                           /*!< @brief Slots currently held by the queue's messages */
+  u8 u8SlotsHighWater;                      /*!< @brief Most slots the queue's messages have held at once */
+} MessageQueueStatsType;
+
 /*! 
 @enum MessageSlotType
 @brief Message node in the message list 
@@ -63,9 +167,23 @@ typedef struct
 typedef struct
 {
   bool bFree;                               /*!< @brief TRUE if message slot is available */
+  MessageQueueType* psOwner;                /*!< @brief Queue the slot was allocated for (NULL for plain linked lists) */
   MessageType Message;                      /*!< @brief The slot's message */
 } MessageSlotType;
 
+/*! 
+@struct MessageSizeClassType
+@brief Slots and free slot bitmap of one message size class 
+*/
+typedef struct
+{
+  u16 u16Length;                            /*!< @brief Payload bytes available in each slot of this class */
+  u8 u8FirstSlot;                           /*!< @brief Index in Msg_asPool of the first slot in this class */
+  u8 u8Slots;                               /*!< @brief Number of slots in this class */
+  u32 u32FreeSlots;                         /*!< @brief Bit n is set when slot u8FirstSlot + n is free */
+  u8 u8SlotsUsed;                           /*!< @brief Number of slots in this class that are in use */
+} MessageSizeClassType;
+
 /*! 
 @enum MessageStatusType
 @brief Message tracking information 
@@ -74,9 +192,54 @@ typedef struct
 {
   u32 u32Token;                             /*!< @brief Unique token for this message; a token is never 0 */
   MessageStateType eState;                  /*!< @brief State of the message */
-  u32 u32Timestamp;                         /*!< @brief Time the message status was posted */          
+  u8 u8Callback;                            /*!< @brief Index in Msg_asCallbacks of the attached callback or U8_MSG_NO_CALLBACK */
+  u32 u32Timestamp;                         /*!< @brief Time the message was queued, or the time its state became final */          
 } MessageStatusType;
 
+/*! 
+@struct MessageThrottleCountType
+@brief Counts of the times the traffic of one priority level was throttled 
+*/
+typedef struct
+{
+  u32 u32Refused;                           /*!< @brief Messages refused by a priority reserve or a queue quota */
+  u32 u32Dropped;                           /*!< @brief Queued messages dropped to make room for higher priority traffic */
+} MessageThrottleCountType;
+
+/*! 
+@struct MessagingStatsType
+@brief Usage and timing information of the messaging task since startup 
+*/
+typedef struct
+{
+  u32 u32MessagesQueued;                    /*!< @brief Messages queued on all queues */
+  u32 u32QueueFullCount;                    /*!< @brief Messages refused with _MESSAGING_TX_QUEUE_FULL */
+  u32 u32Completed;                         /*!< @brief Messages that finished COMPLETE */
+  u32 u32TimedOut;                          /*!< @brief Messages that finished TIMEOUT */
+  u32 u32Abandoned;                         /*!< @brief Messages that finished ABANDONED */
+  u32 u32Failed;                            /*!< @brief Messages that finished FAILED */
+  u32 u32StatusesExpired;                   /*!< @brief Statuses cleared by the cleaning sweep */
+  u32 u32MessagesReclaimed;                 /*!< @brief Stuck messages removed by the cleaning sweep */
+  u32 au32WaitTime[U8_MSG_LATENCY_BINS];    /*!< @brief Histogram of ms from queued to SENDING */
+  u32 au32CompleteTime[U8_MSG_LATENCY_BINS];/*!< @brief Histogram of ms from queued to COMPLETE */
+  u8 u8SlotsUsed;                           /*!< @brief Slots in use now */
+  u8 u8SlotsHighWater;                      /*!< @brief Most slots in use at once */
+  u8 au8ClassHighWater[U8_MSG_SIZE_CLASSES + 1]; /*!< @brief Most slots in use at once in each size class, then the reference class */
+} MessagingStatsType;
+
+/*! 
+@struct MessageCallbackType
+@brief A registered message completion callback 
+*/
+typedef struct
+{
+  fnMessageCallback_type pfnCallback;       /*!< @brief Function to call when the message is finished */
+  void* pvContext;                          /*!< @brief Caller's value passed back to pfnCallback */
+  u32 u32Token;                             /*!< @brief Token of the message */
+  MessageCallbackModeType eMode;            /*!< @brief Run from the ISR that finishes the message or from the messaging task */
+  MessageStateType eState;                  /*!< @brief Final state of the message once it is known */
+} MessageCallbackType;
+
 
 /**********************************************************************************************************************
 * Function Declarations
@@ -86,6 +249,14 @@ typedef struct
 /*! @publicsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 MessageStateType QueryMessageStatus(u32 u32Token_);
+bool MessageSetCallback(u32 u32Token_, fnMessageCallback_type pfnCallback_, void* pvContext_, MessageCallbackModeType eMode_);
+void MessageQueueSetPriority(MessageQueueType* psQueue_, MessagePriorityType ePriority_, u8 u8Quota_);
+void MessageQueueSetOverflow(MessageQueueType* psQueue_, MessageOverflowType eOverflow_);
+bool CancelMessage(u32 u32Token_);
+void QueryMessageThrottleCounts(MessagePriorityType ePriority_, MessageThrottleCountType* psCounts_);
+void QueryMessagingStats(MessagingStatsType* psStats_);
+bool QueryMessageQueueStats(u8 u8Index_, MessageQueueStatsType* psStats_);
+void MessageAbort(MessageType* psHandle_);
 
 
 /*------------------------------------------------------------------------------------------------------------------*/
@@ -96,13 +267,49 @@ void MessagingRunActiveState(void);
 
 u32 QueueMessage(MessageType** ppeTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_);
 void DeQueueMessage(MessageType** pTargetQueue_);
+void MessageQueueInitialize(MessageQueueType* psQueue_, u8* pu8Name_);
+void MessageQueueSetPendingFlag(MessageQueueType* psQueue_, u32* pu32Flags_, u32 u32Flag_);
+u32 QueueTxMessage(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_);
+u32 QueueTxMessageReference(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_);
+u32 QueueTxMessageFragments(MessageQueueType* psQueue_, MessageFragmentType* psFragments_, u8 u8Fragments_);
+u8* MessageReserve(MessageQueueType* psQueue_, u32 u32Size_, MessageType** ppsHandle_);
+u32 MessageCommit(MessageType* psHandle_, u32 u32Size_);
+u32 MessageIssueToken(MessageType* psHandle_);
+u32 MessageIssueTransferToken(void);
+void DeQueueTxMessage(MessageQueueType* psQueue_);
+MessageType* FinishTxMessage(MessageQueueType* psQueue_, MessageStateType eState_);
 void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_);
 
 
 /*------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
+static bool CreateMessageChain(MessageQueueType* psQueue_, u32 u32MessageSize_, u8* pu8MessageData_, MessageType** ppsFirst_, MessageType** ppsLast_);
+static MessageType* AllocateMessageSlot(MessageQueueType* psQueue_, u8 u8FirstClass_, u32 u32Size_);
+static MessageType* TakeMessageSlot(MessageQueueType* psQueue_, u8 u8FirstClass_, u32 u32Size_);
+static bool DropLowestPriorityMessage(MessagePriorityType ePriority_);
+static bool DropQueuedMessage(MessageQueueType* psQueue_, bool bOldest_);
+static void FreeMessageChain(MessageType* psFirst_);
+static void IssueMessageTokens(MessageType* psFirst_);
+static void AppendMessageChain(MessageQueueType* psQueue_, MessageType* psFirst_, MessageType* psLast_);
+static bool IsPoolMessage(MessageType* psMessage_);
+static void FreeMessageSlot(MessageType* psMessage_);
+static void PostMessageStatus(u32 u32Token_, MessageStateType eNewState_, bool bRunIsrCallback_);
 static void AddNewMessageStatus(u32 u32Token_);
+static bool IsMessageStateFinal(MessageStateType eState_);
+static void SignalMessageCallback(MessageStatusType* psStatus_, bool bRunIsrCallback_);
+static u8 TakeCallbackSlot(void);
+static void DispatchMessageCallbacks(void);
+static void CleanMessageStatuses(void);
+static MessageType* UnlinkQueuedMessage(u32 u32Token_);
+static void ReportStuckMessages(u32 u32Messages_);
+static void CountMessageTime(u32* pau32Histogram_, u32 u32Time_);
+static void AtomicAddWord(u32* pu32Value_, u32 u32Amount_);
+static u8 AtomicAddByte(u8* pu8Value_, s8 s8Amount_);
+static void AtomicRaiseByte(u8* pu8Mark_, u8 u8Value_);
+static void AtomicSetBits(u32* pu32Value_, u32 u32Bits_);
+static u32 AtomicSwapWord(u32* pu32Value_, u32 u32NewValue_);
+static u8 AtomicSwapByte(u8* pu8Value_, u8 u8NewValue_);
 
 
 /***********************************************************************************************************************
@@ -1,14 +1,20 @@
 /*!**********************************************************************************************************************
 @file sam3u_i2c.c                                                                
 @brief MASTER ONLY.  Provides a driver to use TWI0 (IIC/I2C) peripheral to send and receive data using 
-interrupts and PDC direct memory access.
+interrupts and PDC direct memory access.  The ISR runs the queued transfers back-to-back; the state
+machine only handles timeouts and errors.
 
-Currently Set at 200kHz Master Mode.
+Master Mode.  The bus speed comes from TWI0_BUS_SPEED_INIT (200 kHz) and TWI_CWGR is calculated
+from MCK, so TwiSetBusSpeed() can move the whole bus to another rate (e.g. 400 kHz fast mode).
+On a mixed-speed bus, TwiSetSlaveSpeed() gives one slave its own rate; each queued transfer keeps
+the clock setting it was queued with and the ISR reloads TWI_CWGR only when it changes.
 
 Due to the nature of I2C use-cases, this driver does not require tasks to request and release it.
 Read / write messages information is queued locally with all required details.  The driver will
 continually cycle through the local message buffer and perform the reads or writes on a FIFO basis.
-Read messages stand alone.  Write messages will have associated Message task messages.
+Read messages stand alone, but they are given a status token from the Message task so a client can 
+query them or attach a callback with MessageSetCallback().  Write messages will have associated 
+Message task messages.
 
 Clock stretching is supported automatically by the peripheral in Master mode for both read and write.
 
@@ -24,10 +30,15 @@ TYPES
 - TwiDirectionType
 - TwiPeripheralType
 - TwiMessageQueueType
+- TwiSlaveSpeedType
 
 PUBLIC FUNCTIONS
-- bool TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_)
+- u32 TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_)
+- u32 TwiWriteReadData(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_)
 - u32 TwiWriteData(u8 u8SlaveAddress_, u32 u32Size_, u8* pu8Data_, TwiStopType Send_)
+- u32 TwiWriteDataReference(u8 u8SlaveAddress_, u32 u32Size_, u8* pu8Data_, TwiStopType eStop_)
+- bool TwiSetBusSpeed(u32 u32SpeedHz_)
+- bool TwiSetSlaveSpeed(u8 u8SlaveAddress_, u32 u32SpeedHz_)
 
 PROTECTED FUNCTIONS
 - void TwiInitialize(void)
@@ -68,7 +79,11 @@ static TwiPeripheralType TWI_Peripheral0;         /*!< @brief TWI0 peripheral ob
 static TwiMessageQueueType TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE]; /*!< @brief Local circular buffer for TWI msgs */
 static TwiMessageQueueType* TWI_psMsgBufferNext;                        /*!< @brief Next position to place a message */
 static TwiMessageQueueType* TWI_psMsgBufferCurrent;                     /*!< @brief Current message that is being processed */
-static u8 TWI_u8MsgQueueCount;                                          /*!< @brief Counter to track the number of messages in the queue */
+static volatile u8 TWI_u8MsgQueueCount;                                 /*!< @brief Counter to track the number of messages in the queue */
+
+static u32 TWI_u32BusCwgr;                                              /*!< @brief TWI_CWGR value for the bus speed */
+static u32 TWI_u32ActiveCwgr;                                           /*!< @brief TWI_CWGR value currently loaded in the peripheral */
+static TwiSlaveSpeedType TWI_asSlaveSpeeds[U8_TWI_SLAVE_SPEEDS];        /*!< @brief Slaves that run at their own speed */
 
 
 /***********************************************************************************************************************
@@ -80,14 +95,21 @@ Function Definitions
 /*--------------------------------------------------------------------------------------------------------------------*/
 
 /*!--------------------------------------------------------------------------------------------------------------------
-@fn bool TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_)
+@fn u32 TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_)
 
 @brief Queues a TWI Read Message into TWI_asMessageBuffer
 
-Read operations do not have an associated message in the Message task queue.
+Read operations do not have an associated message in the Message task queue, but they get a
+status token so the client knows when pu8RxBuffer_ holds the new data.  The token can be 
+polled with QueryMessageStatus() or given a callback with MessageSetCallback().
+
+Example:
+u32Token = TwiReadData(U8_SLAVE_ADDRESS, au8Data, 6);
+MessageSetCallback(u32Token, MyTaskReadDone, NULL, MSG_CALLBACK_DEFERRED);
 
 Requires:
 - Master mode
+- pu8RxBuffer_ is not used by the caller until the token's status is final
 
 @param u8SlaveAddress_ holds the target's IC address
 @param pu8RxBuffer_ has the space to save the data
@@ -95,72 +117,30 @@ Requires:
 
 Promises:
 - Queues a multi byte command into the command array
-- Returns TRUE if the queue was successful
+- Returns the status token of the read: COMPLETE once all bytes are in pu8RxBuffer_, FAILED if 
+  the slave NACKs or TIMEOUT if the read stalls
+- Returns 0 if the read cannot be queued
 
 */
-bool TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_)
+u32 TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_)
 {
-  if(TWI_u8MsgQueueCount == U8_TWI_MSG_BUFFER_SIZE)
-  {
-    /* TWI Message Task Queue Full or the Tx transmit isn't complete */
-    return FALSE;
-  }
-  
-  /* Critical section: TWI buffer management must be done with interrutps off since 
-  an ISR can also manage the buffer values and pointers */
-  __disable_irq();
-
-  /* Queue Relevant data for TWI register setup */
-  TWI_psMsgBufferNext->eDirection = TWI_READ;
-  TWI_psMsgBufferNext->u32Size = u32Size_;
-  TWI_psMsgBufferNext->u8Address = u8SlaveAddress_;
-  TWI_psMsgBufferNext->pu8RxBuffer = pu8RxBuffer_;
-  
-  /* Stop condition type and message token do not apply for Rx */
-  TWI_psMsgBufferNext->eStopType = TWI_NA; 
-  TWI_psMsgBufferNext->u32MessageTaskToken = 0;
-      
-  /* Update array indexers and size */
-  TWI_u8MsgQueueCount++;
-  TWI_psMsgBufferNext++;
-  if( TWI_psMsgBufferNext == &TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE] )
-  {
-    TWI_psMsgBufferNext = &TWI_asMessageBuffer[0];
-  }
-  
-  /* Clear the new location to avoid confusion */
-  TWI_psMsgBufferNext->eDirection = TWI_EMPTY;
-  TWI_psMsgBufferNext->u32Size = 0;
-  TWI_psMsgBufferNext->u8Address = 0;
-  TWI_psMsgBufferNext->u8InternalAddress = 0;
-  TWI_psMsgBufferNext->pu8RxBuffer = NULL;
-  TWI_psMsgBufferNext->eStopType = TWI_NA; 
-  TWI_psMsgBufferNext->u32MessageTaskToken = 0;
-
-  /* End of critical section */
-  __enable_irq();
-    
-  /* If the system is initializing, manually cycle the TWI task through one iteration to send the message */
-  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
-  {
-    TwiManualMode();
-  }
-
-  return TRUE;
+  return( TwiQueueReadTask(u8SlaveAddress_, 0, pu8RxBuffer_, u32Size_) );
   
 } /* end TwiReadData() */
 
 
 /*!--------------------------------------------------------------------------------------------------------------------
-@fn bool TwiWriteReadData(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_)
+@fn u32 TwiWriteReadData(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_)
 
 @brief Queues a TWI Read Message into TWI_asMessageBuffer but will first execute a TWI Write to set 
 the slave's internal address
 
-Read operations do not have an associated message in the Message task queue.
+Read operations do not have an associated message in the Message task queue, but they get a
+status token like TwiReadData().
 
 Requires:
 - Master mode
+- pu8RxBuffer_ is not used by the caller until the token's status is final
 
 @param u8SlaveAddress_ holds the target's IC address
 @param u8InternalAddress_ is the slave's internal address to start reading
@@ -169,59 +149,12 @@ Requires:
 
 Promises:
 - Queues a multi byte command into the command array
-- Returns TRUE if the queue was successful
+- Returns the status token of the read (see TwiReadData()) or 0 if the read cannot be queued
 
 */
-bool TwiWriteReadData(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_)
+u32 TwiWriteReadData(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_)
 {
-  if(TWI_u8MsgQueueCount == U8_TWI_MSG_BUFFER_SIZE)
-  {
-    /* TWI Message Task Queue Full or the Tx transmit isn't complete */
-    return FALSE;
-  }
-  
-  /* Critical section: TWI buffer management must be done with interrutps off since 
-  an ISR can also manage the buffer values and pointers */
-  __disable_irq();
-
-  /* Queue Relevant data for TWI register setup */
-  TWI_psMsgBufferNext->eDirection = TWI_READ;
-  TWI_psMsgBufferNext->u32Size = u32Size_;
-  TWI_psMsgBufferNext->u8Address = u8SlaveAddress_;
-  TWI_psMsgBufferNext->u8InternalAddress = u8InternalAddress_;
-  TWI_psMsgBufferNext->pu8RxBuffer = pu8RxBuffer_;
-  
-  /* Stop condition type and message token do not apply for Rx */
-  TWI_psMsgBufferNext->eStopType = TWI_NA; 
-  TWI_psMsgBufferNext->u32MessageTaskToken = 0;
-      
-  /* Update array indexers and size */
-  TWI_u8MsgQueueCount++;
-  TWI_psMsgBufferNext++;
-  if( TWI_psMsgBufferNext == &TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE] )
-  {
-    TWI_psMsgBufferNext = &TWI_asMessageBuffer[0];
-  }
-  
-  /* Clear the new location to avoid confusion */
-  TWI_psMsgBufferNext->eDirection = TWI_EMPTY;
-  TWI_psMsgBufferNext->u32Size = 0;
-  TWI_psMsgBufferNext->u8Address = 0;
-  TWI_psMsgBufferNext->u8InternalAddress = 0;
-  TWI_psMsgBufferNext->pu8RxBuffer = NULL;
-  TWI_psMsgBufferNext->eStopType = TWI_NA; 
-  TWI_psMsgBufferNext->u32MessageTaskToken = 0;
-
-  /* End of critical section */
-  __enable_irq();
-    
-  /* If the system is initializing, manually cycle the TWI task through one iteration to send the message */
-  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
-  {
-    TwiManualMode();
-  }
-
-  return TRUE;
+  return( TwiQueueReadTask(u8SlaveAddress_, u8InternalAddress_, pu8RxBuffer_, u32Size_) );
   
 } /* end TwiWriteReadData() */
 
@@ -246,7 +179,7 @@ Requires:
           register address must first be specified, then the data is read after.
 
 Promises:
-- adds the data message at TWI_Peripheral0.pTransmitBuffer buffer that will be sent by the TWI application
+- adds the data message to TWI_Peripheral0.sTransmitQueue that will be sent by the TWI application
   when it is available.
 - Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
   G_u32MessagingFlags can be checked for the reason
@@ -263,56 +196,166 @@ u32 TwiWriteData(u8 u8SlaveAddress_, u32 u32Size_, u8* pu8Data_, TwiStopType eSt
   }
 
   /* Queue Message in message system */
-  u32Token = QueueMessage(&TWI_Peripheral0.pTransmitBuffer, u32Size_, pu8Data_);
+  u32Token = QueueTxMessage(&TWI_Peripheral0.sTransmitQueue, u32Size_, pu8Data_);
   if(u32Token == 0)
   {
     /* TWI Message Task Queue Full or the Tx transmit isn't complete */
     return 0;
   }
 
-  /* Critical section: TWI buffer management must be done with interrutps off since 
-  an ISR can also manage the buffer values and pointers */
-  __disable_irq();
+  TwiQueueWriteTask(u32Token, u8SlaveAddress_, u32Size_, eStop_);
 
-  /* Queue Relevant data for TWI register setup */
-  TWI_psMsgBufferNext->u32MessageTaskToken = u32Token;
-  TWI_psMsgBufferNext->eDirection = TWI_WRITE;
-  TWI_psMsgBufferNext->u32Size    = u32Size_;
-  TWI_psMsgBufferNext->u8Address  = u8SlaveAddress_;
-  TWI_psMsgBufferNext->eStopType  = eStop_; 
+  return(u32Token);
   
-  /* Not used by Transmit */
-  TWI_psMsgBufferNext->pu8RxBuffer = NULL;
+} /* end TwiWriteData() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 TwiWriteDataReference(u8 u8SlaveAddress_, u32 u32Size_, u8* pu8Data_, TwiStopType eStop_)
+
+@brief Queues a data array for transfer on the TWI0 peripheral without copying it.  
+
+The PDC transfers directly from pu8Data_, so the caller must keep the data unchanged until the
+message status is no longer WAITING or SENDING.
+
+Requires:
+- if a transmission is in progress, the node in the buffer that is currently being sent will not 
+  be destroyed during this function.
+
+@param u8SlaveAddress_ holds the target's IC address
+@param u32Size_ is the number of bytes to send NOT including the address byte
+@param pu8Data_ points to the start of the data to send
+@param eStop_ is the type of operation (see TwiWriteData())
+
+Promises:
+- adds a message referencing pu8Data_ to TWI_Peripheral0.sTransmitQueue that will be sent by the 
+  TWI application when it is available.
+- Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
+  G_u32MessagingFlags can be checked for the reason
+
+*/
+u32 TwiWriteDataReference(u8 u8SlaveAddress_, u32 u32Size_, u8* pu8Data_, TwiStopType eStop_)
+{
+  u32 u32Token;
+    
+  if(TWI_u8MsgQueueCount == U8_TWI_MSG_BUFFER_SIZE)
+  {
+    /* TWI Message Task Queue Full or the Tx transmit isn't complete */
+    return 0;
+  }
+
+  /* Queue Message in message system */
+  u32Token = QueueTxMessageReference(&TWI_Peripheral0.sTransmitQueue, u32Size_, pu8Data_);
+  if(u32Token == 0)
+  {
+    return 0;
+  }
+
+  TwiQueueWriteTask(u32Token, u8SlaveAddress_, u32Size_, eStop_);
+
+  return(u32Token);
   
-  /* Update array pointers and size */
-  TWI_u8MsgQueueCount++;
-  TWI_psMsgBufferNext++;
-  if( TWI_psMsgBufferNext == &TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE] )
+} /* end TwiWriteDataReference() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn bool TwiSetBusSpeed(u32 u32SpeedHz_)
+
+@brief Changes the TWI bus speed used for all slaves without their own setting.
+
+TWI_CWGR is calculated from MCK, so any rate from U32_TWI_SPEED_MIN_HZ to U32_TWI_SPEED_MAX_HZ 
+can be used; the actual rate is the closest one that is not faster than u32SpeedHz_.
+
+Example:
+TwiSetBusSpeed(U32_TWI_SPEED_400KHZ);
+
+Requires:
+@param u32SpeedHz_ is the SCL frequency in Hz, e.g. U32_TWI_SPEED_100KHZ or U32_TWI_SPEED_400KHZ
+
+Promises:
+- Transfers queued from now on run at u32SpeedHz_ unless their slave has a TwiSetSlaveSpeed() 
+  setting; transfers already queued keep the speed they were queued with
+- Returns FALSE and leaves the speed unchanged if u32SpeedHz_ is out of range
+
+*/
+bool TwiSetBusSpeed(u32 u32SpeedHz_)
+{
+  if( (u32SpeedHz_ < U32_TWI_SPEED_MIN_HZ) || (u32SpeedHz_ > U32_TWI_SPEED_MAX_HZ) )
   {
-    TWI_psMsgBufferNext = &TWI_asMessageBuffer[0];
+    return FALSE;
   }
+  
+  TWI_u32BusCwgr = TwiCalculateCwgr(u32SpeedHz_);
+  return TRUE;
+  
+} /* end TwiSetBusSpeed() */
 
-  /* Clear the new location to avoid confusion */
-  TWI_psMsgBufferNext->eDirection  = TWI_EMPTY;
-  TWI_psMsgBufferNext->u32Size     = 0;
-  TWI_psMsgBufferNext->u8Address   = 0;
-  TWI_psMsgBufferNext->pu8RxBuffer = NULL;
-  TWI_psMsgBufferNext->eStopType   = TWI_NA; 
-  TWI_psMsgBufferNext->u8InternalAddress = 0;
-  TWI_psMsgBufferNext->u32MessageTaskToken = 0;
 
-  /* End of critical section */
-  __enable_irq();
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn bool TwiSetSlaveSpeed(u8 u8SlaveAddress_, u32 u32SpeedHz_)
 
-  /* If the system is initializing, manually cycle the TWI task through one iteration to send the message */
-  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+@brief Sets the speed of the transfers to one slave on a mixed-speed bus.
+
+A fast slave (e.g. a fast mode sensor) can run at 400 kHz while slower slaves on the same bus 
+stay at the bus speed.  The setting is applied to every transfer queued to u8SlaveAddress_.
+
+Example:
+TwiSetSlaveSpeed(U8_LSM6DSL_I2C_ADDRESS, U32_TWI_SPEED_400KHZ);
+
+Requires:
+@param u8SlaveAddress_ holds the target's IC address
+@param u32SpeedHz_ is the SCL frequency in Hz, or 0 to go back to the bus speed
+
+Promises:
+- Transfers queued to u8SlaveAddress_ from now on run at u32SpeedHz_ 
+- Returns FALSE if u32SpeedHz_ is out of range or U8_TWI_SLAVE_SPEEDS slaves already have a setting
+
+*/
+bool TwiSetSlaveSpeed(u8 u8SlaveAddress_, u32 u32SpeedHz_)
+{
+  TwiSlaveSpeedType* psEntry = NULL;
+  
+  if( (u32SpeedHz_ != 0) && 
+      ( (u32SpeedHz_ < U32_TWI_SPEED_MIN_HZ) || (u32SpeedHz_ > U32_TWI_SPEED_MAX_HZ) ) )
   {
-    TwiManualMode();
+    return FALSE;
+  }
+  
+  /* Use the slave's existing entry or the first free one */
+  for(u8 i = 0; i < U8_TWI_SLAVE_SPEEDS; i++)
+  {
+    if(TWI_asSlaveSpeeds[i].u8Address == u8SlaveAddress_)
+    {
+      psEntry = &TWI_asSlaveSpeeds[i];
+      break;
+    }
+    
+    if( (psEntry == NULL) && (TWI_asSlaveSpeeds[i].u8Address == 0) )
+    {
+      psEntry = &TWI_asSlaveSpeeds[i];
+    }
+  }
+  
+  if(u32SpeedHz_ == 0)
+  {
+    if( (psEntry != NULL) && (psEntry->u8Address == u8SlaveAddress_) )
+    {
+      psEntry->u8Address = 0;
+      psEntry->u32Cwgr = 0;
+    }
+    return TRUE;
   }
 
-  return(u32Token);
+  if(psEntry == NULL)
+  {
+    return FALSE;
+  }
   
-} /* end TwiWriteData() */
+  psEntry->u32Cwgr = TwiCalculateCwgr(u32SpeedHz_);
+  psEntry->u8Address = u8SlaveAddress_;
+  return TRUE;
+  
+} /* end TwiSetSlaveSpeed() */
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -353,11 +396,22 @@ void TwiInitialize(void)
     TWI_asMessageBuffer[i].u32Size = 0;
     TWI_asMessageBuffer[i].u8Address = 0;
     TWI_asMessageBuffer[i].u8InternalAddress = 0;
+    TWI_asMessageBuffer[i].u32Cwgr = 0;
+  }
+  
+  /* No slave has its own speed until TwiSetSlaveSpeed() is called */
+  for(u8 i = 0; i < U8_TWI_SLAVE_SPEEDS; i++)
+  {
+    TWI_asSlaveSpeeds[i].u8Address = 0;
+    TWI_asSlaveSpeeds[i].u32Cwgr = 0;
   }
    
   /* Initialize the TWI peripheral structures */
   TWI_Peripheral0.pBaseAddress    = AT91C_BASE_TWI0;
-  TWI_Peripheral0.pTransmitBuffer = NULL;
+  MessageQueueInitialize(&TWI_Peripheral0.sTransmitQueue, "TWI0");
+  
+  /* TWI carries the character LCD and sensor writes, so it must not be starved by debug output */
+  MessageQueueSetPriority(&TWI_Peripheral0.sTransmitQueue, MSG_PRIORITY_HIGH, 0);
   TWI_Peripheral0.u32PrivateFlags = 0;
 
   /* Software reset of peripheral */
@@ -365,8 +419,10 @@ void TwiInitialize(void)
   TWI_u32Timer = G_u32SystemTime1ms;
   while( !IsTimeUp(&TWI_u32Timer, 1) );
   
-  /* Configure Peripheral for Master mode */
-  TWI_Peripheral0.pBaseAddress->TWI_CWGR = TWI0_CWGR_INIT;
+  /* Configure Peripheral for Master mode at the default bus speed */
+  TWI_u32BusCwgr = TwiCalculateCwgr(TWI0_BUS_SPEED_INIT);
+  TWI_u32ActiveCwgr = TWI_u32BusCwgr;
+  TWI_Peripheral0.pBaseAddress->TWI_CWGR = TWI_u32ActiveCwgr;
   TWI_Peripheral0.pBaseAddress->TWI_CR   = TWI0_CR_INIT;
   TWI_Peripheral0.pBaseAddress->TWI_MMR  = TWI0_MMR_INIT;
   TWI_Peripheral0.pBaseAddress->TWI_IER  = TWI0_IER_INIT;
@@ -418,6 +474,8 @@ Requires:
 Promises:
 - All pending messages sent
 - TWI_u8MsgQueueCount = 0
+- If the messages take longer than U32_TWI_MANUAL_MODE_TIMEOUT_MS, _TWI_ERROR_MANUAL_MODE_TIMEOUT
+  is set and the rest are left for the main loop
     
 */
 void TwiManualMode(void)
@@ -425,17 +483,26 @@ void TwiManualMode(void)
   u32 u32Timer;
   
   TWI_u32Flags |=_TWI_INIT_MODE;
+  u32Timer = G_u32SystemTime1ms;
   
-  while(TWI_u32Flags &_TWI_INIT_MODE)
+  /* The ISR runs the queued transfers, so just poll for the queue to empty.  The state
+  machine still runs to handle any errors. */
+  while(TWI_u8MsgQueueCount != 0)
   {
     WATCHDOG_BONE();
     TWI_pfnStateMachine();
     MessagingRunActiveState();
     DebugRunActiveState();
     
-    u32Timer = G_u32SystemTime1ms;
-    while( !IsTimeUp(&u32Timer, 1) );
+    if( IsTimeUp(&u32Timer, U32_TWI_MANUAL_MODE_TIMEOUT_MS) )
+    {
+      TWI_u32Flags |= _TWI_ERROR_MANUAL_MODE_TIMEOUT;
+      DebugPrintf("TWI manual mode timeout\n\r");
+      break;
+    }
   }
+  
+  TWI_u32Flags &= ~_TWI_INIT_MODE;
       
 } /* end TwiManualMode() */
 
@@ -443,20 +510,32 @@ void TwiManualMode(void)
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn ISR void TWI0_IrqHandler(void)
 
-@brief Handles the TWI0 Peripheral interrupts
+@brief Handles the TWI0 Peripheral interrupts and runs the queued transfers back-to-back.
+
+Only the interrupt for the current step of a transfer is enabled, so each step is entered from
+the one before it:
+- Write: ENDTX -> TXCOMP (STOP) or TXRDY (no STOP)
+- Read: ENDRX (multi-byte only) -> RXRDY -> TXCOMP
+
+When a transfer is done, the next entry in TWI_asMessageBuffer is started right away.
 
 Requires:
 - NONE
 
 Promises:
-- NACK: flags error, disables ENDTX and sets Error state
-- ENDTX: disables interrupt & PDC, writes STOP (if applicable), and clears _TWI_TRANSMITTING
-- ENDRX: disables interrupt & PDC and writes STOP
+- NACK: stops the transfer, flags the error and sets the Error state; _TWI_TRANSMITTING / 
+  _TWI_RECEIVING stay set so no other transfer starts until the state machine cleans up
+- ENDTX: chains the next fragment of the message or waits for the end of the transfer (writing 
+  STOP if applicable)
+- ENDRX: disables the PDC, writes STOP and waits for the last byte
+- RXRDY: saves the last byte and waits for TXCOMP
+- TXCOMP or TXRDY: finishes the transfer and starts the next one
 
 */
 void TWI0_IrqHandler(void)
 {
   u32 u32InterruptStatus;
+  MessageType* psHead;
   
   /* Grab active interrupts and compare with status */
   u32InterruptStatus = AT91C_BASE_TWI0->TWI_IMR;
@@ -465,45 +544,81 @@ void TWI0_IrqHandler(void)
   /*** NACK Received (Master only) ***/
   if(u32InterruptStatus & AT91C_TWI_NACK_MASTER )
   {
-    /* Error has occurred, abort the message */
+    /* Error has occurred, abort the transfer and let the state machine clean up */
     TWI_u32Flags |= _TWI_ERROR_NACK;
-    TWI_Peripheral0.pBaseAddress->TWI_IDR = AT91C_TWI_ENDTX;
-    TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_TXTDIS;
+    TWI_Peripheral0.pBaseAddress->TWI_IDR = TWI_TRANSFER_INTERRUPTS;
+    TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_TXTDIS | AT91C_PDC_RXTDIS;
     TWI_pfnStateMachine = TwiSM_Error;
+    return;
   }
 
-  /*** ENDTX (transmit has finished) ***/
+  /*** ENDTX (the PDC has loaded the last byte of the message or fragment) ***/
   if(u32InterruptStatus & AT91C_TWI_ENDTX )
   {
-    /* Disable interrupt and PDC transfer */
-    TWI_Peripheral0.pBaseAddress->TWI_IDR = AT91C_TWI_ENDTX;
-    TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_TXTDIS;
-
-    /* Set stop condition if multi-byte transfer */
-    if( (TWI_Peripheral0.pTransmitBuffer->u32Size != 1) &&
-        (TWI_psMsgBufferCurrent->eStopType == TWI_STOP) )
+    psHead = TWI_Peripheral0.sTransmitQueue.psHead;
+    
+    /* Another fragment of the same message continues the transfer (writing TCR clears ENDTX) */
+    if( (psHead->u8Flags & _MSG_MORE_FRAGMENTS) && (psHead->psNextMessage != NULL) )
     {
-      TWI_Peripheral0.pBaseAddress->TWI_CR = AT91C_TWI_STOP;
+      psHead = FinishTxMessage(&TWI_Peripheral0.sTransmitQueue, COMPLETE);
+      TWI_Peripheral0.pBaseAddress->TWI_TPR = (u32)psHead->pu8Message;
+      TWI_Peripheral0.pBaseAddress->TWI_TCR = psHead->u32Size;
     }
-    
-    TWI_Peripheral0.u32PrivateFlags &= ~_TWI_TRANSMITTING;
+    else
+    {
+      /* Disable interrupt and PDC transfer */
+      TWI_Peripheral0.pBaseAddress->TWI_IDR = AT91C_TWI_ENDTX;
+      TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_TXTDIS;
 
+      if(TWI_psMsgBufferCurrent->eStopType == TWI_STOP)
+      {
+        /* Set stop condition if multi-byte transfer (single bytes set it at the start) */
+        if(TWI_psMsgBufferCurrent->u32Size != 1)
+        {
+          TWI_Peripheral0.pBaseAddress->TWI_CR = AT91C_TWI_STOP;
+        }
+        
+        TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_TXCOMP_MASTER;
+      }
+      else
+      {
+        /* Without a STOP the bus is held once the last byte leaves THR */
+        TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_TXRDY_MASTER;
+      }
+    }
   } /* end ENDTX handler */
   
-  
   /*** ENDRX (receive has finished ALL BUT ONE bytes) ***/
-  if(u32InterruptStatus & AT91C_TWI_ENDRX )
+  else if(u32InterruptStatus & AT91C_TWI_ENDRX )
   {
     /* Disable interrupt and PDC transfer */
     TWI_Peripheral0.pBaseAddress->TWI_IDR = AT91C_TWI_ENDRX;
     TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_RXTDIS;
 
-    /* Set stop condition and change states */
+    /* Set stop condition and wait for the last byte */
     TWI_Peripheral0.pBaseAddress->TWI_CR = AT91C_TWI_STOP;
-    TWI_pfnStateMachine = TwiSM_ReceiveLastByte;
+    TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_RXRDY;
 
   } /* end ENDRX handler */
   
+  /*** RXRDY (the last byte of a read has arrived) ***/
+  else if(u32InterruptStatus & AT91C_TWI_RXRDY )
+  {
+    *(TWI_psMsgBufferCurrent->pu8RxBuffer + TWI_psMsgBufferCurrent->u32Size - 1) = TWI_Peripheral0.pBaseAddress->TWI_RHR;
+    
+    TWI_Peripheral0.pBaseAddress->TWI_IDR = AT91C_TWI_RXRDY;
+    TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_TXCOMP_MASTER;
+    
+  } /* end RXRDY handler */
+
+  /*** TXCOMP (STOP has been sent) or TXRDY (last byte of a write without STOP is in the shifter) ***/
+  else if(u32InterruptStatus & (AT91C_TWI_TXCOMP_MASTER | AT91C_TWI_TXRDY_MASTER) )
+  {
+    TWI_Peripheral0.pBaseAddress->TWI_IDR = (AT91C_TWI_TXCOMP_MASTER | AT91C_TWI_TXRDY_MASTER);
+    TwiFinishTransfer();
+    
+  } /* end TXCOMP / TXRDY handler */
+  
 } /* end TWI0_IrqHandler() */
 
 
@@ -511,268 +626,521 @@ void TWI0_IrqHandler(void)
 /*! @privatesection */                                                                                            
 /*----------------------------------------------------------------------------------------------------------------------*/
 
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u32 TwiCalculateCwgr(u32 u32SpeedHz_)
 
-/***********************************************************************************************************************
-State Machine Function Definitions
-***********************************************************************************************************************/
+@brief Calculates the TWI_CWGR value for an SCL frequency from MCK.
+
+Each half of the SCL period is ((DIV * 2^CKDIV) + 4) MCK cycles.  The period is rounded up so 
+the bus never runs faster than asked, and the smallest CKDIV that fits the dividers is used for 
+the best resolution.  Above U32_TWI_SPEED_100KHZ the low time is kept at or above the fast mode
+minimum (U32_TWI_FAST_MODE_TLOW_NS) and the high time is shortened to keep the rate.
+
+e.g. with MCK = 48 MHz: 100 kHz = 0x0000ECEC, 200 kHz = 0x00007474, 400 kHz = 0x0000353B
+
+Requires:
+@param u32SpeedHz_ is from U32_TWI_SPEED_MIN_HZ to U32_TWI_SPEED_MAX_HZ
+
+Promises:
+- Returns the TWI_CWGR value
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TwiSM_Idle(void)
-@brief Wait for a message to be queued then process that message.
 */
-static void TwiSM_Idle(void)
+static u32 TwiCalculateCwgr(u32 u32SpeedHz_)
 {
-  u32 u32Byte;
-
-  /* Do nothing unless new Tx or Rx messages have been queued */
-  if(TWI_u8MsgQueueCount != 0)
+  u32 u32PeriodCycles;
+  u32 u32LowCycles;
+  u32 u32HighCycles;
+  u32 u32MinLowCycles;
+  u32 u32ClockDiv = 0;
+  
+  /* Whole SCL period in MCK cycles, rounded up */
+  u32PeriodCycles = ((u32)(MCK) + u32SpeedHz_ - 1) / u32SpeedHz_;
+  u32LowCycles = (u32PeriodCycles + 1) / 2;
+  
+  /* Fast mode slaves need SCL low for at least 1.3us, which is more than half of a 400 kHz period */
+  if(u32SpeedHz_ > U32_TWI_SPEED_100KHZ)
   {
-    if(TWI_psMsgBufferCurrent->eDirection == TWI_WRITE)
+    u32MinLowCycles = ( (((u32)(MCK) / 1000000) * U32_TWI_FAST_MODE_TLOW_NS) + 999 ) / 1000;
+    if(u32LowCycles < u32MinLowCycles)
     {
-      /* Check that the local buffer Message token matches the message queued
-      and the transmit buffer */
-      if(TWI_psMsgBufferCurrent->u32MessageTaskToken != TWI_Peripheral0.pTransmitBuffer->u32Token)
-      {
-        DebugPrintf("TWI transmit message out of sync!\n\r");
-        TWI_Peripheral0.u32PrivateFlags |= _TWI_ERROR_TX_MSG_SYNC;
-      }
-      else
-      {
-        /* Update the message's status */
-        UpdateMessageStatus(TWI_Peripheral0.pTransmitBuffer->u32Token, SENDING);
-
-        /* Set up to transmit the message */
-        TWI_Peripheral0.u32PrivateFlags |= _TWI_TRANSMITTING;
-        u32Byte = (u32)(TWI_psMsgBufferCurrent->u8Address) << TWI_MMR_ADDRESS_SHIFT;
-        TWI_Peripheral0.pBaseAddress->TWI_MMR = u32Byte; 
-
-        /* Setup PDC and interrupts */
-        TWI_Peripheral0.pBaseAddress->TWI_TPR = (u32)TWI_Peripheral0.pTransmitBuffer->pu8Message; 
-        TWI_Peripheral0.pBaseAddress->TWI_TCR = TWI_Peripheral0.pTransmitBuffer->u32Size;
-
-        /* Enable Tx interrupt and the transmitter (triggers THR load) */
-        TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_ENDTX;
-        TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_TXTEN;
-             
-        /* Single byte transfers need STOP immediately (if applicable) */
-        if(TWI_Peripheral0.pTransmitBuffer->u32Size == 1)
-        {
-          /* Set up the stop condition immediately if applicable */
-          if(TWI_psMsgBufferCurrent->eStopType == TWI_STOP)
-          {
-            TWI_Peripheral0.pBaseAddress->TWI_CR = AT91C_TWI_STOP;
-          }
-        }
+      u32LowCycles = u32MinLowCycles;
+    }
+  }
+  u32HighCycles = u32PeriodCycles - u32LowCycles;
+  
+  /* Take off the fixed part of each half; the rest is DIV * 2^CKDIV */
+  u32LowCycles  -= TWI_CWGR_FIXED_CYCLES;
+  u32HighCycles -= TWI_CWGR_FIXED_CYCLES;
+  
+  /* The low half is the longer one so it sets the clock divider */
+  while( (((u32LowCycles + (1 << u32ClockDiv) - 1) >> u32ClockDiv) > TWI_CWGR_DIV_MAX) && 
+         (u32ClockDiv < TWI_CWGR_CKDIV_MAX) )
+  {
+    u32ClockDiv++;
+  }
+  u32LowCycles  = (u32LowCycles  + (1 << u32ClockDiv) - 1) >> u32ClockDiv;
+  u32HighCycles = (u32HighCycles + (1 << u32ClockDiv) - 1) >> u32ClockDiv;
+  
+  return( (u32ClockDiv << TWI_CWGR_CKDIV_SHIFT) | (u32HighCycles << TWI_CWGR_CHDIV_SHIFT) | u32LowCycles );
+  
+} /* end TwiCalculateCwgr() */
 
-        TWI_pfnStateMachine = TwiSM_Transmit;
 
-      } /* end WRITE setup */
-    } /* end TWI_WRITE */
-    
-    else if(TWI_psMsgBufferCurrent->eDirection == TWI_READ)
-    {
-      /* Set up for READ transaction */
-      u32Byte = AT91C_TWI_MREAD | (TWI_psMsgBufferCurrent->u8Address << TWI_MMR_ADDRESS_SHIFT);
-      TWI_Peripheral0.pBaseAddress->TWI_MMR = u32Byte; 
-      TWI_Peripheral0.u32PrivateFlags |= _TWI_RECEIVING;
-      
-      /* For WriteRead operation, also set the interal address otherwise make sure it is 0 */
-      if(TWI_psMsgBufferCurrent->u8InternalAddress != 0 )
-      {
-        TWI_Peripheral0.pBaseAddress->TWI_IADR = ((u32)(TWI_psMsgBufferCurrent->u8InternalAddress)) & 0x000000FF;
-        TWI_Peripheral0.pBaseAddress->TWI_MMR |= (1 << TWI_MMR_IADRZ_SHIFT);
-      }
-      else
-      {
-        TWI_Peripheral0.pBaseAddress->TWI_IADR = 0;
-      }
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u32 TwiGetSlaveCwgr(u8 u8SlaveAddress_)
 
-      /* Set up to receive the message based on number of bytes */
-      if(TWI_psMsgBufferCurrent->u32Size == 1)
-      {
-        /* Single byte direct receive (no PDC required) */
-        TWI_Peripheral0.pBaseAddress->TWI_CR = (AT91C_TWI_START | AT91C_TWI_STOP);
-        TWI_pfnStateMachine = TwiSM_ReceiveLastByte;
-      }
-      else
-      {
-        /* Multi-byte PDC-based receive */
-        TWI_Peripheral0.pBaseAddress->TWI_RPR = (u32)TWI_psMsgBufferCurrent->pu8RxBuffer;
-        TWI_Peripheral0.pBaseAddress->TWI_RCR = TWI_psMsgBufferCurrent->u32Size - 1;
-        TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_ENDRX;
-        TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_RXTEN;
-
-        /* Trigger the peripheral to start */
-        TWI_Peripheral0.pBaseAddress->TWI_CR = AT91C_TWI_START;
-
-        /* Proceed to receiving state*/
-        TWI_u32Timer = G_u32SystemTime1ms;
-        TWI_pfnStateMachine = TwiSM_PdcReceive;
-      }
-    } /* end TWI_READ */ 
-  } /* if(TWI_u8MsgQueueCount != 0) */  
-  
-} /* end TwiSM_Idle() */
-     
+@brief Returns the TWI_CWGR value to use for a transfer to a slave.
+
+Requires:
+@param u8SlaveAddress_ holds the target's IC address
+
+Promises:
+- Returns the slave's TwiSetSlaveSpeed() setting if it has one, otherwise TWI_u32BusCwgr
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TwiSM_Transmit(void)
-@brief Transmit in progress until until ISR clears _TWI_TRANSMITTING.
 */
-static void TwiSM_Transmit(void)
+static u32 TwiGetSlaveCwgr(u8 u8SlaveAddress_)
 {
-  /* Watch _TWI_TRANSMITTING to indicate transmit is complete */
-  if( !(TWI_Peripheral0.u32PrivateFlags & _TWI_TRANSMITTING) )
+  for(u8 i = 0; i < U8_TWI_SLAVE_SPEEDS; i++)
   {
-    /*  Clean up the Message task message */
-    UpdateMessageStatus(TWI_Peripheral0.pTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage(&TWI_Peripheral0.pTransmitBuffer);
-
-    
-    /* Advance states depending on whether TXCOMP is expected */
-    if(TWI_psMsgBufferCurrent->eStopType == TWI_STOP)
+    if(TWI_asSlaveSpeeds[i].u8Address == u8SlaveAddress_)
     {
-      /* If a STOP condition is requested, need to wait for TXCOMP */
-      TWI_pfnStateMachine = TwiSM_TxWaitComplete;
-    }
-    else
-    {
-      /* Otherwise leave the bus active */
-      TWI_u32Timer = U8_NEXT_TRANSFER_DELAY_MS;
-      TWI_pfnStateMachine = TwiSM_NextTransferDelay;
+      return(TWI_asSlaveSpeeds[i].u32Cwgr);
     }
   }
-    
-} /* end TwiSM_Transmit() */
+  
+  return(TWI_u32BusCwgr);
+  
+} /* end TwiGetSlaveCwgr() */
 
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TwiSM_TxWaitComplete(void)
-@brief Optional state to wait for the TXCOMP bit to be set (indicates STOP condition
-has been placed on the bus). Some Master transmit states will bypass this. */
-static void TwiSM_TxWaitComplete(void)
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u32 TwiQueueReadTask(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_)
+
+@brief Adds the TWI task entry for a read and issues its status token.
+
+Requires:
+@param u8SlaveAddress_ holds the target's IC address
+@param u8InternalAddress_ is the slave's internal address to start reading (0 for none)
+@param pu8RxBuffer_ has the space to save the data
+@param u32Size_ is the number of bytes to receive
+
+Promises:
+- The read is added at TWI_psMsgBufferNext with a new WAITING token and the buffer pointers are advanced
+- The read is started if the TWI is idle
+- If the system is initializing, the TWI task is cycled to finish the read
+- Returns the token, or 0 if TWI_asMessageBuffer is full
+
+*/
+static u32 TwiQueueReadTask(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_)
 {
-  /* Wait for TX to complete */
-  if(TWI_Peripheral0.pBaseAddress->TWI_SR & AT91C_TWI_TXCOMP_MASTER)
+  u32 u32Token;
+  
+  if(TWI_u8MsgQueueCount == U8_TWI_MSG_BUFFER_SIZE)
+  {
+    /* TWI Message Task Queue Full or the Tx transmit isn't complete */
+    return 0;
+  }
+  
+  /* The token is issued from task context like every other message token */
+  u32Token = MessageIssueTransferToken();
+  
+  /* Critical section: TWI buffer management must be done with interrutps off since 
+  an ISR can also manage the buffer values and pointers */
+  __disable_irq();
+
+  /* Queue Relevant data for TWI register setup */
+  TWI_psMsgBufferNext->u32MessageTaskToken = u32Token;
+  TWI_psMsgBufferNext->u32Cwgr = TwiGetSlaveCwgr(u8SlaveAddress_);
+  TWI_psMsgBufferNext->eDirection = TWI_READ;
+  TWI_psMsgBufferNext->u32Size = u32Size_;
+  TWI_psMsgBufferNext->u8Address = u8SlaveAddress_;
+  TWI_psMsgBufferNext->u8InternalAddress = u8InternalAddress_;
+  TWI_psMsgBufferNext->pu8RxBuffer = pu8RxBuffer_;
+  
+  /* Stop condition type does not apply for Rx */
+  TWI_psMsgBufferNext->eStopType = TWI_NA; 
+      
+  /* Update array indexers and size */
+  TWI_u8MsgQueueCount++;
+  TWI_psMsgBufferNext++;
+  if( TWI_psMsgBufferNext == &TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE] )
   {
-    /* Clear flags and advance states */  
-    TWI_u32Timer = U8_NEXT_TRANSFER_DELAY_MS;
-    TWI_pfnStateMachine = TwiSM_NextTransferDelay;
+    TWI_psMsgBufferNext = &TWI_asMessageBuffer[0];
   }
+  
+  /* Clear the new location to avoid confusion */
+  TWI_psMsgBufferNext->eDirection = TWI_EMPTY;
+  TWI_psMsgBufferNext->u32Size = 0;
+  TWI_psMsgBufferNext->u8Address = 0;
+  TWI_psMsgBufferNext->u8InternalAddress = 0;
+  TWI_psMsgBufferNext->pu8RxBuffer = NULL;
+  TWI_psMsgBufferNext->eStopType = TWI_NA; 
+  TWI_psMsgBufferNext->u32MessageTaskToken = 0;
+  TWI_psMsgBufferNext->u32Cwgr = 0;
+
+  /* Start the transfer now if the TWI is idle; otherwise the ISR starts it when its turn comes */
+  if( !(TWI_Peripheral0.u32PrivateFlags & (_TWI_TRANSMITTING | _TWI_RECEIVING)) )
+  {
+    TwiStartNextTransfer();
+  }
+
+  /* End of critical section */
+  __enable_irq();
     
-} /* end TwiSM_TxWaitComplete() */
+  /* If the system is initializing, wait for the transfer to finish */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    TwiManualMode();
+  }
 
+  return(u32Token);
+  
+} /* end TwiQueueReadTask() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TwiQueueWriteTask(u32 u32Token_, u8 u8SlaveAddress_, u32 u32Size_, TwiStopType eStop_)
+
+@brief Adds the TWI task entry for a write whose data has been queued in the message system.
+
+Requires:
+- TWI_asMessageBuffer has room for another entry
+
+@param u32Token_ is the message token of the queued data
+@param u8SlaveAddress_ holds the target's IC address
+@param u32Size_ is the number of bytes to send NOT including the address byte
+@param eStop_ is the type of operation
+
+Promises:
+- The write is added at TWI_psMsgBufferNext and the buffer pointers are advanced
+- The write is started if the TWI is idle
+- If the system is initializing, the TWI task is cycled to send the message
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TwiSM_PdcReceive(void)
-@brief Receive in progress through PDC until 1 byte remains.
-The ENDRX ISR is responsible for changing states to exit here.
 */
-static void TwiSM_PdcReceive(void)
+static void TwiQueueWriteTask(u32 u32Token_, u8 u8SlaveAddress_, u32 u32Size_, TwiStopType eStop_)
 {
-  if( IsTimeUp(&TWI_u32Timer, U32_RX_TIMEOUT_MS) )
+  /* Critical section: TWI buffer management must be done with interrutps off since 
+  an ISR can also manage the buffer values and pointers */
+  __disable_irq();
+
+  /* Queue Relevant data for TWI register setup */
+  TWI_psMsgBufferNext->u32MessageTaskToken = u32Token_;
+  TWI_psMsgBufferNext->u32Cwgr    = TwiGetSlaveCwgr(u8SlaveAddress_);
+  TWI_psMsgBufferNext->eDirection = TWI_WRITE;
+  TWI_psMsgBufferNext->u32Size    = u32Size_;
+  TWI_psMsgBufferNext->u8Address  = u8SlaveAddress_;
+  TWI_psMsgBufferNext->eStopType  = eStop_; 
+  
+  /* Not used by Transmit */
+  TWI_psMsgBufferNext->pu8RxBuffer = NULL;
+  
+  /* Update array pointers and size */
+  TWI_u8MsgQueueCount++;
+  TWI_psMsgBufferNext++;
+  if( TWI_psMsgBufferNext == &TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE] )
   {
-    TWI_u32Flags |= _TWI_ERROR_RX_TIMEOUT;
-    TWI_pfnStateMachine = TwiSM_Error;
+    TWI_psMsgBufferNext = &TWI_asMessageBuffer[0];
   }
-     
-} /* end TwiSM_PdcReceive() */
 
+  /* Clear the new location to avoid confusion */
+  TWI_psMsgBufferNext->eDirection  = TWI_EMPTY;
+  TWI_psMsgBufferNext->u32Size     = 0;
+  TWI_psMsgBufferNext->u8Address   = 0;
+  TWI_psMsgBufferNext->pu8RxBuffer = NULL;
+  TWI_psMsgBufferNext->eStopType   = TWI_NA; 
+  TWI_psMsgBufferNext->u8InternalAddress = 0;
+  TWI_psMsgBufferNext->u32MessageTaskToken = 0;
+  TWI_psMsgBufferNext->u32Cwgr     = 0;
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TwiSM_ReceiveLastByte(void)
-@brief Wait for RXRDY on the last byte transfer.
-*/
-static void TwiSM_ReceiveLastByte(void)
-{
-  if( (TWI_Peripheral0.pBaseAddress->TWI_SR) & AT91C_TWI_RXRDY )
+  /* Start the transfer now if the TWI is idle; otherwise the ISR starts it when its turn comes */
+  if( !(TWI_Peripheral0.u32PrivateFlags & (_TWI_TRANSMITTING | _TWI_RECEIVING)) )
   {
-    /* Read the final byte */
-    *(TWI_psMsgBufferCurrent->pu8RxBuffer + TWI_psMsgBufferCurrent->u32Size - 1) =  TWI_Peripheral0.pBaseAddress->TWI_RHR;
-    
-    TWI_pfnStateMachine = TwiSM_ReceiveComplete;
+    TwiStartNextTransfer();
+  }
+
+  /* End of critical section */
+  __enable_irq();
+
+  /* If the system is initializing, wait for the transfer to finish */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    TwiManualMode();
   }
   
-} /* end TwiSM_ReceiveLastByte() */
+} /* end TwiQueueWriteTask() */
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TwiStartNextTransfer(void)
 
+@brief Starts the transfer at TWI_psMsgBufferCurrent if there is one.
+
+Requires:
+- Called from the TWI ISR or with interrupts off
+- _TWI_TRANSMITTING and _TWI_RECEIVING are clear
+
+Promises:
+- If a transfer is queued, TWI_CWGR is loaded with its clock setting if needed, the peripheral and PDC are set up for it, _TWI_TRANSMITTING or 
+  _TWI_RECEIVING is set, the interrupt for its first step is enabled and TWI_u32Timer is started
+- If a write's token does not match the head of the transmit queue, _TWI_ERROR_TX_MSG_SYNC is set
+  and the state machine goes to Error
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TwiSM_ReceiveComplete(void)
-@brief Wait for final TXCOMP flag
 */
-static void TwiSM_ReceiveComplete(void)
+static void TwiStartNextTransfer(void)
 {
-  if( (TWI_Peripheral0.pBaseAddress->TWI_SR) & AT91C_TWI_TXCOMP_MASTER)
-  {   
-    /* Clear RX flag and advance states */
-    TWI_Peripheral0.u32PrivateFlags &= ~_TWI_RECEIVING;
-    
-    TWI_u32Timer = U8_NEXT_TRANSFER_DELAY_MS;
-    TWI_pfnStateMachine = TwiSM_NextTransferDelay;
+  u32 u32Byte;
+
+  if(TWI_u8MsgQueueCount == 0)
+  {
+    return;
+  }
+  
+  TWI_u32Timer = G_u32SystemTime1ms;
+  
+  /* The bus is idle between transfers so the clock can change for a slave with its own speed */
+  if(TWI_psMsgBufferCurrent->u32Cwgr != TWI_u32ActiveCwgr)
+  {
+    TWI_u32ActiveCwgr = TWI_psMsgBufferCurrent->u32Cwgr;
+    TWI_Peripheral0.pBaseAddress->TWI_CWGR = TWI_u32ActiveCwgr;
   }
-     
-} /* end TwiSM_ReceiveComplete() */
 
+  if(TWI_psMsgBufferCurrent->eDirection == TWI_WRITE)
+  {
+    TWI_Peripheral0.u32PrivateFlags |= _TWI_TRANSMITTING;
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TwiSM_NextTransferDelay(void)
-@brief Provide a delay before next transfer starts then do final clean-up before Idle. 
-*/
-static void TwiSM_NextTransferDelay(void)          
-{
-  TWI_u32Timer--;
+    /* Check that the local buffer Message token matches the message queued
+    and the transmit buffer */
+    if( (TWI_Peripheral0.sTransmitQueue.psHead == NULL) ||
+        (TWI_psMsgBufferCurrent->u32MessageTaskToken != TWI_Peripheral0.sTransmitQueue.psHead->u32Token) )
+    {
+      TWI_Peripheral0.u32PrivateFlags |= _TWI_ERROR_TX_MSG_SYNC;
+      TWI_pfnStateMachine = TwiSM_Error;
+      return;
+    }
+    
+    /* Update the message's status */
+    UpdateMessageStatus(TWI_Peripheral0.sTransmitQueue.psHead->u32Token, SENDING);
+
+    /* Set up to transmit the message */
+    u32Byte = (u32)(TWI_psMsgBufferCurrent->u8Address) << TWI_MMR_ADDRESS_SHIFT;
+    TWI_Peripheral0.pBaseAddress->TWI_MMR = u32Byte; 
+
+    /* Setup PDC and interrupts */
+    TWI_Peripheral0.pBaseAddress->TWI_TPR = (u32)TWI_Peripheral0.sTransmitQueue.psHead->pu8Message; 
+    TWI_Peripheral0.pBaseAddress->TWI_TCR = TWI_Peripheral0.sTransmitQueue.psHead->u32Size;
+
+    /* Enable Tx interrupt and the transmitter (triggers THR load) */
+    TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_ENDTX;
+    TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_TXTEN;
+         
+    /* Single byte transfers need STOP immediately (if applicable) */
+    if( (TWI_psMsgBufferCurrent->u32Size == 1) && (TWI_psMsgBufferCurrent->eStopType == TWI_STOP) )
+    {
+      TWI_Peripheral0.pBaseAddress->TWI_CR = AT91C_TWI_STOP;
+    }
+  } /* end TWI_WRITE */
   
-  if(TWI_u32Timer == 0)
+  else
   {
-    /* Clean up the local message queue (interrupts off, so not critical) */
-    TWI_u8MsgQueueCount--;
-    TWI_psMsgBufferCurrent++;
-    if(TWI_psMsgBufferCurrent == &TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE])
+    /* Update the read's status */
+    UpdateMessageStatus(TWI_psMsgBufferCurrent->u32MessageTaskToken, SENDING);
+
+    /* Set up for READ transaction */
+    u32Byte = AT91C_TWI_MREAD | (TWI_psMsgBufferCurrent->u8Address << TWI_MMR_ADDRESS_SHIFT);
+    TWI_Peripheral0.pBaseAddress->TWI_MMR = u32Byte; 
+    TWI_Peripheral0.u32PrivateFlags |= _TWI_RECEIVING;
+    
+    /* For WriteRead operation, also set the interal address otherwise make sure it is 0 */
+    if(TWI_psMsgBufferCurrent->u8InternalAddress != 0 )
+    {
+      TWI_Peripheral0.pBaseAddress->TWI_IADR = ((u32)(TWI_psMsgBufferCurrent->u8InternalAddress)) & 0x000000FF;
+      TWI_Peripheral0.pBaseAddress->TWI_MMR |= (1 << TWI_MMR_IADRZ_SHIFT);
+    }
+    else
     {
-      TWI_psMsgBufferCurrent = &TWI_asMessageBuffer[0];
+      TWI_Peripheral0.pBaseAddress->TWI_IADR = 0;
     }
 
-    /* Make sure _TWI_INIT_MODE flag is clear if no more messages in case this was a manual cycle */
-    if(TWI_u8MsgQueueCount == 0)
+    /* Set up to receive the message based on number of bytes */
+    if(TWI_psMsgBufferCurrent->u32Size == 1)
     {
-      TWI_u32Flags &= ~_TWI_INIT_MODE;
+      /* Single byte direct receive (no PDC required) */
+      TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_RXRDY;
+      TWI_Peripheral0.pBaseAddress->TWI_CR = (AT91C_TWI_START | AT91C_TWI_STOP);
     }
+    else
+    {
+      /* Multi-byte PDC-based receive */
+      TWI_Peripheral0.pBaseAddress->TWI_RPR = (u32)TWI_psMsgBufferCurrent->pu8RxBuffer;
+      TWI_Peripheral0.pBaseAddress->TWI_RCR = TWI_psMsgBufferCurrent->u32Size - 1;
+      TWI_Peripheral0.pBaseAddress->TWI_IER = AT91C_TWI_ENDRX;
+      TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_RXTEN;
+
+      /* Trigger the peripheral to start */
+      TWI_Peripheral0.pBaseAddress->TWI_CR = AT91C_TWI_START;
+    }
+  } /* end TWI_READ */ 
+  
+} /* end TwiStartNextTransfer() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TwiFinishTransfer(void)
+
+@brief Retires the transfer that just completed and starts the next one.
 
-    TWI_pfnStateMachine = TwiSM_Idle;
+Requires:
+- Called from the TWI ISR
+- The transfer at TWI_psMsgBufferCurrent is done on the bus
+
+Promises:
+- A write's message is COMPLETE and removed from the transmit queue; a read's token is COMPLETE
+- _TWI_TRANSMITTING / _TWI_RECEIVING are cleared, the local buffer is advanced and the next
+  queued transfer (if any) is started
+
+*/
+static void TwiFinishTransfer(void)
+{
+  if(TWI_Peripheral0.u32PrivateFlags & _TWI_TRANSMITTING)
+  {
+    FinishTxMessage(&TWI_Peripheral0.sTransmitQueue, COMPLETE);
+  }
+  else
+  {
+    UpdateMessageStatus(TWI_psMsgBufferCurrent->u32MessageTaskToken, COMPLETE);
   }
   
-} /* TwiSM_NextTransferDelay */
+  TWI_Peripheral0.u32PrivateFlags &= ~(_TWI_TRANSMITTING | _TWI_RECEIVING);
+  TwiAdvanceMessageBuffer();
+  TwiStartNextTransfer();
+  
+} /* end TwiFinishTransfer() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TwiAdvanceMessageBuffer(void)
 
+@brief Removes the entry at TWI_psMsgBufferCurrent from the local message buffer.
+
+Requires:
+- Called from the TWI ISR or with interrupts off
+- TWI_u8MsgQueueCount is not 0
+
+Promises:
+- TWI_u8MsgQueueCount is decremented and TWI_psMsgBufferCurrent points to the next entry
+
+*/
+static void TwiAdvanceMessageBuffer(void)
+{
+  TWI_u8MsgQueueCount--;
+  TWI_psMsgBufferCurrent++;
+  if(TWI_psMsgBufferCurrent == &TWI_asMessageBuffer[U8_TWI_MSG_BUFFER_SIZE])
+  {
+    TWI_psMsgBufferCurrent = &TWI_asMessageBuffer[0];
+  }
+  
+} /* end TwiAdvanceMessageBuffer() */
+
+
+/***********************************************************************************************************************
+State Machine Function Definitions
+
+Transfers are sequenced by TWI0_IrqHandler(), so the state machine only watches for a transfer that 
+stalls and cleans up after errors.
+***********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void TwiSM_Idle(void)
+@brief Watch the current transfer for a timeout.
+*/
+static void TwiSM_Idle(void)
+{
+  if( (TWI_Peripheral0.u32PrivateFlags & (_TWI_TRANSMITTING | _TWI_RECEIVING)) &&
+      IsTimeUp(&TWI_u32Timer, U32_TWI_TRANSFER_TIMEOUT_MS) )
+  {
+    /* Check again with interrupts off since the ISR may have just moved on to the next transfer */
+    __disable_irq();
+    if( (TWI_Peripheral0.u32PrivateFlags & (_TWI_TRANSMITTING | _TWI_RECEIVING)) &&
+        IsTimeUp(&TWI_u32Timer, U32_TWI_TRANSFER_TIMEOUT_MS) )
+    {
+      /* Stop the transfer and leave the busy flag set for TwiSM_Error() */
+      TWI_Peripheral0.pBaseAddress->TWI_IDR = TWI_TRANSFER_INTERRUPTS;
+      TWI_Peripheral0.pBaseAddress->TWI_PTCR = AT91C_PDC_TXTDIS | AT91C_PDC_RXTDIS;
+      
+      if(TWI_Peripheral0.u32PrivateFlags & _TWI_TRANSMITTING)
+      {
+        TWI_u32Flags |= _TWI_ERROR_TX_TIMEOUT;
+      }
+      else
+      {
+        TWI_u32Flags |= _TWI_ERROR_RX_TIMEOUT;
+      }
+      
+      TWI_pfnStateMachine = TwiSM_Error;
+    }
+    __enable_irq();
+  }
+  
+} /* end TwiSM_Idle() */
+     
 
 /*!-------------------------------------------------------------------------------------------------------------------
 @fn static void TwiSM_Error(void)
-@brief Handle an error 
+@brief Handle an error, drop the failed transfer and restart with the next one 
 */
 static void TwiSM_Error(void)          
 {
-  /* NACK recieved (write only) */
+  /* NACK recieved */
   if(TWI_u32Flags & _TWI_ERROR_NACK)
   {
     /* Announce the error and clear flag */
     TWI_u32Flags &= ~_TWI_ERROR_NACK;
-    DebugPrintNumber(TWI_Peripheral0.pTransmitBuffer->u32Token);
-    DebugPrintf(" TWI NACK. Message deleted.\n\r");
-    
-    /* Clear flags and clean up the Message task message */
-    UpdateMessageStatus(TWI_Peripheral0.pTransmitBuffer->u32Token, FAILED);
-    DeQueueMessage(&TWI_Peripheral0.pTransmitBuffer);
-    TWI_Peripheral0.u32PrivateFlags &= ~_TWI_TRANSMITTING;
+    if(TWI_Peripheral0.u32PrivateFlags & _TWI_TRANSMITTING)
+    {
+      DebugPrintNumber(TWI_Peripheral0.sTransmitQueue.psHead->u32Token);
+      DebugPrintf(" TWI NACK. Message deleted.\n\r");
+      
+      /* Clean up the Message task message */
+      FinishTxMessage(&TWI_Peripheral0.sTransmitQueue, FAILED);
+    }
+    else
+    {
+      DebugPrintf("TWI NACK on read.\n\r");
+      UpdateMessageStatus(TWI_psMsgBufferCurrent->u32MessageTaskToken, FAILED);
+    }
   }
   
-  /* RX TIMEOUT (receive only) */
+  /* TX TIMEOUT */
+  if(TWI_u32Flags & _TWI_ERROR_TX_TIMEOUT)
+  {
+    TWI_u32Flags &= ~_TWI_ERROR_TX_TIMEOUT;
+    DebugPrintf("TWI Tx Timeout. Message deleted.\n\r");
+    FinishTxMessage(&TWI_Peripheral0.sTransmitQueue, TIMEOUT);
+  }  
+
+  /* RX TIMEOUT */
   if(TWI_u32Flags & _TWI_ERROR_RX_TIMEOUT)
   {
+    TWI_u32Flags &= ~_TWI_ERROR_RX_TIMEOUT;
     DebugPrintf("TWI Rx Timeout. Message deleted.\n\r");
+    UpdateMessageStatus(TWI_psMsgBufferCurrent->u32MessageTaskToken, TIMEOUT);
   }  
 
-  /* Advance states */
-  TWI_u32Timer = U8_NEXT_TRANSFER_DELAY_MS;
-  TWI_pfnStateMachine = TwiSM_NextTransferDelay;
+  /* Local buffer and transmit queue out of sync: only the local entry is dropped */
+  if(TWI_Peripheral0.u32PrivateFlags & _TWI_ERROR_TX_MSG_SYNC)
+  {
+    TWI_Peripheral0.u32PrivateFlags &= ~_TWI_ERROR_TX_MSG_SYNC;
+    DebugPrintf("TWI transmit message out of sync!\n\r");
+  }
+
+  /* Drop the failed transfer and start the next one.  The state is set first since starting
+  the next transfer can report another error. */
+  TWI_pfnStateMachine = TwiSM_Idle;
+  
+  __disable_irq();
+  TWI_Peripheral0.u32PrivateFlags &= ~(_TWI_TRANSMITTING | _TWI_RECEIVING);
+  TwiAdvanceMessageBuffer();
+  TwiStartNextTransfer();
+  __enable_irq();
 
 } /* end TwiSM_Error() */
 
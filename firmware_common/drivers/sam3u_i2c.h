@@ -33,7 +33,7 @@ typedef enum {TWI_EMPTY, TWI_WRITE, TWI_READ} TwiDirectionType;
 typedef struct 
 {
   AT91PS_TWI pBaseAddress;             /*!< @brief Base address of the associated peripheral */
-  MessageType* pTransmitBuffer;        /*!< @brief Pointer to the transmit message struct linked list */
+  MessageQueueType sTransmitQueue;     /*!< @brief Transmit message queue */
   u32 u32PrivateFlags;                 /*!< @brief Private peripheral flags */
 } TwiPeripheralType;
 
@@ -51,7 +51,8 @@ typedef struct
 */
 typedef struct
 {
-  u32 u32MessageTaskToken;             /*!< @brief TX ONLY: Token corresponding to Message in message task */
+  u32 u32MessageTaskToken;             /*!< @brief Token of the Message task message (TX) or the read's status token (RX) */
+  u32 u32Cwgr;                         /*!< @brief TWI_CWGR value for the transfer (bus or slave speed) */
   u32 u32Size;                         /*!< @brief RX ONLY: Size of the transfer */
   u8* pu8RxBuffer;                     /*!< @brief RX ONLY: Pointer to receive buffer in user application */
   u8 u8Address;                        /*!< @brief Slave address */
@@ -62,6 +63,17 @@ typedef struct
 } TwiMessageQueueType;
 
 
+/*! 
+@struct TwiSlaveSpeedType
+@brief Speed of one slave that does not run at the bus speed 
+*/
+typedef struct
+{
+  u32 u32Cwgr;                         /*!< @brief TWI_CWGR value for transfers to the slave */
+  u8 u8Address;                        /*!< @brief Slave address (0 if the entry is free) */
+} TwiSlaveSpeedType;
+
+
 /**********************************************************************************************************************
 Constants / Definitions
 **********************************************************************************************************************/
@@ -70,21 +82,38 @@ Constants / Definitions
 
 #define _TWI_ERROR_NACK                (u32)0x01000000     /*!< @brief Set if a NACK is received */
 #define _TWI_ERROR_INTERRUPT           (u32)0x02000000     /*!< @brief Set if an unexpected interrupt occurs */
-#define _TWI_ERROR_RX_TIMEOUT          (u32)0x04000000     /*!< @brief Set if a NACK is received */
+#define _TWI_ERROR_RX_TIMEOUT          (u32)0x04000000     /*!< @brief Set if a read takes longer than U32_TWI_TRANSFER_TIMEOUT_MS */
+#define _TWI_ERROR_MANUAL_MODE_TIMEOUT (u32)0x08000000     /*!< @brief Set if TwiManualMode() gave up before the queue was empty */
+#define _TWI_ERROR_TX_TIMEOUT          (u32)0x10000000     /*!< @brief Set if a write takes longer than U32_TWI_TRANSFER_TIMEOUT_MS */
 
 #define TWI_ERROR_FLAG_MASK            (u32)0xFF000000     /*!< @brief AND to TWI_u32Flags to get just error flags */
 /* end of TWI_u32Flags */
 
 #define U8_TWI_MSG_BUFFER_SIZE         (u8)32              /*!< @brief Max number of messages in the TWI msg buffer */
 
-#define U8_NEXT_TRANSFER_DELAY_MS      (u8)1               /*!< @brief Time before next transfer will begin */
-#define U32_RX_TIMEOUT_MS              (u32)3000           /*!< @brief Max time allowed for Rx message */
+#define U32_TWI_TRANSFER_TIMEOUT_MS    (u32)3000           /*!< @brief Max time allowed for one read or write */
+#define U32_TWI_MANUAL_MODE_TIMEOUT_MS (u32)100            /*!< @brief Max time TwiManualMode() waits for the queued messages */
+
+#define U32_TWI_SPEED_100KHZ           (u32)100000         /*!< @brief Standard mode bus speed */
+#define U32_TWI_SPEED_400KHZ           (u32)400000         /*!< @brief Fast mode bus speed */
+#define U32_TWI_SPEED_MIN_HZ           (u32)1000           /*!< @brief Slowest speed TWI_CWGR can be set for */
+#define U32_TWI_SPEED_MAX_HZ           U32_TWI_SPEED_400KHZ /*!< @brief Fastest speed supported by the peripheral */
+#define U32_TWI_FAST_MODE_TLOW_NS      (u32)1300           /*!< @brief Minimum SCL low time of fast mode slaves */
+#define U8_TWI_SLAVE_SPEEDS            (u8)4               /*!< @brief Max number of slaves with their own speed */
 
 
 /*! @cond DOXYGEN_EXCLUDE */
+#define TWI_TRANSFER_INTERRUPTS        (u32)(AT91C_TWI_ENDTX | AT91C_TWI_ENDRX | AT91C_TWI_RXRDY | \
+                                             AT91C_TWI_TXRDY_MASTER | AT91C_TWI_TXCOMP_MASTER)  /* Interrupts used to step through a transfer */
 #define TWI_MMR_ADDRESS_SHIFT          (u8)16              /* Used with << to shift address to correct position in MMR */
 #define TWI_MMR_IADRZ_SHIFT            (u8)8               /* Used with << to shift address to correct position in MMR */
 
+#define TWI_CWGR_CKDIV_SHIFT           (u8)16              /* Used with << to shift CKDIV to correct position in CWGR */
+#define TWI_CWGR_CHDIV_SHIFT           (u8)8               /* Used with << to shift CHDIV to correct position in CWGR */
+#define TWI_CWGR_FIXED_CYCLES          (u32)4              /* MCK cycles added to each half of the SCL period */
+#define TWI_CWGR_DIV_MAX               (u32)255            /* Largest CLDIV / CHDIV value */
+#define TWI_CWGR_CKDIV_MAX             (u32)7              /* Largest CKDIV value */
+
 /*! @endcond */
 
 
@@ -96,9 +125,12 @@ Constants / Definitions
 /*-------------------------------------------------------------------------------------------------------------------*/
 /*! @publicsection */                                                                                            
 /*-------------------------------------------------------------------------------------------------------------------*/
-bool TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_);
-bool TwiWriteReadData(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_);
+u32 TwiReadData(u8 u8SlaveAddress_, u8* pu8RxBuffer_, u32 u32Size_);
+u32 TwiWriteReadData(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_);
 u32 TwiWriteData(u8 u8SlaveAddress_, u32 u32Size_, u8* pu8Data_, TwiStopType eStop_);
+u32 TwiWriteDataReference(u8 u8SlaveAddress_, u32 u32Size_, u8* pu8Data_, TwiStopType eStop_);
+bool TwiSetBusSpeed(u32 u32SpeedHz_);
+bool TwiSetSlaveSpeed(u8 u8SlaveAddress_, u32 u32SpeedHz_);
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -114,22 +146,19 @@ void TWI0_IrqHandler(void);
 /*-------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*-------------------------------------------------------------------------------------------------------------------*/
+static u32 TwiCalculateCwgr(u32 u32SpeedHz_);
+static u32 TwiGetSlaveCwgr(u8 u8SlaveAddress_);
+static u32 TwiQueueReadTask(u8 u8SlaveAddress_, u8 u8InternalAddress_, u8* pu8RxBuffer_, u32 u32Size_);
+static void TwiQueueWriteTask(u32 u32Token_, u8 u8SlaveAddress_, u32 u32Size_, TwiStopType eStop_);
+static void TwiStartNextTransfer(void);
+static void TwiFinishTransfer(void);
+static void TwiAdvanceMessageBuffer(void);
 
 
 /***********************************************************************************************************************
 State Machine Declarations
 ***********************************************************************************************************************/
 static void TwiSM_Idle(void);
-
-static void TwiSM_Transmit(void);
-static void TwiSM_TxWaitComplete(void);
-
-static void TwiSM_PdcReceive(void);
-static void TwiSM_ReceiveLastByte(void);
-static void TwiSM_ReceiveComplete(void);
-
-static void TwiSM_NextTransferDelay(void);       
-
 static void TwiSM_Error(void);         
 
 
@@ -1,7 +1,13 @@
 /*!**********************************************************************************************************************
 @file sam3u_spi.c                                                                
 @brief Provides a driver to use the dedicated SPI peripheral to send and 
-receive data using interrupts.
+receive data using the DMA controller or interrupts.
+
+The SAM3U SPI peripheral is not served by a PDC.  Instead, a Master with MSB-first
+data moves its transfers with two HDMA channels that are paced by the SPI hardware 
+handshaking interfaces, so an N-byte transfer costs a single HDMA interrupt.  
+LSB-first peripherals (the bits are flipped by the CPU as each byte is loaded) and 
+Slaves (circular receive buffer) use the original byte-by-byte TDRE/RDRF interrupts.
 
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
@@ -33,6 +39,7 @@ PROTECTED FUNCTIONS
 - void SpiRunActiveState(void)
 - void SpiManualMode(void)
 - void SPI0_IRQHandler(void)
+- void HDMA_IrqHandler(void)
 
 
 **********************************************************************************************************************/
@@ -83,10 +90,12 @@ If the resource is available, the transmit and receive parameters are set up
 and the peripheral is made ready to use in the application. The peripheral will be 
 configured in different ways for different SPI modes.  The following modes are supported:
 
-SPI_MASTER: transmit and receive using peripheral registers on byte-wise basis using 
+SPI_MASTER: transmit and receive using the HDMA channels if the bit order is
+SPI_MSB_FIRST, otherwise using peripheral registers on byte-wise basis using 
 interrupts.  Transmit is initiated through Message task.  Receive is based on
 queued Rx bytes.  Master receive is non-circular.  The Rx buffer is initialized
-to SPI_DUMMY_BYTE and is the source for the transmit dummies.
+to SPI_DUMMY_BYTE and is the source for the transmit dummies.  Bytes clocked in 
+during an HDMA transmit are discarded.
 
 SPI_SLAVE: transmit through peripheral registers on byte-wise basis using interrupts.
 Transmit is initiated through Message.  Receive set up per-byte using peripheral
@@ -136,6 +145,18 @@ SpiPeripheralType* SpiRequest(SpiConfigurationType* psSpiConfig_)
   SPI_Peripheral0.pBaseAddress->SPI_CSR[2] = SPI0_CSR2_INIT;
   SPI_Peripheral0.pBaseAddress->SPI_CSR[3] = SPI0_CSR3_INIT;
   
+  /* An MSB-first Master moves its data with the DMA controller */
+  if( (SPI_Peripheral0.eSpiMode == SPI_MASTER) && (SPI_Peripheral0.eBitOrder == SPI_MSB_FIRST) )
+  {
+    SPI_Peripheral0.u32PrivateFlags |= _SPI_PERIPHERAL_DMA;
+
+    AT91C_BASE_PMC->PMC_PCER |= (1 << AT91C_ID_HDMA);
+    AT91C_BASE_HDMA->HDMA_EN = AT91C_HDMA_ENABLE_ENABLE;
+    
+    NVIC_ClearPendingIRQ(IRQn_HDMA);
+    NVIC_EnableIRQ(IRQn_HDMA);
+  }
+  
   /* Special considerations for SPI Slaves */
   if(SPI_Peripheral0.eSpiMode == SPI_SLAVE)
   {
@@ -187,6 +208,14 @@ void SpiRelease(SpiPeripheralType* psSpiPeripheral_)
   /* Disable interrupts */
   NVIC_DisableIRQ( (IRQn_Type)(psSpiPeripheral_->u8PeripheralId) );
   NVIC_ClearPendingIRQ( (IRQn_Type)(psSpiPeripheral_->u8PeripheralId) );
+  
+  /* Stop any transfer on the HDMA channels */
+  if(psSpiPeripheral_->u32PrivateFlags & _SPI_PERIPHERAL_DMA)
+  {
+    SpiStopDma();
+    NVIC_DisableIRQ(IRQn_HDMA);
+    NVIC_ClearPendingIRQ(IRQn_HDMA);
+  }
  
   /* Now it's safe to release all of the resources in the target peripheral */
   psSpiPeripheral_->pCsGpioAddress  = NULL;
@@ -195,12 +224,16 @@ void SpiRelease(SpiPeripheralType* psSpiPeripheral_)
   psSpiPeripheral_->u32PrivateFlags = 0;
   
   /* Empty the transmit buffer if there were leftover messages */
-  while(psSpiPeripheral_->psTransmitBuffer != NULL)
+  while(psSpiPeripheral_->sTransmitQueue.psHead != NULL)
   {
-    UpdateMessageStatus(psSpiPeripheral_->psTransmitBuffer->u32Token, ABANDONED);
-    DeQueueMessage(&psSpiPeripheral_->psTransmitBuffer);
+    UpdateMessageStatus(psSpiPeripheral_->sTransmitQueue.psHead->u32Token, ABANDONED);
+    DeQueueTxMessage(&psSpiPeripheral_->sTransmitQueue);
   }
   
+  /* The next owner starts with default message priority and overflow policy */
+  MessageQueueSetPriority(&psSpiPeripheral_->sTransmitQueue, MSG_PRIORITY_NORMAL, 0);
+  MessageQueueSetOverflow(&psSpiPeripheral_->sTransmitQueue, MSG_OVERFLOW_DROP_LOWEST_PRIORITY);
+  
 } /* end SpiRelease() */
 
 
@@ -214,7 +247,7 @@ Requires:
 @param u8Byte_ is the byte to send
 
 Promises:
-- Creates a 1-byte message at psSpiPeripheral_->psTransmitBuffer that will be sent 
+- Creates a 1-byte message on psSpiPeripheral_->sTransmitQueue that will be sent 
   by the SPI application when it is available.
 - Returns the message token assigned to the message; 0 is returned if the message 
   cannot be queued in which case G_u32MessagingFlags can be checked for the reason
@@ -226,7 +259,7 @@ u32 SpiWriteByte(SpiPeripheralType* psSpiPeripheral_, u8 u8Byte_)
   u8 u8Data = u8Byte_;
   
   /* Attempt to queue message and get a response token */
-  u32Token = QueueMessage(&psSpiPeripheral_->psTransmitBuffer, 1, &u8Data);
+  u32Token = QueueTxMessage(&psSpiPeripheral_->sTransmitQueue, 1, &u8Data);
   if( u32Token != 0 )
   {
     /* If the system is initializing, we want to manually cycle the SPI task through one iteration
@@ -253,7 +286,7 @@ Requires:
 @param pu8Data_ points to the first byte of the data array
 
 Promises:
-- adds the data message at psSpiPeripheral_->psTransmitBuffer that will be sent by the SPI application
+- adds the data message to psSpiPeripheral_->sTransmitQueue that will be sent by the SPI application
   when it is available.
 - Returns the message token assigned to the message; 0 is returned if the message 
   cannot be queued in which case G_u32MessagingFlags can be checked for the reason
@@ -270,7 +303,7 @@ u32 SpiWriteData(SpiPeripheralType* psSpiPeripheral_, u32 u32Size_, u8* pu8Data_
   }
 
   /* Attempt to queue message and get a response token */
-  u32Token = QueueMessage(&psSpiPeripheral_->psTransmitBuffer, u32Size_, pu8Data_);
+  u32Token = QueueTxMessage(&psSpiPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
   if( u32Token == 0 )
   {
     return(0);
@@ -299,7 +332,7 @@ Requires:
 @param psSpiPeripheral_ is the SPI peripheral to use and it has already been requested.
 
 Promises:
-- Creates a message with one SPI_DUMMY_BYTE at psSpiPeripheral_->psTransmitBuffer that will be sent by the SPI application
+- Creates a message with one SPI_DUMMY_BYTE at psSpiPeripheral_->sTransmitQueue.psHead that will be sent by the SPI application
   when it is available and thus clock in a received byte to the target receive buffer.
 - Returns TRUE and loads the target SPI u16RxBytes
 
@@ -313,7 +346,7 @@ bool SpiReadByte(SpiPeripheralType* psSpiPeripheral_)
   }
 
   /* Make sure no Tx or Rx function is already in progress */
-  if( (psSpiPeripheral_->u16RxBytes != 0) || (psSpiPeripheral_->psTransmitBuffer != NULL) )
+  if( (psSpiPeripheral_->u16RxBytes != 0) || (psSpiPeripheral_->sTransmitQueue.psHead != NULL) )
   {
     return FALSE;
   }
@@ -350,7 +383,7 @@ bool SpiReadData(SpiPeripheralType* psSpiPeripheral_, u16 u16Size_)
   }
 
   /* Make sure no Tx or Rx function is already in progress */
-  if( (psSpiPeripheral_->u16RxBytes != 0) || (psSpiPeripheral_->psTransmitBuffer != NULL) )
+  if( (psSpiPeripheral_->u16RxBytes != 0) || (psSpiPeripheral_->sTransmitQueue.psHead != NULL) )
   {
     return FALSE;
   }
@@ -445,7 +478,7 @@ void SpiInitialize(void)
   SPI_Peripheral0.pBaseAddress     = AT91C_BASE_SPI0;
   SPI_Peripheral0.u8PeripheralId   = AT91C_ID_SPI0;
   SPI_Peripheral0.pCsGpioAddress   = NULL;
-  SPI_Peripheral0.psTransmitBuffer = NULL;
+  MessageQueueInitialize(&SPI_Peripheral0.sTransmitQueue, "SPI0");
   SPI_Peripheral0.pu8RxBuffer      = NULL;
   SPI_Peripheral0.u16RxBufferSize  = 0;
   SPI_Peripheral0.ppu8RxNextByte   = NULL;
@@ -495,7 +528,8 @@ Requires:
 - SPI application has been initialized.
 
 Promises:
-- All currently queued SPI Master transmit and receive operations are completed.
+- All currently queued SPI Master transmit and receive operations are completed, or 
+  _SPI_ERROR_MANUAL_MODE_TIMEOUT is set if they take longer than U32_SPI_MANUAL_MODE_TIMEOUT_MS
 
 */
 void SpiManualMode(void)
@@ -504,17 +538,25 @@ void SpiManualMode(void)
   
   /* Set up for manual mode */
   SPI_u32Flags |= _SPI_MANUAL_MODE;
+  u32Timer = G_u32SystemTime1ms;
 
-  /* Run the SPI state machine so all SPI peripherals send their current message */  
-  while(SPI_u32Flags & _SPI_MANUAL_MODE)
+  /* Run the SPI state machine until the Master transfers are done.  The HDMA or ISR moves 
+  the data, so the loop only polls and does not wait between passes. */  
+  while( SpiMasterTransferPending() )
   {
     WATCHDOG_BONE();
     Spi_pfnStateMachine();
     MessagingRunActiveState();
     
-    u32Timer = G_u32SystemTime1ms;
-    while( !IsTimeUp(&u32Timer, 1) );
+    if( IsTimeUp(&u32Timer, U32_SPI_MANUAL_MODE_TIMEOUT_MS) )
+    {
+      SPI_u32Flags |= _SPI_ERROR_MANUAL_MODE_TIMEOUT;
+      DebugPrintf("SPI manual mode timeout\n\r");
+      break;
+    }
   }
+  
+  SPI_u32Flags &= ~_SPI_MANUAL_MODE;
       
 } /* end SpiManualMode() */
 
@@ -620,8 +662,8 @@ void SPI0_IrqHandler(void)
       {
         SPI_Peripheral0.u32PrivateFlags &= ~_SPI_PERIPHERAL_TX;  
         G_u32Spi0ApplicationFlags |= _SPI_TX_COMPLETE; 
-        UpdateMessageStatus(SPI_Peripheral0.psTransmitBuffer->u32Token, COMPLETE);
-        DeQueueMessage(&SPI_Peripheral0.psTransmitBuffer);
+        UpdateMessageStatus(SPI_Peripheral0.sTransmitQueue.psHead->u32Token, COMPLETE);
+        DeQueueTxMessage(&SPI_Peripheral0.sTransmitQueue);
       }
     }
   } /* end AT91C_SPI_TDRE */
@@ -629,11 +671,193 @@ void SPI0_IrqHandler(void)
 } /* end SPI0_IrqHandler() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void HDMA_IrqHandler(void)
+
+@brief Handler for the end of an SPI transfer on the HDMA channels.
+
+Only the channel that finishes last has its interrupt enabled: the receive channel for 
+a Master receive and the transmit channel for a transmit.
+
+Requires:
+- The SPI driver is the only user of the HDMA
+
+Promises:
+- Receive: the received bytes are in the client's Rx buffer, *ppu8RxNextByte is moved past 
+  them, the peripheral is disabled and the receive is flagged complete
+- Transmit: the message is retired from the transmit queue.  The next fragment of a 
+  scatter-gather message is started right away; otherwise _SPI_TX_COMPLETE is set.
+- A channel access error ends the transfer and a transmit message is FAILED
+
+*/
+void HDMA_IrqHandler(void)
+{
+  u32 u32Status;
+  u32 u32Timeout;
+  MessageType* psNextFragment;
+  
+  /* Reading EBCISR clears it, so take one copy of the enabled sources */
+  u32Status = AT91C_BASE_HDMA->HDMA_EBCISR & AT91C_BASE_HDMA->HDMA_EBCIMR;
+  
+  /*** Master receive: the receive channel is the last to finish ***/
+  if( u32Status & (SPI_DMA_RX_CHANNEL_BIT | (SPI_DMA_RX_CHANNEL_BIT << SPI_DMA_ERROR_SHIFT)) )
+  {
+    SpiStopDma();
+    SPI_Peripheral0.pBaseAddress->SPI_CR = AT91C_SPI_SPIDIS;
+    
+    /* Advance the client's pointer past the new bytes */
+    *SPI_Peripheral0.ppu8RxNextByte += SPI_Peripheral0.u16RxBytes;
+    if( *SPI_Peripheral0.ppu8RxNextByte == (SPI_Peripheral0.pu8RxBuffer + (u32)SPI_Peripheral0.u16RxBufferSize) )
+    {
+      *SPI_Peripheral0.ppu8RxNextByte = SPI_Peripheral0.pu8RxBuffer;  
+    }
+
+    SPI_Peripheral0.u16RxBytes = 0;
+    SPI_Peripheral0.u32PrivateFlags &= ~(_SPI_PERIPHERAL_RX | _SPI_PERIPHERAL_DMA_ACTIVE);
+    if( !(u32Status & (SPI_DMA_RX_CHANNEL_BIT << SPI_DMA_ERROR_SHIFT)) )
+    {
+      SPI_Peripheral0.u32PrivateFlags |= _SPI_PERIPHERAL_RX_COMPLETE;
+      G_u32Spi0ApplicationFlags |= _SPI_RX_COMPLETE;
+    }
+  } /* end of receive handling */
+  
+  
+  /*** Transmit: the transmit channel has written the last byte to SPI_TDR ***/
+  if( u32Status & (SPI_DMA_TX_CHANNEL_BIT | (SPI_DMA_TX_CHANNEL_BIT << SPI_DMA_ERROR_SHIFT)) )
+  {
+    /* A failed message is dropped with any fragments that follow it */
+    if(u32Status & (SPI_DMA_TX_CHANNEL_BIT << SPI_DMA_ERROR_SHIFT))
+    {
+      SpiStopDma();
+      psNextFragment = FinishTxMessage(&SPI_Peripheral0.sTransmitQueue, FAILED);
+    }
+    else
+    {
+      /* Allow the peripheral to finish clocking out the last byte */
+      u32Timeout = 0;
+      while ( !(SPI_Peripheral0.pBaseAddress->SPI_SR & AT91C_SPI_TXEMPTY) && 
+              u32Timeout < SPI_TXEMPTY_TIMEOUT)
+      {
+        u32Timeout++;
+      } 
+      
+      psNextFragment = FinishTxMessage(&SPI_Peripheral0.sTransmitQueue, COMPLETE);
+    }
+    
+    /* Keep going with the next fragment of the same message */
+    if(psNextFragment != NULL)
+    {
+      SpiStartDmaChannel(SPI_DMA_TX_CHANNEL, SPI_DMA_TX_CHANNEL_BIT, 
+                         (u32)psNextFragment->pu8Message, (u32)AT91C_SPI0_TDR,
+                         (u16)psNextFragment->u32Size, SPI_DMA_TX_CTRLB_INIT, SPI_DMA_TX_CFG_INIT);
+    }
+    else
+    {
+      SpiStopDma();
+      SPI_Peripheral0.u32PrivateFlags &= ~(_SPI_PERIPHERAL_TX | _SPI_PERIPHERAL_DMA_ACTIVE);  
+      G_u32Spi0ApplicationFlags |= _SPI_TX_COMPLETE; 
+    }
+  } /* end of transmit handling */
+  
+} /* end HDMA_IrqHandler() */
+
+
 
 /*----------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*----------------------------------------------------------------------------------------------------------------------*/
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SpiStartDmaChannel(AT91PS_HDMA_CH pChannel_, u32 u32ChannelBit_, u32 u32Source_, u32 u32Destination_, 
+                                   u16 u16Size_, u32 u32CtrlB_, u32 u32Cfg_)
+
+@brief Programs one HDMA channel for a single buffer transfer and enables it.
+
+Requires:
+- The channel is disabled
+- The peripheral end of the transfer is paced by its hardware handshaking interface
+
+@param pChannel_ is SPI_DMA_TX_CHANNEL or SPI_DMA_RX_CHANNEL
+@param u32ChannelBit_ is the matching SPI_DMA_x_CHANNEL_BIT
+@param u32Source_ is the address the channel reads from
+@param u32Destination_ is the address the channel writes to
+@param u16Size_ is the number of bytes to move (not 0)
+@param u32CtrlB_ is SPI_DMA_TX_CTRLB_INIT or SPI_DMA_RX_CTRLB_INIT
+@param u32Cfg_ is SPI_DMA_TX_CFG_INIT or SPI_DMA_RX_CFG_INIT
+
+Promises:
+- The channel is moving u16Size_ bytes; its buffer complete status starts clear
+
+*/
+static void SpiStartDmaChannel(AT91PS_HDMA_CH pChannel_, u32 u32ChannelBit_, u32 u32Source_, u32 u32Destination_, 
+                               u16 u16Size_, u32 u32CtrlB_, u32 u32Cfg_)
+{
+  /* The channel must be off while it is programmed */
+  AT91C_BASE_HDMA->HDMA_CHDR = u32ChannelBit_;
+  while(AT91C_BASE_HDMA->HDMA_CHSR & u32ChannelBit_);
+  
+  pChannel_->HDMA_SADDR = u32Source_;
+  pChannel_->HDMA_DADDR = u32Destination_;
+  pChannel_->HDMA_DSCR  = 0;
+  pChannel_->HDMA_CTRLA = SPI_DMA_CTRLA_INIT | (u32)u16Size_;
+  pChannel_->HDMA_CTRLB = u32CtrlB_;
+  pChannel_->HDMA_CFG   = u32Cfg_;
+  
+  AT91C_BASE_HDMA->HDMA_CHER = u32ChannelBit_;
+  
+} /* end SpiStartDmaChannel() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SpiStopDma(void)
+
+@brief Disables both SPI HDMA channels and their interrupts.
+
+Requires:
+- NONE
+
+Promises:
+- SPI_DMA_TX_CHANNEL and SPI_DMA_RX_CHANNEL are disabled with no interrupts enabled
+
+*/
+static void SpiStopDma(void)
+{
+  u32 u32Channels = SPI_DMA_TX_CHANNEL_BIT | SPI_DMA_RX_CHANNEL_BIT;
+  
+  AT91C_BASE_HDMA->HDMA_EBCIDR = u32Channels | (u32Channels << SPI_DMA_ERROR_SHIFT);
+  AT91C_BASE_HDMA->HDMA_CHDR   = u32Channels;
+  
+} /* end SpiStopDma() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool SpiMasterTransferPending(void)
+
+@brief Checks if the SPI Master still has something to send or receive.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if SPI_Peripheral0 is an assigned Master with a queued message, bytes to receive 
+  or a transfer in progress
+
+*/
+static bool SpiMasterTransferPending(void)
+{
+  if( (SPI_Peripheral0.u32PrivateFlags & _SPI_PERIPHERAL_ASSIGNED) && 
+      (SPI_Peripheral0.eSpiMode == SPI_MASTER) &&
+      ( (SPI_Peripheral0.sTransmitQueue.psHead != NULL) || (SPI_Peripheral0.u16RxBytes != 0) ||
+        (SPI_Peripheral0.u32PrivateFlags & (_SPI_PERIPHERAL_TX | _SPI_PERIPHERAL_RX)) ) )
+  {
+    return TRUE;
+  }
+  
+  return FALSE;
+  
+} /* end SpiMasterTransferPending() */
+
+
 
 /***********************************************************************************************************************
 State Machine Function Definitions
@@ -654,7 +878,7 @@ static void SpiSM_Idle(void)
 {
   u32 u32Byte;
 
-  if( ( (SPI_Peripheral0.psTransmitBuffer != NULL) || (SPI_Peripheral0.u16RxBytes !=0) ) && 
+  if( ( (SPI_Peripheral0.sTransmitQueue.psHead != NULL) || (SPI_Peripheral0.u16RxBytes !=0) ) && 
      !(SPI_Peripheral0.u32PrivateFlags & (_SPI_PERIPHERAL_TX | _SPI_PERIPHERAL_RX) ) 
     )
   {
@@ -669,6 +893,32 @@ static void SpiSM_Idle(void)
       predictable dummy bytes since we'll point to this buffer to source the transmit dummies */
       memset(SPI_Peripheral0.pu8RxBuffer, SPI_DUMMY, SPI_Peripheral0.u16RxBufferSize);
       
+      /* The HDMA writes the bytes in one piece, so it can only be used if they do not wrap the 
+      end of the Rx buffer */
+      if( (SPI_Peripheral0.u32PrivateFlags & _SPI_PERIPHERAL_DMA) &&
+          ( (*SPI_Peripheral0.ppu8RxNextByte + SPI_Peripheral0.u16RxBytes) <= 
+            (SPI_Peripheral0.pu8RxBuffer + (u32)SPI_Peripheral0.u16RxBufferSize) ) )
+      {
+        SPI_Peripheral0.u32PrivateFlags |= _SPI_PERIPHERAL_DMA_ACTIVE;
+        
+        /* Enable the SPI peripheral and make sure RDR is clear */
+        SPI_Peripheral0.pBaseAddress->SPI_CR = AT91C_SPI_SPIEN;
+        u32Byte = SPI_Peripheral0.pBaseAddress->SPI_RDR;
+        
+        /* Start the receive channel first so it is ready for the first byte, then the dummies.  
+        The dummies come from the same bytes the receive channel fills, which it always reaches 
+        after they are sent.  Only the receive channel interrupts since it finishes last. */
+        SpiStartDmaChannel(SPI_DMA_RX_CHANNEL, SPI_DMA_RX_CHANNEL_BIT, 
+                           (u32)AT91C_SPI0_RDR, (u32)*SPI_Peripheral0.ppu8RxNextByte,
+                           SPI_Peripheral0.u16RxBytes, SPI_DMA_RX_CTRLB_INIT, SPI_DMA_RX_CFG_INIT);
+        (void)AT91C_BASE_HDMA->HDMA_EBCISR;
+        AT91C_BASE_HDMA->HDMA_EBCIER = SPI_DMA_RX_CHANNEL_BIT | (SPI_DMA_RX_CHANNEL_BIT << SPI_DMA_ERROR_SHIFT);
+        SpiStartDmaChannel(SPI_DMA_TX_CHANNEL, SPI_DMA_TX_CHANNEL_BIT, 
+                           (u32)*SPI_Peripheral0.ppu8RxNextByte, (u32)AT91C_SPI0_TDR,
+                           SPI_Peripheral0.u16RxBytes, SPI_DMA_TX_CTRLB_INIT, SPI_DMA_TX_CFG_INIT);
+        return;
+      }
+      
       /* Transmit drives the receive operation, so set it up */
       SPI_Peripheral0.u32CurrentTxBytesRemaining = SPI_Peripheral0.u16RxBytes;
       SPI_Peripheral0.pu8CurrentTxData = SPI_Peripheral0.pu8RxBuffer;
@@ -686,12 +936,26 @@ static void SpiSM_Idle(void)
     else
     {
       /* Transmitting: update the message's status and flag that the peripheral is now busy */
-      UpdateMessageStatus(SPI_Peripheral0.psTransmitBuffer->u32Token, SENDING);
+      UpdateMessageStatus(SPI_Peripheral0.sTransmitQueue.psHead->u32Token, SENDING);
       SPI_Peripheral0.u32PrivateFlags |= _SPI_PERIPHERAL_TX;    
       
+      /* The HDMA sends the whole message; the ISR chains any further fragments */
+      if(SPI_Peripheral0.u32PrivateFlags & _SPI_PERIPHERAL_DMA)
+      {
+        SPI_Peripheral0.u32PrivateFlags |= _SPI_PERIPHERAL_DMA_ACTIVE;
+        SPI_Peripheral0.pBaseAddress->SPI_CR = AT91C_SPI_SPIEN;
+        
+        (void)AT91C_BASE_HDMA->HDMA_EBCISR;
+        AT91C_BASE_HDMA->HDMA_EBCIER = SPI_DMA_TX_CHANNEL_BIT | (SPI_DMA_TX_CHANNEL_BIT << SPI_DMA_ERROR_SHIFT);
+        SpiStartDmaChannel(SPI_DMA_TX_CHANNEL, SPI_DMA_TX_CHANNEL_BIT, 
+                           (u32)SPI_Peripheral0.sTransmitQueue.psHead->pu8Message, (u32)AT91C_SPI0_TDR,
+                           (u16)SPI_Peripheral0.sTransmitQueue.psHead->u32Size, SPI_DMA_TX_CTRLB_INIT, SPI_DMA_TX_CFG_INIT);
+        return;
+      }
+      
       /* Load in the message parameters. */
-      SPI_Peripheral0.u32CurrentTxBytesRemaining = SPI_Peripheral0.psTransmitBuffer->u32Size;
-      SPI_Peripheral0.pu8CurrentTxData = SPI_Peripheral0.psTransmitBuffer->pu8Message;
+      SPI_Peripheral0.u32CurrentTxBytesRemaining = SPI_Peripheral0.sTransmitQueue.psHead->u32Size;
+      SPI_Peripheral0.pu8CurrentTxData = SPI_Peripheral0.sTransmitQueue.psHead->pu8Message;
        
       /* Load first byte.  If we need LSB first, use inline assembly to flip bits with a single instruction. */
       u32Byte = 0x000000FF &  *SPI_Peripheral0.pu8CurrentTxData;
@@ -66,7 +66,7 @@ typedef struct
   u8** ppu8RxNextByte;                /*!< @brief Pointer to buffer location where next received byte will be placed (SPI_SLAVE_FLOW_CONTROL only) */
   u16 u16RxBufferSize;                /*!< @brief Size of receive buffer in bytes */
   u16 u16RxBytes;                     /*!< @brief Number of bytes to receive */
-  MessageType* psTransmitBuffer;      /*!< @brief Pointer to the transmit message struct linked list */
+  MessageQueueType sTransmitQueue;    /*!< @brief Transmit message queue */
   u32 u32CurrentTxBytesRemaining;     /*!< @brief Counter for bytes remaining in current transfer */
   u8* pu8CurrentTxData;               /*!< @brief Pointer to current location in the Tx buffer */
 } SpiPeripheralType;
@@ -76,6 +76,8 @@ typedef struct
 #define _SPI_PERIPHERAL_TX            (u32)0x00200000    /*!< @brief Set when the peripheral is transmitting */
 #define _SPI_PERIPHERAL_RX            (u32)0x00400000    /*!< @brief Set when the peripheral is receiving */
 #define _SPI_PERIPHERAL_RX_COMPLETE   (u32)0x00800000    /*!< @brief Set when the peripheral is finished receiving */
+#define _SPI_PERIPHERAL_DMA           (u32)0x01000000    /*!< @brief Set when the peripheral can move data with the HDMA (MSB-first Master only) */
+#define _SPI_PERIPHERAL_DMA_ACTIVE    (u32)0x02000000    /*!< @brief Set while the current transfer is running on the HDMA channels */
 /* end u32PrivateFlags */
 
 
@@ -93,6 +95,7 @@ Constants / Definitions
 #define _SPI_MANUAL_MODE              (u32)0x00000001    /*!< @brief Set to push a cycle during initialization mode */
 
 #define _SPI_ERROR_INVALID_SPI        (u32)0x01000000    /*!< @brief Set if a function case switches to default */
+#define _SPI_ERROR_MANUAL_MODE_TIMEOUT (u32)0x02000000   /*!< @brief Set if SpiManualMode() gave up before the Master transfers finished */
 
 #define SPI_ERROR_FLAG_MASK           (u32)0xFF000000    /*!< @brief AND to SPI_u32Flags to get just error flags */
 /* end of SPI_u32Flags flags */
@@ -100,6 +103,30 @@ Constants / Definitions
 #define SPI_DUMMY                     (u8)0xAA           /*!< @brief Byte to send for dummy */
 
 #define SPI_TXEMPTY_TIMEOUT           (u32)100           /*!< @brief Instruction cycles of a while loop that waits for a register to clear */
+#define U32_SPI_MANUAL_MODE_TIMEOUT_MS (u32)100          /*!< @brief Max time SpiManualMode() waits for the Master transfers to finish */
+
+/* HDMA channels used by SPI0.  The SAM3U SPI has no PDC, so the DMA controller moves the data 
+using the SPI hardware handshaking interfaces. */
+#define SPI_DMA_TX_CHANNEL            AT91C_BASE_HDMA_CH_0  /*!< @brief HDMA channel that writes SPI_TDR */
+#define SPI_DMA_RX_CHANNEL            AT91C_BASE_HDMA_CH_1  /*!< @brief HDMA channel that reads SPI_RDR */
+#define SPI_DMA_TX_CHANNEL_BIT        (u32)0x00000001    /*!< @brief Channel 0 bit in HDMA_CHER/CHDR and BTC bit in HDMA_EBCIxR */
+#define SPI_DMA_RX_CHANNEL_BIT        (u32)0x00000002    /*!< @brief Channel 1 bit in HDMA_CHER/CHDR and BTC bit in HDMA_EBCIxR */
+#define SPI_DMA_ERROR_SHIFT           (u8)16             /*!< @brief Shift a channel bit by this to get its ERR bit in HDMA_EBCIxR */
+#define SPI_DMA_TX_HANDSHAKE          (u32)1             /*!< @brief HDMA hardware handshaking interface of the SPI transmitter */
+#define SPI_DMA_RX_HANDSHAKE          (u32)2             /*!< @brief HDMA hardware handshaking interface of the SPI receiver */
+
+#define SPI_DMA_CTRLA_INIT            (u32)(AT91C_HDMA_SCSIZE_1 | AT91C_HDMA_DCSIZE_1 | \
+                                            AT91C_HDMA_SRC_WIDTH_BYTE | AT91C_HDMA_DST_WIDTH_BYTE)
+#define SPI_DMA_TX_CTRLB_INIT         (u32)(AT91C_HDMA_SRC_DSCR_FETCH_DISABLE | AT91C_HDMA_DST_DSCR_FETCH_DISABLE | \
+                                            AT91C_HDMA_FC_MEM2PER | \
+                                            AT91C_HDMA_SRC_ADDRESS_MODE_INCR | AT91C_HDMA_DST_ADDRESS_MODE_FIXED)
+#define SPI_DMA_RX_CTRLB_INIT         (u32)(AT91C_HDMA_SRC_DSCR_FETCH_DISABLE | AT91C_HDMA_DST_DSCR_FETCH_DISABLE | \
+                                            AT91C_HDMA_FC_PER2MEM | \
+                                            AT91C_HDMA_SRC_ADDRESS_MODE_FIXED | AT91C_HDMA_DST_ADDRESS_MODE_INCR)
+#define SPI_DMA_TX_CFG_INIT           (u32)( (SPI_DMA_TX_HANDSHAKE << 4) | AT91C_HDMA_DST_H2SEL_HW | \
+                                             AT91C_HDMA_SOD_ENABLE | AT91C_HDMA_FIFOCFG_ENOUGHSPACE)
+#define SPI_DMA_RX_CFG_INIT           (u32)( SPI_DMA_RX_HANDSHAKE | AT91C_HDMA_SRC_H2SEL_HW | \
+                                             AT91C_HDMA_SOD_ENABLE | AT91C_HDMA_FIFOCFG_ENOUGHSPACE)
 
 
 /**********************************************************************************************************************
@@ -129,11 +156,16 @@ void SpiRunActiveState(void);
 void SpiManualMode(void);
 
 void SPI0_IrqHandler(void);
+void HDMA_IrqHandler(void);
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*-------------------------------------------------------------------------------------------------------------------*/
+static void SpiStartDmaChannel(AT91PS_HDMA_CH pChannel_, u32 u32ChannelBit_, u32 u32Source_, u32 u32Destination_, 
+                               u16 u16Size_, u32 u32CtrlB_, u32 u32Cfg_);
+static void SpiStopDma(void);
+static bool SpiMasterTransferPending(void);
 
 
 /***********************************************************************************************************************
@@ -48,6 +48,19 @@ To receive data from an SSP Slave, call SspReadByte() for a single
 byte or SspReadData() for multiple bytes.  These functions will automatically 
 queue SSP_DUMMY bytes to transmit and activate the clock.
 
+For a full-duplex transaction, e.g. a register-burst read where the command and 
+the data that comes back share one chip select, call SspTransfer().  Both PDC 
+channels run at once: bytes are sent from the caller's transmit buffer while the 
+bytes clocked in are written to the caller's receive buffer.  The transfer ends 
+with one ENDRX interrupt, which runs the caller's callback.
+
+Devices with a data/command select line (e.g. the A0 line of an LCD controller) 
+can send a whole command and data sequence in one chip select with 
+SspWriteSegments().  Give the line in pDcGpioAddress/u32DcPin of the configuration.  
+The ISR sets the line for each segment once the previous segment has completely 
+left the shift register, so the transaction costs one TXEMPTY interrupt per segment 
+and no trips through the SSP task.
+
 Received bytes on the allocated peripheral will be dropped into the application's 
 designated receive buffer.  The buffer is written circularly, with no provision 
 to monitor bytes that are overwritten.  The application is responsible for 
@@ -104,6 +117,7 @@ TYPES
 - SspBitOrderType
 - SspModeType
 - SspRxStatusType
+- SspSegmentType
 - SspConfigurationType
 - SspPeripheralType
 
@@ -114,11 +128,16 @@ PUBLIC FUNCTIONS
 - void SspDeAssertCS(SspPeripheralType* psSspPeripheral_)
 - u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_)
 - u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_)
+- u32 SspWriteDataReference(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_)
+- u32 SspWriteFragments(SspPeripheralType* psSspPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_)
 
 Master mode only:
 - bool SspReadByte(SspPeripheralType* psSspPeripheral_)
 - bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
 - SspRxStatusType SspQueryReceiveStatus(SspPeripheralType* psSspPeripheral_)
+- bool SspTransfer(SspPeripheralType* psSspPeripheral_, u8* pu8TxData_, u8* pu8RxData_, u16 u16Size_, fnCode_type fnCallback_)
+- bool SspWriteSegments(SspPeripheralType* psSspPeripheral_, SspSegmentType* psSegments_, u8 u8Segments_, fnCode_type fnCallback_)
+- void SspAbortSegments(SspPeripheralType* psSspPeripheral_)
 
 PROTECTED FUNCTIONS
 - void SspInitialize(void)
@@ -285,6 +304,8 @@ SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
   psRequestedSsp->u32PrivateFlags |= _SSP_PERIPHERAL_ASSIGNED;
   psRequestedSsp->fnSlaveTxFlowCallback = psSspConfig_->fnSlaveTxFlowCallback;
   psRequestedSsp->fnSlaveRxFlowCallback = psSspConfig_->fnSlaveRxFlowCallback;
+  psRequestedSsp->pDcGpioAddress   = psSspConfig_->pDcGpioAddress;
+  psRequestedSsp->u32DcPin         = psSspConfig_->u32DcPin;
    
   psRequestedSsp->pBaseAddress->US_CR   = u32TargetCR;
   psRequestedSsp->pBaseAddress->US_MR   = u32TargetMR;
@@ -369,14 +390,22 @@ void SspRelease(SspPeripheralType* psSspPeripheral_)
   
   psSspPeripheral_->fnSlaveTxFlowCallback = NULL;
   psSspPeripheral_->fnSlaveRxFlowCallback = NULL;
+  psSspPeripheral_->fnTransferCallback    = NULL;
+  psSspPeripheral_->u16RxBytes            = 0;
+  psSspPeripheral_->pDcGpioAddress        = NULL;
+  psSspPeripheral_->psSegment             = NULL;
+  psSspPeripheral_->u8SegmentsRemaining   = 0;
 
   /* Empty the transmit buffer if there were leftover messages */
-  while(psSspPeripheral_->psTransmitBuffer != NULL)
+  while(psSspPeripheral_->sTransmitQueue.psHead != NULL)
   {
-    UpdateMessageStatus(psSspPeripheral_->psTransmitBuffer->u32Token, ABANDONED);
-    DeQueueMessage(&psSspPeripheral_->psTransmitBuffer);
+    FinishTxMessage(&psSspPeripheral_->sTransmitQueue, ABANDONED);
   }
   
+  /* The next owner starts with default message priority and overflow policy */
+  MessageQueueSetPriority(&psSspPeripheral_->sTransmitQueue, MSG_PRIORITY_NORMAL, 0);
+  MessageQueueSetOverflow(&psSspPeripheral_->sTransmitQueue, MSG_OVERFLOW_DROP_LOWEST_PRIORITY);
+  
   /* Ensure the SM is in the Idle state */
   Ssp_pfnStateMachine = SspSM_Idle;
   
@@ -443,7 +472,7 @@ Requires:
 @param u8Byte_ is the byte to send
 
 Promises:
-- Creates a 1-byte message at psSspPeripheral_->psTransmitBuffer that will be sent 
+- Creates a 1-byte message on psSspPeripheral_->sTransmitQueue that will be sent 
   by the SSP application when it is available.
 - Returns the message token assigned to the message; 0 is returned if the message 
   cannot be queued in which case G_u32MessagingFlags can be checked for the reason
@@ -460,7 +489,7 @@ u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_)
     return(0);
   }
 
-  u32Token = QueueMessage(&psSspPeripheral_->psTransmitBuffer, 1, &u8Data);
+  u32Token = QueueTxMessage(&psSspPeripheral_->sTransmitQueue, 1, &u8Data);
   if( u32Token != 0 )
   {
     /* If the system is initializing, we want to manually cycle the SSP task through one iteration
@@ -489,7 +518,7 @@ Requires:
 @param pu8Data_ points to the first byte of the data array
 
 Promises:
-- adds the data message at psSspPeripheral_->psTransmitBuffer that will be sent by the SSP application
+- adds the data message to psSspPeripheral_->sTransmitQueue that will be sent by the SSP application
   when it is available.
 - Returns the message token assigned to the message; 0 is returned if the message 
   cannot be queued in which case G_u32MessagingFlags can be checked for the reason
@@ -505,7 +534,7 @@ u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_
     return(0);
   }
 
-  u32Token = QueueMessage(&psSspPeripheral_->psTransmitBuffer, u32Size_, pu8Data_);
+  u32Token = QueueTxMessage(&psSspPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
   if( u32Token == 0 )
   {
     return(0);
@@ -522,6 +551,106 @@ u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_
 } /* end SspWriteData() */
 
 
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 SspWriteDataReference(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_)
+
+@brief Queues a data array for transfer on the target SSP peripheral without copying it.  
+
+The SSP transfers directly from pu8Data_, so this is best for constant data or buffers the 
+caller already keeps until the message is sent (e.g. an LCD page buffer).
+
+Requires:
+- A receive request cannot be in progress
+
+@param psSspPeripheral_ is the SSP peripheral to use and it has already been requested.
+@param u32Size_ is the number of bytes in the data array
+@param pu8Data_ points to the first byte of the data array which must not change until the message
+       status is no longer WAITING or SENDING
+
+Promises:
+- adds a message referencing pu8Data_ to psSspPeripheral_->sTransmitQueue that will be sent by the 
+  SSP application when it is available.
+- Returns the message token assigned to the message; 0 is returned if the message 
+  cannot be queued in which case G_u32MessagingFlags can be checked for the reason
+
+*/
+u32 SspWriteDataReference(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_)
+{
+  u32 u32Token;
+
+  /* Make sure no receive function is already in progress based on the bytes in the buffer */
+  if( psSspPeripheral_->u16RxBytes != 0)
+  {
+    return(0);
+  }
+
+  u32Token = QueueTxMessageReference(&psSspPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
+  if( u32Token == 0 )
+  {
+    return(0);
+  }
+  
+  /* If the system is initializing, manually cycle the SSP task through one iteration to send the message */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    SspManualMode();
+  }
+
+  return(u32Token);
+
+} /* end SspWriteDataReference() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 SspWriteFragments(SspPeripheralType* psSspPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+
+@brief Queues a list of fragments that the target SSP peripheral sends as one message.  
+
+Master peripherals chain the fragments through the PDC next pointer registers so they are
+clocked out back-to-back within one chip select.  See QueueTxMessageFragments() for the rules 
+on fragment data.
+
+Requires:
+- A receive request cannot be in progress
+
+@param psSspPeripheral_ is the SSP peripheral to use and it has already been requested.
+@param psFragments_ points to the list of fragments in the order they are sent
+@param u8Fragments_ is the number of fragments in the list
+
+Promises:
+- adds the fragments to psSspPeripheral_->sTransmitQueue that will be sent by the SSP 
+  application when it is available.
+- Returns the one message token assigned to all of the fragments; 0 is returned if the message 
+  cannot be queued in which case G_u32MessagingFlags can be checked for the reason
+
+*/
+u32 SspWriteFragments(SspPeripheralType* psSspPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+{
+  u32 u32Token;
+
+  /* Make sure no receive function is already in progress based on the bytes in the buffer */
+  if( psSspPeripheral_->u16RxBytes != 0)
+  {
+    return(0);
+  }
+
+  u32Token = QueueTxMessageFragments(&psSspPeripheral_->sTransmitQueue, psFragments_, u8Fragments_);
+  if( u32Token == 0 )
+  {
+    return(0);
+  }
+  
+  /* If the system is initializing, manually cycle the SSP task through one iteration to send the message */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    SspManualMode();
+  }
+
+  return(u32Token);
+
+} /* end SspWriteFragments() */
+
+
 /*!--------------------------------------------------------------------------------------------------------------------
 @fn bool SspReadByte(SspPeripheralType* psSspPeripheral_)
 
@@ -534,7 +663,7 @@ Requires:
 @param psSspPeripheral_ is the SSP peripheral to use and it has already been requested.
 
 Promises:
-- Creates a message with one SSP_DUMMY_BYTE at psSspPeripheral_->psTransmitBuffer that will be sent by the SSP application
+- Creates a message with one SSP_DUMMY_BYTE at psSspPeripheral_->sTransmitQueue.psHead that will be sent by the SSP application
   when it is available and thus clock in a received byte to the target receive buffer.
 - Returns TRUE and loads the target SSP u16RxBytes
 
@@ -549,7 +678,7 @@ bool SspReadByte(SspPeripheralType* psSspPeripheral_)
   }
 
   /* Make sure no Tx or Rx function is already in progress */
-  if( (psSspPeripheral_->u16RxBytes != 0) || (psSspPeripheral_->psTransmitBuffer != NULL) )
+  if( (psSspPeripheral_->u16RxBytes != 0) || (psSspPeripheral_->sTransmitQueue.psHead != NULL) )
   {
     return FALSE;
   }
@@ -587,7 +716,7 @@ bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_)
   }
 
   /* Make sure no Tx or Rx function is already in progress */
-  if( (psSspPeripheral_->u16RxBytes != 0) || (psSspPeripheral_->psTransmitBuffer != NULL) )
+  if( (psSspPeripheral_->u16RxBytes != 0) || (psSspPeripheral_->sTransmitQueue.psHead != NULL) )
   {
     return FALSE;
   }
@@ -658,6 +787,198 @@ SspRxStatusType SspQueryReceiveStatus(SspPeripheralType* psSspPeripheral_)
 } /* end SspQueryReceiveStatus() */
 
 
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn bool SspTransfer(SspPeripheralType* psSspPeripheral_, u8* pu8TxData_, u8* pu8RxData_, u16 u16Size_, fnCode_type fnCallback_)
+
+@brief Master mode only. Prepares a full-duplex transfer that sends and receives u16Size_ bytes at once.  
+
+Both PDC channels are programmed when the SSP task starts the transfer: pu8TxData_ is clocked out 
+while the bytes that come back are written to pu8RxData_.  For SSP_MASTER_AUTO_CS, chip select is 
+asserted for the whole transfer and released when it is done.  The transfer finishes with a single 
+ENDRX interrupt, at which point the status reads SSP_RX_COMPLETE and fnCallback_ is called.
+
+Example (read 6 bytes starting at sensor register 0x28):
+static u8 au8Command[7] = {0x80 | 0x28};
+static u8 au8Response[7];
+
+SspTransfer(psSensorSsp, au8Command, au8Response, sizeof(au8Command), SensorReadDone);
+... au8Response[1..6] hold the register values when SensorReadDone() runs
+
+Requires:
+- Master mode 
+
+@param psSspPeripheral_ is the SSP peripheral to use and it has already been requested.
+@param pu8TxData_ holds u16Size_ bytes to send; NULL sends SSP_DUMMY_BYTE (the receive buffer is
+       filled with dummies first and sent).  It must not change until the transfer is done.
+@param pu8RxData_ receives u16Size_ bytes; it must not be used until the transfer is done.
+@param u16Size_ is the number of bytes to send and receive (1 to U16_MAX_TX_MESSAGE_LENGTH)
+@param fnCallback_ is called from the SSP ISR when the transfer is done (NULL for none)
+
+Promises:
+- Returns FALSE if the peripheral is not a Master, is busy, or the parameters are invalid
+- Returns TRUE and the transfer starts the next time the SSP task services the peripheral
+
+*/
+bool SspTransfer(SspPeripheralType* psSspPeripheral_, u8* pu8TxData_, u8* pu8RxData_, u16 u16Size_, fnCode_type fnCallback_)
+{
+  /* Confirm Master Mode */
+  if( (psSspPeripheral_->eSspMode == SSP_SLAVE) || 
+      (psSspPeripheral_->eSspMode == SSP_SLAVE_FLOW_CONTROL) )
+  {
+    return FALSE;
+  }
+
+  /* Make sure no Tx or Rx function is already in progress */
+  if( (psSspPeripheral_->u16RxBytes != 0) || (psSspPeripheral_->sTransmitQueue.psHead != NULL) )
+  {
+    return FALSE;
+  }
+
+  if( (pu8RxData_ == NULL) || (u16Size_ == 0) || (u16Size_ > U16_MAX_TX_MESSAGE_LENGTH) )
+  {
+    return FALSE;
+  }
+  
+  /* Load the transfer and return success; the counter is loaded last since it starts the transfer */
+  psSspPeripheral_->pu8TransferTxData  = pu8TxData_;
+  psSspPeripheral_->pu8TransferRxData  = pu8RxData_;
+  psSspPeripheral_->fnTransferCallback = fnCallback_;
+  psSspPeripheral_->u32PrivateFlags   |= _SSP_PERIPHERAL_TRANSFER;
+  psSspPeripheral_->u16RxBytes         = u16Size_;
+  return TRUE;
+  
+} /* end SspTransfer() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn bool SspWriteSegments(SspPeripheralType* psSspPeripheral_, SspSegmentType* psSegments_, u8 u8Segments_, fnCode_type fnCallback_)
+
+@brief Master mode only. Prepares a transaction that sends several segments in one chip select and 
+switches the data/command select line between them.
+
+Each segment goes out through the PDC.  When the last bit of a segment has been shifted out, the ISR 
+sets the data/command line for the next segment and starts it, so the device never sees the line 
+change in the middle of a byte.  The received bytes are discarded.  fnCallback_ is called from the 
+ISR when the last segment is done.
+
+Example (set the page and column address of an LCD, then write the page):
+static SspSegmentType asPage[2] = { {au8Address, 3, FALSE}, {au8PageData, 128, TRUE} };
+
+SspWriteSegments(psLcdSsp, asPage, 2, LcdPageDone);
+
+Requires:
+- Master mode with a data/command select line in the configuration
+
+@param psSspPeripheral_ is the SSP peripheral to use and it has already been requested.
+@param psSegments_ points to u8Segments_ segments; the segments and their data must not change until 
+       the transaction is done
+@param u8Segments_ is the number of segments (at least 1)
+@param fnCallback_ is called from the SSP ISR when the transaction is done (NULL for none)
+
+Promises:
+- Returns FALSE if the peripheral is not a Master, has no data/command line, is busy, or a segment 
+  is empty
+- Returns TRUE and the transaction starts the next time the SSP task services the peripheral
+
+*/
+bool SspWriteSegments(SspPeripheralType* psSspPeripheral_, SspSegmentType* psSegments_, u8 u8Segments_, fnCode_type fnCallback_)
+{
+  /* Confirm Master Mode with a data/command line */
+  if( (psSspPeripheral_->eSspMode == SSP_SLAVE) || 
+      (psSspPeripheral_->eSspMode == SSP_SLAVE_FLOW_CONTROL) ||
+      (psSspPeripheral_->pDcGpioAddress == NULL) )
+  {
+    return FALSE;
+  }
+
+  /* Make sure no Tx or Rx function is already in progress */
+  if( (psSspPeripheral_->u16RxBytes != 0) || (psSspPeripheral_->sTransmitQueue.psHead != NULL) ||
+      (psSspPeripheral_->u32PrivateFlags & _SSP_PERIPHERAL_SEGMENTS) )
+  {
+    return FALSE;
+  }
+
+  if( (psSegments_ == NULL) || (u8Segments_ == 0) )
+  {
+    return FALSE;
+  }
+  
+  for(u8 i = 0; i < u8Segments_; i++)
+  {
+    if( (psSegments_[i].pu8Data == NULL) || (psSegments_[i].u16Size == 0) )
+    {
+      return FALSE;
+    }
+  }
+  
+  /* Load the transaction and return success; the flag is set last since it starts the transaction */
+  psSspPeripheral_->psSegment           = psSegments_;
+  psSspPeripheral_->u8SegmentsRemaining = u8Segments_;
+  psSspPeripheral_->fnTransferCallback  = fnCallback_;
+  psSspPeripheral_->u32PrivateFlags    |= _SSP_PERIPHERAL_SEGMENTS;
+  
+  /* If the system is initializing, manually cycle the SSP task through one iteration to start the transaction */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    SspManualMode();
+  }
+
+  return TRUE;
+  
+} /* end SspWriteSegments() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void SspAbortSegments(SspPeripheralType* psSspPeripheral_)
+
+@brief Master mode only. Stops an SspWriteSegments() transaction that has not finished so the 
+caller can reuse its segments and data.
+
+The caller decides when a transaction has taken too long; the SSP task has no timeout of its own
+for segments.  The peripheral interrupt is held off while the transaction is torn down so the ISR
+cannot load another segment or call the callback part way through.
+
+Requires:
+- Called from task context, not from an SSP callback
+
+@param psSspPeripheral_ is the SSP peripheral that was given the transaction
+
+Promises:
+- If a segment is on the wire, the PDC transmitter is stopped, TXEMPTY is disabled and an 
+  SSP_MASTER_AUTO_CS chip select is released
+- The transaction is cleared and its callback is NOT called
+- Does nothing if no segment transaction is pending
+
+*/
+void SspAbortSegments(SspPeripheralType* psSspPeripheral_)
+{
+  if( !(psSspPeripheral_->u32PrivateFlags & _SSP_PERIPHERAL_SEGMENTS) )
+  {
+    return;
+  }
+  
+  NVIC_DisableIRQ( (IRQn_Type)(psSspPeripheral_->u8PeripheralId) );
+
+  if(psSspPeripheral_->u32PrivateFlags & _SSP_PERIPHERAL_SEGMENTS_TX)
+  {
+    psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+    psSspPeripheral_->pBaseAddress->US_IDR  = AT91C_US_TXEMPTY;
+    if(psSspPeripheral_->eSspMode == SSP_MASTER_AUTO_CS)
+    {
+      psSspPeripheral_->pCsGpioAddress->PIO_SODR = psSspPeripheral_->u32CsPin;
+    }
+  }
+  
+  psSspPeripheral_->psSegment           = NULL;
+  psSspPeripheral_->u8SegmentsRemaining = 0;
+  psSspPeripheral_->fnTransferCallback  = NULL;
+  psSspPeripheral_->u32PrivateFlags    &= ~(_SSP_PERIPHERAL_SEGMENTS | _SSP_PERIPHERAL_SEGMENTS_TX);
+  
+  NVIC_EnableIRQ( (IRQn_Type)(psSspPeripheral_->u8PeripheralId) );
+  
+} /* end SspAbortSegments() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -683,28 +1004,37 @@ void SspInitialize(void)
   SSP_Peripheral0.pBaseAddress     = AT91C_BASE_US0;
   SSP_Peripheral0.u8PeripheralId   = AT91C_ID_US0;
   SSP_Peripheral0.pCsGpioAddress   = NULL;
-  SSP_Peripheral0.psTransmitBuffer = NULL;
+  MessageQueueInitialize(&SSP_Peripheral0.sTransmitQueue, "SSP0");
   SSP_Peripheral0.pu8RxBuffer      = NULL;
   SSP_Peripheral0.u16RxBufferSize  = 0;
   SSP_Peripheral0.ppu8RxNextByte   = NULL;
+  SSP_Peripheral0.fnTransferCallback = NULL;
+  SSP_Peripheral0.pDcGpioAddress   = NULL;
+  SSP_Peripheral0.psSegment        = NULL;
   SSP_Peripheral0.u32PrivateFlags  = 0;
   
   SSP_Peripheral1.pBaseAddress     = AT91C_BASE_US1;
   SSP_Peripheral1.u8PeripheralId   = AT91C_ID_US1;
   SSP_Peripheral1.pCsGpioAddress   = NULL;
-  SSP_Peripheral1.psTransmitBuffer = NULL;
+  MessageQueueInitialize(&SSP_Peripheral1.sTransmitQueue, "SSP1");
   SSP_Peripheral1.pu8RxBuffer      = NULL;
   SSP_Peripheral1.u16RxBufferSize  = 0;
   SSP_Peripheral1.ppu8RxNextByte   = NULL;
+  SSP_Peripheral1.fnTransferCallback = NULL;
+  SSP_Peripheral1.pDcGpioAddress   = NULL;
+  SSP_Peripheral1.psSegment        = NULL;
   SSP_Peripheral1.u32PrivateFlags  = 0;
 
   SSP_Peripheral2.pBaseAddress     = AT91C_BASE_US2;
   SSP_Peripheral2.u8PeripheralId   = AT91C_ID_US2;
   SSP_Peripheral2.pCsGpioAddress   = NULL;
-  SSP_Peripheral2.psTransmitBuffer = NULL;
+  MessageQueueInitialize(&SSP_Peripheral2.sTransmitQueue, "SSP2");
   SSP_Peripheral2.pu8RxBuffer      = NULL;
   SSP_Peripheral2.u16RxBufferSize  = 0;
   SSP_Peripheral2.ppu8RxNextByte   = NULL;
+  SSP_Peripheral2.fnTransferCallback = NULL;
+  SSP_Peripheral2.pDcGpioAddress   = NULL;
+  SSP_Peripheral2.psSegment        = NULL;
   SSP_Peripheral2.u32PrivateFlags  = 0;
 
   /* Init starting SSP and clear all flags */
@@ -754,7 +1084,8 @@ Requires:
 - SSP application has been initialized.
 
 Promises:
-- All currently queued SSP Master transmit and receive operations are completed.
+- All currently queued SSP Master transmit and receive operations are completed, or 
+  _SSP_ERROR_MANUAL_MODE_TIMEOUT is set if they take longer than U32_SSP_MANUAL_MODE_TIMEOUT_MS
 
 */
 void SspManualMode(void)
@@ -764,16 +1095,24 @@ void SspManualMode(void)
   /* Set up for manual mode */
   SSP_u32Flags |= _SSP_MANUAL_MODE;
   SSP_psCurrentSsp = &SSP_Peripheral0;
+  u32Timer = G_u32SystemTime1ms;
 
-  /* Run the SSP state machine so all SSP peripherals send their current message */  
-  while(SSP_u32Flags & _SSP_MANUAL_MODE)
+  /* Run the SSP state machine until every peripheral has been visited and the Master transfers
+  are done.  The PDC and ISR move the data, so the loop only polls and does not wait between passes.
+  Slaves are not waited on since their transfers depend on the other device. */  
+  while( (SSP_u32Flags & _SSP_MANUAL_MODE) || SspMasterTransfersPending() )
   {
     WATCHDOG_BONE();
     Ssp_pfnStateMachine();
     MessagingRunActiveState();
     
-    u32Timer = G_u32SystemTime1ms;
-    while( !IsTimeUp(&u32Timer, 1) );
+    if( IsTimeUp(&u32Timer, U32_SSP_MANUAL_MODE_TIMEOUT_MS) )
+    {
+      SSP_u32Flags &= ~_SSP_MANUAL_MODE;
+      SSP_u32Flags |= _SSP_ERROR_MANUAL_MODE_TIMEOUT;
+      DebugPrintf("SSP manual mode timeout\n\r");
+      break;
+    }
   }
       
 } /* end SspManualMode() */
@@ -896,6 +1235,8 @@ static void SspGenericHandler(void)
   u32 u32Byte;
   u32 u32Timeout;
   u32 u32Current_CSR;
+  bool bTransferDone;
+  MessageType* psNextFragment;
   
   /* Get a copy of CSR because reading it changes it */
   u32Current_CSR = SSP_psCurrentISR->pBaseAddress->US_CSR;
@@ -915,7 +1256,7 @@ static void SspGenericHandler(void)
       /* If a no flow control Slave is receiving, then it should be ready to respond with dummy bytes */
       if(SSP_psCurrentISR->eSspMode == SSP_SLAVE)
       {
-        if(SSP_psCurrentISR->psTransmitBuffer == NULL)
+        if(SSP_psCurrentISR->sTransmitQueue.psHead == NULL)
         {
           SSP_psCurrentISR->pBaseAddress->US_THR = SSP_DUMMY_BYTE;
         }
@@ -940,8 +1281,7 @@ static void SspGenericHandler(void)
         SSP_psCurrentISR->pBaseAddress->US_IDR = AT91C_US_ENDTX;
         
         SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;  
-        UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, ABANDONED);
-        DeQueueMessage(&SSP_psCurrentISR->psTransmitBuffer);
+        FinishTxMessage(&SSP_psCurrentISR->sTransmitQueue, ABANDONED);
    
         *SSP_pu32SspApplicationFlagsISR |= _SSP_TX_COMPLETE; 
         
@@ -966,8 +1306,48 @@ static void SspGenericHandler(void)
   } /* end CS change state interrupt */
 
   
+  /*** SSP ISR segment handling for SspWriteSegments() transactions (Master only) ***/
+  if( (SSP_psCurrentISR->u32PrivateFlags & _SSP_PERIPHERAL_SEGMENTS_TX) &&
+      (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_TXEMPTY) && 
+      (u32Current_CSR & AT91C_US_TXEMPTY) )
+  {
+    /* TXEMPTY with TCR = 0 means the whole segment is on the wire.  If TCR is not 0 the PDC has 
+    not loaded the first byte of the segment yet, so wait for the next interrupt. */
+    if(SSP_psCurrentISR->pBaseAddress->US_TCR == 0)
+    {
+      SSP_psCurrentISR->psSegment++;
+      SSP_psCurrentISR->u8SegmentsRemaining--;
+      
+      if(SSP_psCurrentISR->u8SegmentsRemaining != 0)
+      {
+        SspLoadSegment(SSP_psCurrentISR);
+      }
+      else
+      {
+        /* Done: stop the transmitter and release chip select */
+        SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+        SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_TXEMPTY;
+        if(SSP_psCurrentISR->eSspMode == SSP_MASTER_AUTO_CS)
+        {
+          SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+        }
+        
+        SSP_psCurrentISR->psSegment = NULL;
+        SSP_psCurrentISR->u32PrivateFlags &= ~(_SSP_PERIPHERAL_SEGMENTS | _SSP_PERIPHERAL_SEGMENTS_TX);
+        *SSP_pu32SspApplicationFlagsISR |= _SSP_TX_COMPLETE; 
+
+        if(SSP_psCurrentISR->fnTransferCallback != NULL)
+        {
+          SSP_psCurrentISR->fnTransferCallback();
+        }
+      }
+    }
+  } /* end of segment handling */
+  
+  
   /*** SSP ISR transmit handling for flow-control devices that do not use DMA ***/
-  if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_TXEMPTY) && 
+  if( (SSP_psCurrentISR->eSspMode == SSP_SLAVE_FLOW_CONTROL) &&
+      (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_TXEMPTY) && 
       (u32Current_CSR & AT91C_US_TXEMPTY) )
   {
     /* Decrement counter and read the dummy byte so the SSP peripheral doesn't overrun */
@@ -991,17 +1371,33 @@ static void SspGenericHandler(void)
     }
     else
     {
-      /* Done! Disable TX interrupt */
-      SSP_psCurrentISR->pBaseAddress->US_IDR = AT91C_US_TXEMPTY;
-      
-      /* Clean up the message status and flags */
-      *SSP_pu32SspApplicationFlagsISR |= _SSP_TX_COMPLETE; 
-      UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-      DeQueueMessage(&SSP_psCurrentISR->psTransmitBuffer);
-      SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;  
- 
-      /* Re-enable Rx interrupt and make final call to callback */    
-      SSP_psCurrentISR->pBaseAddress->US_IER = AT91C_US_RXRDY;
+      /* This message or fragment is done.  If another fragment of the message follows, carry on with it. */
+      psNextFragment = FinishTxMessage(&SSP_psCurrentISR->sTransmitQueue, COMPLETE);
+      if(psNextFragment != NULL)
+      {
+        SSP_psCurrentISR->u32CurrentTxBytesRemaining = psNextFragment->u32Size;
+        SSP_psCurrentISR->pu8CurrentTxData = psNextFragment->pu8Message;
+        u32Byte = 0x000000FF & *SSP_psCurrentISR->pu8CurrentTxData;
+
+        if(SSP_psCurrentISR->eBitOrder == SSP_LSB_FIRST)
+        {
+          u32Byte = __RBIT(u32Byte) >> 24;
+        }
+        
+        SSP_psCurrentISR->pBaseAddress->US_THR = (u8)u32Byte; 
+      }
+      else
+      {
+        /* Done! Disable TX interrupt */
+        SSP_psCurrentISR->pBaseAddress->US_IDR = AT91C_US_TXEMPTY;
+        
+        /* Clean up the flags */
+        *SSP_pu32SspApplicationFlagsISR |= _SSP_TX_COMPLETE; 
+        SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;  
+   
+        /* Re-enable Rx interrupt and make final call to callback */    
+        SSP_psCurrentISR->pBaseAddress->US_IER = AT91C_US_RXRDY;
+      }
     }
     
     /* Both cases use the callback */
@@ -1063,6 +1459,16 @@ static void SspGenericHandler(void)
       /* Disable the receiver and transmitter */
       SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
       SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDRX;
+      
+      /* A full-duplex transfer tells its owner that both buffers are done */
+      if(SSP_psCurrentISR->u32PrivateFlags & _SSP_PERIPHERAL_TRANSFER)
+      {
+        SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TRANSFER;
+        if(SSP_psCurrentISR->fnTransferCallback != NULL)
+        {
+          SSP_psCurrentISR->fnTransferCallback();
+        }
+      }
     }
     /* Otherwise the peripheral is a Slave that just received a byte */
     /* ENDRX Interrupt when a byte has been received (RNCR is moved to RCR; RNPR is copied to RPR))*/
@@ -1089,44 +1495,237 @@ static void SspGenericHandler(void)
   if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDTX) && 
       (u32Current_CSR & AT91C_US_ENDTX) )
   {
+    bTransferDone = TRUE;
+    
     /* If this was a non-dummy transmit... */
     if(SSP_psCurrentISR->u32PrivateFlags & _SSP_PERIPHERAL_TX)
     {
-      /* Update this message token status and then DeQueue it */
-      UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-      DeQueueMessage(&SSP_psCurrentISR->psTransmitBuffer);
-      SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
+      /* Update this message token status and then DeQueue it.  Master devices keep going
+      if more fragments of the message are queued. Slave devices send the next fragment
+      when SspSM_Idle starts it since their "Next" PDC registers are used for dummies. */
+      if( (SSP_psCurrentISR->eSspMode == SSP_MASTER_AUTO_CS) ||
+          (SSP_psCurrentISR->eSspMode == SSP_MASTER_MANUAL_CS) )
+      {
+        bTransferDone = SspRetireTransmit(SSP_psCurrentISR);
+      }
+      else
+      {
+        FinishTxMessage(&SSP_psCurrentISR->sTransmitQueue, COMPLETE);
+      }
+      
+      if(bTransferDone)
+      {
+        SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
+      }
     }
  
-    /* Master devices: Disable the transmitter and interrupt source. 
-    No action for Slave devices as the PDC pointers are already reset back to 
-    SSP_u8Dummies due to the "Next" PDC registers and the transmitter stays on.
-    Flow control Slaves do not use PDC and thus will not generate this interrupt. */
-    if( (SSP_psCurrentISR->eSspMode == SSP_MASTER_AUTO_CS) ||
-        (SSP_psCurrentISR->eSspMode == SSP_MASTER_MANUAL_CS) )
+    if(bTransferDone)
     {
-      SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
-      SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
+      /* Master devices: Disable the transmitter and interrupt source. 
+      No action for Slave devices as the PDC pointers are already reset back to 
+      SSP_u8Dummies due to the "Next" PDC registers and the transmitter stays on.
+      Flow control Slaves do not use PDC and thus will not generate this interrupt. */
+      if( (SSP_psCurrentISR->eSspMode == SSP_MASTER_AUTO_CS) ||
+          (SSP_psCurrentISR->eSspMode == SSP_MASTER_MANUAL_CS) )
+      {
+        SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+        SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
+      }
+  
+      /* Allow the peripheral to finish clocking out the Tx byte */
+      u32Timeout = 0;
+      while ( !(SSP_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_TXEMPTY) && 
+              u32Timeout < SSP_TXEMPTY_TIMEOUT)
+      {
+        u32Timeout++;
+      } 
+      
+      /* Deassert chip select when the buffer and shift register are totally empty */
+      if(SSP_psCurrentSsp->eSspMode == SSP_MASTER_AUTO_CS)
+      {
+        SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+      }
     }
+    
+  } /* end ENDTX interrupt handling */
+
+  
+} /* end SspGenericHandler() */
+
 
-    /* Allow the peripheral to finish clocking out the Tx byte */
-    u32Timeout = 0;
-    while ( !(SSP_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_TXEMPTY) && 
-            u32Timeout < SSP_TXEMPTY_TIMEOUT)
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool SspRetireTransmit(SspPeripheralType* psSsp_)
+
+@brief Handles ENDTX for a Master transmit, which may be one fragment of a scatter-gather message.
+
+While one fragment is sent from TPR/TCR, the next one waits in TNPR/TNCR (_SSP_PERIPHERAL_TX_NEXT 
+is set) and the PDC switches to it on its own.  ENDTX fires for every fragment.  If the ISR is 
+late, the preloaded fragment may also be finished, which shows as TCR = 0 when 
+_SSP_PERIPHERAL_TX_NEXT is set.
+
+Requires:
+- psSsp_ is a Master that is transmitting and ENDTX is set
+
+@param psSsp_ is the SSP peripheral that interrupted
+
+Promises:
+- Fragments that have been sent are retired from the transmit queue; the message status is set
+  to COMPLETE with its last fragment
+- Returns FALSE if the PDC is still sending fragments of the message (ENDTX is cleared)
+- Returns TRUE if the transfer is finished
+
+*/
+static bool SspRetireTransmit(SspPeripheralType* psSsp_)
+{
+  MessageType* psNextFragment;
+  bool bCheckAgain;
+  
+  do
+  {
+    bCheckAgain = FALSE;
+    
+    /* The message or fragment loaded in TPR is done */
+    psNextFragment = FinishTxMessage(&psSsp_->sTransmitQueue, COMPLETE);
+    
+    /* A preloaded fragment is now the head of the queue.  If TCR is already 0 then it is also done. */
+    if(psSsp_->u32PrivateFlags & _SSP_PERIPHERAL_TX_NEXT)
     {
-      u32Timeout++;
-    } 
+      psSsp_->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX_NEXT;
+      if(psSsp_->pBaseAddress->US_TCR == 0)
+      {
+        psNextFragment = FinishTxMessage(&psSsp_->sTransmitQueue, COMPLETE);
+      }
+      else
+      {
+        /* Still sending: preload its next fragment (writing TNCR clears ENDTX) */
+        SspLoadNextFragment(psSsp_);
+        if( !(psSsp_->u32PrivateFlags & _SSP_PERIPHERAL_TX_NEXT) )
+        {
+          /* It is the last fragment so just clear ENDTX.  If the fragment finished before 
+          ENDTX was cleared, go around again to retire it. */
+          psSsp_->pBaseAddress->US_TNCR = 0;
+          if(psSsp_->pBaseAddress->US_TCR == 0)
+          {
+            bCheckAgain = TRUE;
+          }
+        }
+        continue;
+      }
+    }
     
-    /* Deassert chip select when the buffer and shift register are totally empty */
-    if(SSP_psCurrentSsp->eSspMode == SSP_MASTER_AUTO_CS)
+    /* More fragments of the message that have not been loaded yet: restart the PDC with them 
+    (writing TCR clears ENDTX) */
+    if(psNextFragment != NULL)
     {
-      SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+      psSsp_->pBaseAddress->US_TPR = (unsigned int)psNextFragment->pu8Message;
+      psSsp_->pBaseAddress->US_TCR = psNextFragment->u32Size;
+      SspLoadNextFragment(psSsp_);
+      return(FALSE);
     }
     
-  } /* end ENDTX interrupt handling */
+    return(TRUE);
+    
+  } while(bCheckAgain);
 
+  return(FALSE);
   
-} /* end SspGenericHandler() */
+} /* end SspRetireTransmit() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SspLoadNextFragment(SspPeripheralType* psSsp_)
+
+@brief Preloads the next fragment of the message being sent into the PDC "next" registers.
+
+Requires:
+- psSsp_ is a Master and the head message of its transmit queue is loaded in TPR/TCR 
+
+@param psSsp_ is the SSP peripheral that is transmitting
+
+Promises:
+- If the head message has more fragments, TNPR/TNCR are loaded with the next one (which 
+  also clears ENDTX) and _SSP_PERIPHERAL_TX_NEXT is set; otherwise nothing is changed
+
+*/
+static void SspLoadNextFragment(SspPeripheralType* psSsp_)
+{
+  MessageType* psHead = psSsp_->sTransmitQueue.psHead;
+  
+  if( (psHead->u8Flags & _MSG_MORE_FRAGMENTS) && (psHead->psNextMessage != NULL) )
+  {
+    psSsp_->pBaseAddress->US_TNPR = (unsigned int)((MessageType*)psHead->psNextMessage)->pu8Message;
+    psSsp_->pBaseAddress->US_TNCR = ((MessageType*)psHead->psNextMessage)->u32Size;
+    psSsp_->u32PrivateFlags |= _SSP_PERIPHERAL_TX_NEXT;
+  }
+  
+} /* end SspLoadNextFragment() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SspLoadSegment(SspPeripheralType* psSsp_)
+
+@brief Sets the data/command select line for the current SspWriteSegments() segment and starts it on the PDC.
+
+Requires:
+- psSsp_->psSegment is the next segment to send and the previous one (if any) is completely sent
+
+@param psSsp_ is the SSP peripheral that is sending the segments
+
+Promises:
+- The data/command line is high for a data segment and low for a command segment
+- TPR/TCR are loaded with the segment, which also clears ENDTX
+
+*/
+static void SspLoadSegment(SspPeripheralType* psSsp_)
+{
+  if(psSsp_->psSegment->bDataMode)
+  {
+    psSsp_->pDcGpioAddress->PIO_SODR = psSsp_->u32DcPin;
+  }
+  else
+  {
+    psSsp_->pDcGpioAddress->PIO_CODR = psSsp_->u32DcPin;
+  }
+  
+  psSsp_->pBaseAddress->US_TPR = (unsigned int)psSsp_->psSegment->pu8Data;
+  psSsp_->pBaseAddress->US_TCR = psSsp_->psSegment->u16Size;
+  
+} /* end SspLoadSegment() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool SspMasterTransfersPending(void)
+
+@brief Checks if any assigned Master peripheral still has something to send or receive.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if a Master has a queued message, bytes to receive or a transfer in progress
+
+*/
+static bool SspMasterTransfersPending(void)
+{
+  SspPeripheralType* apsPeripherals[] = {&SSP_Peripheral0, &SSP_Peripheral1, &SSP_Peripheral2};
+  SspPeripheralType* psSsp;
+  
+  for(u8 i = 0; i < (sizeof(apsPeripherals) / sizeof(SspPeripheralType*)); i++)
+  {
+    psSsp = apsPeripherals[i];
+    
+    if( (psSsp->u32PrivateFlags & _SSP_PERIPHERAL_ASSIGNED) &&
+        ( (psSsp->eSspMode == SSP_MASTER_AUTO_CS) || (psSsp->eSspMode == SSP_MASTER_MANUAL_CS) ) &&
+        ( (psSsp->sTransmitQueue.psHead != NULL) || (psSsp->u16RxBytes != 0) ||
+          (psSsp->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX | _SSP_PERIPHERAL_SEGMENTS)) ) )
+    {
+      return TRUE;
+    }
+  }
+  
+  return FALSE;
+  
+} /* end SspMasterTransfersPending() */
 
 
 /***********************************************************************************************************************
@@ -1152,12 +1751,13 @@ static void SspSM_Idle(void)
   /* Check all SPI/SSP peripherals for message activity or skip the current peripheral 
   if it is already busy.
   Slave devices receive outside of the state machine.
-  For Master devices sending a message, SSP_psCurrentSsp->psTransmitBuffer->pu8Message will 
+  For Master devices sending a message, SSP_psCurrentSsp->sTransmitQueue.psHead->pu8Message will 
   point to the application transmit buffer.
   For Master devices receiving a message, SSP_psCurrentSsp->u16RxBytes will != 0. Dummy bytes 
   are sent. */
-  if( ( (SSP_psCurrentSsp->psTransmitBuffer != NULL) || (SSP_psCurrentSsp->u16RxBytes !=0) ) && 
-     !(SSP_psCurrentSsp->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX)       ) 
+  if( ( (SSP_psCurrentSsp->sTransmitQueue.psHead != NULL) || (SSP_psCurrentSsp->u16RxBytes !=0) ||
+        (SSP_psCurrentSsp->u32PrivateFlags & _SSP_PERIPHERAL_SEGMENTS) ) && 
+     !(SSP_psCurrentSsp->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX | _SSP_PERIPHERAL_SEGMENTS_TX) ) 
     )
   {
     /* For an SSP_MASTER_AUTO_CS device, start by asserting chip select 
@@ -1167,19 +1767,46 @@ static void SspSM_Idle(void)
       SSP_psCurrentSsp->pCsGpioAddress->PIO_CODR = SSP_psCurrentSsp->u32CsPin;
     }
        
+    /* A segment transaction was requested while the peripheral was idle, so it goes first */
+    if(SSP_psCurrentSsp->u32PrivateFlags & _SSP_PERIPHERAL_SEGMENTS)
+    {
+      SSP_psCurrentSsp->u32PrivateFlags |= _SSP_PERIPHERAL_SEGMENTS_TX;
+      SspLoadSegment(SSP_psCurrentSsp);
+      
+      /* Enable the transmitter, then TXEMPTY marks the end of each segment */
+      SSP_psCurrentSsp->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
+      SSP_psCurrentSsp->pBaseAddress->US_IER  = AT91C_US_TXEMPTY;
+    }
+    
     /* Check if the message is receiving based on expected byte count */
-    if(SSP_psCurrentSsp->u16RxBytes !=0)
+    else if(SSP_psCurrentSsp->u16RxBytes !=0)
     {
       /* Receiving: flag that the peripheral is now busy */
       SSP_psCurrentSsp->u32PrivateFlags |= _SSP_PERIPHERAL_RX;    
       
-      /* Initialize the receive buffer so we can see data changes but also so we send
-      predictable dummy bytes since we'll point to this buffer to source the transmit dummies */
-      memset(SSP_psCurrentSsp->pu8RxBuffer, SSP_DUMMY_BYTE, SSP_psCurrentSsp->u16RxBufferSize);
+      /* A full-duplex transfer uses the caller's buffers in both directions */
+      if(SSP_psCurrentSsp->u32PrivateFlags & _SSP_PERIPHERAL_TRANSFER)
+      {
+        if(SSP_psCurrentSsp->pu8TransferTxData == NULL)
+        {
+          memset(SSP_psCurrentSsp->pu8TransferRxData, SSP_DUMMY_BYTE, SSP_psCurrentSsp->u16RxBytes);
+          SSP_psCurrentSsp->pu8TransferTxData = SSP_psCurrentSsp->pu8TransferRxData;
+        }
+        
+        SSP_psCurrentSsp->pBaseAddress->US_RPR = (unsigned int)SSP_psCurrentSsp->pu8TransferRxData; 
+        SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->pu8TransferTxData; 
+      }
+      else
+      {
+        /* Initialize the receive buffer so we can see data changes but also so we send
+        predictable dummy bytes since we'll point to this buffer to source the transmit dummies */
+        memset(SSP_psCurrentSsp->pu8RxBuffer, SSP_DUMMY_BYTE, SSP_psCurrentSsp->u16RxBufferSize);
+
+        SSP_psCurrentSsp->pBaseAddress->US_RPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
+        SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
+      }
 
-      /* Load the PDC counter and pointer registers */
-      SSP_psCurrentSsp->pBaseAddress->US_RPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
-      SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->pu8RxBuffer; 
+      /* Load the PDC counter registers */
       SSP_psCurrentSsp->pBaseAddress->US_RCR = SSP_psCurrentSsp->u16RxBytes;
       SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->u16RxBytes;
 
@@ -1193,7 +1820,7 @@ static void SspSM_Idle(void)
     else
     {
       /* Transmitting: update the message's status and flag that the peripheral is now busy */
-      UpdateMessageStatus(SSP_psCurrentSsp->psTransmitBuffer->u32Token, SENDING);
+      UpdateMessageStatus(SSP_psCurrentSsp->sTransmitQueue.psHead->u32Token, SENDING);
       SSP_psCurrentSsp->u32PrivateFlags |= _SSP_PERIPHERAL_TX;    
       
       /* TRANSMIT SPI_SSP_SLAVE_FLOW_CONTROL */ 
@@ -1203,8 +1830,8 @@ static void SspSM_Idle(void)
         CS must be asserted for the Slave to have queued data to get to here. */
 
         /* Load in the message parameters. */
-        SSP_psCurrentSsp->u32CurrentTxBytesRemaining = SSP_psCurrentSsp->psTransmitBuffer->u32Size;
-        SSP_psCurrentSsp->pu8CurrentTxData = SSP_psCurrentSsp->psTransmitBuffer->pu8Message;
+        SSP_psCurrentSsp->u32CurrentTxBytesRemaining = SSP_psCurrentSsp->sTransmitQueue.psHead->u32Size;
+        SSP_psCurrentSsp->pu8CurrentTxData = SSP_psCurrentSsp->sTransmitQueue.psHead->pu8Message;
 
         /* If we need LSB first, use inline assembly to flip bits with a single instruction. */
         u32Byte = 0x000000FF & *SSP_psCurrentSsp->pu8CurrentTxData;
@@ -1231,10 +1858,14 @@ static void SspSM_Idle(void)
       /* A Master or Slave device without flow control uses the PDC */
       else
       {
-        /* Load the PDC counter and pointer registers.  The "Next" pointers are never changed and will
-        always point to SSP_u8Dummies with length 1.  */
-        SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->psTransmitBuffer->pu8Message; 
-        SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->psTransmitBuffer->u32Size;
+        /* Load the PDC counter and pointer registers.  For Slaves, the "Next" pointers are never changed and will
+        always point to SSP_u8Dummies with length 1.  Masters use them for the next fragment of the message. */
+        SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->sTransmitQueue.psHead->pu8Message; 
+        SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->sTransmitQueue.psHead->u32Size;
+        if(SSP_psCurrentSsp->eSspMode != SSP_SLAVE)
+        {
+          SspLoadNextFragment(SSP_psCurrentSsp);
+        }
    
         /* When TCR is loaded, the ENDTX flag is cleared so it is safe to enable the interrupt */
         SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_ENDTX;
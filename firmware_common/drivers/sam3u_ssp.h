@@ -30,6 +30,17 @@ typedef enum {SSP_MASTER_AUTO_CS, SSP_MASTER_MANUAL_CS, SSP_SLAVE, SSP_SLAVE_FLO
 */
 typedef enum {SSP_RX_EMPTY = 0, SSP_RX_WAITING, SSP_RX_RECEIVING, SSP_RX_COMPLETE, SSP_RX_TIMEOUT, SSP_RX_INVALID} SspRxStatusType;
 
+/*! 
+@struct SspSegmentType
+@brief One piece of an SspWriteSegments() transaction and the level of the data/command select line while it is sent
+*/
+typedef struct
+{
+  u8* pu8Data;                        /*!< @brief Start of the segment's bytes */
+  u16 u16Size;                        /*!< @brief Number of bytes in the segment (not 0) */
+  bool bDataMode;                     /*!< @brief TRUE to send with the data/command line high (data); FALSE for low (command) */
+} SspSegmentType;
+
 /*! 
 @struct SspConfigurationType
 @brief User-defined SSP configuration information 
@@ -47,6 +58,8 @@ typedef struct
   u8** ppu8RxNextByte;                /*!< @brief Location of pointer to next byte to write in buffer for SSP_SLAVE_FLOW_CONTROL only */
   u16 u16RxBufferSize;                /*!< @brief Size of receive buffer in bytes */
   u16 u16Pad;                         /*!< @brief Preserve 4-byte alignment */
+  AT91PS_PIO pDcGpioAddress;          /*!< @brief Base address for GPIO port for the data/command select line used by SspWriteSegments() (NULL for none) */
+  u32 u32DcPin;                       /*!< @brief Pin location for the data/command select line */
 } SspConfigurationType;
 
 
@@ -71,9 +84,17 @@ typedef struct
   u8 u8PeripheralId;                  /*!< @brief Simple peripheral ID number */
   u8 u8Pad;                           /*!< @brief Preserve 4-byte alignment */
   u16 u16Pad;                         /*!< @brief Preserve 4-byte alignment */
-  MessageType* psTransmitBuffer;      /*!< @brief Pointer to the transmit message struct linked list */
+  MessageQueueType sTransmitQueue;    /*!< @brief Transmit message queue */
   u32 u32CurrentTxBytesRemaining;     /*!< @brief Counter for bytes remaining in current transfer */
   u8* pu8CurrentTxData;               /*!< @brief Pointer to current location in the Tx buffer */
+  u8* pu8TransferTxData;              /*!< @brief SspTransfer() bytes to send (NULL to send dummies) */
+  u8* pu8TransferRxData;              /*!< @brief SspTransfer() buffer for the bytes received */
+  fnCode_type fnTransferCallback;     /*!< @brief SspTransfer() or SspWriteSegments() function called from the ISR when the transfer is done (may be NULL) */
+  AT91PS_PIO pDcGpioAddress;          /*!< @brief Base address for GPIO port for the data/command select line (NULL for none) */
+  u32 u32DcPin;                       /*!< @brief Pin location for the data/command select line */
+  SspSegmentType* psSegment;          /*!< @brief SspWriteSegments() segment being sent */
+  u8 u8SegmentsRemaining;             /*!< @brief SspWriteSegments() segments left including psSegment */
+  u8 au8Pad2[3];                      /*!< @brief Preserve 4-byte alignment */
 } SspPeripheralType;
 
 /* u32PrivateFlags in SspPeripheralType */
@@ -81,6 +102,10 @@ typedef struct
 #define _SSP_PERIPHERAL_TX            (u32)0x00200000    /*!< @brief Set when the peripheral is transmitting */
 #define _SSP_PERIPHERAL_RX            (u32)0x00400000    /*!< @brief Set when the peripheral is receiving */
 #define _SSP_PERIPHERAL_RX_COMPLETE   (u32)0x00800000    /*!< @brief Set when the peripheral is finished receiving */
+#define _SSP_PERIPHERAL_TX_NEXT       (u32)0x01000000    /*!< @brief Set when the next fragment is loaded in TNPR/TNCR (Master only) */
+#define _SSP_PERIPHERAL_TRANSFER      (u32)0x02000000    /*!< @brief Set when u16RxBytes belong to a full-duplex SspTransfer() (Master only) */
+#define _SSP_PERIPHERAL_SEGMENTS      (u32)0x08000000    /*!< @brief Set from SspWriteSegments() until the transaction is done (Master only) */
+#define _SSP_PERIPHERAL_SEGMENTS_TX   (u32)0x10000000    /*!< @brief Set while the segments of an SspWriteSegments() transaction are being sent */
 /* end u32PrivateFlags */
 
 
@@ -97,6 +122,7 @@ Constants / Definitions
 #define _SSP_MANUAL_MODE              (u32)0x00000001    /*!< @brief Set to push a cycle during initialization mode */
 
 #define _SSP_ERROR_INVALID_SSP        (u32)0x01000000    /*!< @brief Set if a function case switches to default */
+#define _SSP_ERROR_MANUAL_MODE_TIMEOUT (u32)0x02000000   /*!< @brief Set if SspManualMode() gave up before the Master transfers finished */
 
 #define SSP_ERROR_FLAG_MASK           (u32)0xFF000000    /*!< @brief AND to SSP_u32Flags to get just error flags */
 /* end of SSP_u32Flags flags */
@@ -104,6 +130,7 @@ Constants / Definitions
 #define SSP_DUMMY_BYTE                (u8)0x00           /*!< @brief Byte to send for dummy */
 
 #define SSP_TXEMPTY_TIMEOUT           (u32)100           /*!< @brief Instruction cycles of a while loop that waits for a register to clear */
+#define U32_SSP_MANUAL_MODE_TIMEOUT_MS (u32)100          /*!< @brief Max time SspManualMode() waits for the Master transfers to finish */
 
 
 /**********************************************************************************************************************
@@ -121,10 +148,15 @@ void SspDeAssertCS(SspPeripheralType* psSspPeripheral_);
 
 u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_);
 u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* u8Data_);
+u32 SspWriteDataReference(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_);
+u32 SspWriteFragments(SspPeripheralType* psSspPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_);
 
 bool SspReadData(SspPeripheralType* psSspPeripheral_, u16 u16Size_);
 bool SspReadByte(SspPeripheralType* psSspPeripheral_);
 SspRxStatusType SspQueryReceiveStatus(SspPeripheralType* psSspPeripheral_);
+bool SspTransfer(SspPeripheralType* psSspPeripheral_, u8* pu8TxData_, u8* pu8RxData_, u16 u16Size_, fnCode_type fnCallback_);
+bool SspWriteSegments(SspPeripheralType* psSspPeripheral_, SspSegmentType* psSegments_, u8 u8Segments_, fnCode_type fnCallback_);
+void SspAbortSegments(SspPeripheralType* psSspPeripheral_);
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -144,6 +176,10 @@ void SSP2_IRQHandler(void);
 /*! @privatesection */                                                                                            
 /*-------------------------------------------------------------------------------------------------------------------*/
 static void SspGenericHandler(void);
+static bool SspRetireTransmit(SspPeripheralType* psSsp_);
+static void SspLoadNextFragment(SspPeripheralType* psSsp_);
+static void SspLoadSegment(SspPeripheralType* psSsp_);
+static bool SspMasterTransfersPending(void);
 
 
 /***********************************************************************************************************************
@@ -15,6 +15,18 @@ accessible to your application.
 
 3. If the application no longer needs the UART resource, call UartRelease().  
 
+RECEIVING:
+By default every received byte raises an ENDRX interrupt and calls fnRxCallback.  At high baud rates a USART
+can instead receive in blocks: set u16RxBlockSize in the configuration and the PDC fills the circular receive
+buffer u16RxBlockSize bytes at a time.  The receiver time-out reports a partial block once the line has been 
+idle for U32_UART_RX_TIMEOUT_BITS bit periods.  Received bytes are reported with fnRxBytesCallback(count), or
+with one fnRxCallback call per byte if fnRxBytesCallback is NULL.
+
+TRANSMIT COALESCING:
+UartSetCoalescing() makes a UART merge small writes (up to U8_UART_COALESCE_MAX_WRITE bytes from 
+UartWriteByte() and UartWriteData()) into one message until the UART task runs again, so characters 
+echoed in one main loop iteration go out as one transfer.  The merged writes share one token.
+
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
 - NONE
@@ -31,6 +43,11 @@ PUBLIC FUNCTIONS
 - void UartRelease(UartPeripheralType* psUartPeripheral_)
 - u32 UartWriteByte(UartPeripheralType* psUartPeripheral_, u8 u8Byte_)
 - u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Data_)
+- u32 UartWriteDataReference(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Data_)
+- u32 UartWriteFragments(UartPeripheralType* psUartPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+- u8* UartReserveData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, MessageType** ppsHandle_)
+- u32 UartCommitData(MessageType* psHandle_, u32 u32Size_)
+- void UartSetCoalescing(UartPeripheralType* psUartPeripheral_, bool bEnable_)
 
 PROTECTED FUNCTIONS
 - void UartInitialize(void);
@@ -73,7 +90,7 @@ static UartPeripheralType Uart_sPeripheral0;     /*!< @brief USART0 peripheral o
 static UartPeripheralType Uart_sPeripheral1;     /*!< @brief USART1 peripheral object (used as UART) */
 static UartPeripheralType Uart_sPeripheral2;     /*!< @brief USART2 peripheral object (used as UART) */
 
-static UartPeripheralType* Uart_psCurrentUart;   /*!< @brief Current UART peripheral being processed */
+static u32 Uart_u32PendingTx;                    /*!< @brief _UART_PENDING_x bits of UARTs that have had messages queued */
 static UartPeripheralType* Uart_psCurrentISR;    /*!< @brief Current UART peripheral being processed in ISR */
 
 static u32 Uart_u32IntCount  = 0;                /*!< @brief Debug counter for UART interrupts */
@@ -106,7 +123,9 @@ Requires:
 - UART/USART peripheral registers configured here are at the same address offset regardless of the peripheral. 
 
 @param psUartConfig_ has the UART peripheral number, address of the RxBuffer, and the RxBuffer size and the calling
-       application is ready to start using the peripheral.
+       application is ready to start using the peripheral.  Block mode (u16RxBlockSize != 0) needs a USART (the
+       DBGU UART has no receiver time-out) and a receive buffer of at least two blocks that is a whole number
+       of blocks; otherwise the peripheral receives one byte per interrupt.
 
 Promises:
 - Returns NULL if a resource cannot be assigned; OR
@@ -196,19 +215,40 @@ UartPeripheralType* UartRequest(UartConfigurationType* psUartConfig_)
   psRequestedUart->u16RxBufferSize = psUartConfig_->u16RxBufferSize;
   psRequestedUart->pu8RxNextByte   = psUartConfig_->pu8RxNextByte;
   psRequestedUart->fnRxCallback    = psUartConfig_->fnRxCallback;
+  psRequestedUart->fnRxBytesCallback = psUartConfig_->fnRxBytesCallback;
+  psRequestedUart->u16RxBlockSize  = 1;
+  psRequestedUart->u16RxReported   = 0;
   psRequestedUart->u32PrivateFlags |= _UART_PERIPHERAL_ASSIGNED;
   
+  if( (psUartConfig_->u16RxBlockSize != 0) && 
+      (psRequestedUart->u8PeripheralId != AT91C_ID_DBGU) &&
+      (psUartConfig_->u16RxBufferSize >= (2 * psUartConfig_->u16RxBlockSize)) &&
+      ((psUartConfig_->u16RxBufferSize % psUartConfig_->u16RxBlockSize) == 0) )
+  {
+    psRequestedUart->u16RxBlockSize   = psUartConfig_->u16RxBlockSize;
+    psRequestedUart->u32PrivateFlags |= _UART_PERIPHERAL_RX_BLOCK;
+  }
+  
   psRequestedUart->pBaseAddress->US_CR   = u32TargetCR;
   psRequestedUart->pBaseAddress->US_MR   = u32TargetMR;
   psRequestedUart->pBaseAddress->US_IER  = u32TargetIER;
   psRequestedUart->pBaseAddress->US_IDR  = u32TargetIDR;
   psRequestedUart->pBaseAddress->US_BRGR = u32TargetBRGR;
 
-  /* Preset the receive PDC pointers and counters; the receive buffer must be starting from [0] and be at least 2 bytes long)*/
+  /* Preset the receive PDC pointers and counters for the first two blocks (1 byte each unless in block mode); 
+  the receive buffer must be starting from [0] and be at least 2 blocks long */
   psRequestedUart->pBaseAddress->US_RPR  = (unsigned int)psUartConfig_->pu8RxBufferAddress;
-  psRequestedUart->pBaseAddress->US_RNPR = (unsigned int)((psUartConfig_->pu8RxBufferAddress) + 1);
-  psRequestedUart->pBaseAddress->US_RCR  = 1;
-  psRequestedUart->pBaseAddress->US_RNCR = 1;
+  psRequestedUart->pBaseAddress->US_RNPR = (unsigned int)((psUartConfig_->pu8RxBufferAddress) + psRequestedUart->u16RxBlockSize);
+  psRequestedUart->pBaseAddress->US_RCR  = psRequestedUart->u16RxBlockSize;
+  psRequestedUart->pBaseAddress->US_RNCR = psRequestedUart->u16RxBlockSize;
+  
+  /* In block mode, the time-out starts counting at the first character and flushes partial blocks */
+  if(psRequestedUart->u32PrivateFlags & _UART_PERIPHERAL_RX_BLOCK)
+  {
+    psRequestedUart->pBaseAddress->US_RTOR = U32_UART_RX_TIMEOUT_BITS;
+    psRequestedUart->pBaseAddress->US_CR   = AT91C_US_STTTO;
+    psRequestedUart->pBaseAddress->US_IER  = AT91C_US_TIMEOUT;
+  }
   
   /* Enable the receiver and transmitter requests */
   psRequestedUart->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN | AT91C_PDC_TXTEN;
@@ -234,6 +274,7 @@ Promises:
 - Disables the associated interrupts
 - Resets peripheral object's pointers
 - Any unsent messages are dumped and set to ABANDONED status
+- The transmit queue is back to MSG_PRIORITY_NORMAL with no quota
 - Main SM reset to Idle
 
 */
@@ -253,15 +294,21 @@ void UartRelease(UartPeripheralType* psUartPeripheral_)
   psUartPeripheral_->pu8RxBuffer   = NULL;
   psUartPeripheral_->pu8RxNextByte = NULL;
   psUartPeripheral_->fnRxCallback  = NULL;
+  psUartPeripheral_->fnRxBytesCallback = NULL;
   psUartPeripheral_->u32PrivateFlags = 0;
+  MessageAbort(psUartPeripheral_->psCoalesce);
+  psUartPeripheral_->psCoalesce = NULL;
 
   /* Empty the transmit buffer if there were leftover messages */
-  while(psUartPeripheral_->psTransmitBuffer != NULL)
+  while(psUartPeripheral_->sTransmitQueue.psHead != NULL)
   {
-    UpdateMessageStatus(psUartPeripheral_->psTransmitBuffer->u32Token, ABANDONED);
-    DeQueueMessage(&psUartPeripheral_->psTransmitBuffer);
+    FinishTxMessage(&psUartPeripheral_->sTransmitQueue, ABANDONED);
   }
   
+  /* The next owner starts with default message priority and overflow policy */
+  MessageQueueSetPriority(&psUartPeripheral_->sTransmitQueue, MSG_PRIORITY_NORMAL, 0);
+  MessageQueueSetOverflow(&psUartPeripheral_->sTransmitQueue, MSG_OVERFLOW_DROP_LOWEST_PRIORITY);
+  
   /* Ensure the SM is in the Idle state */
   Uart_pfnStateMachine = UartSM_Idle;
  
@@ -278,8 +325,8 @@ Requires:
 @param u8Byte_ is the byte to send
 
 Promises:
-- Creates a 1-byte message at psUartPeripheral_->pTransmitBuffer that will be sent by the UART application
-  when it is available.
+- Creates a 1-byte message on psUartPeripheral_->sTransmitQueue that will be sent by the UART application
+  when it is available, or merges the byte into the open message if coalescing is on
 - Returns the message token assigned to the message
 
 */
@@ -288,8 +335,14 @@ u32 UartWriteByte(UartPeripheralType* psUartPeripheral_, u8 u8Byte_)
   u32 u32Token;
   u8 u8Data = u8Byte_;
   
+  if( (psUartPeripheral_->u32PrivateFlags & _UART_PERIPHERAL_COALESCE) && 
+     !(G_u32SystemFlags & _SYSTEM_INITIALIZING) )
+  {
+    return( UartCoalesceData(psUartPeripheral_, 1, &u8Data) );
+  }
+  
   /* Attempt to queue message and get a response token */
-  u32Token = QueueMessage(&psUartPeripheral_->psTransmitBuffer, 1, &u8Data);
+  u32Token = QueueTxMessage(&psUartPeripheral_->sTransmitQueue, 1, &u8Data);
   
   if( u32Token != NULL )
   {
@@ -318,8 +371,8 @@ Requires:
 @param pu8Data_ points to the first byte of the data array
 
 Promises:
-- adds the data message at psUartPeripheral_->pTransmitBuffer that will be sent by the UART application
-  when it is available.
+- adds the data message to psUartPeripheral_->sTransmitQueue that will be sent by the UART application
+  when it is available, or merges a small message into the open message if coalescing is on
 - Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
   G_u32MessagingFlags can be checked for the reason
 
@@ -334,8 +387,17 @@ u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Da
     return NULL;
   }
 
+  if( (psUartPeripheral_->u32PrivateFlags & _UART_PERIPHERAL_COALESCE) && 
+      (u32Size_ <= U8_UART_COALESCE_MAX_WRITE) && !(G_u32SystemFlags & _SYSTEM_INITIALIZING) )
+  {
+    return( UartCoalesceData(psUartPeripheral_, u32Size_, pu8Data_) );
+  }
+  
+  /* Anything merged earlier must go out first */
+  UartFlushCoalesced(psUartPeripheral_);
+  
   /* Attempt to queue message and get a response token */
-  u32Token = QueueMessage(&psUartPeripheral_->psTransmitBuffer, u32Size_, pu8Data_);
+  u32Token = QueueTxMessage(&psUartPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
   if(u32Token)
   {
     /* If the system is initializing, manually cycle the UART task through one iteration to send the message */
@@ -350,6 +412,197 @@ u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Da
 } /* end UartWriteData() */
 
 
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u32 UartWriteDataReference(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Data_)
+
+@brief Queues an array of bytes for transfer on the target UART peripheral without copying it.  
+
+The UART transfers directly from pu8Data_, so this is best for constant strings or buffers the 
+caller already keeps until the message is sent.
+
+Requires:
+@param psUartPeripheral_ has been requested and holds a valid pointer to a transmit buffer; even if a transmission is
+       in progress, the node in the buffer that is currently being sent will not be destroyed during this function.
+@param u32Size_ is the number of bytes in the data array; should not be 0
+@param pu8Data_ points to the first byte of the data array which must not change until the message
+       status is no longer WAITING or SENDING
+
+Promises:
+- adds a message referencing pu8Data_ to psUartPeripheral_->sTransmitQueue that will be sent by the 
+  UART application when it is available.
+- Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
+  G_u32MessagingFlags can be checked for the reason
+
+*/
+u32 UartWriteDataReference(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Data_)
+{
+  u32 u32Token;
+  
+  /* Check for a valid size */
+  if(u32Size_ == 0)
+  {
+    return(0);
+  }
+
+  /* Anything merged earlier must go out first */
+  UartFlushCoalesced(psUartPeripheral_);
+  
+  /* Attempt to queue message and get a response token */
+  u32Token = QueueTxMessageReference(&psUartPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
+  if(u32Token)
+  {
+    /* If the system is initializing, manually cycle the UART task through one iteration to send the message */
+    if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+    {
+      UartManualMode();
+    }
+  }
+  
+  return(u32Token);
+  
+} /* end UartWriteDataReference() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u32 UartWriteFragments(UartPeripheralType* psUartPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+
+@brief Queues a list of fragments that the target UART peripheral sends as one message.  
+
+The fragments are chained through the PDC next pointer registers so they go out back-to-back.
+See QueueTxMessageFragments() for the rules on fragment data.
+
+Requires:
+@param psUartPeripheral_ has been requested and holds a valid pointer to a transmit buffer; even if a transmission is
+       in progress, the node in the buffer that is currently being sent will not be destroyed during this function.
+@param psFragments_ points to the list of fragments in the order they are sent
+@param u8Fragments_ is the number of fragments in the list
+
+Promises:
+- adds the fragments to psUartPeripheral_->sTransmitQueue that will be sent by the UART application
+  when it is available.
+- Returns the one message token assigned to all of the fragments; 0 is returned if the message cannot be 
+  queued in which case G_u32MessagingFlags can be checked for the reason
+
+*/
+u32 UartWriteFragments(UartPeripheralType* psUartPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_)
+{
+  u32 u32Token;
+  
+  /* Anything merged earlier must go out first */
+  UartFlushCoalesced(psUartPeripheral_);
+  
+  /* Attempt to queue message and get a response token */
+  u32Token = QueueTxMessageFragments(&psUartPeripheral_->sTransmitQueue, psFragments_, u8Fragments_);
+  if(u32Token)
+  {
+    /* If the system is initializing, manually cycle the UART task through one iteration to send the message */
+    if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+    {
+      UartManualMode();
+    }
+  }
+  
+  return(u32Token);
+  
+} /* end UartWriteFragments() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u8* UartReserveData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, MessageType** ppsHandle_)
+
+@brief Reserves a message slot on the target UART so data can be formatted straight into it.  
+
+Write up to u32Size_ bytes into the returned buffer then call UartCommitData(), or MessageAbort() 
+if nothing is to be sent.  See MessageReserve().
+
+Requires:
+@param psUartPeripheral_ has been requested
+@param u32Size_ is the most bytes that will be written (1 to U16_MAX_TX_MESSAGE_LENGTH)
+@param ppsHandle_ receives the handle for UartCommitData() or MessageAbort()
+
+Promises:
+- Returns the buffer to write the message in; NULL is returned if no slot is available in which case
+  G_u32MessagingFlags can be checked for the reason
+
+*/
+u8* UartReserveData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, MessageType** ppsHandle_)
+{
+  return( MessageReserve(&psUartPeripheral_->sTransmitQueue, u32Size_, ppsHandle_) );
+  
+} /* end UartReserveData() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u32 UartCommitData(MessageType* psHandle_, u32 u32Size_)
+
+@brief Queues a message written in place after UartReserveData().  
+
+Requires:
+@param psHandle_ is the handle from UartReserveData()
+@param u32Size_ is the number of bytes written; 0 gives the slot back without sending anything
+
+Promises:
+- The message is added to the transmit queue of the UART it was reserved on
+- Returns the message token assigned to the message; 0 is returned if nothing was queued
+
+*/
+u32 UartCommitData(MessageType* psHandle_, u32 u32Size_)
+{
+  u32 u32Token;
+  
+  /* Anything merged earlier must go out first (the handle does not say which UART it is for) */
+  UartFlushAllCoalesced();
+  
+  u32Token = MessageCommit(psHandle_, u32Size_);
+  if(u32Token)
+  {
+    /* If the system is initializing, manually cycle the UART task through one iteration to send the message */
+    if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+    {
+      UartManualMode();
+    }
+  }
+  
+  return(u32Token);
+  
+} /* end UartCommitData() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void UartSetCoalescing(UartPeripheralType* psUartPeripheral_, bool bEnable_)
+
+@brief Turns transmit coalescing on or off for a UART.  
+
+With coalescing on, writes of up to U8_UART_COALESCE_MAX_WRITE bytes through UartWriteByte() and 
+UartWriteData() are copied into one open message instead of each taking a message slot, a token and 
+a PDC transfer.  The open message is queued the next time the UART task runs (once per main loop), or 
+sooner if it fills up or a write that is not merged comes along, so output stays in order.  All the 
+writes merged into one message return the same token, so they resolve to COMPLETE together.  
+Writes are not merged during initialization.
+
+Requires:
+@param psUartPeripheral_ has been requested
+@param bEnable_ is TRUE to merge small writes, FALSE to send each one on its own
+
+Promises:
+- _UART_PERIPHERAL_COALESCE is updated; anything merged so far is queued when coalescing is turned off
+
+*/
+void UartSetCoalescing(UartPeripheralType* psUartPeripheral_, bool bEnable_)
+{
+  if(bEnable_)
+  {
+    psUartPeripheral_->u32PrivateFlags |= _UART_PERIPHERAL_COALESCE;
+  }
+  else
+  {
+    psUartPeripheral_->u32PrivateFlags &= ~_UART_PERIPHERAL_COALESCE;
+    UartFlushCoalesced(psUartPeripheral_);
+  }
+  
+} /* end UartSetCoalescing() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -371,39 +624,51 @@ void UartInitialize(void)
 {
   /* Initialize all the UART peripheral structures */
   Uart_sPeripheral.pBaseAddress      = (AT91S_USART*)AT91C_BASE_DBGU;
-  Uart_sPeripheral.psTransmitBuffer  = NULL;
+  MessageQueueInitialize(&Uart_sPeripheral.sTransmitQueue, "DBGU");
+  MessageQueueSetPendingFlag(&Uart_sPeripheral.sTransmitQueue, &Uart_u32PendingTx, _UART_PENDING_DBGU);
   Uart_sPeripheral.pu8RxBuffer       = NULL;
   Uart_sPeripheral.u16RxBufferSize   = 0;
   Uart_sPeripheral.pu8RxNextByte     = NULL;
+  Uart_sPeripheral.fnRxBytesCallback = NULL;
+  Uart_sPeripheral.psCoalesce = NULL;
   Uart_sPeripheral.u32PrivateFlags   = 0;
   Uart_sPeripheral.u8PeripheralId    = AT91C_ID_DBGU;
 
   Uart_sPeripheral0.pBaseAddress     = AT91C_BASE_US0;
-  Uart_sPeripheral0.psTransmitBuffer = NULL;
+  MessageQueueInitialize(&Uart_sPeripheral0.sTransmitQueue, "USART0");
+  MessageQueueSetPendingFlag(&Uart_sPeripheral0.sTransmitQueue, &Uart_u32PendingTx, _UART_PENDING_US0);
   Uart_sPeripheral0.pu8RxBuffer      = NULL;
   Uart_sPeripheral0.u16RxBufferSize  = 0;
   Uart_sPeripheral0.pu8RxNextByte    = NULL;
+  Uart_sPeripheral0.fnRxBytesCallback = NULL;
+  Uart_sPeripheral0.psCoalesce = NULL;
   Uart_sPeripheral0.u32PrivateFlags  = 0;
   Uart_sPeripheral0.u8PeripheralId   = AT91C_ID_US0;
 
   Uart_sPeripheral1.pBaseAddress     = AT91C_BASE_US1;
-  Uart_sPeripheral1.psTransmitBuffer = NULL;
+  MessageQueueInitialize(&Uart_sPeripheral1.sTransmitQueue, "USART1");
+  MessageQueueSetPendingFlag(&Uart_sPeripheral1.sTransmitQueue, &Uart_u32PendingTx, _UART_PENDING_US1);
   Uart_sPeripheral1.pu8RxBuffer      = NULL;
   Uart_sPeripheral1.u16RxBufferSize  = 0;
   Uart_sPeripheral1.pu8RxNextByte    = NULL;
+  Uart_sPeripheral1.fnRxBytesCallback = NULL;
+  Uart_sPeripheral1.psCoalesce = NULL;
   Uart_sPeripheral1.u32PrivateFlags  = 0;
   Uart_sPeripheral1.u8PeripheralId   = AT91C_ID_US1;
 
   Uart_sPeripheral2.pBaseAddress     = AT91C_BASE_US2;
-  Uart_sPeripheral2.psTransmitBuffer = NULL;
+  MessageQueueInitialize(&Uart_sPeripheral2.sTransmitQueue, "USART2");
+  MessageQueueSetPendingFlag(&Uart_sPeripheral2.sTransmitQueue, &Uart_u32PendingTx, _UART_PENDING_US2);
   Uart_sPeripheral2.pu8RxBuffer      = NULL;
   Uart_sPeripheral2.u16RxBufferSize  = 0;
   Uart_sPeripheral2.pu8RxNextByte    = NULL;
+  Uart_sPeripheral2.fnRxBytesCallback = NULL;
+  Uart_sPeripheral2.psCoalesce = NULL;
   Uart_sPeripheral2.u32PrivateFlags  = 0;
   Uart_sPeripheral2.u8PeripheralId   = AT91C_ID_US2;
   
-  /* Select the first UART peripheral and initialize other globals */
-  Uart_psCurrentUart = &Uart_sPeripheral;
+  /* Initialize other globals */
+  Uart_u32PendingTx = 0;
   Uart_u32Flags = 0;
   Uart_u8ActiveUarts = 0;
   Uart_pfnStateMachine = UartSM_Idle;
@@ -428,6 +693,9 @@ Promises:
 */
 void UartRunActiveState(void)
 {
+  /* Small writes merged since the last main loop iteration are sent now */
+  UartFlushAllCoalesced();
+  
   Uart_pfnStateMachine();
 
 } /* end UartRunActiveState */
@@ -444,7 +712,8 @@ Requires:
 - UART application has been initialized.
 
 Promises:
-- Runs the UART task until no UART messages are queued for transmission.
+- Runs the UART task until no UART messages are queued for transmission, or sets 
+  _UART_ERROR_MANUAL_MODE_TIMEOUT if that takes longer than U32_UART_MANUAL_MODE_TIMEOUT_MS
 
 */
 static void UartManualMode(void)
@@ -452,16 +721,20 @@ static void UartManualMode(void)
   u32 u32Timer;
   
   Uart_u32Flags |=_UART_MANUAL_MODE;
-  Uart_psCurrentUart = &Uart_sPeripheral;
+  u32Timer = G_u32SystemTime1ms;
   
+  /* The PDC and ISR send the data, so the task is polled back-to-back until they are done */
   while(Uart_u32Flags &_UART_MANUAL_MODE)
   {
     WATCHDOG_BONE();
     UartRunActiveState();
     MessagingRunActiveState();
 
-    u32Timer = G_u32SystemTime1ms;
-    while( !IsTimeUp(&u32Timer, 1) );
+    if( IsTimeUp(&u32Timer, U32_UART_MANUAL_MODE_TIMEOUT_MS) )
+    {
+      Uart_u32Flags &= ~_UART_MANUAL_MODE;
+      Uart_u32Flags |= _UART_ERROR_MANUAL_MODE_TIMEOUT;
+    }
   }
       
 } /* end UartManualMode() */
@@ -578,14 +851,53 @@ No processing is done on the data - it is up to the processing application to pa
 and to manage dummy bytes.  All data reception is done with DMA, but only 1 byte at a time.  Receiving is done by using
 the two reception pointers to ensure no data is missed.
 
-Transmit: All data bytes in the transmit buffer are sent using DMA and interrupts. Once the full message has been sent,
-the message status is updated.
+Transmit: All data bytes in the transmit buffer are sent using DMA and interrupts.  Queued messages are chained so
+the PDC streams them back to back: while one message (or fragment) is sent from TPR/TCR, the next one in the queue 
+waits in TNPR/TNCR (_UART_PERIPHERAL_TX_NEXT is set).  The PDC switches to it on its own and ENDTX fires for 
+every message.  The ISR then updates the token status of the finished message, marks the new one SENDING and 
+preloads the one after it.  If the ISR is late, the preloaded message may also be finished, which shows as 
+TCR = 0 when _UART_PERIPHERAL_TX_NEXT is set.  Messages queued after the last one was preloaded are started
+by the ISR when the PDC runs dry, so UartSM_Idle() only starts a transfer when the UART is idle.
 
 */
 static void UartGenericHandler(void)
 {
+  MessageQueueType* psQueue = &Uart_psCurrentISR->sTransmitQueue;
+  u32 u32FinishedToken;
+  bool bCheckAgain;
+
+  /* ENDRX Interrupt in block mode when a block has been received (RNCR is moved to RCR; RNPR is copied to RPR) */
+  if( (Uart_psCurrentISR->u32PrivateFlags & _UART_PERIPHERAL_RX_BLOCK) &&
+      (Uart_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDRX) && 
+      (Uart_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_ENDRX) )
+  {
+    /* Queue the block after the one now being filled with wrap-around check */
+    Uart_psCurrentISR->pBaseAddress->US_RNPR += Uart_psCurrentISR->u16RxBlockSize;
+    if(Uart_psCurrentISR->pBaseAddress->US_RNPR >= (u32)(Uart_psCurrentISR->pu8RxBuffer + (u32)Uart_psCurrentISR->u16RxBufferSize) )
+    {
+      Uart_psCurrentISR->pBaseAddress->US_RNPR = (u32)Uart_psCurrentISR->pu8RxBuffer;  
+    }
+
+    /* Writing RNCR clears the ENDRX flag */
+    Uart_psCurrentISR->pBaseAddress->US_RNCR = Uart_psCurrentISR->u16RxBlockSize;
+    UartReportRxBytes(Uart_psCurrentISR);
+    
+  } /* end of block mode ENDRX interrupt processing */
+
+  /* TIMEOUT Interrupt in block mode when the line has gone idle part way into a block */
+  if( (Uart_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_TIMEOUT) && 
+      (Uart_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_TIMEOUT) )
+  {
+    UartReportRxBytes(Uart_psCurrentISR);
+    
+    /* Clear TIMEOUT and wait for the next character to start the time-out again */
+    Uart_psCurrentISR->pBaseAddress->US_CR = AT91C_US_STTTO;
+    
+  } /* end of TIMEOUT interrupt processing */
+
   /* ENDRX Interrupt when a byte has been received (RNCR is moved to RCR; RNPR is copied to RPR) */
-  if( (Uart_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDRX) && 
+  if( !(Uart_psCurrentISR->u32PrivateFlags & _UART_PERIPHERAL_RX_BLOCK) &&
+      (Uart_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDRX) && 
       (Uart_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_ENDRX) )
   {
     /* Update the "next" DMA pointer to the next valid Rx location with wrap-around check */
@@ -608,32 +920,312 @@ static void UartGenericHandler(void)
   if( (Uart_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDTX) && 
       (Uart_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_ENDTX) )
   {
-    /* Update this message's token status and then DeQueue it */
-    UpdateMessageStatus(Uart_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage( &Uart_psCurrentISR->psTransmitBuffer );
-    Uart_psCurrentISR->u32PrivateFlags &= ~_UART_PERIPHERAL_TX;
+    do
+    {
+      bCheckAgain = FALSE;
+      
+      /* The message or fragment loaded in TPR is done: update its token status and DeQueue it */
+      u32FinishedToken = (psQueue->psHead != NULL) ? psQueue->psHead->u32Token : 0;
+      FinishTxMessage(psQueue, COMPLETE);
+      
+      /* A preloaded message is now the head of the queue and is in TPR/TCR */
+      if(Uart_psCurrentISR->u32PrivateFlags & _UART_PERIPHERAL_TX_NEXT)
+      {
+        Uart_psCurrentISR->u32PrivateFlags &= ~_UART_PERIPHERAL_TX_NEXT;
+        if(psQueue->psHead->u32Token != u32FinishedToken)
+        {
+          UpdateMessageStatus(psQueue->psHead->u32Token, SENDING);
+        }
         
-    /* Disable the transmitter and interrupt sources that were enabled in UART Idle to 
-    start the transmission sequence */
-    Uart_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
-    Uart_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
+        /* If TCR is already 0 then it is also done */
+        if(Uart_psCurrentISR->pBaseAddress->US_TCR == 0)
+        {
+          bCheckAgain = TRUE;
+          continue;
+        }
+
+        /* Still sending: preload the message after it (writing TNCR clears ENDTX) */
+        UartLoadNextMessage(Uart_psCurrentISR);
+        if( !(Uart_psCurrentISR->u32PrivateFlags & _UART_PERIPHERAL_TX_NEXT) )
+        {
+          /* Nothing else is queued so just clear ENDTX.  If the message finished before 
+          ENDTX was cleared, go around again to retire it. */
+          Uart_psCurrentISR->pBaseAddress->US_TNCR = 0;
+          if(Uart_psCurrentISR->pBaseAddress->US_TCR == 0)
+          {
+            bCheckAgain = TRUE;
+          }
+        }
+        continue;
+      }
+      
+      /* Messages queued too late to be preloaded: restart the PDC with them (writing TCR clears ENDTX) */
+      if(psQueue->psHead != NULL)
+      {
+        if(psQueue->psHead->u32Token != u32FinishedToken)
+        {
+          UpdateMessageStatus(psQueue->psHead->u32Token, SENDING);
+        }
+        Uart_psCurrentISR->pBaseAddress->US_TPR = (unsigned int)psQueue->psHead->pu8Message;
+        Uart_psCurrentISR->pBaseAddress->US_TCR = psQueue->psHead->u32Size;
+        UartLoadNextMessage(Uart_psCurrentISR);
+        continue;
+      }
+      
+      /* The transfer is done */
+      Uart_psCurrentISR->u32PrivateFlags &= ~_UART_PERIPHERAL_TX;
+          
+      /* Disable the transmitter and interrupt sources that were enabled in UART Idle to 
+      start the transmission sequence */
+      Uart_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+      Uart_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
+      
+      /* Decrement # of UARTs that are currently sending (incremented in UART Idle when the
+      transmission started) */
+      if(Uart_u8ActiveUarts != 0)
+      {
+        Uart_u8ActiveUarts--;
+      }
+      else
+      {
+        /* If Uart_u8ActiveUarts is already 0, then we are not properly synchronized */
+        DebugPrintf("\n\rUART counter out of sync\n\r");
+        Uart_u32Flags |= _UART_NO_ACTIVE_UARTS;
+      }
+    } while(bCheckAgain);
     
-    /* Decrement # of UARTs that are currently sending (incremented in UART Idle when the
-    transmission started) */
-    if(Uart_u8ActiveUarts != 0)
+  } /* end of ENDTX interrupt processing */
+  
+} /* end UartGenericHandler() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UartLoadNextMessage(UartPeripheralType* psUart_)
+
+@brief Preloads the message queued after the one being sent into the PDC "next" registers.
+
+The preloaded message is flagged _MSG_LOADED so it cannot be dropped or cancelled while 
+the PDC points at it.
+
+Requires:
+- The head message of psUart_->sTransmitQueue is loaded in TPR/TCR 
+
+@param psUart_ is the UART that is transmitting
+
+Promises:
+- If another message (or fragment) is queued behind the head, TNPR/TNCR are loaded with it 
+  (which also clears ENDTX) and _UART_PERIPHERAL_TX_NEXT is set; otherwise nothing is changed
+
+*/
+static void UartLoadNextMessage(UartPeripheralType* psUart_)
+{
+  MessageType* psNext = psUart_->sTransmitQueue.psHead->psNextMessage;
+  
+  if(psNext != NULL)
+  {
+    psNext->u8Flags |= _MSG_LOADED;
+    psUart_->pBaseAddress->US_TNPR = (unsigned int)psNext->pu8Message;
+    psUart_->pBaseAddress->US_TNCR = psNext->u32Size;
+    psUart_->u32PrivateFlags |= _UART_PERIPHERAL_TX_NEXT;
+  }
+  
+} /* end UartLoadNextMessage() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UartReportRxBytes(UartPeripheralType* psUart_)
+
+@brief Reports the bytes that the PDC has written to the circular receive buffer since the last report.
+
+Requires:
+- psUart_ is in block mode and the receive PDC is running
+
+@param psUart_ is the UART that is receiving
+
+Promises:
+- If new bytes have arrived, fnRxBytesCallback is called with the number of bytes (or fnRxCallback 
+  is called once per byte if there is no fnRxBytesCallback) and u16RxReported is advanced past them
+
+*/
+static void UartReportRxBytes(UartPeripheralType* psUart_)
+{
+  u16 u16WriteIndex;
+  u16 u16Bytes;
+  
+  /* RPR is the next location the PDC will write; it sits at the end of the buffer if both blocks are full */
+  u16WriteIndex = (u16)(psUart_->pBaseAddress->US_RPR - (u32)psUart_->pu8RxBuffer);
+  if(u16WriteIndex >= psUart_->u16RxBufferSize)
+  {
+    u16WriteIndex = 0;
+  }
+  
+  if(u16WriteIndex >= psUart_->u16RxReported)
+  {
+    u16Bytes = u16WriteIndex - psUart_->u16RxReported;
+  }
+  else
+  {
+    u16Bytes = psUart_->u16RxBufferSize - psUart_->u16RxReported + u16WriteIndex;
+  }
+  
+  if(u16Bytes == 0)
+  {
+    return;
+  }
+  
+  psUart_->u16RxReported = u16WriteIndex;
+  if(psUart_->fnRxBytesCallback != NULL)
+  {
+    psUart_->fnRxBytesCallback(u16Bytes);
+  }
+  else
+  {
+    for(u16 i = 0; i < u16Bytes; i++)
     {
-      Uart_u8ActiveUarts--;
+      psUart_->fnRxCallback();
     }
-    else
+  }
+  
+} /* end UartReportRxBytes() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 UartCoalesceData(UartPeripheralType* psUart_, u32 u32Size_, u8* pu8Data_)
+
+@brief Merges a small write into the open message of a UART.
+
+Requires:
+- Called from task context
+@param psUart_ is the UART with coalescing on
+@param u32Size_ is the number of bytes to write (1 to U8_UART_COALESCE_MAX_WRITE)
+@param pu8Data_ points to the bytes to write
+
+Promises:
+- If the bytes do not fit in the open message, it is queued first
+- The bytes are copied into the open message, which is reserved (and given its token) if needed
+- Returns the token of the open message; 0 if no message slot is available
+
+*/
+static u32 UartCoalesceData(UartPeripheralType* psUart_, u32 u32Size_, u8* pu8Data_)
+{
+  u8* pu8Buffer;
+  
+  if( (psUart_->psCoalesce != NULL) && 
+      ((psUart_->u16CoalesceLength + u32Size_) > U16_UART_COALESCE_SIZE) )
+  {
+    UartFlushCoalesced(psUart_);
+  }
+  
+  if(psUart_->psCoalesce == NULL)
+  {
+    pu8Buffer = MessageReserve(&psUart_->sTransmitQueue, U16_UART_COALESCE_SIZE, &psUart_->psCoalesce);
+    if(pu8Buffer == NULL)
     {
-      /* If Uart_u8ActiveUarts is already 0, then we are not properly synchronized */
-      DebugPrintf("\n\rUART counter out of sync\n\r");
-      Uart_u32Flags |= _UART_NO_ACTIVE_UARTS;
+      return(0);
     }
     
-  } /* end of ENDTX interrupt processing */
+    MessageIssueToken(psUart_->psCoalesce);
+    psUart_->u16CoalesceLength = 0;
+  }
   
-} /* end UartGenericHandler() */
+  memcpy(psUart_->psCoalesce->pu8Message + psUart_->u16CoalesceLength, pu8Data_, u32Size_);
+  psUart_->u16CoalesceLength += (u16)u32Size_;
+  
+  return(psUart_->psCoalesce->u32Token);
+  
+} /* end UartCoalesceData() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UartFlushCoalesced(UartPeripheralType* psUart_)
+
+@brief Queues the open message of a UART that small writes have been merged into.
+
+Requires:
+- Called from task context
+@param psUart_ is the UART
+
+Promises:
+- If psUart_ has an open message, it is committed to the transmit queue and psCoalesce is NULL
+
+*/
+static void UartFlushCoalesced(UartPeripheralType* psUart_)
+{
+  if(psUart_->psCoalesce != NULL)
+  {
+    MessageCommit(psUart_->psCoalesce, psUart_->u16CoalesceLength);
+    psUart_->psCoalesce = NULL;
+  }
+  
+} /* end UartFlushCoalesced() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UartFlushAllCoalesced(void)
+
+@brief Queues the open messages of all UARTs.
+
+Requires:
+- Called from task context
+
+Promises:
+- No UART has an open message
+
+*/
+static void UartFlushAllCoalesced(void)
+{
+  UartFlushCoalesced(&Uart_sPeripheral);
+  UartFlushCoalesced(&Uart_sPeripheral0);
+  UartFlushCoalesced(&Uart_sPeripheral1);
+  UartFlushCoalesced(&Uart_sPeripheral2);
+  
+} /* end UartFlushAllCoalesced() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UartStartTransmit(UartPeripheralType* psUart_)
+
+@brief Starts the PDC on the head message of a UART that is not already sending.
+
+Requires:
+- Called from the UART task
+@param psUart_ is the UART that has had messages queued
+
+Promises:
+- If psUart_ is idle and has a message queued, the message is SENDING, loaded in TPR/TCR (with 
+  the next message in TNPR/TNCR), ENDTX is enabled and _UART_PERIPHERAL_TX is set
+- Otherwise nothing is changed
+
+*/
+static void UartStartTransmit(UartPeripheralType* psUart_)
+{
+  /* Devices sending a message will have psUart_->sTransmitQueue.psHead->pu8Message pointing to the message to send. */
+  if( (psUart_->sTransmitQueue.psHead != NULL) && 
+     !(psUart_->u32PrivateFlags & _UART_PERIPHERAL_TX ) )
+  {
+    /* Transmitting: update the message's status and flag that the peripheral is now busy */
+    UpdateMessageStatus(psUart_->sTransmitQueue.psHead->u32Token, SENDING);
+    psUart_->u32PrivateFlags |= _UART_PERIPHERAL_TX;    
+      
+    /* Load the PDC counter and pointer registers, and the next message if one is queued */
+    psUart_->pBaseAddress->US_TPR = (unsigned int)psUart_->sTransmitQueue.psHead->pu8Message;
+    psUart_->pBaseAddress->US_TCR = psUart_->sTransmitQueue.psHead->u32Size;
+    UartLoadNextMessage(psUart_);
+
+    /* When TCR is loaded, the ENDTX flag is cleared so it is safe to enable the interrupt */
+    psUart_->pBaseAddress->US_IER = AT91C_US_ENDTX;
+    
+    /* Update active UART count and enable the transmitter to start the transfer */
+    Uart_u8ActiveUarts++;
+    if(Uart_u8ActiveUarts > U8_MAX_NUM_UARTS)
+    {
+      /* Alert that the number of actual UARTs has been exceeded */
+      Uart_u32Flags |= _UART_TOO_MANY_UARTS;
+    }
+    psUart_->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
+  }
+  
+} /* end UartStartTransmit() */
 
 
 /***********************************************************************************************************************
@@ -660,74 +1252,46 @@ assume they won't.
 @fn static void UartSM_Idle(void)
 
 @brief Wait for a transmit message to be queued.  Received data is handled in interrupts. 
+
+Queuing a message sets the UART's bit in Uart_u32PendingTx, so every UART with new data is serviced 
+on the same visit instead of one UART per main loop.  A UART that is already sending needs nothing: 
+its ISR chains the new messages.
 */
 static void UartSM_Idle(void)
 {
-  /* Check all UART peripherals for message activity or skip the current peripheral if it is already busy sending.
-  All receive functions take place outside of the state machine.
-  Devices sending a message will have Uart_psCurrentSsp->psTransmitBuffer->pu8Message pointing to the message to send. */
-  if( (Uart_psCurrentUart->psTransmitBuffer != NULL) && 
-     !(Uart_psCurrentUart->u32PrivateFlags & _UART_PERIPHERAL_TX ) )
+  u32 u32Pending;
+  
+  /* Take the pending bits; anything queued from here on sets them again */
+  do
   {
-    /* Transmitting: update the message's status and flag that the peripheral is now busy */
-    UpdateMessageStatus(Uart_psCurrentUart->psTransmitBuffer->u32Token, SENDING);
-    Uart_psCurrentUart->u32PrivateFlags |= _UART_PERIPHERAL_TX;    
-      
-    /* Load the PDC counter and pointer registers */
-    Uart_psCurrentUart->pBaseAddress->US_TPR = (unsigned int)Uart_psCurrentUart->psTransmitBuffer->pu8Message;
-    Uart_psCurrentUart->pBaseAddress->US_TCR = Uart_psCurrentUart->psTransmitBuffer->u32Size;
+    u32Pending = __LDREXW((volatile uint32_t*)&Uart_u32PendingTx);
+  } while(__STREXW(0, (volatile uint32_t*)&Uart_u32PendingTx) != 0);
+  
+  if(u32Pending & _UART_PENDING_DBGU)
+  {
+    UartStartTransmit(&Uart_sPeripheral);
+  }
 
-    /* When TCR is loaded, the ENDTX flag is cleared so it is safe to enable the interrupt */
-    Uart_psCurrentUart->pBaseAddress->US_IER = AT91C_US_ENDTX;
-    
-    /* Update active UART count and enable the transmitter to start the transfer */
-    Uart_u8ActiveUarts++;
-    if(Uart_u8ActiveUarts > U8_MAX_NUM_UARTS)
-    {
-      /* Alert that the number of actual UARTs has been exceeded */
-      Uart_u32Flags |= _UART_TOO_MANY_UARTS;
-    }
-    Uart_psCurrentUart->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
+  if(u32Pending & _UART_PENDING_US0)
+  {
+    UartStartTransmit(&Uart_sPeripheral0);
   }
-  
-  /* Adjust to check the next peripheral next time through */
-  switch (Uart_psCurrentUart->u8PeripheralId)
+
+  if(u32Pending & _UART_PENDING_US1)
   {
-    case AT91C_ID_DBGU:
-    {
-      Uart_psCurrentUart = &Uart_sPeripheral0;
-      break;
-    }
-    
-    case AT91C_ID_US0:
-    {
-      Uart_psCurrentUart = &Uart_sPeripheral1;
-      break;
-    }
-    
-    case AT91C_ID_US1:
-    {  Uart_psCurrentUart = &Uart_sPeripheral2;
-      break;
-    }
-    
-    case AT91C_ID_US2:
-    {
-      Uart_psCurrentUart = &Uart_sPeripheral;
-      
-      /* Only clear _UART_MANUAL_MODE if all UARTs are done sending to ensure messages are sent during initialization */
-      if( (G_u32SystemFlags & _SYSTEM_INITIALIZING) && !Uart_u8ActiveUarts)
-      {
-        Uart_u32Flags &= ~_UART_MANUAL_MODE;
-      }
-      break;
-    }
-    
-    default:
-    {
-      Uart_psCurrentUart = &Uart_sPeripheral;
-      break;
-    }
-  } /* end switch */
+    UartStartTransmit(&Uart_sPeripheral1);
+  }
+
+  if(u32Pending & _UART_PENDING_US2)
+  {
+    UartStartTransmit(&Uart_sPeripheral2);
+  }
+
+  /* Only clear _UART_MANUAL_MODE if all UARTs are done sending to ensure messages are sent during initialization */
+  if( (G_u32SystemFlags & _SYSTEM_INITIALIZING) && !Uart_u8ActiveUarts)
+  {
+    Uart_u32Flags &= ~_UART_MANUAL_MODE;
+  }
   
 } /* end UartSM_Idle() */
 
@@ -21,7 +21,9 @@ typedef struct
   u16 u16RxBufferSize;                /*!< @brief Size of receive buffer in bytes */
   u8* pu8RxBufferAddress;             /*!< @brief Address to circular receive buffer */
   u8** pu8RxNextByte;                 /*!< @brief Pointer to buffer location where next received byte will be placed */
-  fnCode_type fnRxCallback;           /*!< @brief Callback function for receiving data */
+  fnCode_type fnRxCallback;           /*!< @brief Callback function for receiving data (once per byte) */
+  fnCode_u16_type fnRxBytesCallback;  /*!< @brief Block mode: callback with the number of bytes received (NULL to use fnRxCallback) */
+  u16 u16RxBlockSize;                 /*!< @brief 0 for a receive interrupt per byte; otherwise bytes per receive PDC block (see UartRequest) */
 } UartConfigurationType;
 
 /*! 
@@ -32,13 +34,19 @@ typedef struct
 {
   AT91PS_USART pBaseAddress;          /*!< @brief Base address of the associated peripheral */
   u32 u32PrivateFlags;                /*!< @brief Flags for peripheral */
-  MessageType* psTransmitBuffer;      /*!< @brief Pointer to the transmit message linked list */
+  MessageQueueType sTransmitQueue;    /*!< @brief Transmit message queue */
   u32 u32CurrentTxBytesRemaining;     /*!< @brief Counter for bytes remaining in current transfer */
   u8* pu8CurrentTxData;               /*!< @brief Pointer to current location in the Tx buffer */
   u8* pu8RxBuffer;                    /*!< @brief Pointer to circular receive buffer in user application */
   u8** pu8RxNextByte;                 /*!< @brief Pointer to buffer location where next received byte will be placed */
   fnCode_type fnRxCallback;           /*!< @brief Callback function for receiving data */
+  fnCode_u16_type fnRxBytesCallback;  /*!< @brief Block mode callback with the number of bytes received */
+  MessageType* psCoalesce;            /*!< @brief Reserved message that small writes are being merged into (NULL if none) */
+  u16 u16CoalesceLength;              /*!< @brief Bytes written into psCoalesce so far */
+  u16 u16Pad;
   u16 u16RxBufferSize;                /*!< @brief Size of receive buffer in bytes */
+  u16 u16RxBlockSize;                 /*!< @brief Bytes per receive PDC block in block mode */
+  u16 u16RxReported;                  /*!< @brief Block mode: index of the first byte in the receive buffer not yet reported */
   u8 u8PeripheralId;                  /*!< @brief Simple peripheral ID number */
   u8 u8Pad;
 } UartPeripheralType;
@@ -46,6 +54,9 @@ typedef struct
 /* u32PrivateFlags in UartPeripheralType */
 #define   _UART_PERIPHERAL_ASSIGNED     (u32)0x00000001   /*!< @brief Set when the peripheral is in use */
 #define   _UART_PERIPHERAL_TX           (u32)0x00200000   /*!< @brief Set when the peripheral is transmitting */
+#define   _UART_PERIPHERAL_TX_NEXT      (u32)0x00400000   /*!< @brief Set when the next message is loaded in TNPR/TNCR */
+#define   _UART_PERIPHERAL_RX_BLOCK     (u32)0x00800000   /*!< @brief Set when the peripheral receives in PDC blocks with the receiver time-out */
+#define   _UART_PERIPHERAL_COALESCE     (u32)0x01000000   /*!< @brief Set when small writes are merged into one transfer per main loop */
 /* end u32PrivateFlags */
 
 
@@ -61,6 +72,11 @@ void UartRelease(UartPeripheralType* psUartPeripheral_);
 
 u32 UartWriteByte(UartPeripheralType* psUartPeripheral_, u8 u8Byte_);
 u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Data_);
+u32 UartWriteDataReference(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* pu8Data_);
+u32 UartWriteFragments(UartPeripheralType* psUartPeripheral_, MessageFragmentType* psFragments_, u8 u8Fragments_);
+u8* UartReserveData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, MessageType** ppsHandle_);
+u32 UartCommitData(MessageType* psHandle_, u32 u32Size_);
+void UartSetCoalescing(UartPeripheralType* psUartPeripheral_, bool bEnable_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -81,6 +97,12 @@ void UART2_IRQHandler(void);
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 static void UartGenericHandler(void);
+static void UartLoadNextMessage(UartPeripheralType* psUart_);
+static void UartReportRxBytes(UartPeripheralType* psUart_);
+static u32 UartCoalesceData(UartPeripheralType* psUart_, u32 u32Size_, u8* pu8Data_);
+static void UartFlushCoalesced(UartPeripheralType* psUart_);
+static void UartFlushAllCoalesced(void);
+static void UartStartTransmit(UartPeripheralType* psUart_);
 
 
 /***********************************************************************************************************************
@@ -100,9 +122,21 @@ Constants / Definitions
 
 #define _UART_NO_ACTIVE_UARTS           (u32)0x02000000   /*!< @brief Set if Uart_u8ActiveUarts is 0 when decremented */
 #define _UART_TOO_MANY_UARTS            (u32)0x04000000   /*!< @brief Set if Uart_u8ActiveUarts is 0 when decremented */
+#define _UART_ERROR_MANUAL_MODE_TIMEOUT (u32)0x08000000   /*!< @brief Set if UartManualMode() gave up before all UARTs finished sending */
 /* end of Uart_u32Flags */
 
+/* Uart_u32PendingTx (set by messaging when a message is queued) */
+#define _UART_PENDING_DBGU              (u32)0x00000001   /*!< @brief Messages queued on the DBGU UART */
+#define _UART_PENDING_US0               (u32)0x00000002   /*!< @brief Messages queued on USART0 */
+#define _UART_PENDING_US1               (u32)0x00000004   /*!< @brief Messages queued on USART1 */
+#define _UART_PENDING_US2               (u32)0x00000008   /*!< @brief Messages queued on USART2 */
+/* end of Uart_u32PendingTx */
+
 #define U8_MAX_NUM_UARTS                (u8)5             /*!< @brief Total number of UARTs possible on SAM3U */
+#define U16_UART_COALESCE_SIZE          (u16)64           /*!< @brief Bytes in the message that small writes are merged into */
+#define U8_UART_COALESCE_MAX_WRITE      (u8)16            /*!< @brief Largest write that is merged when coalescing is on */
+#define U32_UART_RX_TIMEOUT_BITS        (u32)20           /*!< @brief Idle bit periods (two characters) before a partial receive block is reported */
+#define U32_UART_MANUAL_MODE_TIMEOUT_MS (u32)500          /*!< @brief Max time UartManualMode() waits for the queued messages */
 
 
 
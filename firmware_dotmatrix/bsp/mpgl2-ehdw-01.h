@@ -21,6 +21,7 @@ Type Definitions
 #define PLLACK_VALUE              (u32)(OSC_VALUE * (MULA + 1)) / DIVA      /* 96 MHz */
 #define CPU_DIVIDER               (u32)2
 #define CCLK_VALUE                PLLACK_VALUE / CPU_DIVIDER                /* 48 MHz */
+#define MCK                       CCLK_VALUE                                /* 48 MHz */
 #define PERIPHERAL_DIVIDER        (u32)1
 #define PCLK_VALUE                CCLK_VALUE / PERIPHERAL_DIVIDER           /* 48 MHz */
 #define SYSTICK_DIVIDER           (u32)8
@@ -250,7 +250,12 @@ increased by more than one since this function was last called
 */
 void SystemTimeCheck(void)
 {    
-   static u32 u32PreviousSystemTick = 0;
+  static u32 u32PreviousSystemTick = 0;
+  static u8 au8Count[11];
+  static MessageFragmentType asWarning[] = 
+  { {"\n\r*** 1ms timing violation: ", 28, FALSE},
+    {au8Count, 0, TRUE},
+    {"\n\r", 2, FALSE} };
    
   /* Check system timing */
   if( (G_u32SystemTime1ms - u32PreviousSystemTick) != 1)
@@ -261,9 +266,9 @@ void SystemTimeCheck(void)
     
     if(G_u32DebugFlags & _DEBUG_TIME_WARNING_ENABLE)
     {
-      DebugPrintf("\n\r*** 1ms timing violation: ");
-      DebugPrintNumber(Bsp_u32TimingViolationsCounter);
-      DebugLineFeed();
+      /* Send the warning as one message; only the count is copied */
+      asWarning[1].u32Size = NumberToAscii(Bsp_u32TimingViolationsCounter, au8Count);
+      DebugPrintFragments(asWarning, 3);
     }
   }
   
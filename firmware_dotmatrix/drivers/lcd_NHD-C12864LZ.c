@@ -201,6 +201,7 @@ static u32 Lcd_u32RefreshTimer;                                   /*!< @brief LC
 
 static fnCode_type Lcd_ReturnState;                               /*!< @brief Saved return state */
 static u32 Lcd_u32CurrentMsgToken;                                /*!< @brief Token of message currently being sent to LCD */
+static volatile MessageStateType Lcd_eTransferState;              /*!< @brief Final state of the current message set by LcdTransferCallback() */
 
 static SspConfigurationType Lcd_sSspConfig;                       /*!< @brief Configuration information for SSP peripheral */
 static SspPeripheralType* Lcd_Ssp;                                /*!< @brief Pointer to LCD's SSP peripheral object */
@@ -208,6 +209,10 @@ static u8 Lcd_u8PagesToUpdate;                                    /*!< @brief Co
 static u8 Lcd_u8CurrentPage;                                      /*!< @brief Current page being updated */
 
 static u8 Lcd_au8TxBuffer[U16_LCD_TX_BUFFER_SIZE];                /*!< @brief Buffer for outgoing data to LCD during the current refresh cycle */
+static u8 Lcd_aau8RefreshAddress[U8_LCD_REFRESH_BUFFERS][U8_LCD_ADDRESS_BYTES]; /*!< @brief Address commands of the refresh pages */
+static u8 Lcd_aau8RefreshData[U8_LCD_REFRESH_BUFFERS][U16_LCD_COLUMNS]; /*!< @brief Data of the refresh pages */
+static SspSegmentType Lcd_aasRefreshSegments[U8_LCD_REFRESH_BUFFERS][U8_LCD_REFRESH_SEGMENTS]; /*!< @brief Command and data segments of each refresh page */
+static u8 Lcd_u8RefreshBuffer;                                    /*!< @brief Refresh buffer that the next page is rendered into */
 static u8 Lcd_au8RxDummyBuffer[U16_LCD_RX_BUFFER_SIZE];           /*!< @brief Dummy location for LCD receive buffer (LCD does not send data) */
 static u8* Lcd_pu8RxDummyBuffer;                                  /*!< @brief Dummy buffer pointer */
 
@@ -570,19 +575,21 @@ Requires:
 @param u8Command_ is a valid A0 type command for the LCD (see list in lcd_NHD-C12864LZ.h)
 
 Promises:
-- A command message is queued to the TxBuffer
+- A command message is queued to the TxBuffer and returns TRUE
+- Returns FALSE without touching A0 or the transfer state if a command is already queued or a 
+  screen refresh is in progress; the caller should try again on a later pass
 
 */
 bool LcdCommand(u8 u8Command_)
 {
-  if( !(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE) )
+  if( !(Lcd_u32Flags & (_LCD_FLAGS_COMMAND_IN_QUEUE | _LCD_FLAGS_REFRESH)) )
   {
     Lcd_u32Flags |= _LCD_FLAGS_COMMAND_IN_QUEUE;
     Lcd_au8TxBuffer[0] = u8Command_;
   
     /* Set hardware for command mode and queue the message */
     LCD_COMMAND_MODE();
-    Lcd_u32CurrentMsgToken = SspWriteData(Lcd_Ssp, 1, &Lcd_au8TxBuffer[0]);
+    LcdSendTxBuffer(1);
     
     /* Zero the timer so the command sends immediately and push the command out if initializing */
     Lcd_u32RefreshTimer = 0;
@@ -667,8 +674,16 @@ void LcdInitialize(void)
   Lcd_sSspConfig.u16RxBufferSize    = U16_LCD_RX_BUFFER_SIZE;
   Lcd_sSspConfig.eBitOrder          = SSP_MSB_FIRST;
   Lcd_sSspConfig.eSspMode           = SSP_MASTER_AUTO_CS;
+  Lcd_sSspConfig.pDcGpioAddress     = AT91C_BASE_PIOB;
+  Lcd_sSspConfig.u32DcPin           = PB_15_LCD_A0;
 
   Lcd_Ssp = SspRequest(&Lcd_sSspConfig);
+  
+  /* Screen refreshes must not be starved by debug output */
+  if(Lcd_Ssp != NULL)
+  {
+    MessageQueueSetPriority(&Lcd_Ssp->sTransmitQueue, MSG_PRIORITY_HIGH, 0);
+  }
         
   /* Carry out the prescribed LCD initialization starting with delay after releasing reset */
   LCD_CS_ASSERT();
@@ -800,7 +815,12 @@ void LcdRunActiveState(void)
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn void LcdManualMode(void)
 
-@brief Runs a cycle of the LCD state machine until there are no messages queued up to transmit.
+@brief Runs the LCD state machine back to back until the current command or refresh is done.
+
+During initialization the SSP sends each transfer before SspWriteDataReference() or 
+SspWriteSegments() returns, so the message is already final when LcdTransferCallback() is 
+attached and the messaging task defers the callback to its next pass.  The loop runs that pass 
+too, as SspManualMode() does.
 
 *** Violates 1ms system timing: use only during initialization ***
 
@@ -809,6 +829,9 @@ Requires:
            
 Promises:
 - The current command for an LCD will be sent; or an LCD refresh will be carried out.
+- If that takes longer than U32_LCD_MANUAL_MODE_TIMEOUT_MS, _LCD_MANUAL_MODE is cleared, 
+  _LCD_ERROR_MANUAL_MODE_TIMEOUT is set and the LCD task finishes the transfer once the 
+  system is running
   
 */
 void LcdManualMode(void)
@@ -820,15 +843,22 @@ void LcdManualMode(void)
     /* Zero the refresh timer so the LCD refreshes right away in manual mode */
     Lcd_u32RefreshTimer = 0; 
     Lcd_u32Flags |= _LCD_MANUAL_MODE;
+    u32ManualModeTimer = G_u32SystemTime1ms;
+    
     while(Lcd_u32Flags & _LCD_MANUAL_MODE)
     {
-      /* Run the two SMs that are needed to send LCD bytes */
+      /* Run the two SMs that are needed to finish LCD transfers */
       WATCHDOG_BONE();
       Lcd_pfnStateMachine();
+      MessagingRunActiveState();
       
-      /* Provide an equivalent system tick delay */
-      u32ManualModeTimer = G_u32SystemTime1ms;
-      while( !IsTimeUp(&u32ManualModeTimer, 1) );
+      if( IsTimeUp(&u32ManualModeTimer, U32_LCD_MANUAL_MODE_TIMEOUT_MS) )
+      {
+        Lcd_u32Flags &= ~_LCD_MANUAL_MODE;
+        Lcd_u32Flags |= _LCD_ERROR_MANUAL_MODE_TIMEOUT;
+        DebugPrintf("LCD manual mode timeout\n\r");
+        break;
+      }
     }
   }
   
@@ -839,6 +869,86 @@ void LcdManualMode(void)
 /*! @privatesection */                                                                                            
 /*----------------------------------------------------------------------------------------------------------------------*/
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdTransferCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_)
+
+@brief Message callback that runs from the SSP ISR when the current LCD message is finished.
+
+This is defined ahead of LcdSendTxBuffer() instead of being declared in the header because 
+configuration.h includes this driver's header before messaging.h.
+
+Requires:
+@param u32Token_ is the token of the message that finished
+@param eState_ is the final state of the message
+@param pvContext_ is not used
+
+Promises:
+- Lcd_eTransferState = eState_ if the message is the current LCD message
+
+*/
+static void LcdTransferCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_)
+{
+  if(u32Token_ == Lcd_u32CurrentMsgToken)
+  {
+    Lcd_eTransferState = eState_;
+  }
+  
+} /* end LcdTransferCallback() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdRefreshCallback(void)
+
+@brief SspWriteSegments() callback that runs from the SSP ISR when a refresh page is done.
+
+Requires:
+- NONE
+
+Promises:
+- Lcd_eTransferState = COMPLETE
+
+*/
+static void LcdRefreshCallback(void)
+{
+  Lcd_eTransferState = COMPLETE;
+  
+} /* end LcdRefreshCallback() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdSendTxBuffer(u32 u32Size_)
+
+@brief Queues the first u32Size_ bytes of Lcd_au8TxBuffer to the SSP and asks to be told when they are sent.
+
+Requires:
+- LCD_COMMAND_MODE() or LCD_DATA_MODE() is set for the bytes
+- Lcd_au8TxBuffer is not touched until Lcd_eTransferState is no longer WAITING
+
+@param u32Size_ is the number of bytes to send
+
+Promises:
+- Lcd_u32CurrentMsgToken holds the token of the message 
+- Lcd_eTransferState is WAITING until LcdTransferCallback() reports the final state
+- Lcd_u32Timer is started for the U32_LCD_TRANSFER_TIMEOUT_MS limit
+- If no callback slot is available, _LCD_FLAGS_POLL_STATUS is set so LcdSM_WaitTransfer 
+  queries the message status instead
+
+*/
+static void LcdSendTxBuffer(u32 u32Size_)
+{
+  Lcd_u32Timer = G_u32SystemTime1ms;
+  Lcd_eTransferState = WAITING;
+  Lcd_u32Flags &= ~_LCD_FLAGS_POLL_STATUS;
+  Lcd_u32CurrentMsgToken = SspWriteDataReference(Lcd_Ssp, u32Size_, &Lcd_au8TxBuffer[0]);
+  
+  if( !MessageSetCallback(Lcd_u32CurrentMsgToken, LcdTransferCallback, NULL, MSG_CALLBACK_ISR) )
+  {
+    Lcd_u32Flags |= _LCD_FLAGS_POLL_STATUS;
+  }
+  
+} /* end LcdSendTxBuffer() */
+
+
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn static bool LcdSetStartAddressForDataTransfer(u8 u8LocalRamPage_)          
 
@@ -858,18 +968,14 @@ Promises:
 */
 static bool LcdSetStartAddressForDataTransfer(u8 u8LocalRamPage_)          
 {
-  u16 u16ColumnStartLcd = U16_LCD_COLUMNS - (Lcd_sCurrentUpdateArea.u16ColumnStart + Lcd_sCurrentUpdateArea.u16ColumnSize);
-  
   if( !(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE) )
   {
     /* Set the message bytes for the current transfer */
-    Lcd_au8TxBuffer[0] = U8_LCD_SET_PAGE_ADDRESSx    | u8LocalRamPage_;
-    Lcd_au8TxBuffer[1] = U8_LCD_SET_COL_ADDRESS_MSNx | (u8)( (u16ColumnStartLcd >> 4) & 0x0F);
-    Lcd_au8TxBuffer[2] = U8_LCD_SET_COL_ADDRESS_LSNx | (u8)( u16ColumnStartLcd & 0x0F);
+    LcdLoadPageAddress(u8LocalRamPage_, &Lcd_au8TxBuffer[0]);
       
     LCD_COMMAND_MODE(); 
     Lcd_u32Flags |= _LCD_FLAGS_COMMAND_IN_QUEUE;
-    Lcd_u32CurrentMsgToken = SspWriteData(Lcd_Ssp, 3, &Lcd_au8TxBuffer[0]);
+    LcdSendTxBuffer(U8_LCD_ADDRESS_BYTES);
 
     return TRUE;
   }
@@ -880,9 +986,37 @@ static bool LcdSetStartAddressForDataTransfer(u8 u8LocalRamPage_)
 
 
 /*!----------------------------------------------------------------------------------------------------------------------
-@fn static void LcdLoadPageToBuffer(u8 u8LocalRamPage_) 
+@fn static void LcdLoadPageAddress(u8 u8LocalRamPage_, u8* pu8Buffer_)
+
+@brief Writes the commands that set the LCD cursor to the start of the update area on a page.
+
+The starting address is mapped appropriately for the actual physical LCD screen.
+
+Requires:
+- Lcd_sCurrentUpdateArea has the current area for the update
+
+@param u8LocalRamPage_ is the page address for this update
+@param pu8Buffer_ has room for U8_LCD_ADDRESS_BYTES bytes
+
+Promises:
+- pu8Buffer_ holds the page, column MSN and column LSN commands
+
+*/
+static void LcdLoadPageAddress(u8 u8LocalRamPage_, u8* pu8Buffer_)
+{
+  u16 u16ColumnStartLcd = U16_LCD_COLUMNS - (Lcd_sCurrentUpdateArea.u16ColumnStart + Lcd_sCurrentUpdateArea.u16ColumnSize);
+  
+  pu8Buffer_[0] = U8_LCD_SET_PAGE_ADDRESSx    | u8LocalRamPage_;
+  pu8Buffer_[1] = U8_LCD_SET_COL_ADDRESS_MSNx | (u8)( (u16ColumnStartLcd >> 4) & 0x0F);
+  pu8Buffer_[2] = U8_LCD_SET_COL_ADDRESS_LSNx | (u8)( u16ColumnStartLcd & 0x0F);
+  
+} /* end LcdLoadPageAddress() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdLoadPageToBuffer(u8 u8LocalRamPage_, u8* pu8Buffer_) 
 
-@brief Loads Lcd_au8TxBuffer with one page of the current LCD data to refresh the screen.
+@brief Loads a buffer with one page of the current LCD data to refresh the screen.
 
 This function translates the logical addressing of the bits in G_aau8LcdRamImage to the
 addressing used by the ST7565 LCD controller.  Column bits must always be loaded
@@ -898,13 +1032,14 @@ Requires:
 - G_aau8LcdRamImage has the correct updated data to send
 
 @param u8LocalRamPage_ is the LCD page that is to be updated (provides row address for LCD RAM)
+@param pu8Buffer_ has room for Lcd_sCurrentUpdateArea.u16ColumnSize bytes
            
 Promises:
 - Data from G_aau8LcdRamImage is parsed out by row & column for the current page that requires
-  updating.  A maximum of 128 bytes are posted to Lcd_au8TxBuffer (updates a full page).
+  updating.  A maximum of 128 bytes are posted to pu8Buffer_ (updates a full page).
    
 */
-static void LcdLoadPageToBuffer(u8 u8LocalRamPage_) 
+static void LcdLoadPageToBuffer(u8 u8LocalRamPage_, u8* pu8Buffer_) 
 {
   u16 u16LocalRamCurrentRow; 
   u8* pu8TxBufferParser;
@@ -913,7 +1048,7 @@ static void LcdLoadPageToBuffer(u8 u8LocalRamPage_)
   u8 u8CurrentPixelBitInLocalRamMask;
   u8 u8CurrentColumnByte;
 
-  pu8TxBufferParser = &Lcd_au8TxBuffer[0];
+  pu8TxBufferParser = pu8Buffer_;
   
   /* Initialize the variables for the first column of pixel data */
   u8LocalRamBitGroup = (Lcd_sCurrentUpdateArea.u16ColumnStart + Lcd_sCurrentUpdateArea.u16ColumnSize - 1) / 8; 
@@ -937,7 +1072,7 @@ static void LcdLoadPageToBuffer(u8 u8LocalRamPage_)
       }
     }
     
-    /* The byte has been built: add to Lcd_au8TxBuffer */
+    /* The byte has been built: add to the buffer */
     *pu8TxBufferParser = u8CurrentColumnByte;
     pu8TxBufferParser++;
     
@@ -950,11 +1085,118 @@ static void LcdLoadPageToBuffer(u8 u8LocalRamPage_)
     }
   }
   
-  /* Lcd_au8TxBuffer now has all of the bytes for the current transfer */
-  LCD_DATA_MODE();
-  Lcd_u32CurrentMsgToken = SspWriteData(Lcd_Ssp, Lcd_sCurrentUpdateArea.u16ColumnSize, &Lcd_au8TxBuffer[0]);
- 
 } /* end LcdLoadPageToBuffer () */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdRenderRefreshPage(void) 
+
+@brief Builds the address commands and data of the next refresh page and its two SspWriteSegments() segments.
+
+Only one page is rendered per call so the LCD task stays inside its share of the 1ms loop.  The
+pages are double buffered: while one is on the wire, the next one is rendered into the other buffer.
+
+Requires:
+- Lcd_sCurrentUpdateArea is set for the refresh and Lcd_u8CurrentPage is the next page to send
+- Lcd_u8RefreshBuffer is not the buffer of a page being sent
+
+Promises:
+- Lcd_aasRefreshSegments[Lcd_u8RefreshBuffer] sends Lcd_u8CurrentPage and _LCD_FLAGS_PAGE_READY is set
+
+*/
+static void LcdRenderRefreshPage(void)
+{
+  SspSegmentType* psSegment = &Lcd_aasRefreshSegments[Lcd_u8RefreshBuffer][0];
+  
+  LcdLoadPageAddress(Lcd_u8CurrentPage, &Lcd_aau8RefreshAddress[Lcd_u8RefreshBuffer][0]);
+  psSegment->pu8Data   = &Lcd_aau8RefreshAddress[Lcd_u8RefreshBuffer][0];
+  psSegment->u16Size   = U8_LCD_ADDRESS_BYTES;
+  psSegment->bDataMode = FALSE;
+  psSegment++;
+  
+  LcdLoadPageToBuffer(Lcd_u8CurrentPage, &Lcd_aau8RefreshData[Lcd_u8RefreshBuffer][0]);
+  psSegment->pu8Data   = &Lcd_aau8RefreshData[Lcd_u8RefreshBuffer][0];
+  psSegment->u16Size   = Lcd_sCurrentUpdateArea.u16ColumnSize;
+  psSegment->bDataMode = TRUE;
+  
+  Lcd_u32Flags |= _LCD_FLAGS_PAGE_READY;
+  
+} /* end LcdRenderRefreshPage() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LcdStartRefreshPage(void) 
+
+@brief Sends the rendered refresh page as one SSP transaction.
+
+SspWriteSegments() switches A0 from the SSP ISR between the address commands and the data, so the 
+page takes one trip through LcdSM_WaitTransfer and the next page can be rendered meanwhile.
+
+Requires:
+- _LCD_FLAGS_PAGE_READY is set
+- No LCD message is being sent
+
+Promises:
+- Returns TRUE with the page started: Lcd_eTransferState is WAITING until LcdRefreshCallback() runs,
+  Lcd_u32Timer is started for the U32_LCD_TRANSFER_TIMEOUT_MS limit,
+  _LCD_FLAGS_SEGMENTS is set, Lcd_u8CurrentPage and Lcd_u8PagesToUpdate move on to the next page and 
+  the next page will be rendered into the other buffer
+- Returns FALSE if the SSP did not take the transaction; the page and buffers are not changed
+
+*/
+static bool LcdStartRefreshPage(void)
+{
+  Lcd_u32Timer = G_u32SystemTime1ms;
+  Lcd_eTransferState = WAITING;
+  Lcd_u32Flags &= ~_LCD_FLAGS_POLL_STATUS;
+  if( !SspWriteSegments(Lcd_Ssp, &Lcd_aasRefreshSegments[Lcd_u8RefreshBuffer][0], U8_LCD_REFRESH_SEGMENTS, LcdRefreshCallback) )
+  {
+    return FALSE;
+  }
+  
+  Lcd_u32Flags |= _LCD_FLAGS_SEGMENTS;
+  Lcd_u32Flags &= ~_LCD_FLAGS_PAGE_READY;
+  Lcd_u8RefreshBuffer = (Lcd_u8RefreshBuffer + 1) % U8_LCD_REFRESH_BUFFERS;
+  Lcd_u8CurrentPage++;
+  Lcd_u8PagesToUpdate--;
+  return TRUE;
+  
+} /* end LcdStartRefreshPage() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdAbandonTransfer(void) 
+
+@brief Drops the command or refresh that failed or timed out and puts the task back in Idle.
+
+The pixels of an abandoned refresh are added back to Lcd_sUpdateArea so the next refresh period 
+sends them again.  A dropped command is not retried.
+
+Requires:
+- The SSP is no longer using Lcd_au8TxBuffer or the refresh buffers
+
+Promises:
+- A refresh in progress is queued again and Lcd_u8PagesToUpdate is 0
+- The transfer flags and _LCD_MANUAL_MODE are cleared, _LCD_ERROR_TRANSFER is set
+- Lcd_pfnStateMachine is LcdSM_Idle
+
+*/
+static void LcdAbandonTransfer(void)
+{
+  if(Lcd_u32Flags & _LCD_FLAGS_REFRESH)
+  {
+    LcdUpdateScreenRefreshArea(&Lcd_sCurrentUpdateArea);
+  }
+  
+  Lcd_u8PagesToUpdate = 0;
+  Lcd_u32Flags &= ~(_LCD_MANUAL_MODE | _LCD_FLAGS_COMMAND_IN_QUEUE | _LCD_FLAGS_POLL_STATUS | 
+                    _LCD_FLAGS_SEGMENTS | _LCD_FLAGS_PAGE_READY | _LCD_FLAGS_REFRESH);
+  Lcd_u32Flags |= _LCD_ERROR_TRANSFER;
+  
+  Lcd_ReturnState = LcdSM_Idle;
+  Lcd_pfnStateMachine = LcdSM_Idle;
+  
+} /* end LcdAbandonTransfer() */
     
 
 /*!----------------------------------------------------------------------------------------------------------------------
@@ -1030,7 +1272,6 @@ static void LcdSM_Idle(void)
   /* Check if a command is queued: commands are always sent immediately */
   if(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE)
   {
-    Lcd_u32Timer = G_u32SystemTime1ms;
     Lcd_ReturnState = LcdSM_Idle;
     Lcd_pfnStateMachine = LcdSM_WaitTransfer;
   }
@@ -1064,8 +1305,17 @@ static void LcdSM_Idle(void)
       /* Set the starting page; subsequent pages are incremental */
       Lcd_u8CurrentPage = Lcd_sCurrentUpdateArea.u16RowStart / U8_LCD_PAGE_SIZE;
 
-      /* Start the refresh cycle by loading the command to set the cursor location */
-      LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage);
+      /* Send each page as one transaction, rendering only the first one now; LcdSM_WaitTransfer
+      renders each following page while the one before it is on the wire.  If the SSP cannot 
+      take a transaction, fall back to sending the pages as a command message and a data 
+      message, starting with the command to set the cursor location. */
+      Lcd_u32Flags &= ~(_LCD_FLAGS_SEGMENTS | _LCD_FLAGS_PAGE_READY);
+      Lcd_u32Flags |= _LCD_FLAGS_REFRESH;
+      LcdRenderRefreshPage();
+      if( !LcdStartRefreshPage() )
+      {
+        LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage);
+      }
       Lcd_pfnStateMachine = LcdSM_WaitTransfer;
     }
   }
@@ -1083,45 +1333,109 @@ static void LcdSM_Idle(void)
 
 @brief Sends the current queued LCD command or data to the SPI peripheral through the SSP API.
 
-This waits until the message token is complete or a timeout occurs.  We can determine the next step based
+This waits until LcdTransferCallback() reports the message is complete or a timeout occurs.  We can determine the next step based
 on Lcd_u8PagesToUpdate that will be 0 if the last transfer was a comand or non-zero if we are waiting
-on the screen refresh process.
+on the screen refresh process.  While a refresh page is sent as a segment transaction, the next 
+page is rendered so it can start as soon as the current one is done.  A transfer that fails or
+is not done within U32_LCD_TRANSFER_TIMEOUT_MS is dropped by LcdAbandonTransfer().
 */
 static void LcdSM_WaitTransfer(void)
 {
-  /* Wait for message to be sent */
-  if(QueryMessageStatus(Lcd_u32CurrentMsgToken) == COMPLETE)
+  if( (Lcd_u32Flags & _LCD_FLAGS_SEGMENTS) && (Lcd_u8PagesToUpdate != 0) && 
+     !(Lcd_u32Flags & _LCD_FLAGS_PAGE_READY) )
   {
-    /* The next step depends on what we did last */
-    if(Lcd_u8PagesToUpdate != 0)
+    LcdRenderRefreshPage();
+  }
+  
+  /* Fall back to polling if the message did not get a callback */
+  if(Lcd_u32Flags & _LCD_FLAGS_POLL_STATUS)
+  {
+    Lcd_eTransferState = QueryMessageStatus(Lcd_u32CurrentMsgToken);
+  }
+  
+  switch(Lcd_eTransferState)
+  {
+    case COMPLETE:
     {
-      /* If the last transmission was a command, that means it's time to load an LCD page */
-      if(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE)
+      /* The next step depends on what we did last */
+      if(Lcd_u8PagesToUpdate != 0)
       {
-        Lcd_u32Flags &= ~_LCD_FLAGS_COMMAND_IN_QUEUE;
+        /* The next segment page is already rendered; if the SSP cannot take it, the rest of the 
+        refresh is sent as messages */
+        if(Lcd_u32Flags & _LCD_FLAGS_SEGMENTS)
+        {
+          if( !LcdStartRefreshPage() )
+          {
+            Lcd_u32Flags &= ~_LCD_FLAGS_SEGMENTS;
+            LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage);
+          }
+        }
+      
+        /* If the last transmission was a command, that means it's time to load an LCD page */
+        else if(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE)
+        {
+          Lcd_u32Flags &= ~_LCD_FLAGS_COMMAND_IN_QUEUE;
         
-        LcdLoadPageToBuffer(Lcd_u8CurrentPage);
-        Lcd_u8CurrentPage++;
-        Lcd_u8PagesToUpdate--;
+          LcdLoadPageToBuffer(Lcd_u8CurrentPage, &Lcd_au8TxBuffer[0]);
+          LCD_DATA_MODE();
+          LcdSendTxBuffer(Lcd_sCurrentUpdateArea.u16ColumnSize);
+          Lcd_u8CurrentPage++;
+          Lcd_u8PagesToUpdate--;
+        }
+        else
+        {
+          LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage);
+        }
+      
+        Lcd_ReturnState = LcdSM_WaitTransfer;
       }
+      /* Either just sent a command, or just sent that last data page */
       else
       {
-        LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage);
+        Lcd_u32Flags &= ~(_LCD_MANUAL_MODE | _LCD_FLAGS_COMMAND_IN_QUEUE | _LCD_FLAGS_SEGMENTS | _LCD_FLAGS_REFRESH);
+        Lcd_ReturnState = LcdSM_Idle;
       }
-      
-      Lcd_ReturnState = LcdSM_WaitTransfer;
+
+      Lcd_pfnStateMachine = Lcd_ReturnState;
+      break;
     }
-    /* Either just sent a command, or just sent that last data page */
-    else
+    
+    case TIMEOUT:
+    case ABANDONED:
+    case FAILED:
+    case NOT_FOUND:
     {
-      Lcd_u32Flags &= ~(_LCD_MANUAL_MODE | _LCD_FLAGS_COMMAND_IN_QUEUE);
-      Lcd_ReturnState = LcdSM_Idle;
+      /* The data never made it to the LCD */
+      LcdAbandonTransfer();
+      break;
     }
-
-    Lcd_pfnStateMachine = Lcd_ReturnState;
-  }
-  
-  /* Check for timeout */
+    
+    default:
+    {
+      /* Still WAITING or SENDING: give up after U32_LCD_TRANSFER_TIMEOUT_MS */
+      if( IsTimeUp(&Lcd_u32Timer, U32_LCD_TRANSFER_TIMEOUT_MS) )
+      {
+        if(Lcd_u32Flags & _LCD_FLAGS_SEGMENTS)
+        {
+          SspAbortSegments(Lcd_Ssp);
+          LcdAbandonTransfer();
+        }
+        
+        /* A message can only be pulled back before it starts; one that is being sent still 
+        owns Lcd_au8TxBuffer, so keep waiting for its final state */
+        else if( CancelMessage(Lcd_u32CurrentMsgToken) )
+        {
+          LcdAbandonTransfer();
+        }
+        else
+        {
+          Lcd_u32Flags |= _LCD_ERROR_TRANSFER;
+          Lcd_u32Timer = G_u32SystemTime1ms;
+        }
+      }
+      break;
+    }
+  } /* end switch(Lcd_eTransferState) */
   
 } /* end LcdSM_WaitTransfer() */
 
@@ -80,6 +80,12 @@ typedef struct
 *******************************************************************************/
 /* Lcd_u32Flags */
 #define _LCD_FLAGS_COMMAND_IN_QUEUE      (u32)0x00000001      /*!< @brief Command or data in LCD */
+#define _LCD_FLAGS_POLL_STATUS           (u32)0x00000002      /*!< @brief No callback on the current message so its status is polled */
+#define _LCD_FLAGS_SEGMENTS              (u32)0x00000004      /*!< @brief The refresh page being sent is an SspWriteSegments() transaction */
+#define _LCD_FLAGS_PAGE_READY            (u32)0x00000008      /*!< @brief The next refresh page is rendered in Lcd_aau8RefreshData[Lcd_u8RefreshBuffer] */
+#define _LCD_FLAGS_REFRESH               (u32)0x00000010      /*!< @brief A screen refresh owns A0 and the SSP until its last page is sent */
+#define _LCD_ERROR_TRANSFER              (u32)0x01000000      /*!< @brief A command or refresh page failed or timed out and was dropped */
+#define _LCD_ERROR_MANUAL_MODE_TIMEOUT   (u32)0x02000000      /*!< @brief LcdManualMode() gave up before the command or refresh was done */
 #define _LCD_MANUAL_MODE                 (u32)0x10000000      /*!< @brief The task is in manual mode */
 /* end Lcd_u32Flags */
 
@@ -101,11 +107,16 @@ typedef struct
 #define U16_LCD_IMAGE_COLUMNS            (u16)(U16_LCD_COLUMNS * (u16)U8_LCD_PIXEL_BITS / 8)
 
 #define U16_LCD_TX_BUFFER_SIZE           (u16)128   /* Enough for a complete page refresh */
+#define U8_LCD_ADDRESS_BYTES             (u8)3      /* Page and column address commands sent before each page of data */
+#define U8_LCD_REFRESH_SEGMENTS          (u8)2      /* An address and a data segment for each refresh page */
+#define U8_LCD_REFRESH_BUFFERS           (u8)2      /* One refresh page is sent while the next one is rendered */
 #define U16_LCD_RX_BUFFER_SIZE           (u16)1     /* Enough for a complete page refresh */
 
 #define U32_LCD_STARTUP_DELAY_200        (u32)205
 #define U32_LCD_STARTUP_DELAY_10         (u32)11
 #define U32_LCD_REFRESH_TIME             (u32)25                
+#define U32_LCD_TRANSFER_TIMEOUT_MS      (u32)100   /* Max time a command or refresh page may take to be sent */
+#define U32_LCD_MANUAL_MODE_TIMEOUT_MS   (u32)250   /* Max time LcdManualMode() runs; longer than a transfer timeout so that is seen first */
 
 /* Bitmap sizes (x = # of column pixels, y = # of row pixels) */
 #define U8_LCD_SMALL_FONT_COLUMNS        (u8)5
@@ -239,8 +250,14 @@ void LcdManualMode(void);
 /*-------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*-------------------------------------------------------------------------------------------------------------------*/
+static void LcdSendTxBuffer(u32 u32Size_);
 static bool LcdSetStartAddressForDataTransfer(u8 u8Page_);         
-static void LcdLoadPageToBuffer(u8 u8LocalRamPage_); 
+static void LcdLoadPageAddress(u8 u8LocalRamPage_, u8* pu8Buffer_);
+static void LcdLoadPageToBuffer(u8 u8LocalRamPage_, u8* pu8Buffer_); 
+static void LcdRenderRefreshPage(void);
+static bool LcdStartRefreshPage(void);
+static void LcdAbandonTransfer(void);
+static void LcdRefreshCallback(void);
 static void LcdUpdateScreenRefreshArea(PixelBlockType* sPixelsToClear_);
 
 
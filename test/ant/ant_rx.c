@@ -0,0 +1,629 @@
+/*!**********************************************************************************************************************
+@file ant_rx.c
+@brief Host test of the ANT SPI link: the unmodified ant.c, sam3u_ssp.c and messaging.c against the
+simulated nRF51422 SPI master in nrf51422_host.c.
+
+The nRF51422 clocks one byte per SRDY pulse, so every byte the host receives or sends costs one
+USART2 interrupt and one SRDY pulse from the host.  The test runs the firmware through the same
+steps as main():
+- AntInitialize() with _SYSTEM_INITIALIZING set: reset, the startup message and the version request
+  must bring ANT up
+- A 1ms main loop of SspRunActiveState(), MessagingRunActiveState() and AntRunActiveState()
+
+On random passes the nRF51422 queues frames for the host: broadcast and acknowledged data (some
+with channel ID extended data), channel status replies and broadcasts with a bad checksum.  On
+other random passes the host queues broadcast data with AntQueueOutgoingMessage(), so its MRDY
+requests regularly collide with frames from the nRF51422 and take the _ANT_FLAGS_TX_INTERRUPTED path.
+
+Checks:
+- Every good data frame reaches G_psAntApplicationMsgList once, in order, with its channel, payload
+  and device ID; corrupted frames and status replies never do
+- Every host frame reaches the nRF51422 once, in order and intact
+- No byte is overrun or sent from an empty THR and no receive or transmit error is reported on the
+  debug port ("ANT transmit failed" is expected for collisions and only counted)
+
+Usage: ant_rx [main loop passes] [seed].  The exit status is 0 if every check passed.
+**********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "configuration.h"
+#include "nrf51422_host.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+***********************************************************************************************************************/
+/* Existing variables that the drivers take from main.c */
+volatile u32 G_u32SystemTime1ms;
+volatile u32 G_u32SystemTime1s;
+volatile u32 G_u32SystemFlags;
+volatile u32 G_u32ApplicationFlags;
+
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern AntApplicationMsgListType *G_psAntApplicationMsgList;  /*!< @brief From ant.c */
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U32_TEST_DEFAULT_PASSES         (u32)100000    /*!< @brief Main loop passes (simulated ms) when none are given */
+#define U32_TEST_PASS_US                (u32)1000      /*!< @brief Simulated time of one main loop pass */
+#define U32_TEST_ISTIMEUP_US            (u32)10        /*!< @brief Simulated time of one IsTimeUp() poll in a wait loop */
+#define U32_TEST_DRAIN_PASSES           (u32)2000      /*!< @brief Most passes to let the traffic in flight finish */
+
+#define U32_TEST_NRF_FRAME_ODDS         (u32)3         /*!< @brief The nRF51422 queues a frame on one pass in this many */
+#define U8_TEST_NRF_MAX_PENDING         (u8)4          /*!< @brief Frames the nRF51422 holds before the test waits */
+#define U32_TEST_HOST_FRAME_ODDS        (u32)5         /*!< @brief The host queues a frame on one pass in this many */
+#define U8_TEST_HOST_MAX_PENDING        (u8)8          /*!< @brief Host frames in flight before the test waits */
+
+#define U8_TEST_EXPECTED_SIZE           (u8)32         /*!< @brief Expected messages kept per direction */
+#define U8_TEST_DATA_BYTES              (u8)8          /*!< @brief Payload bytes of a data message */
+#define U8_TEST_EXT_FRAME_SIZE          (u8)14         /*!< @brief Length byte of data with channel ID extended data */
+#define U8_TEST_MAX_ERRORS              (u8)16         /*!< @brief Errors saved for the report */
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@struct TestAppMessageType
+@brief A data message the application should see
+*/
+typedef struct
+{
+  u8 u8Channel;                                  /*!< @brief ANT channel */
+  u8 au8Data[U8_TEST_DATA_BYTES];                /*!< @brief Payload */
+  u16 u16DeviceID;                               /*!< @brief Device ID from extended data, 0xFFFF if none */
+} TestAppMessageType;
+
+/*!
+@struct TestHostFrameType
+@brief A frame the nRF51422 should receive from the host
+*/
+typedef struct
+{
+  u8 u8Size;                                     /*!< @brief Bytes in au8Frame */
+  u8 au8Frame[U8_NRF_MAX_FRAME];                 /*!< @brief Length, ID, data and checksum */
+} TestHostFrameType;
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Test_<type>" and be declared as static.
+***********************************************************************************************************************/
+static u32 Test_u32Random;                             /*!< @brief Random state */
+
+static TestAppMessageType Test_asExpectedApp[U8_TEST_EXPECTED_SIZE]; /*!< @brief Data messages on their way to the application */
+static u8 Test_u8ExpectedAppHead;                      /*!< @brief Oldest entry of Test_asExpectedApp */
+static u8 Test_u8ExpectedAppCount;                     /*!< @brief Entries in Test_asExpectedApp */
+static TestHostFrameType Test_asExpectedHost[U8_TEST_EXPECTED_SIZE]; /*!< @brief Host frames on their way to the nRF51422 */
+static u8 Test_u8ExpectedHostHead;                     /*!< @brief Oldest entry of Test_asExpectedHost */
+static u8 Test_u8ExpectedHostCount;                    /*!< @brief Entries in Test_asExpectedHost */
+
+static u32 Test_u32DataFrames;                         /*!< @brief Good data frames queued by the nRF51422 */
+static u32 Test_u32ExtendedFrames;                     /*!< @brief ... of which had extended data */
+static u32 Test_u32StatusFrames;                       /*!< @brief Channel status frames queued */
+static u32 Test_u32CorruptFrames;                      /*!< @brief Frames queued with a bad checksum */
+static u32 Test_u32AppMessages;                        /*!< @brief Data messages the application received */
+static u32 Test_u32HostFrames;                         /*!< @brief Frames the host queued */
+static u32 Test_u32HostFramesSeen;                     /*!< @brief Host frames the nRF51422 received */
+static u32 Test_u32Collisions;                         /*!< @brief "ANT transmit failed" reports */
+
+static u32 Test_u32Errors;                             /*!< @brief Checks that failed */
+static const char* Test_apcErrors[U8_TEST_MAX_ERRORS]; /*!< @brief What the first checks that failed were */
+static u32 Test_au32ErrorValues[U8_TEST_MAX_ERRORS];   /*!< @brief A value for each saved error */
+
+/*! @brief Debug output that means the link failed */
+static const char* Test_apcDebugErrors[] =
+{
+  "AntRx:", "AntTx:", "failed boot", "ANT flags", "No space", "Transmit message timeout",
+  "unexpected", "Unexpected", "manual mode timeout"
+};
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+static void TestError(const char* pcError_, u32 u32Value_);
+static u32 TestRandom(u32 u32Range_);
+static void TestNrfFrame(void);
+static void TestHostFrame(void);
+static void TestCheckApplication(void);
+static void TestCheckHostFrames(void);
+static void TestRunPass(bool bTraffic_);
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Stand-ins for the other firmware tasks */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/* Each poll lets a little time pass so the wait loops in ant.c see the nRF51422 move */
+bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
+{
+  Nrf51422Tick(U32_TEST_ISTIMEUP_US);
+  return( (G_u32SystemTime1ms - *pu32SavedTick_) >= u32Period_ ? TRUE : FALSE );
+}
+
+u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_)
+{
+  return( (u8)sprintf((char*)pu8AsciiString_, "%u", (unsigned)u32Number_) );
+}
+
+u8 HexToASCIICharLower(u8 u8Char_)
+{
+  return( (u8)"0123456789abcdef"[u8Char_ & 0x0F] );
+}
+
+u32 DebugPrintf(u8* u8String_)
+{
+  if(strstr((char*)u8String_, "ANT transmit failed") != NULL)
+  {
+    Test_u32Collisions++;
+    return(0);
+  }
+
+  for(u8 i = 0; i < (sizeof(Test_apcDebugErrors) / sizeof(Test_apcDebugErrors[0])); i++)
+  {
+    if(strstr((char*)u8String_, Test_apcDebugErrors[i]) != NULL)
+    {
+      TestError(Test_apcDebugErrors[i], G_u32SystemTime1ms);
+    }
+  }
+
+  return(0);
+}
+
+void DebugLineFeed(void)
+{
+}
+
+void DebugPrintNumber(u32 u32Number_)
+{
+  (void)u32Number_;
+}
+
+u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_)
+{
+  (void)psFragments_;
+  (void)u8Fragments_;
+
+  return(0);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Test */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+  u32 u32Passes = U32_TEST_DEFAULT_PASSES;
+  u32 u32Seed = 1;
+  u32 u32Drain;
+  u32 u32Bytes;
+  Nrf51422StatsType sStats;
+
+  if(argc > 1)
+  {
+    u32Passes = (u32)strtoul(argv[1], NULL, 0);
+  }
+  if(argc > 2)
+  {
+    u32Seed = (u32)strtoul(argv[2], NULL, 0);
+  }
+
+  /* messaging.c links messages through 32-bit words */
+  if( (uintptr_t)&Test_asExpectedHost[0] > UINT32_MAX )
+  {
+    printf("FAIL: data is not in the low 4GB; build with -no-pie\n");
+    return(1);
+  }
+
+  Test_u32Random = (u32Seed * 0x9E3779B9) | 1;
+
+  /* Start up as main() does */
+  Nrf51422Initialize();
+  G_u32SystemFlags = _SYSTEM_INITIALIZING;
+  MessagingInitialize();
+  SspInitialize();
+  AntInitialize();
+  G_u32SystemFlags &= ~_SYSTEM_INITIALIZING;
+
+  if( !(G_u32ApplicationFlags & _APPLICATION_FLAGS_ANT) )
+  {
+    printf("FAIL: ANT did not start\n");
+    return(1);
+  }
+
+  for(u32 i = 0; i < u32Passes; i++)
+  {
+    TestRunPass(TRUE);
+  }
+
+  /* Let everything in flight arrive */
+  for(u32Drain = 0; u32Drain < U32_TEST_DRAIN_PASSES; u32Drain++)
+  {
+    if( (Nrf51422PendingFrames() == 0) && (Test_u8ExpectedAppCount == 0) && (Test_u8ExpectedHostCount == 0) )
+    {
+      break;
+    }
+    TestRunPass(FALSE);
+  }
+
+  if(Test_u8ExpectedAppCount != 0)
+  {
+    TestError("data messages never reached the application", Test_u8ExpectedAppCount);
+  }
+  if(Test_u8ExpectedHostCount != 0)
+  {
+    TestError("host frames never reached the nRF51422", Test_u8ExpectedHostCount);
+  }
+
+  Nrf51422GetStats(&sStats);
+  if(sStats.u32Overruns != 0)
+  {
+    TestError("receive overruns", sStats.u32Overruns);
+  }
+  if(sStats.u32Underruns != 0)
+  {
+    TestError("bytes clocked from an empty THR", sStats.u32Underruns);
+  }
+  if(sStats.u32BadFramesFromHost != 0)
+  {
+    TestError("host frames with a bad checksum", sStats.u32BadFramesFromHost);
+  }
+
+  u32Bytes = sStats.u32BytesToHost + sStats.u32BytesFromHost;
+  printf("%u passes, seed %u: ANT up, %u frames to the host, %u from the host\n", (unsigned)u32Passes,
+         (unsigned)u32Seed, (unsigned)sStats.u32FramesToHost, (unsigned)sStats.u32FramesFromHost);
+  printf("  nRF51422 queued %u data (%u extended), %u status, %u corrupted; application got %u\n",
+         (unsigned)Test_u32DataFrames, (unsigned)Test_u32ExtendedFrames, (unsigned)Test_u32StatusFrames,
+         (unsigned)Test_u32CorruptFrames, (unsigned)Test_u32AppMessages);
+  printf("  host queued %u, nRF51422 got %u, %u MRDY collisions\n", (unsigned)Test_u32HostFrames,
+         (unsigned)Test_u32HostFramesSeen, (unsigned)Test_u32Collisions);
+  printf("  %u bytes: %u USART2 interrupts (%.2f per byte), %u SRDY pulses (%.2f per byte, %u with no byte)\n",
+         (unsigned)u32Bytes, (unsigned)sStats.u32Interrupts, u32Bytes ? (double)sStats.u32Interrupts / u32Bytes : 0.0,
+         (unsigned)sStats.u32SrdyPulses, u32Bytes ? (double)sStats.u32SrdyPulses / u32Bytes : 0.0,
+         (unsigned)sStats.u32StraySrdyPulses);
+
+  if(Test_u32Errors != 0)
+  {
+    for(u8 i = 0; (i < Test_u32Errors) && (i < U8_TEST_MAX_ERRORS); i++)
+    {
+      printf("  ERROR: %s (%u)\n", Test_apcErrors[i], (unsigned)Test_au32ErrorValues[i]);
+    }
+    printf("FAIL: %u errors\n", (unsigned)Test_u32Errors);
+    return(1);
+  }
+
+  printf("PASS\n");
+  return(0);
+
+} /* end main() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestError(const char* pcError_, u32 u32Value_)
+
+@brief Records a failed check.
+
+Requires:
+@param pcError_ describes the check
+@param u32Value_ is a value that helps explain it
+
+Promises:
+- The error is counted and the first U8_TEST_MAX_ERRORS are saved
+
+*/
+static void TestError(const char* pcError_, u32 u32Value_)
+{
+  if(Test_u32Errors < U8_TEST_MAX_ERRORS)
+  {
+    Test_apcErrors[Test_u32Errors] = pcError_;
+    Test_au32ErrorValues[Test_u32Errors] = u32Value_;
+  }
+
+  Test_u32Errors++;
+
+} /* end TestError() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u32 TestRandom(u32 u32Range_)
+
+@brief xorshift32 random number.
+
+Requires:
+@param u32Range_ is the number of possible results
+
+Promises:
+- Returns a number from 0 to u32Range_ - 1
+
+*/
+static u32 TestRandom(u32 u32Range_)
+{
+  Test_u32Random ^= Test_u32Random << 13;
+  Test_u32Random ^= Test_u32Random >> 17;
+  Test_u32Random ^= Test_u32Random << 5;
+
+  return(Test_u32Random % u32Range_);
+
+} /* end TestRandom() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestNrfFrame(void)
+
+@brief Has the nRF51422 queue a random frame for the host.
+
+Requires:
+- Test_asExpectedApp has room
+
+Promises:
+- One of: broadcast or acknowledged data, data with channel ID extended data, a channel status
+  reply, or a broadcast with a bad checksum is queued
+- Good data frames are added to Test_asExpectedApp
+
+*/
+static void TestNrfFrame(void)
+{
+  u8 au8Data[U8_TEST_EXT_FRAME_SIZE];
+  u8 u8Kind = (u8)TestRandom(8);
+  u8 u8Size = MESG_DATA_SIZE;
+  u8 u8MessageId = (TestRandom(2) == 0) ? MESG_BROADCAST_DATA_ID : MESG_ACKNOWLEDGED_DATA_ID;
+  TestAppMessageType* psExpected;
+
+  au8Data[0] = (u8)TestRandom(ANT_NUM_CHANNELS);
+  for(u8 i = 1; i < sizeof(au8Data); i++)
+  {
+    au8Data[i] = (u8)TestRandom(256);
+  }
+
+  /* Channel status: [channel, status], handled by ant.c without an application message */
+  if(u8Kind == 0)
+  {
+    if(Nrf51422QueueFrame(MESG_CHANNEL_STATUS_ID, au8Data, MESG_CHANNEL_STATUS_SIZE, FALSE))
+    {
+      Test_u32StatusFrames++;
+    }
+    return;
+  }
+
+  /* Bad checksum: ant.c must drop it */
+  if(u8Kind == 1)
+  {
+    if(Nrf51422QueueFrame(MESG_BROADCAST_DATA_ID, au8Data, MESG_DATA_SIZE, TRUE))
+    {
+      Test_u32CorruptFrames++;
+    }
+    return;
+  }
+
+  /* Channel ID extended data: flag byte, device ID, device type, transmission type */
+  if(u8Kind == 2)
+  {
+    u8Size = U8_TEST_EXT_FRAME_SIZE;
+    au8Data[MESG_DATA_SIZE] = LIB_CONFIG_CHANNEL_ID_FLAG;
+  }
+
+  if(!Nrf51422QueueFrame(u8MessageId, au8Data, u8Size, FALSE))
+  {
+    return;
+  }
+
+  psExpected = &Test_asExpectedApp[(Test_u8ExpectedAppHead + Test_u8ExpectedAppCount) % U8_TEST_EXPECTED_SIZE];
+  psExpected->u8Channel = au8Data[0];
+  memcpy(psExpected->au8Data, &au8Data[1], U8_TEST_DATA_BYTES);
+  psExpected->u16DeviceID = 0xFFFF;
+  if(u8Kind == 2)
+  {
+    psExpected->u16DeviceID = (u16)au8Data[MESG_DATA_SIZE + 1] | ((u16)au8Data[MESG_DATA_SIZE + 2] << 8);
+    Test_u32ExtendedFrames++;
+  }
+
+  Test_u8ExpectedAppCount++;
+  Test_u32DataFrames++;
+
+} /* end TestNrfFrame() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestHostFrame(void)
+
+@brief Has the host queue broadcast data for the nRF51422.
+
+Requires:
+- Test_asExpectedHost has room
+
+Promises:
+- A broadcast frame with random channel and payload is queued with AntQueueOutgoingMessage() and
+  added to Test_asExpectedHost
+
+*/
+static void TestHostFrame(void)
+{
+  TestHostFrameType* psExpected;
+  u8* pu8Frame;
+
+  psExpected = &Test_asExpectedHost[(Test_u8ExpectedHostHead + Test_u8ExpectedHostCount) % U8_TEST_EXPECTED_SIZE];
+  pu8Frame = psExpected->au8Frame;
+
+  pu8Frame[0] = MESG_DATA_SIZE;
+  pu8Frame[1] = MESG_BROADCAST_DATA_ID;
+  pu8Frame[2] = (u8)TestRandom(ANT_NUM_CHANNELS);
+  for(u8 i = 0; i < U8_TEST_DATA_BYTES; i++)
+  {
+    pu8Frame[3 + i] = (u8)TestRandom(256);
+  }
+  pu8Frame[MESG_DATA_SIZE + 2] = AntCalculateTxChecksum(pu8Frame);
+  psExpected->u8Size = MESG_DATA_SIZE + 3;
+
+  if(!AntQueueOutgoingMessage(pu8Frame))
+  {
+    TestError("AntQueueOutgoingMessage() refused a frame", Test_u32HostFrames);
+    return;
+  }
+
+  Test_u8ExpectedHostCount++;
+  Test_u32HostFrames++;
+
+} /* end TestHostFrame() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestCheckApplication(void)
+
+@brief Takes every message off G_psAntApplicationMsgList and checks it against Test_asExpectedApp.
+
+Promises:
+- Each message must be ANT_DATA and match the oldest expected message, which is removed
+
+*/
+static void TestCheckApplication(void)
+{
+  TestAppMessageType* psExpected;
+
+  while(G_psAntApplicationMsgList != NULL)
+  {
+    Test_u32AppMessages++;
+
+    if(Test_u8ExpectedAppCount == 0)
+    {
+      TestError("unexpected application message", G_psAntApplicationMsgList->eMessageType);
+      AntDeQueueApplicationMessage();
+      continue;
+    }
+
+    psExpected = &Test_asExpectedApp[Test_u8ExpectedAppHead];
+    if(G_psAntApplicationMsgList->eMessageType != ANT_DATA)
+    {
+      TestError("application message is not ANT_DATA", G_psAntApplicationMsgList->eMessageType);
+    }
+    else if(G_psAntApplicationMsgList->sExtendedData.u8Channel != psExpected->u8Channel)
+    {
+      TestError("application message on the wrong channel", G_psAntApplicationMsgList->sExtendedData.u8Channel);
+    }
+    else if(memcmp(G_psAntApplicationMsgList->au8MessageData, psExpected->au8Data, U8_TEST_DATA_BYTES) != 0)
+    {
+      TestError("application message payload differs", Test_u32AppMessages);
+    }
+    else if(G_psAntApplicationMsgList->sExtendedData.u16DeviceID != psExpected->u16DeviceID)
+    {
+      TestError("application message device ID differs", G_psAntApplicationMsgList->sExtendedData.u16DeviceID);
+    }
+
+    Test_u8ExpectedAppHead = (Test_u8ExpectedAppHead + 1) % U8_TEST_EXPECTED_SIZE;
+    Test_u8ExpectedAppCount--;
+    AntDeQueueApplicationMessage();
+  }
+
+} /* end TestCheckApplication() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestCheckHostFrames(void)
+
+@brief Takes every frame the nRF51422 received and checks it against Test_asExpectedHost.
+
+Promises:
+- Each frame must match the oldest expected frame, which is removed
+
+*/
+static void TestCheckHostFrames(void)
+{
+  u8 au8Frame[U8_NRF_MAX_FRAME];
+  u8 u8Size;
+  TestHostFrameType* psExpected;
+
+  while( (u8Size = Nrf51422ReadHostFrame(au8Frame)) != 0 )
+  {
+    Test_u32HostFramesSeen++;
+
+    if(Test_u8ExpectedHostCount == 0)
+    {
+      TestError("unexpected frame from the host", au8Frame[1]);
+      continue;
+    }
+
+    psExpected = &Test_asExpectedHost[Test_u8ExpectedHostHead];
+    if( (u8Size != psExpected->u8Size) || (memcmp(au8Frame, psExpected->au8Frame, u8Size) != 0) )
+    {
+      TestError("host frame differs or is out of order", Test_u32HostFramesSeen);
+    }
+
+    Test_u8ExpectedHostHead = (Test_u8ExpectedHostHead + 1) % U8_TEST_EXPECTED_SIZE;
+    Test_u8ExpectedHostCount--;
+  }
+
+} /* end TestCheckHostFrames() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestRunPass(bool bTraffic_)
+
+@brief Runs one 1ms main loop pass.
+
+Requires:
+@param bTraffic_ is TRUE to let both sides queue new frames
+
+Promises:
+- New frames may be queued, the SSP, messaging and ANT tasks run once, what arrived is checked
+  and U32_TEST_PASS_US pass
+- Half the nRF51422 frames are queued just before AntRunActiveState(), so the nRF51422 has not
+  asserted SEN for them yet when the ANT task asserts MRDY
+
+*/
+static void TestRunPass(bool bTraffic_)
+{
+  bool bNrfFrame = FALSE;
+  bool bLateFrame = FALSE;
+
+  if(bTraffic_)
+  {
+    if( (Nrf51422PendingFrames() < U8_TEST_NRF_MAX_PENDING) &&
+        (Test_u8ExpectedAppCount < (U8_TEST_EXPECTED_SIZE - U8_TEST_NRF_MAX_PENDING)) &&
+        (TestRandom(U32_TEST_NRF_FRAME_ODDS) == 0) )
+    {
+      bNrfFrame = TRUE;
+      bLateFrame = (TestRandom(2) == 0);
+    }
+
+    if( (Test_u8ExpectedHostCount < U8_TEST_HOST_MAX_PENDING) && (TestRandom(U32_TEST_HOST_FRAME_ODDS) == 0) )
+    {
+      TestHostFrame();
+    }
+  }
+
+  if(bNrfFrame && !bLateFrame)
+  {
+    TestNrfFrame();
+  }
+
+  SspRunActiveState();
+  MessagingRunActiveState();
+
+  /* A frame that shows up right before the ANT task collides with a host transmit started in this pass */
+  if(bLateFrame)
+  {
+    TestNrfFrame();
+  }
+
+  AntRunActiveState();
+
+  TestCheckApplication();
+  TestCheckHostFrames();
+
+  Nrf51422Tick(U32_TEST_PASS_US);
+
+} /* end TestRunPass() */
@@ -0,0 +1,173 @@
+/*!**********************************************************************************************************************
+@file configuration.h
+@brief Host stand-in for firmware_common/bsp/configuration.h used by the ANT receive test.
+
+ant.c, sam3u_ssp.c and messaging.c include only configuration.h, so this file gives them the EiE
+types, the real SAM3U register layouts with the peripherals they touch moved into host memory, the
+ANT board pins wired to the simulated nRF51422 (nrf51422_host.c) and the few symbols they take from
+other tasks.  u32 must be exactly 32 bits here since messaging.c stores pointers through
+(volatile uint32_t*).
+***********************************************************************************************************************/
+
+#ifndef __CONFIG_H
+#define __CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**********************************************************************************************************************
+Type Definitions (see firmware_common/bsp/typedefs.h)
+**********************************************************************************************************************/
+typedef int32_t  s32;
+typedef int16_t  s16;
+typedef int8_t   s8;
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+
+typedef unsigned char UCHAR;
+
+typedef void(*fnCode_type)(void);
+
+typedef enum {FALSE = 0, TRUE = !FALSE} bool;
+
+typedef enum {SPI0, UART, USART0, USART1, USART2, USART3} PeripheralType;
+
+
+/**********************************************************************************************************************
+SAM3U registers: the peripherals the drivers touch live in host memory (nrf51422_host.c)
+**********************************************************************************************************************/
+#include "AT91SAM3U4.h"
+
+#undef AT91C_BASE_US0
+#undef AT91C_BASE_US1
+#undef AT91C_BASE_US2
+#undef AT91C_BASE_PIOA
+#undef AT91C_BASE_PIOB
+#undef AT91C_BASE_PMC
+
+extern AT91S_USART Host_sUsart0;
+extern AT91S_USART Host_sUsart1;
+extern AT91S_USART Host_sUsart2;
+extern AT91S_PIO Host_sPioA;
+extern AT91S_PIO Host_sPioB;
+extern AT91S_PMC Host_sPmc;
+
+#define AT91C_BASE_US0              (&Host_sUsart0)
+#define AT91C_BASE_US1              (&Host_sUsart1)
+#define AT91C_BASE_US2              (&Host_sUsart2)
+#define AT91C_BASE_PIOA             (&Host_sPioA)
+#define AT91C_BASE_PIOB             (&Host_sPioB)
+#define AT91C_BASE_PMC              (&Host_sPmc)
+
+#include "interrupts.h"
+#include "main.h"
+#include "utilities.h"
+
+
+/**********************************************************************************************************************
+Cortex-M3 intrinsics and NVIC (nrf51422_host.c)
+**********************************************************************************************************************/
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __LDREXW(volatile uint32_t* pu32Address_);
+uint32_t __STREXW(uint32_t u32Value_, volatile uint32_t* pu32Address_);
+uint8_t __LDREXB(volatile uint8_t* pu8Address_);
+uint32_t __STREXB(uint8_t u8Value_, volatile uint8_t* pu8Address_);
+void __CLREX(void);
+uint8_t __CLZ(uint32_t u32Value_);
+uint32_t __RBIT(uint32_t u32Value_);
+
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+
+
+/**********************************************************************************************************************
+Board: ANT lines (see firmware_dotmatrix/bsp/mpgl2-ehdw-02.h) wired to the simulated nRF51422
+**********************************************************************************************************************/
+#define PA_25_ANT_USPI2_SCK         (u32)0x02000000
+#define PA_23_ANT_USPI2_MOSI        (u32)0x00800000
+#define PA_22_ANT_USPI2_MISO        (u32)0x00400000
+
+#define PB_24_ANT_SRDY              (u32)0x01000000
+#define PB_23_ANT_MRDY              (u32)0x00800000
+#define PB_22_ANT_USPI2_CS          (u32)0x00400000
+#define PB_21_ANT_RESET             (u32)0x00200000
+#define PB_00_BUTTON1               (u32)0x00000001
+
+void Nrf51422SrdyAssert(void);
+void Nrf51422SrdyDeassert(void);
+void Nrf51422MrdyAssert(void);
+void Nrf51422MrdyDeassert(void);
+void Nrf51422ResetAssert(void);
+void Nrf51422ResetDeassert(void);
+
+#define ANT_MRDY_READ_REG           (AT91C_BASE_PIOB->PIO_PDSR & PB_23_ANT_MRDY)
+#define ANT_MRDY_CLEAR_REG          (Nrf51422MrdyAssert())
+#define ANT_MRDY_SET_REG            (Nrf51422MrdyDeassert())
+#define ANT_SRDY_CLEAR_REG          (Nrf51422SrdyAssert())
+#define ANT_SRDY_SET_REG            (Nrf51422SrdyDeassert())
+#define ANT_RESET_CLEAR_REG         (Nrf51422ResetAssert())
+#define ANT_RESET_SET_REG           (Nrf51422ResetDeassert())
+
+#define ANT_PIOA_PINS               (u32)(PA_25_ANT_USPI2_SCK | PA_23_ANT_USPI2_MOSI | PA_22_ANT_USPI2_MISO)
+#define ANT_PIOB_PINS               (u32)(PB_21_ANT_RESET | PB_22_ANT_USPI2_CS | PB_23_ANT_MRDY | PB_24_ANT_SRDY)
+#define ANT_DISABLE_BUTTON          (AT91C_BASE_PIOB->PIO_PDSR & PB_00_BUTTON1)
+
+#define WATCHDOG_BONE()
+
+
+/**********************************************************************************************************************
+SSP allocation (see firmware_common/bsp/configuration.h); only USART2 is used
+**********************************************************************************************************************/
+#define ANT_SPI                     USART2
+#define ANT_SSP_FLAGS               G_u32Ssp2ApplicationFlags
+#define ANT_SPI_CS_GPIO             AT91C_BASE_PIOB
+#define ANT_SPI_CS_PIN              PB_22_ANT_USPI2_CS
+
+#define ANT_SPI_US_CR_INIT          (u32)0x00000050
+#define ANT_SPI_US_MR_INIT          (u32)0x004118FF
+#define ANT_SPI_US_IER_INIT         (u32)0x00080000
+#define ANT_SPI_US_IDR_INIT         (u32)~ANT_SPI_US_IER_INIT
+#define ANT_SPI_US_BRGR_INIT        (u32)0x00000000
+
+#define USART0_US_CR_INIT           (u32)0
+#define USART0_US_MR_INIT           (u32)0
+#define USART0_US_IER_INIT          (u32)0
+#define USART0_US_IDR_INIT          (u32)0xFFFFFFFF
+#define USART0_US_BRGR_INIT         (u32)0
+#define USART1_US_CR_INIT           (u32)0
+#define USART1_US_MR_INIT           (u32)0
+#define USART1_US_IER_INIT          (u32)0
+#define USART1_US_IDR_INIT          (u32)0xFFFFFFFF
+#define USART1_US_BRGR_INIT         (u32)0
+#define USART2_US_CR_INIT           ANT_SPI_US_CR_INIT
+#define USART2_US_MR_INIT           ANT_SPI_US_MR_INIT
+#define USART2_US_IER_INIT          ANT_SPI_US_IER_INIT
+#define USART2_US_IDR_INIT          ANT_SPI_US_IDR_INIT
+#define USART2_US_BRGR_INIT         ANT_SPI_US_BRGR_INIT
+
+
+/**********************************************************************************************************************
+Driver header files
+**********************************************************************************************************************/
+#include "messaging.h"
+#include "antmessage.h"
+#include "antdefines.h"
+#include "ant.h"
+#include "ant_api.h"
+#include "sam3u_ssp.h"
+
+/* Stand-ins for debug.h (ant_rx.c) */
+u32 DebugPrintf(u8* u8String_);
+void DebugLineFeed(void);
+void DebugPrintNumber(u32 u32Number_);
+u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_);
+
+
+#endif /* __CONFIG_H */
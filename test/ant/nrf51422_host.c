@@ -0,0 +1,817 @@
+/*!**********************************************************************************************************************
+@file nrf51422_host.c
+@brief Simulates the nRF51422 SPI master and the SAM3U USART2 it talks to so ant.c and sam3u_ssp.c
+can be run on a host.
+
+The nRF51422 is the SPI master and uses the ANT SPI handshake:
+- It asserts SEN (the USART2 chip select) to start a transaction: when it has a frame for the host,
+  or when the host asks to send by asserting MRDY
+- It clocks exactly one byte for each SRDY pulse from the host, full duplex
+- The first byte it sends is MESG_TX_SYNC if it is sending a frame, or MESG_RX_SYNC if the host may send
+- It deasserts SEN after the last byte of the frame
+
+USART2 is modelled at the register level.  A byte clock moves THR out and sets RHR and RXRDY (with
+the bits reversed, since the ANT link is LSB first and the driver flips each byte), and SEN edges set
+CTSIC.  IER and IDR writes are applied to IMR before each interrupt check, and interrupts are taken
+synchronously: right after the event if interrupts are enabled, otherwise when __enable_irq() or
+NVIC_EnableIRQ() unmasks them.  Reading RHR and CSR cannot be trapped, so RXRDY is cleared after an
+ISR that serviced RXRDY or TXEMPTY (both read RHR) and CTSIC after every ISR.
+
+An SRDY pulse from inside the ISR is clocked when the ISR returns, as the ISR would be re-entered for
+that byte on the target.  SEN is only deasserted once no interrupt is pending, since the host ISR
+runs well inside the time the nRF51422 holds SEN after the last byte.
+
+Time is simulated in microseconds and drives G_u32SystemTime1ms.
+
+------------------------------------------------------------------------------------------------------------------------
+API:
+- void Nrf51422Initialize(void)
+- bool Nrf51422QueueFrame(u8 u8MessageId_, u8* pu8Data_, u8 u8Size_, bool bCorrupt_)
+- u8 Nrf51422ReadHostFrame(u8* pu8Frame_)
+- u8 Nrf51422PendingFrames(void)
+- void Nrf51422Tick(u32 u32Microseconds_)
+- void Nrf51422GetStats(Nrf51422StatsType* psStats_)
+- The board line hooks, intrinsics and NVIC functions declared in configuration.h
+
+**********************************************************************************************************************/
+
+#include "configuration.h"
+#include "nrf51422_host.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+***********************************************************************************************************************/
+/* Peripherals that configuration.h moves into host memory */
+AT91S_USART Host_sUsart0;
+AT91S_USART Host_sUsart1;
+AT91S_USART Host_sUsart2;
+AT91S_PIO Host_sPioA;
+AT91S_PIO Host_sPioB;
+AT91S_PMC Host_sPmc;
+
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From ant_rx.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From ant_rx.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Nrf_<type>" and be declared as static.
+***********************************************************************************************************************/
+#define U32_NRF_THR_EMPTY               (u32)0xFFFFFFFF /*!< @brief THR value while nothing is waiting to be shifted out */
+
+static Nrf51422StateType Nrf_eState;                   /*!< @brief Transaction state */
+static u32 Nrf_u32TimeUs;                              /*!< @brief Simulated time */
+static bool Nrf_bBooting;                              /*!< @brief Reset has been released and the startup message is due */
+static u32 Nrf_u32BootDoneUs;                          /*!< @brief Time the startup message is queued */
+static u32 Nrf_u32NextSenUs;                           /*!< @brief Earliest time SEN may be asserted again */
+
+static u8 Nrf_aau8TxQueue[U8_NRF_TX_QUEUE_SIZE][U8_NRF_MAX_FRAME]; /*!< @brief Frames waiting for the host */
+static u8 Nrf_au8TxQueueSize[U8_NRF_TX_QUEUE_SIZE];    /*!< @brief Size of each waiting frame */
+static u8 Nrf_u8TxQueueHead;                           /*!< @brief Oldest waiting frame */
+static u8 Nrf_u8TxQueueCount;                          /*!< @brief Number of waiting frames */
+
+static u8 Nrf_au8Frame[U8_NRF_MAX_FRAME];              /*!< @brief Frame being clocked out to the host */
+static u8 Nrf_u8FrameSize;                             /*!< @brief Size of Nrf_au8Frame */
+static u8 Nrf_u8FrameIndex;                            /*!< @brief Next byte of Nrf_au8Frame to clock */
+static bool Nrf_bRxSyncSent;                           /*!< @brief MESG_RX_SYNC went out in a host-to-ANT transaction */
+static u8 Nrf_au8HostFrame[U8_NRF_MAX_FRAME];          /*!< @brief Frame being clocked in from the host */
+static u8 Nrf_u8HostBytes;                             /*!< @brief Bytes in Nrf_au8HostFrame */
+
+static u8 Nrf_aau8HostLog[U8_NRF_HOST_LOG_SIZE][U8_NRF_MAX_FRAME]; /*!< @brief Good frames from the host */
+static u8 Nrf_au8HostLogSize[U8_NRF_HOST_LOG_SIZE];    /*!< @brief Size of each logged frame */
+static u8 Nrf_u8HostLogHead;                           /*!< @brief Oldest logged frame */
+static u8 Nrf_u8HostLogCount;                          /*!< @brief Number of logged frames */
+
+static bool Nrf_bInIsr;                                /*!< @brief SSP2_IRQHandler is running */
+static bool Nrf_bPrimask;                              /*!< @brief __disable_irq() is in effect */
+static bool Nrf_bUs2Enabled;                           /*!< @brief The USART2 interrupt is enabled in the NVIC */
+static u8 Nrf_u8IsrPulses;                             /*!< @brief SRDY pulses made by the ISR, clocked when it returns */
+
+static volatile void* Nrf_pvMonitor;                   /*!< @brief Address of the last LDREX */
+
+static Nrf51422StatsType Nrf_sStats;                   /*!< @brief Bus statistics */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+static u8 NrfReverse(u8 u8Byte_);
+static void NrfSetSen(bool bAsserted_);
+static void NrfStartTransaction(void);
+static void NrfSrdyPulse(void);
+static void NrfClockByte(void);
+static void NrfHostFrameDone(void);
+static void NrfRunInterrupts(void);
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void Nrf51422Initialize(void)
+
+@brief Powers up the simulated board with the nRF51422 held in reset.
+
+Requires:
+- NONE
+
+Promises:
+- Registers are at their reset values: SEN, MRDY and SRDY are high, BUTTON1 is not pressed, THR is empty
+- Time is 0, every queue and statistic is empty and interrupts are enabled
+
+*/
+void Nrf51422Initialize(void)
+{
+  memset(&Host_sUsart0, 0, sizeof(Host_sUsart0));
+  memset(&Host_sUsart1, 0, sizeof(Host_sUsart1));
+  memset(&Host_sUsart2, 0, sizeof(Host_sUsart2));
+  memset(&Host_sPioA, 0, sizeof(Host_sPioA));
+  memset(&Host_sPioB, 0, sizeof(Host_sPioB));
+  memset(&Host_sPmc, 0, sizeof(Host_sPmc));
+  memset(&Nrf_sStats, 0, sizeof(Nrf_sStats));
+
+  Host_sPioB.PIO_PDSR = PB_24_ANT_SRDY | PB_23_ANT_MRDY | PB_22_ANT_USPI2_CS | PB_00_BUTTON1;
+  Host_sUsart2.US_THR = U32_NRF_THR_EMPTY;
+  Host_sUsart2.US_CSR = AT91C_US_TXEMPTY;
+
+  Nrf_eState = NRF_RESET;
+  Nrf_bBooting = FALSE;
+  Nrf_u32TimeUs = 0;
+  Nrf_u32NextSenUs = 0;
+  Nrf_u8TxQueueHead = 0;
+  Nrf_u8TxQueueCount = 0;
+  Nrf_u8HostLogHead = 0;
+  Nrf_u8HostLogCount = 0;
+  Nrf_bInIsr = FALSE;
+  Nrf_bPrimask = FALSE;
+  Nrf_bUs2Enabled = FALSE;
+  Nrf_u8IsrPulses = 0;
+
+  G_u32SystemTime1ms = 0;
+  G_u32SystemTime1s = 0;
+
+} /* end Nrf51422Initialize() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn bool Nrf51422QueueFrame(u8 u8MessageId_, u8* pu8Data_, u8 u8Size_, bool bCorrupt_)
+
+@brief Queues an ANT message for the nRF51422 to send to the host.
+
+Requires:
+@param u8MessageId_ is the ANT message ID
+@param pu8Data_ points to the message content (channel number first for channel messages)
+@param u8Size_ is the number of bytes at pu8Data_, which is the frame's length byte
+@param bCorrupt_ is TRUE to send the frame with a bad checksum
+
+Promises:
+- Returns TRUE if the frame is queued as SYNC, length, ID, data and checksum; SEN is asserted for it
+  on a later Nrf51422Tick() once the bus is free
+- Returns FALSE if the queue is full or the frame is too big
+
+*/
+bool Nrf51422QueueFrame(u8 u8MessageId_, u8* pu8Data_, u8 u8Size_, bool bCorrupt_)
+{
+  u8* pu8Frame;
+  u8 u8Checksum;
+
+  if( (Nrf_u8TxQueueCount == U8_NRF_TX_QUEUE_SIZE) || ((u8Size_ + 4) > U8_NRF_MAX_FRAME) )
+  {
+    return(FALSE);
+  }
+
+  pu8Frame = Nrf_aau8TxQueue[(Nrf_u8TxQueueHead + Nrf_u8TxQueueCount) % U8_NRF_TX_QUEUE_SIZE];
+  pu8Frame[0] = MESG_TX_SYNC;
+  pu8Frame[1] = u8Size_;
+  pu8Frame[2] = u8MessageId_;
+  memcpy(&pu8Frame[3], pu8Data_, u8Size_);
+
+  /* The ANT checksum is the XOR of every byte from SYNC on */
+  u8Checksum = 0;
+  for(u8 i = 0; i < (u8Size_ + 3); i++)
+  {
+    u8Checksum ^= pu8Frame[i];
+  }
+
+  if(bCorrupt_)
+  {
+    u8Checksum ^= 0x5A;
+  }
+
+  pu8Frame[u8Size_ + 3] = u8Checksum;
+  Nrf_au8TxQueueSize[(Nrf_u8TxQueueHead + Nrf_u8TxQueueCount) % U8_NRF_TX_QUEUE_SIZE] = u8Size_ + 4;
+  Nrf_u8TxQueueCount++;
+
+  return(TRUE);
+
+} /* end Nrf51422QueueFrame() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u8 Nrf51422ReadHostFrame(u8* pu8Frame_)
+
+@brief Takes the oldest good frame the host sent, other than the version requests the nRF51422 answers.
+
+Requires:
+@param pu8Frame_ has room for U8_NRF_MAX_FRAME bytes
+
+Promises:
+- Returns the frame size and copies it to pu8Frame_ as length, ID, data and checksum, the same
+  layout the host passes to AntQueueOutgoingMessage()
+- Returns 0 if there are no frames
+
+*/
+u8 Nrf51422ReadHostFrame(u8* pu8Frame_)
+{
+  u8 u8Size;
+
+  if(Nrf_u8HostLogCount == 0)
+  {
+    return(0);
+  }
+
+  u8Size = Nrf_au8HostLogSize[Nrf_u8HostLogHead];
+  memcpy(pu8Frame_, Nrf_aau8HostLog[Nrf_u8HostLogHead], u8Size);
+  Nrf_u8HostLogHead = (Nrf_u8HostLogHead + 1) % U8_NRF_HOST_LOG_SIZE;
+  Nrf_u8HostLogCount--;
+
+  return(u8Size);
+
+} /* end Nrf51422ReadHostFrame() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u8 Nrf51422PendingFrames(void)
+
+@brief Reports how many frames are waiting to go to the host, counting one that is on the bus.
+
+Requires:
+- NONE
+
+Promises:
+- Returns the number of queued frames, plus one if a frame to the host is in progress
+
+*/
+u8 Nrf51422PendingFrames(void)
+{
+  return( Nrf_u8TxQueueCount + ((Nrf_eState == NRF_TO_HOST) ? 1 : 0) );
+
+} /* end Nrf51422PendingFrames() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void Nrf51422Tick(u32 u32Microseconds_)
+
+@brief Advances simulated time and lets the nRF51422 start a transaction that is due.
+
+Requires:
+@param u32Microseconds_ is the time that passed
+
+Promises:
+- G_u32SystemTime1ms and G_u32SystemTime1s follow the simulated time
+- The startup message is queued once U32_NRF_BOOT_US have passed since reset was released
+- If the bus is idle, a frame is waiting and U32_NRF_SEN_GAP_US have passed since the last
+  transaction, SEN is asserted for it
+
+*/
+void Nrf51422Tick(u32 u32Microseconds_)
+{
+  u8 au8StartupReason[] = {0x20};
+
+  Nrf_u32TimeUs += u32Microseconds_;
+  G_u32SystemTime1ms = Nrf_u32TimeUs / 1000;
+  G_u32SystemTime1s  = Nrf_u32TimeUs / 1000000;
+
+  /* Boot: the first thing the nRF51422 does is send the startup message (power-on reset reason) */
+  if( Nrf_bBooting && ((s32)(Nrf_u32TimeUs - Nrf_u32BootDoneUs) >= 0) )
+  {
+    Nrf_bBooting = FALSE;
+    Nrf_eState = NRF_IDLE;
+    Nrf51422QueueFrame(MESG_RESTART_ID, au8StartupReason, sizeof(au8StartupReason), FALSE);
+  }
+
+  if( (Nrf_eState == NRF_IDLE) && (Nrf_u8TxQueueCount != 0) &&
+      ((s32)(Nrf_u32TimeUs - Nrf_u32NextSenUs) >= 0) )
+  {
+    NrfStartTransaction();
+  }
+
+} /* end Nrf51422Tick() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void Nrf51422GetStats(Nrf51422StatsType* psStats_)
+
+@brief Copies the bus statistics.
+
+Requires:
+@param psStats_ is where to put them
+
+Promises:
+- *psStats_ holds the statistics since Nrf51422Initialize()
+
+*/
+void Nrf51422GetStats(Nrf51422StatsType* psStats_)
+{
+  *psStats_ = Nrf_sStats;
+
+} /* end Nrf51422GetStats() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Board lines (configuration.h ANT_*_REG macros) */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+void Nrf51422SrdyAssert(void)
+{
+  Host_sPioB.PIO_PDSR &= ~PB_24_ANT_SRDY;
+}
+
+/* The nRF51422 clocks a byte at the end of each SRDY pulse */
+void Nrf51422SrdyDeassert(void)
+{
+  if(Host_sPioB.PIO_PDSR & PB_24_ANT_SRDY)
+  {
+    return;
+  }
+
+  Host_sPioB.PIO_PDSR |= PB_24_ANT_SRDY;
+  Nrf_sStats.u32SrdyPulses++;
+
+  if(Nrf_bInIsr)
+  {
+    Nrf_u8IsrPulses++;
+  }
+  else
+  {
+    NrfSrdyPulse();
+    NrfRunInterrupts();
+  }
+}
+
+/* MRDY starts a transaction right away if the bus is idle */
+void Nrf51422MrdyAssert(void)
+{
+  Host_sPioB.PIO_PDSR &= ~PB_23_ANT_MRDY;
+
+  if(Nrf_eState == NRF_IDLE)
+  {
+    NrfStartTransaction();
+  }
+}
+
+void Nrf51422MrdyDeassert(void)
+{
+  Host_sPioB.PIO_PDSR |= PB_23_ANT_MRDY;
+}
+
+/* Reset drops any transaction and everything queued */
+void Nrf51422ResetAssert(void)
+{
+  Host_sPioB.PIO_PDSR &= ~PB_21_ANT_RESET;
+
+  if( (Nrf_eState != NRF_RESET) && (Nrf_eState != NRF_IDLE) )
+  {
+    NrfSetSen(FALSE);
+  }
+
+  Nrf_eState = NRF_RESET;
+  Nrf_bBooting = FALSE;
+  Nrf_u8TxQueueCount = 0;
+  NrfRunInterrupts();
+}
+
+void Nrf51422ResetDeassert(void)
+{
+  Host_sPioB.PIO_PDSR |= PB_21_ANT_RESET;
+
+  if( (Nrf_eState == NRF_RESET) && !Nrf_bBooting )
+  {
+    Nrf_bBooting = TRUE;
+    Nrf_u32BootDoneUs = Nrf_u32TimeUs + U32_NRF_BOOT_US;
+  }
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Cortex-M3 intrinsics and NVIC */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+void __disable_irq(void)
+{
+  Nrf_bPrimask = TRUE;
+}
+
+void __enable_irq(void)
+{
+  Nrf_bPrimask = FALSE;
+  NrfRunInterrupts();
+}
+
+/* Nothing preempts between LDREX and STREX except an ISR taken in between, which clears the monitor */
+uint32_t __LDREXW(volatile uint32_t* pu32Address_)
+{
+  Nrf_pvMonitor = pu32Address_;
+  return(*pu32Address_);
+}
+
+uint32_t __STREXW(uint32_t u32Value_, volatile uint32_t* pu32Address_)
+{
+  if(Nrf_pvMonitor != pu32Address_)
+  {
+    return(1);
+  }
+
+  *pu32Address_ = u32Value_;
+  Nrf_pvMonitor = NULL;
+  return(0);
+}
+
+uint8_t __LDREXB(volatile uint8_t* pu8Address_)
+{
+  Nrf_pvMonitor = pu8Address_;
+  return(*pu8Address_);
+}
+
+uint32_t __STREXB(uint8_t u8Value_, volatile uint8_t* pu8Address_)
+{
+  if(Nrf_pvMonitor != pu8Address_)
+  {
+    return(1);
+  }
+
+  *pu8Address_ = u8Value_;
+  Nrf_pvMonitor = NULL;
+  return(0);
+}
+
+void __CLREX(void)
+{
+  Nrf_pvMonitor = NULL;
+}
+
+uint8_t __CLZ(uint32_t u32Value_)
+{
+  return( (u32Value_ == 0) ? 32 : (uint8_t)__builtin_clz(u32Value_) );
+}
+
+uint32_t __RBIT(uint32_t u32Value_)
+{
+  uint32_t u32Result = 0;
+
+  for(u8 i = 0; i < 32; i++)
+  {
+    u32Result = (u32Result << 1) | (u32Value_ & 1);
+    u32Value_ >>= 1;
+  }
+
+  return(u32Result);
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+  if(IRQn == IRQn_US2)
+  {
+    Nrf_bUs2Enabled = TRUE;
+    NrfRunInterrupts();
+  }
+}
+
+void NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+  if(IRQn == IRQn_US2)
+  {
+    Nrf_bUs2Enabled = FALSE;
+  }
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn)
+{
+  (void)IRQn;
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u8 NrfReverse(u8 u8Byte_)
+
+@brief Reverses the bits of a byte, which is how an LSB-first byte looks in the USART shift register.
+
+*/
+static u8 NrfReverse(u8 u8Byte_)
+{
+  return( (u8)(__RBIT(u8Byte_) >> 24) );
+
+} /* end NrfReverse() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void NrfSetSen(bool bAsserted_)
+
+@brief Drives SEN, which the host sees as the USART2 chip select and a CTSIC interrupt.
+
+Requires:
+@param bAsserted_ is TRUE to assert SEN (low)
+
+Promises:
+- PB_22 follows SEN and CTSIC is set if it changed
+
+*/
+static void NrfSetSen(bool bAsserted_)
+{
+  bool bWasAsserted = ( (Host_sPioB.PIO_PDSR & PB_22_ANT_USPI2_CS) == 0 );
+
+  if(bAsserted_ == bWasAsserted)
+  {
+    return;
+  }
+
+  if(bAsserted_)
+  {
+    Host_sPioB.PIO_PDSR &= ~PB_22_ANT_USPI2_CS;
+  }
+  else
+  {
+    Host_sPioB.PIO_PDSR |= PB_22_ANT_USPI2_CS;
+  }
+
+  Host_sUsart2.US_CSR |= AT91C_US_CTSIC;
+
+} /* end NrfSetSen() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void NrfStartTransaction(void)
+
+@brief Asserts SEN to send the oldest waiting frame, or to let the host send if nothing is waiting.
+
+Requires:
+- Nrf_eState is NRF_IDLE
+
+Promises:
+- Nrf_eState is NRF_TO_HOST with the frame loaded, or NRF_FROM_HOST
+- SEN is asserted and the CTSIC interrupt has been taken if interrupts are enabled
+
+*/
+static void NrfStartTransaction(void)
+{
+  if(Nrf_u8TxQueueCount != 0)
+  {
+    Nrf_u8FrameSize = Nrf_au8TxQueueSize[Nrf_u8TxQueueHead];
+    memcpy(Nrf_au8Frame, Nrf_aau8TxQueue[Nrf_u8TxQueueHead], Nrf_u8FrameSize);
+    Nrf_u8TxQueueHead = (Nrf_u8TxQueueHead + 1) % U8_NRF_TX_QUEUE_SIZE;
+    Nrf_u8TxQueueCount--;
+    Nrf_u8FrameIndex = 0;
+    Nrf_eState = NRF_TO_HOST;
+  }
+  else
+  {
+    Nrf_bRxSyncSent = FALSE;
+    Nrf_u8HostBytes = 0;
+    Nrf_eState = NRF_FROM_HOST;
+  }
+
+  NrfSetSen(TRUE);
+  NrfRunInterrupts();
+
+} /* end NrfStartTransaction() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void NrfSrdyPulse(void)
+
+@brief Acts on one SRDY pulse: clocks a byte if the transaction has one left.
+
+*/
+static void NrfSrdyPulse(void)
+{
+  if( (Nrf_eState == NRF_TO_HOST) || (Nrf_eState == NRF_FROM_HOST) )
+  {
+    NrfClockByte();
+  }
+  else
+  {
+    Nrf_sStats.u32StraySrdyPulses++;
+  }
+
+} /* end NrfSrdyPulse() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void NrfClockByte(void)
+
+@brief Clocks one byte in each direction.
+
+Requires:
+- Nrf_eState is NRF_TO_HOST or NRF_FROM_HOST
+
+Promises:
+- The nRF51422 byte is in RHR and RXRDY is set (an overrun is counted if RXRDY was already set)
+- In NRF_FROM_HOST after the SYNC byte, THR is taken as the next host byte (an underrun is counted if
+  THR was empty); THR is empty afterwards
+- Nrf_eState is NRF_CLOSING after the last byte of the frame
+
+*/
+static void NrfClockByte(void)
+{
+  u8 u8Out = 0x00;
+  u32 u32Thr = Host_sUsart2.US_THR;
+
+  Host_sUsart2.US_THR = U32_NRF_THR_EMPTY;
+
+  if(Nrf_eState == NRF_TO_HOST)
+  {
+    u8Out = Nrf_au8Frame[Nrf_u8FrameIndex++];
+    Nrf_sStats.u32BytesToHost++;
+  }
+  else if(!Nrf_bRxSyncSent)
+  {
+    u8Out = MESG_RX_SYNC;
+    Nrf_bRxSyncSent = TRUE;
+    Nrf_sStats.u32BytesToHost++;
+  }
+  else if(u32Thr == U32_NRF_THR_EMPTY)
+  {
+    Nrf_sStats.u32Underruns++;
+  }
+  else
+  {
+    Nrf_au8HostFrame[Nrf_u8HostBytes++] = NrfReverse((u8)u32Thr);
+    Nrf_sStats.u32BytesFromHost++;
+  }
+
+  if(Host_sUsart2.US_CSR & AT91C_US_RXRDY)
+  {
+    Nrf_sStats.u32Overruns++;
+  }
+
+  Host_sUsart2.US_RHR = NrfReverse(u8Out);
+  Host_sUsart2.US_CSR |= AT91C_US_RXRDY;
+
+  /* Find the end of the frame */
+  if( (Nrf_eState == NRF_TO_HOST) && (Nrf_u8FrameIndex == Nrf_u8FrameSize) )
+  {
+    Nrf_sStats.u32FramesToHost++;
+    Nrf_eState = NRF_CLOSING;
+  }
+
+  if( (Nrf_eState == NRF_FROM_HOST) && (Nrf_u8HostBytes != 0) )
+  {
+    if( (Nrf_au8HostFrame[0] + 3) > U8_NRF_MAX_FRAME )
+    {
+      Nrf_sStats.u32BadFramesFromHost++;
+      Nrf_eState = NRF_CLOSING;
+    }
+    else if(Nrf_u8HostBytes == (Nrf_au8HostFrame[0] + 3))
+    {
+      NrfHostFrameDone();
+      Nrf_eState = NRF_CLOSING;
+    }
+  }
+
+} /* end NrfClockByte() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void NrfHostFrameDone(void)
+
+@brief Checks a complete frame from the host and answers a version request.
+
+Requires:
+- Nrf_au8HostFrame holds length, ID, data and checksum
+
+Promises:
+- A bad checksum is counted and the frame dropped
+- A version request queues the MESG_VERSION_ID reply
+- Any other frame is logged for Nrf51422ReadHostFrame() (the oldest is dropped if the log is full)
+
+*/
+static void NrfHostFrameDone(void)
+{
+  u8 u8Checksum = MESG_RX_SYNC;
+  u8 u8Slot;
+
+  for(u8 i = 0; i < (Nrf_u8HostBytes - 1); i++)
+  {
+    u8Checksum ^= Nrf_au8HostFrame[i];
+  }
+
+  if(u8Checksum != Nrf_au8HostFrame[Nrf_u8HostBytes - 1])
+  {
+    Nrf_sStats.u32BadFramesFromHost++;
+    return;
+  }
+
+  Nrf_sStats.u32FramesFromHost++;
+
+  if( (Nrf_au8HostFrame[1] == MESG_REQUEST_ID) && (Nrf_au8HostFrame[3] == MESG_VERSION_ID) )
+  {
+    Nrf51422QueueFrame(MESG_VERSION_ID, (u8*)U8_NRF_VERSION_STRING, MESG_VERSION_SIZE, FALSE);
+    return;
+  }
+
+  if(Nrf_u8HostLogCount == U8_NRF_HOST_LOG_SIZE)
+  {
+    Nrf_u8HostLogHead = (Nrf_u8HostLogHead + 1) % U8_NRF_HOST_LOG_SIZE;
+    Nrf_u8HostLogCount--;
+  }
+
+  u8Slot = (Nrf_u8HostLogHead + Nrf_u8HostLogCount) % U8_NRF_HOST_LOG_SIZE;
+  memcpy(Nrf_aau8HostLog[u8Slot], Nrf_au8HostFrame, Nrf_u8HostBytes);
+  Nrf_au8HostLogSize[u8Slot] = Nrf_u8HostBytes;
+  Nrf_u8HostLogCount++;
+
+} /* end NrfHostFrameDone() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void NrfRunInterrupts(void)
+
+@brief Takes every pending USART2 interrupt and lets the bus catch up, until nothing is left to do.
+
+Requires:
+- Called after anything that can raise an interrupt or unmask one
+
+Promises:
+- Returns at once from inside the ISR
+- Otherwise, in a loop: IER and IDR are applied to IMR; SRDY pulses made by the ISR are clocked;
+  SSP2_IRQHandler() runs while an enabled interrupt is pending and interrupts are unmasked;
+  a finished transaction deasserts SEN once no interrupt is pending
+
+*/
+static void NrfRunInterrupts(void)
+{
+  u32 u32Pending;
+  u32 u32ReadsRhr;
+
+  if(Nrf_bInIsr)
+  {
+    return;
+  }
+
+  while(1)
+  {
+    Host_sUsart2.US_IMR |= Host_sUsart2.US_IER;
+    Host_sUsart2.US_IMR &= ~Host_sUsart2.US_IDR;
+    Host_sUsart2.US_IER = 0;
+    Host_sUsart2.US_IDR = 0;
+
+    if(Nrf_u8IsrPulses != 0)
+    {
+      Nrf_u8IsrPulses--;
+      NrfSrdyPulse();
+      continue;
+    }
+
+    if(Host_sUsart2.US_THR == U32_NRF_THR_EMPTY)
+    {
+      Host_sUsart2.US_CSR |= AT91C_US_TXEMPTY;
+    }
+    else
+    {
+      Host_sUsart2.US_CSR &= ~AT91C_US_TXEMPTY;
+    }
+
+    u32Pending = Host_sUsart2.US_CSR & Host_sUsart2.US_IMR & (AT91C_US_CTSIC | AT91C_US_RXRDY | AT91C_US_TXEMPTY);
+    if( (u32Pending != 0) && !Nrf_bPrimask && Nrf_bUs2Enabled )
+    {
+      /* The ISR reads RHR for RXRDY and for TXEMPTY */
+      u32ReadsRhr = u32Pending & (AT91C_US_RXRDY | AT91C_US_TXEMPTY);
+
+      Nrf_sStats.u32Interrupts++;
+      Nrf_pvMonitor = NULL;
+      Nrf_bInIsr = TRUE;
+      SSP2_IRQHandler();
+      Nrf_bInIsr = FALSE;
+      Nrf_pvMonitor = NULL;
+
+      Host_sUsart2.US_CSR &= ~AT91C_US_CTSIC;
+      if(u32ReadsRhr)
+      {
+        Host_sUsart2.US_CSR &= ~AT91C_US_RXRDY;
+      }
+      continue;
+    }
+
+    if( (Nrf_eState == NRF_CLOSING) && (u32Pending == 0) )
+    {
+      NrfSetSen(FALSE);
+      Nrf_eState = NRF_IDLE;
+      Nrf_u32NextSenUs = Nrf_u32TimeUs + U32_NRF_SEN_GAP_US;
+      continue;
+    }
+
+    break;
+  }
+
+} /* end NrfRunInterrupts() */
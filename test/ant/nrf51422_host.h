@@ -0,0 +1,61 @@
+/*!**********************************************************************************************************************
+@file nrf51422_host.h
+@brief Header file for nrf51422_host.c
+**********************************************************************************************************************/
+
+#ifndef __NRF51422_HOST_H
+#define __NRF51422_HOST_H
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum Nrf51422StateType
+@brief Where the simulated nRF51422 is in an SPI transaction
+*/
+typedef enum {NRF_RESET = 0, NRF_IDLE, NRF_TO_HOST, NRF_FROM_HOST, NRF_CLOSING} Nrf51422StateType;
+
+/*!
+@struct Nrf51422StatsType
+@brief What the simulated nRF51422 and SAM3U USART2 saw on the bus
+*/
+typedef struct
+{
+  u32 u32FramesToHost;                 /*!< @brief Frames completely clocked out to the host (SYNC to checksum) */
+  u32 u32FramesFromHost;               /*!< @brief Frames from the host with a good checksum */
+  u32 u32BadFramesFromHost;            /*!< @brief Frames from the host with a bad checksum */
+  u32 u32BytesToHost;                  /*!< @brief Bytes clocked out to the host, SYNC included */
+  u32 u32BytesFromHost;                /*!< @brief Bytes clocked in from the host */
+  u32 u32SrdyPulses;                   /*!< @brief Every SRDY pulse */
+  u32 u32StraySrdyPulses;              /*!< @brief SRDY pulses with no byte left to clock in the transaction */
+  u32 u32Overruns;                     /*!< @brief Bytes clocked while the previous one was still in RHR */
+  u32 u32Underruns;                    /*!< @brief Host bytes clocked while THR was empty */
+  u32 u32Interrupts;                   /*!< @brief USART2 ISR entries */
+} Nrf51422StatsType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U8_NRF_MAX_FRAME                (u8)(MESG_MAX_SIZE + MESG_SYNC_SIZE)  /*!< @brief Largest frame, SYNC included */
+#define U8_NRF_TX_QUEUE_SIZE            (u8)16     /*!< @brief Frames the nRF51422 can hold for the host */
+#define U8_NRF_HOST_LOG_SIZE            (u8)64     /*!< @brief Frames from the host kept for Nrf51422ReadHostFrame() */
+
+#define U32_NRF_BOOT_US                 (u32)20000 /*!< @brief Reset release to the startup message */
+#define U32_NRF_SEN_GAP_US              (u32)40    /*!< @brief Least time from SEN deassert to the next assert */
+#define U8_NRF_VERSION_STRING           "SIM1.00\0\0\0" /*!< @brief MESG_VERSION_SIZE bytes returned for a version request */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+void Nrf51422Initialize(void);
+bool Nrf51422QueueFrame(u8 u8MessageId_, u8* pu8Data_, u8 u8Size_, bool bCorrupt_);
+u8 Nrf51422ReadHostFrame(u8* pu8Frame_);
+u8 Nrf51422PendingFrames(void);
+void Nrf51422Tick(u32 u32Microseconds_);
+void Nrf51422GetStats(Nrf51422StatsType* psStats_);
+
+
+#endif /* __NRF51422_HOST_H */
@@ -0,0 +1,411 @@
+/*!**********************************************************************************************************************
+@file cm3_host.c
+@brief Emulates the parts of a single-core Cortex-M3 that messaging.c depends on so it can be
+stressed on a host.
+
+The main thread plays the task.  Two peripheral ISRs are POSIX signal handlers on that thread,
+raised by one-shot timers that are rearmed with a random delay each time they fire, so they
+preempt the task at any instruction just like an NVIC interrupt (and on any number of cores):
+- CM3_IRQ_LOW is SIGUSR1 and CM3_IRQ_HIGH is SIGUSR2
+- The high ISR blocks the low one while it runs, so only the high ISR can nest
+
+PRIMASK is the signal mask: __disable_irq() blocks both signals and __enable_irq() goes back to
+the mask of the running context, so a pending interrupt is taken when interrupts are enabled
+again.  The exclusive monitor is a single address and flag.  It is cleared on exception entry
+and return as the M3 does, so a STREX fails whenever an ISR ran since its LDREX.
+
+------------------------------------------------------------------------------------------------------------------------
+API:
+- void Cm3HostInitialize(fnCode_type pfnLowIsr_, fnCode_type pfnHighIsr_)
+- void Cm3HostStartInterrupts(u32 u32MaxGap_)
+- void Cm3HostStopInterrupts(void)
+- u32 Cm3HostInterruptCount(Cm3HostIrqType eIrq_)
+- u32 Cm3HostStrexFailures(void)
+- void Cm3HostRunIsr(Cm3HostIrqType eIrq_)
+- bool Cm3HostInIsr(void)
+
+**********************************************************************************************************************/
+
+#include <signal.h>
+#include <time.h>
+
+#include "configuration.h"
+#include "cm3_host.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Cm3_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type Cm3_apfnIsr[U8_CM3_IRQ_LEVELS];     /*!< @brief ISR of each level */
+static const int Cm3_aiSignal[U8_CM3_IRQ_LEVELS] = {SIGUSR1, SIGUSR2}; /*!< @brief Signal that raises each level */
+static sigset_t Cm3_asIsrMask[U8_CM3_IRQ_LEVELS];      /*!< @brief Signals blocked while each ISR runs */
+static sigset_t Cm3_sAllIrqs;                          /*!< @brief Every interrupt: the mask of __disable_irq() */
+static sigset_t Cm3_sTaskMask;                         /*!< @brief Nothing blocked */
+static const sigset_t* volatile Cm3_psContextMask = &Cm3_sTaskMask; /*!< @brief Mask restored by __enable_irq() */
+
+static volatile void* Cm3_pvMonitor;                   /*!< @brief Address of the last LDREX */
+static volatile bool Cm3_bExclusive;                   /*!< @brief Exclusive monitor state */
+static volatile u32 Cm3_u32StrexFailures;              /*!< @brief Exclusive stores that failed */
+static volatile u32 Cm3_au32Interrupts[U8_CM3_IRQ_LEVELS]; /*!< @brief ISRs run at each level */
+
+static timer_t Cm3_asTimers[U8_CM3_IRQ_LEVELS];       /*!< @brief Timer that raises each level */
+static u32 Cm3_au32Random[U8_CM3_IRQ_LEVELS];          /*!< @brief Random state of each timer */
+static volatile bool Cm3_bInterruptsRunning;           /*!< @brief Cleared to stop rearming the timers */
+static u32 Cm3_u32MaxGap;                              /*!< @brief Longest time between interrupts of a level in ns */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+static void Cm3SignalHandler(int iSignal_);
+static void Cm3ArmTimer(Cm3HostIrqType eIrq_);
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void Cm3HostInitialize(fnCode_type pfnLowIsr_, fnCode_type pfnHighIsr_)
+
+@brief Installs the two ISRs on the calling thread, which becomes the task.
+
+Requires:
+@param pfnLowIsr_ runs for CM3_IRQ_LOW
+@param pfnHighIsr_ runs for CM3_IRQ_HIGH and can preempt pfnLowIsr_
+
+Promises:
+- The ISRs run on this thread when raised; interrupts are enabled
+
+*/
+void Cm3HostInitialize(fnCode_type pfnLowIsr_, fnCode_type pfnHighIsr_)
+{
+  struct sigaction sAction;
+
+  Cm3_apfnIsr[CM3_IRQ_LOW]  = pfnLowIsr_;
+  Cm3_apfnIsr[CM3_IRQ_HIGH] = pfnHighIsr_;
+
+  sigemptyset(&Cm3_sTaskMask);
+  sigemptyset(&Cm3_sAllIrqs);
+  sigaddset(&Cm3_sAllIrqs, SIGUSR1);
+  sigaddset(&Cm3_sAllIrqs, SIGUSR2);
+
+  /* The low ISR only masks itself; the high ISR masks both */
+  sigemptyset(&Cm3_asIsrMask[CM3_IRQ_LOW]);
+  sigaddset(&Cm3_asIsrMask[CM3_IRQ_LOW], SIGUSR1);
+  Cm3_asIsrMask[CM3_IRQ_HIGH] = Cm3_sAllIrqs;
+
+  for(u8 i = 0; i < U8_CM3_IRQ_LEVELS; i++)
+  {
+    sAction.sa_handler = Cm3SignalHandler;
+    sAction.sa_mask = Cm3_asIsrMask[i];
+    sAction.sa_flags = SA_RESTART;
+    sigaction(Cm3_aiSignal[i], &sAction, NULL);
+  }
+
+  Cm3_psContextMask = &Cm3_sTaskMask;
+  pthread_sigmask(SIG_SETMASK, &Cm3_sTaskMask, NULL);
+
+} /* end Cm3HostInitialize() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void Cm3HostStartInterrupts(u32 u32MaxGap_)
+
+@brief Starts raising interrupts at random times.
+
+Requires:
+- Cm3HostInitialize() has been called
+@param u32MaxGap_ is the longest time between two interrupts of a level in ns
+
+Promises:
+- Each level is raised again 1 to u32MaxGap_ ns after its last ISR
+
+*/
+void Cm3HostStartInterrupts(u32 u32MaxGap_)
+{
+  struct sigevent sEvent = {0};
+
+  Cm3_u32MaxGap = u32MaxGap_;
+  Cm3_bInterruptsRunning = TRUE;
+
+  for(u8 i = 0; i < U8_CM3_IRQ_LEVELS; i++)
+  {
+    Cm3_au32Random[i] = 0x9E3779B9 + i;
+    sEvent.sigev_notify = SIGEV_SIGNAL;
+    sEvent.sigev_signo = Cm3_aiSignal[i];
+    timer_create(CLOCK_MONOTONIC, &sEvent, &Cm3_asTimers[i]);
+    Cm3ArmTimer((Cm3HostIrqType)i);
+  }
+
+} /* end Cm3HostStartInterrupts() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void Cm3HostStopInterrupts(void)
+
+@brief Stops raising interrupts.
+
+Requires:
+- Called from the task
+
+Promises:
+- No more interrupts are raised once any pending one has run
+
+*/
+void Cm3HostStopInterrupts(void)
+{
+  __disable_irq();
+  Cm3_bInterruptsRunning = FALSE;
+  for(u8 i = 0; i < U8_CM3_IRQ_LEVELS; i++)
+  {
+    timer_delete(Cm3_asTimers[i]);
+  }
+  __enable_irq();
+
+} /* end Cm3HostStopInterrupts() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 Cm3HostInterruptCount(Cm3HostIrqType eIrq_)
+
+@brief Reports how many times an ISR has run.
+
+Requires:
+@param eIrq_ is the level of interest
+
+Promises:
+- Returns the number of times the ISR of eIrq_ has run
+
+*/
+u32 Cm3HostInterruptCount(Cm3HostIrqType eIrq_)
+{
+  return(Cm3_au32Interrupts[eIrq_]);
+
+} /* end Cm3HostInterruptCount() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn u32 Cm3HostStrexFailures(void)
+
+@brief Reports how many exclusive stores failed, i.e. how often an ISR hit an LDREX/STREX window.
+
+Requires:
+- NONE
+
+Promises:
+- Returns the number of failed __STREXW() and __STREXB() calls
+
+*/
+u32 Cm3HostStrexFailures(void)
+{
+  return(Cm3_u32StrexFailures);
+
+} /* end Cm3HostStrexFailures() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void Cm3HostRunIsr(Cm3HostIrqType eIrq_)
+
+@brief Runs an ISR from the task as if it had been raised (like setting it pending in the NVIC).
+
+Requires:
+- Called from the task
+@param eIrq_ is the level to run
+
+Promises:
+- The ISR of eIrq_ has run in ISR context with the interrupts it masks blocked
+
+*/
+void Cm3HostRunIsr(Cm3HostIrqType eIrq_)
+{
+  sigset_t sOldMask;
+
+  pthread_sigmask(SIG_BLOCK, &Cm3_asIsrMask[eIrq_], &sOldMask);
+  Cm3_bExclusive = FALSE;
+  Cm3_psContextMask = &Cm3_asIsrMask[eIrq_];
+
+  Cm3_apfnIsr[eIrq_]();
+
+  Cm3_psContextMask = &Cm3_sTaskMask;
+  Cm3_bExclusive = FALSE;
+  pthread_sigmask(SIG_SETMASK, &sOldMask, NULL);
+
+} /* end Cm3HostRunIsr() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn bool Cm3HostInIsr(void)
+
+@brief Reports whether the caller is running in one of the ISRs.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE in an ISR and FALSE in the task
+
+*/
+bool Cm3HostInIsr(void)
+{
+  return( (Cm3_psContextMask != &Cm3_sTaskMask) ? TRUE : FALSE );
+
+} /* end Cm3HostInIsr() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Cortex-M3 intrinsics */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+void __disable_irq(void)
+{
+  pthread_sigmask(SIG_BLOCK, &Cm3_sAllIrqs, NULL);
+}
+
+void __enable_irq(void)
+{
+  pthread_sigmask(SIG_SETMASK, Cm3_psContextMask, NULL);
+}
+
+uint32_t __LDREXW(volatile uint32_t* pu32Address_)
+{
+  Cm3_pvMonitor = pu32Address_;
+  Cm3_bExclusive = TRUE;
+  __asm__ volatile("" ::: "memory");
+
+  return(*pu32Address_);
+}
+
+uint32_t __STREXW(uint32_t u32Value_, volatile uint32_t* pu32Address_)
+{
+  sigset_t sOldMask;
+  uint32_t u32Result = 1;
+
+  /* The check and the store must be one step as far as the ISRs are concerned */
+  pthread_sigmask(SIG_BLOCK, &Cm3_sAllIrqs, &sOldMask);
+  if(Cm3_bExclusive && (Cm3_pvMonitor == pu32Address_))
+  {
+    *pu32Address_ = u32Value_;
+    u32Result = 0;
+  }
+  else
+  {
+    Cm3_u32StrexFailures++;
+  }
+  Cm3_bExclusive = FALSE;
+  pthread_sigmask(SIG_SETMASK, &sOldMask, NULL);
+
+  return(u32Result);
+}
+
+uint8_t __LDREXB(volatile uint8_t* pu8Address_)
+{
+  Cm3_pvMonitor = pu8Address_;
+  Cm3_bExclusive = TRUE;
+  __asm__ volatile("" ::: "memory");
+
+  return(*pu8Address_);
+}
+
+uint32_t __STREXB(uint8_t u8Value_, volatile uint8_t* pu8Address_)
+{
+  sigset_t sOldMask;
+  uint32_t u32Result = 1;
+
+  pthread_sigmask(SIG_BLOCK, &Cm3_sAllIrqs, &sOldMask);
+  if(Cm3_bExclusive && (Cm3_pvMonitor == pu8Address_))
+  {
+    *pu8Address_ = u8Value_;
+    u32Result = 0;
+  }
+  else
+  {
+    Cm3_u32StrexFailures++;
+  }
+  Cm3_bExclusive = FALSE;
+  pthread_sigmask(SIG_SETMASK, &sOldMask, NULL);
+
+  return(u32Result);
+}
+
+void __CLREX(void)
+{
+  Cm3_bExclusive = FALSE;
+}
+
+uint8_t __CLZ(uint32_t u32Value_)
+{
+  return( (u32Value_ == 0) ? 32 : (uint8_t)__builtin_clz(u32Value_) );
+}
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void Cm3SignalHandler(int iSignal_)
+
+@brief Exception entry and return around the ISR of the level that was raised.
+
+Requires:
+@param iSignal_ is the signal of the level
+
+Promises:
+- The ISR has run with the context mask of its level and the exclusive monitor is clear
+
+*/
+static void Cm3SignalHandler(int iSignal_)
+{
+  Cm3HostIrqType eIrq = (iSignal_ == SIGUSR1) ? CM3_IRQ_LOW : CM3_IRQ_HIGH;
+  const sigset_t* psPreemptedMask = Cm3_psContextMask;
+
+  Cm3_bExclusive = FALSE;
+  Cm3_psContextMask = &Cm3_asIsrMask[eIrq];
+  Cm3_au32Interrupts[eIrq]++;
+
+  Cm3_apfnIsr[eIrq]();
+
+  if(Cm3_bInterruptsRunning)
+  {
+    Cm3ArmTimer(eIrq);
+  }
+
+  Cm3_psContextMask = psPreemptedMask;
+  Cm3_bExclusive = FALSE;
+
+} /* end Cm3SignalHandler() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void Cm3ArmTimer(Cm3HostIrqType eIrq_)
+
+@brief Sets the timer of a level to fire once after a random delay.
+
+Requires:
+- The timer of eIrq_ exists and the caller cannot be preempted by the ISR of eIrq_
+@param eIrq_ is the level
+
+Promises:
+- The ISR of eIrq_ is raised in 1 to Cm3_u32MaxGap ns
+
+*/
+static void Cm3ArmTimer(Cm3HostIrqType eIrq_)
+{
+  struct itimerspec sTime = {{0, 0}, {0, 0}};
+  u32 u32Random = Cm3_au32Random[eIrq_];
+
+  u32Random ^= u32Random << 13;
+  u32Random ^= u32Random >> 17;
+  u32Random ^= u32Random << 5;
+  Cm3_au32Random[eIrq_] = u32Random;
+
+  sTime.it_value.tv_nsec = 1 + (u32Random % Cm3_u32MaxGap);
+  timer_settime(Cm3_asTimers[eIrq_], 0, &sTime, NULL);
+
+} /* end Cm3ArmTimer() */
@@ -0,0 +1,38 @@
+/*!**********************************************************************************************************************
+@file cm3_host.h
+@brief Header file for cm3_host.c
+**********************************************************************************************************************/
+
+#ifndef __CM3_HOST_H
+#define __CM3_HOST_H
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum Cm3HostIrqType
+@brief The two emulated interrupt priority levels
+*/
+typedef enum {CM3_IRQ_LOW = 0, CM3_IRQ_HIGH} Cm3HostIrqType;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U8_CM3_IRQ_LEVELS               (u8)2          /*!< @brief Number of Cm3HostIrqType levels */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+void Cm3HostInitialize(fnCode_type pfnLowIsr_, fnCode_type pfnHighIsr_);
+void Cm3HostStartInterrupts(u32 u32MaxGap_);
+void Cm3HostStopInterrupts(void);
+u32 Cm3HostInterruptCount(Cm3HostIrqType eIrq_);
+u32 Cm3HostStrexFailures(void);
+void Cm3HostRunIsr(Cm3HostIrqType eIrq_);
+bool Cm3HostInIsr(void);
+
+
+#endif /* __CM3_HOST_H */
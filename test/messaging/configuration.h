@@ -0,0 +1,58 @@
+/*!**********************************************************************************************************************
+@file configuration.h
+@brief Host stand-in for firmware_common/bsp/configuration.h used by the messaging stress test.
+
+messaging.c includes only configuration.h, so this file gives it the EiE types, the Cortex-M3
+intrinsics it uses (emulated in cm3_host.c) and the few symbols it takes from other tasks.
+u32 must be exactly 32 bits here since messaging.c stores pointers through (volatile uint32_t*).
+***********************************************************************************************************************/
+
+#ifndef __CONFIG_H
+#define __CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+
+/**********************************************************************************************************************
+Type Definitions (see firmware_common/bsp/typedefs.h)
+**********************************************************************************************************************/
+typedef int32_t  s32;
+typedef int16_t  s16;
+typedef int8_t   s8;
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+
+typedef void(*fnCode_type)(void);
+
+typedef enum {FALSE = 0, TRUE = !FALSE} bool;
+
+
+/**********************************************************************************************************************
+Cortex-M3 intrinsics (cm3_host.c)
+**********************************************************************************************************************/
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __LDREXW(volatile uint32_t* pu32Address_);
+uint32_t __STREXW(uint32_t u32Value_, volatile uint32_t* pu32Address_);
+uint8_t __LDREXB(volatile uint8_t* pu8Address_);
+uint32_t __STREXB(uint8_t u8Value_, volatile uint8_t* pu8Address_);
+void __CLREX(void);
+uint8_t __CLZ(uint32_t u32Value_);
+
+
+/**********************************************************************************************************************
+Driver header files
+**********************************************************************************************************************/
+#include "messaging.h"
+
+/* Stand-ins for utilities.h and debug.h (messaging_stress.c) */
+bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_);
+u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_);
+u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_);
+
+
+#endif /* __CONFIG_H */
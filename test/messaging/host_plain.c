@@ -0,0 +1,100 @@
+/*!**********************************************************************************************************************
+@file host_plain.c
+@brief Cortex-M3 intrinsics and task stand-ins for the host benchmarks, which run messaging.c with no interrupts.
+
+Nothing can preempt the benchmarks, so __disable_irq() and __enable_irq() do nothing and an
+exclusive store always succeeds.  This keeps the cm3_host.c signal emulation out of the times.
+
+------------------------------------------------------------------------------------------------------------------------
+API:
+- The intrinsics declared in configuration.h
+- bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
+- u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_)
+- u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_)
+
+**********************************************************************************************************************/
+
+#include <stdio.h>
+
+#include "configuration.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+***********************************************************************************************************************/
+/* Existing variables that messaging.c takes from main.c */
+volatile u32 G_u32SystemTime1ms;
+volatile u32 G_u32SystemTime1s;
+volatile u32 G_u32SystemFlags;
+volatile u32 G_u32ApplicationFlags;
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Stand-ins for the other firmware tasks */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
+{
+  return( (G_u32SystemTime1ms - *pu32SavedTick_) >= u32Period_ ? TRUE : FALSE );
+}
+
+u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_)
+{
+  return( (u8)sprintf((char*)pu8AsciiString_, "%u", (unsigned)u32Number_) );
+}
+
+u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_)
+{
+  (void)psFragments_;
+  (void)u8Fragments_;
+
+  return(0);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Cortex-M3 intrinsics */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+void __disable_irq(void)
+{
+}
+
+void __enable_irq(void)
+{
+}
+
+uint32_t __LDREXW(volatile uint32_t* pu32Address_)
+{
+  return(*pu32Address_);
+}
+
+uint32_t __STREXW(uint32_t u32Value_, volatile uint32_t* pu32Address_)
+{
+  *pu32Address_ = u32Value_;
+  return(0);
+}
+
+uint8_t __LDREXB(volatile uint8_t* pu8Address_)
+{
+  return(*pu8Address_);
+}
+
+uint32_t __STREXB(uint8_t u8Value_, volatile uint8_t* pu8Address_)
+{
+  *pu8Address_ = u8Value_;
+  return(0);
+}
+
+void __CLREX(void)
+{
+}
+
+uint8_t __CLZ(uint32_t u32Value_)
+{
+  return( (u32Value_ == 0) ? 32 : (uint8_t)__builtin_clz(u32Value_) );
+}
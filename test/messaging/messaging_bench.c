@@ -0,0 +1,350 @@
+/*!**********************************************************************************************************************
+@file messaging_bench.c
+@brief Host micro-benchmark of the message slot allocator in messaging.c at different pool fill levels.
+
+Each size class of the pool (and the reference class) is filled to a quarter, a half, three
+quarters and all but one of its slots with messages parked on a filler queue.  At each level the
+time of one QueueTxMessage() of a small message and the DeQueueTxMessage() that frees it again
+is measured, so the cost of finding a free slot and of finding the slot that owns a message is
+seen as the pool fills.
+
+For comparison the same pair is timed on a model of the allocator messaging.c had before the
+occupancy bitmaps: a free flag per slot, a scan from slot 0 for a free slot on enqueue and a scan
+for the slot that owns the message on dequeue.  The model holds U8_TX_QUEUE_SIZE slots filled from
+slot 0 to the same fraction, which is where that allocator would have put the filler messages.
+The bitmap column is the whole of QueueTxMessage() and DeQueueTxMessage(), including the token,
+status and statistics work the model leaves out, so the allocators compare by how each column
+grows with the fill level rather than by their values at one level.
+
+No interrupts run here, so the benchmark links host_plain.c instead of the cm3_host.c emulation
+and the times are those of the code itself on the host.
+
+Usage: messaging_bench [pairs per level].  The exit status is 0 unless a message could not be queued.
+**********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "configuration.h"
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U32_BENCH_DEFAULT_PAIRS         (u32)1000000   /*!< @brief Enqueue/dequeue pairs timed at each fill level */
+#define U8_BENCH_LEVELS                 (u8)5          /*!< @brief Fill levels: 0, 1/4, 1/2, 3/4 and all but one slot */
+#define U8_BENCH_MESSAGE_SIZE           (u8)8          /*!< @brief Bytes in the timed message (a class 0 message) */
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@struct BenchScanSlotType
+@brief One slot of the model of the scanning allocator
+*/
+typedef struct
+{
+  bool bFree;                               /*!< @brief TRUE if the slot is available */
+  MessageType Message;                      /*!< @brief The message in the slot */
+  u8 au8Payload[U8_BENCH_MESSAGE_SIZE];     /*!< @brief Payload of the message */
+} BenchScanSlotType;
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Bench_<type>" and be declared as static.
+***********************************************************************************************************************/
+static MessageQueueType Bench_sFillerQueue;            /*!< @brief Holds the messages that fill the pool */
+static MessageQueueType Bench_sTimedQueue;             /*!< @brief Queue of the timed messages */
+static u8 Bench_au8Data[U16_MSG_CLASS2_LENGTH];        /*!< @brief Message data */
+
+static BenchScanSlotType Bench_asScanPool[U8_TX_QUEUE_SIZE]; /*!< @brief Model of the scanning allocator's pool */
+static MessageType* Bench_psScanQueue;                 /*!< @brief Queue of the timed messages in the model */
+
+static const u8 Bench_au8ClassSlots[U8_MSG_SIZE_CLASSES + 1] =
+  {U8_MSG_CLASS0_SLOTS, U8_MSG_CLASS1_SLOTS, U8_MSG_CLASS2_SLOTS, U8_MSG_REFERENCE_SLOTS};
+static const u16 Bench_au16ClassLength[U8_MSG_SIZE_CLASSES] =
+  {U16_MSG_CLASS0_LENGTH, U16_MSG_CLASS1_LENGTH, U16_MSG_CLASS2_LENGTH};
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+static u8 BenchSlotsAtLevel(u8 u8Slots_, u8 u8Level_);
+static uint64_t BenchNow(void);
+static bool BenchFillPool(u8 u8Level_);
+static void BenchEmptyPool(void);
+static bool BenchTimePool(u32 u32Pairs_, double* pdNs_);
+static MessageType* BenchScanQueue(MessageType** ppsQueue_, u8* pu8Data_);
+static void BenchScanDeQueue(MessageType** ppsQueue_);
+static void BenchTimeScan(u8 u8Level_, u32 u32Pairs_, double* pdNs_);
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Benchmark */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+  u32 u32Pairs = U32_BENCH_DEFAULT_PAIRS;
+  double dPoolNs;
+  double dScanNs;
+  u8 u8Used;
+
+  if(argc > 1)
+  {
+    u32Pairs = (u32)strtoul(argv[1], NULL, 0);
+  }
+
+  /* messaging.c links messages through 32-bit words */
+  if( (uintptr_t)&Bench_sTimedQueue > UINT32_MAX )
+  {
+    printf("FAIL: data is not in the low 4GB; build with -no-pie\n");
+    return(1);
+  }
+
+  MessagingInitialize();
+  MessageQueueInitialize(&Bench_sFillerQueue, (u8*)"FILL");
+  MessageQueueInitialize(&Bench_sTimedQueue, (u8*)"BENCH");
+  MessageQueueSetPriority(&Bench_sFillerQueue, MSG_PRIORITY_HIGH, 0);
+  MessageQueueSetPriority(&Bench_sTimedQueue, MSG_PRIORITY_HIGH, 0);
+  MessageQueueSetOverflow(&Bench_sTimedQueue, MSG_OVERFLOW_REJECT_NEW);
+
+  printf("%u enqueue/dequeue pairs per level, %u byte messages, %u slots\n",
+         (unsigned)u32Pairs, (unsigned)U8_BENCH_MESSAGE_SIZE, (unsigned)U8_TX_QUEUE_SIZE);
+  printf("  slots used   bitmap ns/pair   scan ns/pair\n");
+
+  for(u8 u8Level = 0; u8Level < U8_BENCH_LEVELS; u8Level++)
+  {
+    if(!BenchFillPool(u8Level) || !BenchTimePool(u32Pairs, &dPoolNs))
+    {
+      printf("FAIL: could not queue a message at fill level %u\n", (unsigned)u8Level);
+      return(1);
+    }
+    BenchEmptyPool();
+    BenchTimeScan(u8Level, u32Pairs, &dScanNs);
+
+    u8Used = 0;
+    for(u8 i = 0; i <= U8_MSG_SIZE_CLASSES; i++)
+    {
+      u8Used += BenchSlotsAtLevel(Bench_au8ClassSlots[i], u8Level);
+    }
+    printf("  %5u/%-5u  %14.1f   %12.1f\n", (unsigned)u8Used, (unsigned)U8_TX_QUEUE_SIZE, dPoolNs, dScanNs);
+  }
+
+  printf("PASS\n");
+  return(0);
+
+} /* end main() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u8 BenchSlotsAtLevel(u8 u8Slots_, u8 u8Level_)
+
+@brief Returns how many of a class's u8Slots_ are filled at u8Level_ (quarters; the last level
+leaves one slot free).
+*/
+static u8 BenchSlotsAtLevel(u8 u8Slots_, u8 u8Level_)
+{
+  if(u8Level_ == (U8_BENCH_LEVELS - 1))
+  {
+    return(u8Slots_ - 1);
+  }
+
+  return( (u8)((u8Slots_ * u8Level_) / 4) );
+
+} /* end BenchSlotsAtLevel() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t BenchNow(void)
+
+@brief Returns a monotonic time in ns.
+*/
+static uint64_t BenchNow(void)
+{
+  struct timespec sNow;
+
+  clock_gettime(CLOCK_MONOTONIC, &sNow);
+  return( ((uint64_t)sNow.tv_sec * 1000000000ull) + (uint64_t)sNow.tv_nsec );
+
+} /* end BenchNow() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static bool BenchFillPool(u8 u8Level_)
+
+@brief Parks messages on Bench_sFillerQueue until every class is filled to u8Level_.
+
+Each class is filled with messages as long as its slots so none can land in a smaller class.
+Returns FALSE if a message could not be queued.
+*/
+static bool BenchFillPool(u8 u8Level_)
+{
+  for(u8 i = 0; i < U8_MSG_SIZE_CLASSES; i++)
+  {
+    for(u8 j = BenchSlotsAtLevel(Bench_au8ClassSlots[i], u8Level_); j != 0; j--)
+    {
+      if(QueueTxMessage(&Bench_sFillerQueue, Bench_au16ClassLength[i], Bench_au8Data) == 0)
+      {
+        return(FALSE);
+      }
+    }
+  }
+
+  for(u8 j = BenchSlotsAtLevel(Bench_au8ClassSlots[U8_MSG_REFERENCE_CLASS], u8Level_); j != 0; j--)
+  {
+    if(QueueTxMessageReference(&Bench_sFillerQueue, sizeof(Bench_au8Data), Bench_au8Data) == 0)
+    {
+      return(FALSE);
+    }
+  }
+
+  return(TRUE);
+
+} /* end BenchFillPool() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void BenchEmptyPool(void)
+
+@brief Sends every message parked on Bench_sFillerQueue.
+*/
+static void BenchEmptyPool(void)
+{
+  while(Bench_sFillerQueue.psHead != NULL)
+  {
+    FinishTxMessage(&Bench_sFillerQueue, COMPLETE);
+  }
+
+} /* end BenchEmptyPool() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static bool BenchTimePool(u32 u32Pairs_, double* pdNs_)
+
+@brief Times u32Pairs_ QueueTxMessage()/DeQueueTxMessage() pairs on Bench_sTimedQueue.
+
+Returns FALSE if a message could not be queued; *pdNs_ is the mean time of one pair.
+*/
+static bool BenchTimePool(u32 u32Pairs_, double* pdNs_)
+{
+  uint64_t u64Start;
+  u32 u32Failures = 0;
+
+  u64Start = BenchNow();
+  for(u32 i = 0; i < u32Pairs_; i++)
+  {
+    if(QueueTxMessage(&Bench_sTimedQueue, U8_BENCH_MESSAGE_SIZE, Bench_au8Data) == 0)
+    {
+      u32Failures++;
+    }
+    DeQueueTxMessage(&Bench_sTimedQueue);
+  }
+  *pdNs_ = (double)(BenchNow() - u64Start) / (double)u32Pairs_;
+
+  return( (u32Failures == 0) ? TRUE : FALSE );
+
+} /* end BenchTimePool() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static MessageType* BenchScanQueue(MessageType** ppsQueue_, u8* pu8Data_)
+
+@brief Model of the scanning enqueue: takes the first free slot from slot 0, copies the data and
+links the message at the end of the queue.
+*/
+static MessageType* BenchScanQueue(MessageType** ppsQueue_, u8* pu8Data_)
+{
+  BenchScanSlotType* psSlotParser = &Bench_asScanPool[0];
+  MessageType* psListParser;
+
+  while(!psSlotParser->bFree)
+  {
+    psSlotParser++;
+  }
+  psSlotParser->bFree = FALSE;
+
+  psSlotParser->Message.u32Size = U8_BENCH_MESSAGE_SIZE;
+  psSlotParser->Message.pu8Message = psSlotParser->au8Payload;
+  psSlotParser->Message.psNextMessage = NULL;
+  for(u8 i = 0; i < U8_BENCH_MESSAGE_SIZE; i++)
+  {
+    psSlotParser->au8Payload[i] = pu8Data_[i];
+  }
+
+  if(*ppsQueue_ == NULL)
+  {
+    *ppsQueue_ = &psSlotParser->Message;
+  }
+  else
+  {
+    psListParser = *ppsQueue_;
+    while(psListParser->psNextMessage != NULL)
+    {
+      psListParser = psListParser->psNextMessage;
+    }
+    psListParser->psNextMessage = &psSlotParser->Message;
+  }
+
+  return(&psSlotParser->Message);
+
+} /* end BenchScanQueue() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void BenchScanDeQueue(MessageType** ppsQueue_)
+
+@brief Model of the scanning dequeue: finds the slot that owns the head message and frees it.
+*/
+static void BenchScanDeQueue(MessageType** ppsQueue_)
+{
+  BenchScanSlotType* psSlotParser = &Bench_asScanPool[0];
+
+  while( (&psSlotParser->Message != *ppsQueue_) &&
+         (psSlotParser != &Bench_asScanPool[U8_TX_QUEUE_SIZE]) )
+  {
+    psSlotParser++;
+  }
+
+  if(psSlotParser != &Bench_asScanPool[U8_TX_QUEUE_SIZE])
+  {
+    *ppsQueue_ = (*ppsQueue_)->psNextMessage;
+    psSlotParser->bFree = TRUE;
+  }
+
+} /* end BenchScanDeQueue() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void BenchTimeScan(u8 u8Level_, u32 u32Pairs_, double* pdNs_)
+
+@brief Fills the model pool from slot 0 to u8Level_ and times u32Pairs_ enqueue/dequeue pairs.
+*/
+static void BenchTimeScan(u8 u8Level_, u32 u32Pairs_, double* pdNs_)
+{
+  u8 u8Used = BenchSlotsAtLevel(U8_TX_QUEUE_SIZE, u8Level_);
+  uint64_t u64Start;
+
+  for(u8 i = 0; i < U8_TX_QUEUE_SIZE; i++)
+  {
+    Bench_asScanPool[i].bFree = (i < u8Used) ? FALSE : TRUE;
+  }
+  Bench_psScanQueue = NULL;
+
+  u64Start = BenchNow();
+  for(u32 i = 0; i < u32Pairs_; i++)
+  {
+    (void)BenchScanQueue(&Bench_psScanQueue, Bench_au8Data);
+    BenchScanDeQueue(&Bench_psScanQueue);
+  }
+  *pdNs_ = (double)(BenchNow() - u64Start) / (double)u32Pairs_;
+
+} /* end BenchTimeScan() */
@@ -0,0 +1,930 @@
+/*!**********************************************************************************************************************
+@file messaging_stress.c
+@brief Host stress test for the lock-free transmit queues, slot pool and statuses in messaging.c.
+
+The unmodified messaging.c runs against the single-core Cortex-M3 emulation in cm3_host.c.  The
+task (main thread) does what client tasks and drivers do, chosen at random every pass of a 1ms
+main loop:
+- Queue copied messages (including ones long enough to be split), referenced messages and
+  scatter-gather messages
+- Reserve slots and commit or abort them, sometimes issuing the token first
+- Cancel recent messages and attach ISR or deferred callbacks to them; a callback must only ever
+  run in an ISR or from the messaging task, never inline from a task-context messaging call
+- Run the messaging task, which dispatches callbacks and sweeps stuck messages
+
+Two peripheral ISRs preempt all of that at random instructions and send the queues: the low ISR
+owns TEST_QUEUE_LOW and TEST_QUEUE_SLOW, the high ISR owns TEST_QUEUE_HIGH and TEST_QUEUE_REJECT.
+TEST_QUEUE_SLOW periodically stops being sent for longer than U32_MSG_STATUS_WAITING_TIME.  The
+task goes quiet for that time too, so statuses live long enough for the cleaning sweep to expire
+them and to reclaim the messages stuck on TEST_QUEUE_SLOW.  The queues cover every priority and
+overflow policy, and the busy periods keep the pool full so the quota and drop paths run.
+
+Every message is checked as it is sent: the data must be what was queued (copied data is words
+holding a per-queue sequence number that never goes backwards, referenced data is a tagged
+block), tokens must not go backwards on a queue and the fragments of a message must arrive
+together.  At the end the queues are drained and:
+- Every token queued was sent, failed, cancelled, dropped or reclaimed exactly once
+- Every callback attached ran exactly once with a final state
+- No slot is in use and every payload slot can be reserved again
+
+Usage: messaging_stress [main loop passes] [seed].  The exit status is 0 if every check passed.
+**********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "configuration.h"
+#include "cm3_host.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+***********************************************************************************************************************/
+/* Existing variables that messaging.c takes from main.c */
+volatile u32 G_u32SystemTime1ms;
+volatile u32 G_u32SystemTime1s;
+volatile u32 G_u32SystemFlags;
+volatile u32 G_u32ApplicationFlags;
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U32_TEST_DEFAULT_PASSES         (u32)100000    /*!< @brief Main loop passes (simulated ms) when none are given */
+#define U32_TEST_MAX_GAP                (u32)20000     /*!< @brief Longest time in ns between two interrupts of one level */
+#define U8_TEST_MAX_OPERATIONS          (u8)3          /*!< @brief Most task operations per main loop pass */
+#define U8_TEST_SENDS_PER_ISR           (u8)2          /*!< @brief Most messages each ISR sends per queue */
+#define U32_TEST_FAIL_ODDS              (u32)64        /*!< @brief One send in this many is FAILED */
+
+#define U32_TEST_STALL_PERIOD           (u32)20000     /*!< @brief ms between the starts of TEST_QUEUE_SLOW stalls */
+#define U32_TEST_STALL_TIME             (u32)(U32_MSG_STATUS_WAITING_TIME + 2000) /*!< @brief ms TEST_QUEUE_SLOW is not sent */
+#define U32_TEST_QUIET_ODDS             (u32)256       /*!< @brief While stalled, the task only works on one pass in this many */
+
+#define U32_TEST_MAX_WORDS              (u32)150       /*!< @brief Longest copied message in words; longer than a slot so it splits */
+#define U32_TEST_SEQUENCE_MASK          (u32)0x00FFFFFF /*!< @brief Copied data words hold a sequence number up to this */
+#define U32_TEST_REFERENCE_TAG          (u32)0xA5000000 /*!< @brief Top byte of the words of referenced data */
+#define U8_TEST_REFERENCE_BLOCKS        (u8)16         /*!< @brief Number of constant blocks used as referenced data */
+#define U8_TEST_REFERENCE_WORDS         (u8)16         /*!< @brief Words in each referenced block */
+
+#define U8_TEST_RECENT_TOKENS           (u8)64         /*!< @brief Recent tokens kept for cancels and callbacks */
+#define U32_TEST_MAX_TOKENS             (u32)0x00400000 /*!< @brief Tokens that can be tracked for callbacks */
+#define U8_TEST_MAX_ERRORS              (u8)16         /*!< @brief Errors saved for the report */
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum TestQueueIndexType
+@brief The queues under test
+*/
+typedef enum {TEST_QUEUE_LOW = 0, TEST_QUEUE_SLOW, TEST_QUEUE_HIGH, TEST_QUEUE_REJECT, TEST_QUEUES} TestQueueIndexType;
+
+/*!
+@struct TestQueueType
+@brief A queue under test and what the task and its ISR know about it
+*/
+typedef struct
+{
+  MessageQueueType sQueue;                  /*!< @brief The transmit queue */
+  u8* pu8Name;                              /*!< @brief Name for the report */
+  MessagePriorityType ePriority;            /*!< @brief Priority of the queue */
+  u8 u8Quota;                               /*!< @brief Quota of the queue */
+  MessageOverflowType eOverflow;            /*!< @brief Overflow policy of the queue */
+  u32 u32Sequence;                          /*!< @brief Task: sequence number of the next copied data */
+  u32 u32TokensQueued;                      /*!< @brief Task: tokens queued */
+  u32 u32TokensSent;                        /*!< @brief ISR: tokens that finished COMPLETE */
+  u32 u32TokensFailed;                      /*!< @brief ISR: tokens that finished FAILED */
+  u32 u32LastSequence;                      /*!< @brief ISR: sequence number of the last copied data sent */
+  u32 u32LastToken;                         /*!< @brief ISR: token of the last message sent */
+  bool bFragmentOpen;                       /*!< @brief ISR: the last message sent has more fragments */
+} TestQueueType;
+
+/*!
+@struct TestRecentTokenType
+@brief A recently queued token
+*/
+typedef struct
+{
+  u32 u32Token;                             /*!< @brief The token; 0 if the entry is unused */
+  bool bCallback;                           /*!< @brief TRUE once a callback has been attached */
+} TestRecentTokenType;
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Test_<type>" and be declared as static.
+***********************************************************************************************************************/
+static TestQueueType Test_asQueues[TEST_QUEUES] =
+{
+  { .pu8Name = (u8*)"LOW",    .ePriority = MSG_PRIORITY_LOW,    .u8Quota = 0,  .eOverflow = MSG_OVERFLOW_DROP_LOWEST_PRIORITY },
+  { .pu8Name = (u8*)"SLOW",   .ePriority = MSG_PRIORITY_NORMAL, .u8Quota = 20, .eOverflow = MSG_OVERFLOW_DROP_OLDEST },
+  { .pu8Name = (u8*)"HIGH",   .ePriority = MSG_PRIORITY_HIGH,   .u8Quota = 0,  .eOverflow = MSG_OVERFLOW_DROP_LOWEST_PRIORITY },
+  { .pu8Name = (u8*)"REJECT", .ePriority = MSG_PRIORITY_NORMAL, .u8Quota = 12, .eOverflow = MSG_OVERFLOW_REJECT_NEW }
+};
+
+static u32 Test_au32ReferenceData[U8_TEST_REFERENCE_BLOCKS][U8_TEST_REFERENCE_WORDS]; /*!< @brief Constant referenced data */
+static u32 Test_au32Data[U32_TEST_MAX_WORDS];          /*!< @brief Task's message data */
+
+static TestRecentTokenType Test_asRecent[U8_TEST_RECENT_TOKENS]; /*!< @brief Recently queued tokens */
+static u8 Test_u8RecentIndex;                          /*!< @brief Next entry of Test_asRecent to use */
+static u32 Test_u32Random;                             /*!< @brief Task random state */
+static u32 Test_au32IsrRandom[U8_CM3_IRQ_LEVELS];      /*!< @brief ISR random states */
+static volatile bool Test_bSlowStalled;                /*!< @brief TRUE while TEST_QUEUE_SLOW is not sent */
+
+static u32 Test_u32Cancelled;                          /*!< @brief Tokens cancelled */
+static u32 Test_u32Committed;                          /*!< @brief Reservations committed */
+static u32 Test_u32Aborted;                            /*!< @brief Reservations aborted */
+static u32 Test_u32Splits;                             /*!< @brief Copied messages that were split */
+static u32 Test_u32FragmentMessages;                   /*!< @brief Scatter-gather messages queued */
+static u32 Test_u32CallbacksAttached;                  /*!< @brief Callbacks attached */
+static u32 Test_u32CallbacksRun;                       /*!< @brief Callbacks run (ISR or task) */
+static u32 Test_au32CallbackStates[FAILED + 1];        /*!< @brief Callbacks run with each state */
+static u8 Test_au8CallbacksPerToken[U32_TEST_MAX_TOKENS]; /*!< @brief Callbacks run for each token */
+static bool Test_bInMessagingTask;                     /*!< @brief TRUE while the messaging task runs */
+static u32 Test_u32StuckReports;                       /*!< @brief Calls to DebugPrintFragments() */
+
+static u32 Test_u32Errors;                             /*!< @brief Checks that failed */
+static const char* Test_apcErrors[U8_TEST_MAX_ERRORS]; /*!< @brief What the first checks that failed were */
+static u32 Test_au32ErrorValues[U8_TEST_MAX_ERRORS];   /*!< @brief A value for each saved error */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+static void TestError(const char* pcError_, u32 u32Value_);
+static u32 TestRandom(u32* pu32State_, u32 u32Range_);
+static void TestRememberToken(u32 u32Token_);
+static void TestCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_);
+static void TestSendQueue(TestQueueType* psTest_, u32* pu32Random_);
+static void TestLowIsr(void);
+static void TestHighIsr(void);
+static void TestQueueCopy(TestQueueType* psTest_);
+static void TestQueueReference(TestQueueType* psTest_);
+static void TestQueueFragments(TestQueueType* psTest_);
+static void TestReserve(TestQueueType* psTest_);
+static void TestCancel(void);
+static void TestAttachCallback(void);
+static void TestRunTask(u32 u32Passes_);
+static void TestRunMessagingTask(void);
+static void TestDrain(void);
+static void TestCheckEnd(void);
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Stand-ins for the other firmware tasks */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
+{
+  return( (G_u32SystemTime1ms - *pu32SavedTick_) >= u32Period_ ? TRUE : FALSE );
+}
+
+u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_)
+{
+  return( (u8)sprintf((char*)pu8AsciiString_, "%u", (unsigned)u32Number_) );
+}
+
+u32 DebugPrintFragments(MessageFragmentType* psFragments_, u8 u8Fragments_)
+{
+  (void)psFragments_;
+  (void)u8Fragments_;
+  Test_u32StuckReports++;
+
+  return(0);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Test */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+  u32 u32Passes = U32_TEST_DEFAULT_PASSES;
+  u32 u32Seed = 1;
+
+  if(argc > 1)
+  {
+    u32Passes = (u32)strtoul(argv[1], NULL, 0);
+  }
+  if(argc > 2)
+  {
+    u32Seed = (u32)strtoul(argv[2], NULL, 0);
+  }
+
+  /* messaging.c links messages through 32-bit words */
+  if( (uintptr_t)&Test_asQueues[0] > UINT32_MAX )
+  {
+    printf("FAIL: data is not in the low 4GB; build with -no-pie\n");
+    return(1);
+  }
+
+  Test_u32Random = u32Seed | 1;
+  Test_au32IsrRandom[CM3_IRQ_LOW]  = (u32Seed * 7) | 1;
+  Test_au32IsrRandom[CM3_IRQ_HIGH] = (u32Seed * 13) | 1;
+
+  for(u8 i = 0; i < U8_TEST_REFERENCE_BLOCKS; i++)
+  {
+    for(u8 j = 0; j < U8_TEST_REFERENCE_WORDS; j++)
+    {
+      Test_au32ReferenceData[i][j] = U32_TEST_REFERENCE_TAG | i;
+    }
+  }
+
+  MessagingInitialize();
+  for(u8 i = 0; i < TEST_QUEUES; i++)
+  {
+    MessageQueueInitialize(&Test_asQueues[i].sQueue, Test_asQueues[i].pu8Name);
+    MessageQueueSetPriority(&Test_asQueues[i].sQueue, Test_asQueues[i].ePriority, Test_asQueues[i].u8Quota);
+    MessageQueueSetOverflow(&Test_asQueues[i].sQueue, Test_asQueues[i].eOverflow);
+  }
+
+  Cm3HostInitialize(TestLowIsr, TestHighIsr);
+  Cm3HostStartInterrupts(U32_TEST_MAX_GAP);
+  TestRunTask(u32Passes);
+  Cm3HostStopInterrupts();
+
+  TestDrain();
+  TestCheckEnd();
+
+  printf("%u passes, seed %u: %u low and %u high interrupts, %u failed STREX\n", (unsigned)u32Passes,
+         (unsigned)u32Seed, (unsigned)Cm3HostInterruptCount(CM3_IRQ_LOW),
+         (unsigned)Cm3HostInterruptCount(CM3_IRQ_HIGH), (unsigned)Cm3HostStrexFailures());
+
+  for(u8 i = 0; i < TEST_QUEUES; i++)
+  {
+    printf("  %-6s queued %7u  sent %7u  failed %5u  (slots high water %u)\n", (char*)Test_asQueues[i].pu8Name,
+           (unsigned)Test_asQueues[i].u32TokensQueued, (unsigned)Test_asQueues[i].u32TokensSent,
+           (unsigned)Test_asQueues[i].u32TokensFailed, (unsigned)Test_asQueues[i].sQueue.u8SlotsHighWater);
+  }
+
+  printf("  cancelled %u, splits %u, scatter-gather %u, committed %u, aborted %u, stuck reports %u\n",
+         (unsigned)Test_u32Cancelled, (unsigned)Test_u32Splits, (unsigned)Test_u32FragmentMessages,
+         (unsigned)Test_u32Committed, (unsigned)Test_u32Aborted, (unsigned)Test_u32StuckReports);
+  printf("  callbacks %u attached, %u run: %u COMPLETE, %u TIMEOUT, %u ABANDONED, %u FAILED\n",
+         (unsigned)Test_u32CallbacksAttached, (unsigned)Test_u32CallbacksRun,
+         (unsigned)Test_au32CallbackStates[COMPLETE], (unsigned)Test_au32CallbackStates[TIMEOUT],
+         (unsigned)Test_au32CallbackStates[ABANDONED], (unsigned)Test_au32CallbackStates[FAILED]);
+
+  if(Test_u32Errors != 0)
+  {
+    for(u8 i = 0; (i < Test_u32Errors) && (i < U8_TEST_MAX_ERRORS); i++)
+    {
+      printf("  ERROR: %s (%u)\n", Test_apcErrors[i], (unsigned)Test_au32ErrorValues[i]);
+    }
+    printf("FAIL: %u errors\n", (unsigned)Test_u32Errors);
+    return(1);
+  }
+
+  printf("PASS\n");
+  return(0);
+
+} /* end main() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestError(const char* pcError_, u32 u32Value_)
+
+@brief Records a failed check.  Safe to call from the ISRs since nothing is printed until the end.
+
+Requires:
+@param pcError_ describes the check
+@param u32Value_ is a value that helps explain it
+
+Promises:
+- The error is counted and the first U8_TEST_MAX_ERRORS are saved
+
+*/
+static void TestError(const char* pcError_, u32 u32Value_)
+{
+  u32 u32Index = __atomic_fetch_add(&Test_u32Errors, 1, __ATOMIC_RELAXED);
+
+  if(u32Index < U8_TEST_MAX_ERRORS)
+  {
+    Test_apcErrors[u32Index] = pcError_;
+    Test_au32ErrorValues[u32Index] = u32Value_;
+  }
+
+} /* end TestError() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u32 TestRandom(u32* pu32State_, u32 u32Range_)
+
+@brief xorshift32 random number.  Each context has its own state so the ISRs do not share one.
+
+Requires:
+@param pu32State_ is the non-zero state of the caller's context
+@param u32Range_ is the number of possible results
+
+Promises:
+- Returns a number from 0 to u32Range_ - 1
+
+*/
+static u32 TestRandom(u32* pu32State_, u32 u32Range_)
+{
+  u32 u32State = *pu32State_;
+
+  u32State ^= u32State << 13;
+  u32State ^= u32State >> 17;
+  u32State ^= u32State << 5;
+  *pu32State_ = u32State;
+
+  return(u32State % u32Range_);
+
+} /* end TestRandom() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestRememberToken(u32 u32Token_)
+
+@brief Keeps a token that was just queued for later cancels and callbacks.
+
+Requires:
+@param u32Token_ is a new token
+
+Promises:
+- u32Token_ replaces the oldest entry of Test_asRecent
+
+*/
+static void TestRememberToken(u32 u32Token_)
+{
+  Test_asRecent[Test_u8RecentIndex].u32Token = u32Token_;
+  Test_asRecent[Test_u8RecentIndex].bCallback = FALSE;
+  Test_u8RecentIndex = (Test_u8RecentIndex + 1) % U8_TEST_RECENT_TOKENS;
+
+} /* end TestRememberToken() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_)
+
+@brief Completion callback for both modes.  Runs in an ISR or from the messaging task, so it only counts.
+
+Requires:
+@param u32Token_ is the token the callback was attached to
+@param eState_ is the final state
+@param pvContext_ is the token it was attached to
+
+Promises:
+- The run is counted for the token and the state; a non-final state or wrong context is an error
+
+*/
+static void TestCallback(u32 u32Token_, MessageStateType eState_, void* pvContext_)
+{
+  if( (uintptr_t)pvContext_ != u32Token_ )
+  {
+    TestError("callback context does not match its token", u32Token_);
+  }
+
+  /* Client code must never run with the task's interrupts masked or from inside a messaging call */
+  if(!Cm3HostInIsr() && !Test_bInMessagingTask)
+  {
+    TestError("callback run inline from a task-context messaging call", u32Token_);
+  }
+
+  if( (eState_ != COMPLETE) && (eState_ != TIMEOUT) && (eState_ != ABANDONED) && (eState_ != FAILED) )
+  {
+    TestError("callback run with a state that is not final", eState_);
+    return;
+  }
+
+  __atomic_fetch_add(&Test_u32CallbacksRun, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&Test_au32CallbackStates[eState_], 1, __ATOMIC_RELAXED);
+  if(__atomic_fetch_add(&Test_au8CallbacksPerToken[u32Token_], 1, __ATOMIC_RELAXED) != 0)
+  {
+    TestError("callback ran more than once", u32Token_);
+  }
+
+} /* end TestCallback() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestSendQueue(TestQueueType* psTest_, u32* pu32Random_)
+
+@brief Sends up to U8_TEST_SENDS_PER_ISR messages from the head of a queue the way a peripheral
+ISR does and checks each one.
+
+Requires:
+- Called from the ISR that owns the queue, or by the task with the ISRs stopped
+@param psTest_ is the queue
+@param pu32Random_ is the random state of the calling context
+
+Promises:
+- Each message sent is SENDING and then COMPLETE, or FAILED about once in U32_TEST_FAIL_ODDS
+- Bad data, a token that went backwards or a broken scatter-gather message is an error
+
+*/
+static void TestSendQueue(TestQueueType* psTest_, u32* pu32Random_)
+{
+  MessageType* psMessage;
+  MessageType* psNextFragment;
+  MessageStateType eState;
+  u32* pu32Words;
+  u32 u32Words;
+  bool bMoreFragments;
+
+  for(u8 i = TestRandom(pu32Random_, U8_TEST_SENDS_PER_ISR + 1); i != 0; i--)
+  {
+    psMessage = psTest_->sQueue.psHead;
+    if(psMessage == NULL)
+    {
+      if(psTest_->bFragmentOpen)
+      {
+        TestError("scatter-gather message lost its last fragment", psTest_->u32LastToken);
+        psTest_->bFragmentOpen = FALSE;
+      }
+      return;
+    }
+
+    /* The token must not go backwards and the rest of a scatter-gather message must be next */
+    if( (psMessage->u32Token == 0) || (psMessage->u32Token < psTest_->u32LastToken) )
+    {
+      TestError("token went backwards", psMessage->u32Token);
+    }
+    if(psTest_->bFragmentOpen && (psMessage->u32Token != psTest_->u32LastToken))
+    {
+      TestError("scatter-gather message interleaved with another", psMessage->u32Token);
+    }
+    psTest_->u32LastToken = psMessage->u32Token;
+
+    /* Every word must be the same: a sequence number or a reference block tag */
+    pu32Words = (u32*)psMessage->pu8Message;
+    u32Words = psMessage->u32Size / 4;
+    if( (psMessage->u32Size == 0) || ((psMessage->u32Size % 4) != 0) ||
+        (psMessage->u32Size > (U32_TEST_MAX_WORDS * 4)) )
+    {
+      TestError("message has a bad size", psMessage->u32Size);
+      u32Words = 0;
+    }
+    for(u32 j = 1; j < u32Words; j++)
+    {
+      if(pu32Words[j] != pu32Words[0])
+      {
+        TestError("message data corrupted", psMessage->u32Token);
+        break;
+      }
+    }
+    if(u32Words != 0)
+    {
+      if( (pu32Words[0] & ~U32_TEST_SEQUENCE_MASK) == U32_TEST_REFERENCE_TAG )
+      {
+        if( (pu32Words[0] & U32_TEST_SEQUENCE_MASK) >= U8_TEST_REFERENCE_BLOCKS )
+        {
+          TestError("referenced message has bad data", psMessage->u32Token);
+        }
+      }
+      else if( (pu32Words[0] & ~U32_TEST_SEQUENCE_MASK) != 0 )
+      {
+        TestError("copied message has bad data", pu32Words[0]);
+      }
+      else
+      {
+        if(pu32Words[0] < psTest_->u32LastSequence)
+        {
+          TestError("copied data sent out of order", pu32Words[0]);
+        }
+        psTest_->u32LastSequence = pu32Words[0];
+      }
+    }
+
+    /* Send it */
+    bMoreFragments = (psMessage->u8Flags & _MSG_MORE_FRAGMENTS) ? TRUE : FALSE;
+    eState = (TestRandom(pu32Random_, U32_TEST_FAIL_ODDS) == 0) ? FAILED : COMPLETE;
+    UpdateMessageStatus(psMessage->u32Token, SENDING);
+    psNextFragment = FinishTxMessage(&psTest_->sQueue, eState);
+
+    if(eState == FAILED)
+    {
+      psTest_->u32TokensFailed++;
+      bMoreFragments = FALSE;
+    }
+    else if(!bMoreFragments)
+    {
+      psTest_->u32TokensSent++;
+    }
+
+    psTest_->bFragmentOpen = bMoreFragments;
+    if( (psNextFragment != NULL) != bMoreFragments )
+    {
+      TestError("FinishTxMessage() returned the wrong next fragment", psMessage->u32Token);
+    }
+  }
+
+} /* end TestSendQueue() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestLowIsr(void)
+
+@brief The low priority peripheral: sends TEST_QUEUE_LOW and, unless it is stalled, TEST_QUEUE_SLOW.
+*/
+static void TestLowIsr(void)
+{
+  TestSendQueue(&Test_asQueues[TEST_QUEUE_LOW], &Test_au32IsrRandom[CM3_IRQ_LOW]);
+
+  if(!Test_bSlowStalled)
+  {
+    TestSendQueue(&Test_asQueues[TEST_QUEUE_SLOW], &Test_au32IsrRandom[CM3_IRQ_LOW]);
+  }
+
+} /* end TestLowIsr() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestHighIsr(void)
+
+@brief The high priority peripheral: sends TEST_QUEUE_HIGH and TEST_QUEUE_REJECT.
+*/
+static void TestHighIsr(void)
+{
+  TestSendQueue(&Test_asQueues[TEST_QUEUE_HIGH], &Test_au32IsrRandom[CM3_IRQ_HIGH]);
+  TestSendQueue(&Test_asQueues[TEST_QUEUE_REJECT], &Test_au32IsrRandom[CM3_IRQ_HIGH]);
+
+} /* end TestHighIsr() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestQueueCopy(TestQueueType* psTest_)
+
+@brief Queues a copied message of 1 to U32_TEST_MAX_WORDS words with QueueTxMessage().
+*/
+static void TestQueueCopy(TestQueueType* psTest_)
+{
+  u32 u32Words = 1 + TestRandom(&Test_u32Random, U32_TEST_MAX_WORDS);
+  u32 u32Parts = ((u32Words * 4) + U16_MAX_TX_MESSAGE_LENGTH - 1) / U16_MAX_TX_MESSAGE_LENGTH;
+  u32 u32Token;
+
+  for(u32 i = 0; i < u32Words; i++)
+  {
+    Test_au32Data[i] = psTest_->u32Sequence;
+  }
+
+  u32Token = QueueTxMessage(&psTest_->sQueue, u32Words * 4, (u8*)Test_au32Data);
+  if(u32Token != 0)
+  {
+    /* Each part of a split message has its own token; the last one is returned */
+    psTest_->u32Sequence++;
+    psTest_->u32TokensQueued += u32Parts;
+    if(u32Parts > 1)
+    {
+      Test_u32Splits++;
+    }
+    TestRememberToken(u32Token);
+  }
+
+} /* end TestQueueCopy() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestQueueReference(TestQueueType* psTest_)
+
+@brief Queues a referenced message from one of the constant blocks with QueueTxMessageReference().
+*/
+static void TestQueueReference(TestQueueType* psTest_)
+{
+  u8 u8Block = TestRandom(&Test_u32Random, U8_TEST_REFERENCE_BLOCKS);
+  u32 u32Words = 1 + TestRandom(&Test_u32Random, U8_TEST_REFERENCE_WORDS);
+  u32 u32Token;
+
+  u32Token = QueueTxMessageReference(&psTest_->sQueue, u32Words * 4, (u8*)Test_au32ReferenceData[u8Block]);
+  if(u32Token != 0)
+  {
+    psTest_->u32TokensQueued++;
+    TestRememberToken(u32Token);
+  }
+
+} /* end TestQueueReference() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestQueueFragments(TestQueueType* psTest_)
+
+@brief Queues a scatter-gather message of copied and referenced fragments with QueueTxMessageFragments().
+*/
+static void TestQueueFragments(TestQueueType* psTest_)
+{
+  MessageFragmentType asFragments[U8_MSG_MAX_FRAGMENTS];
+  u8 u8Fragments = 1 + TestRandom(&Test_u32Random, U8_MSG_MAX_FRAGMENTS);
+  u32 u32Token;
+
+  for(u32 i = 0; i < (U16_MAX_TX_MESSAGE_LENGTH / 4); i++)
+  {
+    Test_au32Data[i] = psTest_->u32Sequence;
+  }
+
+  for(u8 i = 0; i < u8Fragments; i++)
+  {
+    asFragments[i].bCopy = TestRandom(&Test_u32Random, 2) ? TRUE : FALSE;
+    if(asFragments[i].bCopy)
+    {
+      asFragments[i].pu8Data = (u8*)Test_au32Data;
+      asFragments[i].u32Size = 4 * (1 + TestRandom(&Test_u32Random, U16_MAX_TX_MESSAGE_LENGTH / 4));
+    }
+    else
+    {
+      asFragments[i].pu8Data = (u8*)Test_au32ReferenceData[TestRandom(&Test_u32Random, U8_TEST_REFERENCE_BLOCKS)];
+      asFragments[i].u32Size = 4 * (1 + TestRandom(&Test_u32Random, U8_TEST_REFERENCE_WORDS));
+    }
+  }
+
+  u32Token = QueueTxMessageFragments(&psTest_->sQueue, asFragments, u8Fragments);
+  if(u32Token != 0)
+  {
+    psTest_->u32Sequence++;
+    psTest_->u32TokensQueued++;
+    Test_u32FragmentMessages++;
+    TestRememberToken(u32Token);
+  }
+
+} /* end TestQueueFragments() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestReserve(TestQueueType* psTest_)
+
+@brief Writes a message in place with MessageReserve(), sometimes issues its token first, then
+commits a random length or aborts it.
+*/
+static void TestReserve(TestQueueType* psTest_)
+{
+  MessageType* psHandle;
+  u32 u32Words = 1 + TestRandom(&Test_u32Random, U16_MAX_TX_MESSAGE_LENGTH / 4);
+  u32* pu32Buffer;
+  u32 u32Token = 0;
+
+  pu32Buffer = (u32*)MessageReserve(&psTest_->sQueue, u32Words * 4, &psHandle);
+  if(pu32Buffer == NULL)
+  {
+    return;
+  }
+
+  for(u32 i = 0; i < u32Words; i++)
+  {
+    pu32Buffer[i] = psTest_->u32Sequence;
+  }
+
+  if(TestRandom(&Test_u32Random, 4) == 0)
+  {
+    u32Token = MessageIssueToken(psHandle);
+  }
+
+  if(TestRandom(&Test_u32Random, 5) == 0)
+  {
+    MessageAbort(psHandle);
+    Test_u32Aborted++;
+    if( (u32Token != 0) && (QueryMessageStatus(u32Token) != ABANDONED) )
+    {
+      TestError("aborted reservation is not ABANDONED", u32Token);
+    }
+    return;
+  }
+
+  u32Token = MessageCommit(psHandle, 4 * (1 + TestRandom(&Test_u32Random, u32Words)));
+  if(u32Token == 0)
+  {
+    TestError("commit of a reservation failed", u32Words);
+    return;
+  }
+
+  psTest_->u32Sequence++;
+  psTest_->u32TokensQueued++;
+  Test_u32Committed++;
+  TestRememberToken(u32Token);
+
+} /* end TestReserve() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestCancel(void)
+
+@brief Cancels a recent token, which may be waiting, being sent or finished.
+*/
+static void TestCancel(void)
+{
+  u32 u32Token = Test_asRecent[TestRandom(&Test_u32Random, U8_TEST_RECENT_TOKENS)].u32Token;
+
+  if( (u32Token != 0) && CancelMessage(u32Token) )
+  {
+    Test_u32Cancelled++;
+    if(QueryMessageStatus(u32Token) != ABANDONED)
+    {
+      TestError("cancelled message is not ABANDONED", u32Token);
+    }
+  }
+
+} /* end TestCancel() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestAttachCallback(void)
+
+@brief Attaches an ISR or deferred callback to a recent token that does not have one yet.
+*/
+static void TestAttachCallback(void)
+{
+  TestRecentTokenType* psRecent = &Test_asRecent[TestRandom(&Test_u32Random, U8_TEST_RECENT_TOKENS)];
+  MessageCallbackModeType eMode = TestRandom(&Test_u32Random, 2) ? MSG_CALLBACK_ISR : MSG_CALLBACK_DEFERRED;
+
+  if( (psRecent->u32Token == 0) || psRecent->bCallback || (psRecent->u32Token >= U32_TEST_MAX_TOKENS) )
+  {
+    return;
+  }
+
+  if(MessageSetCallback(psRecent->u32Token, TestCallback, (void*)(uintptr_t)psRecent->u32Token, eMode))
+  {
+    psRecent->bCallback = TRUE;
+    Test_u32CallbacksAttached++;
+  }
+
+} /* end TestAttachCallback() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestRunTask(u32 u32Passes_)
+
+@brief The main loop: each pass is one ms with the messaging task and a few random client operations.
+*/
+static void TestRunTask(u32 u32Passes_)
+{
+  TestQueueType* psTest;
+
+  for(u32 u32Pass = 0; u32Pass < u32Passes_; u32Pass++)
+  {
+    G_u32SystemTime1ms++;
+    if((G_u32SystemTime1ms % 1000) == 0)
+    {
+      G_u32SystemTime1s++;
+    }
+    Test_bSlowStalled = ( (G_u32SystemTime1ms % U32_TEST_STALL_PERIOD) < U32_TEST_STALL_TIME );
+
+    TestRunMessagingTask();
+
+    if(Test_bSlowStalled && (TestRandom(&Test_u32Random, U32_TEST_QUIET_ODDS) != 0))
+    {
+      continue;
+    }
+
+    for(u8 i = TestRandom(&Test_u32Random, U8_TEST_MAX_OPERATIONS + 1); i != 0; i--)
+    {
+      psTest = &Test_asQueues[TestRandom(&Test_u32Random, TEST_QUEUES)];
+
+      switch(TestRandom(&Test_u32Random, 20))
+      {
+        case 0: case 1: case 2: case 3: case 4: case 5: case 6: case 7:
+          TestQueueCopy(psTest);
+          break;
+
+        case 8: case 9:
+          TestQueueReference(psTest);
+          break;
+
+        case 10: case 11:
+          TestQueueFragments(psTest);
+          break;
+
+        case 12: case 13:
+          TestReserve(psTest);
+          break;
+
+        case 14: case 15: case 16:
+          TestCancel();
+          break;
+
+        case 17: case 18:
+          TestAttachCallback();
+          break;
+
+        default:
+          (void)QueryMessageStatus(Test_asRecent[TestRandom(&Test_u32Random, U8_TEST_RECENT_TOKENS)].u32Token);
+          break;
+      } /* end switch */
+    }
+  }
+
+} /* end TestRunTask() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestRunMessagingTask(void)
+
+@brief Runs one pass of the messaging task, which is the only task code that may run callbacks.
+*/
+static void TestRunMessagingTask(void)
+{
+  Test_bInMessagingTask = TRUE;
+  MessagingRunActiveState();
+  Test_bInMessagingTask = FALSE;
+
+} /* end TestRunMessagingTask() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestDrain(void)
+
+@brief With the interrupts stopped, sends everything left and runs the deferred callbacks.
+*/
+static void TestDrain(void)
+{
+  bool bQueued = TRUE;
+
+  Test_bSlowStalled = FALSE;
+  while(bQueued)
+  {
+    Cm3HostRunIsr(CM3_IRQ_LOW);
+    Cm3HostRunIsr(CM3_IRQ_HIGH);
+
+    bQueued = FALSE;
+    for(u8 i = 0; i < TEST_QUEUES; i++)
+    {
+      bQueued |= (Test_asQueues[i].sQueue.psHead != NULL);
+    }
+  }
+
+  TestRunMessagingTask();
+
+} /* end TestDrain() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void TestCheckEnd(void)
+
+@brief Checks that every token, callback and slot is accounted for once the queues are empty.
+*/
+static void TestCheckEnd(void)
+{
+  MessagingStatsType sStats;
+  MessageThrottleCountType sThrottle;
+  MessageType* apsHandles[U8_TX_QUEUE_SIZE];
+  u32 u32Queued = 0;
+  u32 u32Accounted = 0;
+  u32 u32Dropped = 0;
+  u8 u8Reserved = 0;
+
+  QueryMessagingStats(&sStats);
+
+  for(u8 i = 0; i < TEST_QUEUES; i++)
+  {
+    u32Queued += Test_asQueues[i].u32TokensQueued;
+    u32Accounted += Test_asQueues[i].u32TokensSent + Test_asQueues[i].u32TokensFailed;
+
+    if( (Test_asQueues[i].sQueue.psHead != NULL) || (Test_asQueues[i].sQueue.psTail != NULL) )
+    {
+      TestError("queue not empty after draining", i);
+    }
+    if(Test_asQueues[i].sQueue.u8SlotsUsed != 0)
+    {
+      TestError("queue still charged for slots", Test_asQueues[i].sQueue.u8SlotsUsed);
+    }
+  }
+
+  for(u8 i = 0; i < U8_MSG_PRIORITY_LEVELS; i++)
+  {
+    QueryMessageThrottleCounts((MessagePriorityType)i, &sThrottle);
+    u32Dropped += sThrottle.u32Dropped;
+  }
+  u32Accounted += u32Dropped + Test_u32Cancelled + sStats.u32MessagesReclaimed;
+
+  if(u32Queued != u32Accounted)
+  {
+    TestError("tokens queued != sent + failed + cancelled + dropped + reclaimed", u32Queued - u32Accounted);
+  }
+  if(sStats.u8SlotsUsed != 0)
+  {
+    TestError("slots still in use after draining", sStats.u8SlotsUsed);
+  }
+
+  if(Test_u32CallbacksAttached != Test_u32CallbacksRun)
+  {
+    TestError("callbacks attached != callbacks run", Test_u32CallbacksAttached - Test_u32CallbacksRun);
+  }
+
+  /* Every payload slot must be free in its bitmap: high priority traffic can take them all */
+  while( (u8Reserved < U8_TX_QUEUE_SIZE) &&
+         (MessageReserve(&Test_asQueues[TEST_QUEUE_HIGH].sQueue, 1, &apsHandles[u8Reserved]) != NULL) )
+  {
+    u8Reserved++;
+  }
+  if(u8Reserved != (U8_TX_QUEUE_SIZE - U8_MSG_REFERENCE_SLOTS))
+  {
+    TestError("payload slots that could be reserved after draining", u8Reserved);
+  }
+  for(u8 i = 0; i < u8Reserved; i++)
+  {
+    MessageAbort(apsHandles[i]);
+  }
+
+  printf("  dropped %u, reclaimed %u, statuses expired %u\n", (unsigned)u32Dropped,
+         (unsigned)sStats.u32MessagesReclaimed, (unsigned)sStats.u32StatusesExpired);
+
+} /* end TestCheckEnd() */
@@ -0,0 +1,365 @@
+/*!**********************************************************************************************************************
+@file uart_latency.c
+@brief Host measurement of the UART transmit start latency with round-robin and pending-bitmap scheduling.
+
+Four simulated UARTs (DBGU, US0, US1, US2 at 115200 baud) have real messaging.c transmit queues.
+Client tasks queue messages on them at random times inside each 1ms main loop pass and the UART
+task runs once per pass, at the start of it.  Each UART is modelled the way sam3u_uart.c drives it:
+- An idle UART only starts sending when the UART task starts it
+- A sending UART's ISR finishes each message and starts the next one queued on it, so only
+  messages that find the UART idle wait for the task
+
+The same random traffic is run with the two UartSM_Idle() schedulers:
+- Round-robin (the original): the task looks at one UART per pass, DBGU -> US0 -> US1 -> US2
+- Pending bitmap (the current one): queuing sets the UART's bit through MessageQueueSetPendingFlag()
+  and the task takes the bits and starts every UART that has one
+
+The start latency is the time from QueueTxMessage() to the first byte being loaded into the UART.
+It is reported separately for messages the task started (the UART was idle when they were queued)
+and for all messages.
+
+Messages refused because the pool is full are counted; at high loads the round-robin scheduler
+leaves messages queued long enough for that to happen.
+
+Usage: uart_latency [main loop passes] [seed] [load in percent per UART]
+**********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "configuration.h"
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in host_plain.c) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief Stand-in for main.c */
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U32_LAT_DEFAULT_PASSES          (u32)200000    /*!< @brief Main loop passes (ms) when none are given */
+#define U32_LAT_DEFAULT_LOAD            (u32)20        /*!< @brief Default percent of its time each UART spends sending */
+#define U32_LAT_PASS_TIME               (u32)1000      /*!< @brief Time of one main loop pass in us */
+#define U32_LAT_BYTE_TIME_NS            (u32)86806     /*!< @brief Time of one 10-bit character at 115200 baud in ns */
+#define U8_LAT_MIN_MESSAGE              (u8)4          /*!< @brief Shortest message in bytes */
+#define U8_LAT_MAX_MESSAGE              (u8)32         /*!< @brief Longest message in bytes */
+#define U8_LAT_MAX_QUEUED               (u8)64         /*!< @brief Queue times remembered per UART (a power of 2 of at least U8_TX_QUEUE_SIZE) */
+
+#define U8_LAT_UARTS                    (u8)4          /*!< @brief Number of simulated UARTs */
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum LatSchedulerType
+@brief The UartSM_Idle() schedulers compared
+*/
+typedef enum {LAT_ROUND_ROBIN = 0, LAT_PENDING_BITMAP, LAT_SCHEDULERS} LatSchedulerType;
+
+/*!
+@struct LatUartType
+@brief A simulated UART and its transmit queue
+*/
+typedef struct
+{
+  MessageQueueType sQueue;                  /*!< @brief The transmit queue */
+  u8* pu8Name;                              /*!< @brief Name of the UART */
+  u32 u32PendingFlag;                       /*!< @brief _UART_PENDING_x bit of the UART */
+  bool bSending;                            /*!< @brief TRUE while the UART is sending a message */
+  u32 u32SendEnd;                           /*!< @brief Time in us the message being sent finishes */
+  u32 au32QueueTime[U8_LAT_MAX_QUEUED];     /*!< @brief Times in us the messages in the queue were queued */
+  u8 u8QueueHead;                           /*!< @brief au32QueueTime index of the queue head */
+  u8 u8QueueTail;                           /*!< @brief au32QueueTime index of the next message queued */
+} LatUartType;
+
+/*!
+@struct LatResultType
+@brief Start latencies of one run
+*/
+typedef struct
+{
+  u32 u32TaskStarts;                        /*!< @brief Messages started by the UART task */
+  uint64_t u64TaskWait;                     /*!< @brief Sum of their latencies in us */
+  u32 u32TaskMaxWait;                       /*!< @brief Longest of their latencies in us */
+  u32 u32AllStarts;                         /*!< @brief Messages started by the task or an ISR */
+  uint64_t u64AllWait;                      /*!< @brief Sum of their latencies in us */
+  u32 u32AllMaxWait;                        /*!< @brief Longest of their latencies in us */
+  u32 u32Refused;                           /*!< @brief Messages QueueTxMessage() refused */
+} LatResultType;
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Lat_<type>" and be declared as static.
+***********************************************************************************************************************/
+static LatUartType Lat_asUarts[U8_LAT_UARTS] =
+{
+  { .pu8Name = (u8*)"DBGU", .u32PendingFlag = 0x00000001 },
+  { .pu8Name = (u8*)"US0",  .u32PendingFlag = 0x00000002 },
+  { .pu8Name = (u8*)"US1",  .u32PendingFlag = 0x00000004 },
+  { .pu8Name = (u8*)"US2",  .u32PendingFlag = 0x00000008 }
+};
+
+static u32 Lat_u32PendingTx;                           /*!< @brief Pending bits set by QueueTxMessage() */
+static u8 Lat_u8CurrentUart;                           /*!< @brief Next UART the round-robin scheduler looks at */
+static u8 Lat_au8Data[U8_LAT_MAX_MESSAGE];             /*!< @brief Message data */
+static u32 Lat_u32Random;                              /*!< @brief Random state */
+static LatResultType Lat_sResult;                      /*!< @brief Latencies of the current run */
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+static u32 LatRandom(u32 u32Range_);
+static void LatInitialize(u32 u32Seed_);
+static void LatStartMessage(LatUartType* psUart_, u32 u32Now_, bool bTask_);
+static void LatRunUartTask(LatSchedulerType eScheduler_, u32 u32Now_);
+static void LatFinishMessages(LatUartType* psUart_, u32 u32Until_);
+static void LatRun(LatSchedulerType eScheduler_, u32 u32Passes_, u32 u32Seed_, u32 u32Load_);
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+int main(int argc, char* argv[])
+{
+  static const char* apcSchedulers[LAT_SCHEDULERS] = {"round-robin", "pending bitmap"};
+  u32 u32Passes = U32_LAT_DEFAULT_PASSES;
+  u32 u32Seed = 1;
+  u32 u32Load = U32_LAT_DEFAULT_LOAD;
+
+  if(argc > 1)
+  {
+    u32Passes = (u32)strtoul(argv[1], NULL, 0);
+  }
+  if(argc > 2)
+  {
+    u32Seed = (u32)strtoul(argv[2], NULL, 0);
+  }
+  if(argc > 3)
+  {
+    u32Load = (u32)strtoul(argv[3], NULL, 0);
+  }
+
+  /* messaging.c links messages through 32-bit words */
+  if( (uintptr_t)&Lat_asUarts[0] > UINT32_MAX )
+  {
+    printf("FAIL: data is not in the low 4GB; build with -no-pie\n");
+    return(1);
+  }
+
+  printf("%u passes, seed %u, %u UARTs each sending %u%% of the time\n", (unsigned)u32Passes,
+         (unsigned)u32Seed, (unsigned)U8_LAT_UARTS, (unsigned)u32Load);
+  printf("  scheduler        task-started: count  mean us   max us    all: count  mean us   max us  refused\n");
+
+  for(u8 i = 0; i < LAT_SCHEDULERS; i++)
+  {
+    LatRun((LatSchedulerType)i, u32Passes, u32Seed, u32Load);
+
+    printf("  %-15s %19u %8.0f %8u %12u %8.0f %8u %8u\n", apcSchedulers[i],
+           (unsigned)Lat_sResult.u32TaskStarts,
+           (double)Lat_sResult.u64TaskWait / (double)(Lat_sResult.u32TaskStarts ? Lat_sResult.u32TaskStarts : 1),
+           (unsigned)Lat_sResult.u32TaskMaxWait, (unsigned)Lat_sResult.u32AllStarts,
+           (double)Lat_sResult.u64AllWait / (double)(Lat_sResult.u32AllStarts ? Lat_sResult.u32AllStarts : 1),
+           (unsigned)Lat_sResult.u32AllMaxWait, (unsigned)Lat_sResult.u32Refused);
+  }
+
+  return(0);
+
+} /* end main() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static u32 LatRandom(u32 u32Range_)
+
+@brief Returns a pseudo-random number from 0 to u32Range_ - 1 (xorshift32).
+*/
+static u32 LatRandom(u32 u32Range_)
+{
+  Lat_u32Random ^= Lat_u32Random << 13;
+  Lat_u32Random ^= Lat_u32Random >> 17;
+  Lat_u32Random ^= Lat_u32Random << 5;
+
+  return(Lat_u32Random % u32Range_);
+
+} /* end LatRandom() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void LatInitialize(u32 u32Seed_)
+
+@brief Starts a run: fresh messaging.c state, idle UARTs and the random traffic of u32Seed_.
+*/
+static void LatInitialize(u32 u32Seed_)
+{
+  MessagingInitialize();
+
+  for(u8 i = 0; i < U8_LAT_UARTS; i++)
+  {
+    MessageQueueInitialize(&Lat_asUarts[i].sQueue, Lat_asUarts[i].pu8Name);
+    MessageQueueSetPendingFlag(&Lat_asUarts[i].sQueue, &Lat_u32PendingTx, Lat_asUarts[i].u32PendingFlag);
+    Lat_asUarts[i].bSending = FALSE;
+    Lat_asUarts[i].u8QueueHead = 0;
+    Lat_asUarts[i].u8QueueTail = 0;
+  }
+
+  Lat_u32PendingTx = 0;
+  Lat_u8CurrentUart = 0;
+  Lat_u32Random = u32Seed_ | 1;
+  memset(&Lat_sResult, 0, sizeof(Lat_sResult));
+
+} /* end LatInitialize() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void LatStartMessage(LatUartType* psUart_, u32 u32Now_, bool bTask_)
+
+@brief Loads the head message of an idle UART at u32Now_ and records its start latency.
+*/
+static void LatStartMessage(LatUartType* psUart_, u32 u32Now_, bool bTask_)
+{
+  u32 u32Wait = u32Now_ - psUart_->au32QueueTime[psUart_->u8QueueHead];
+
+  psUart_->bSending = TRUE;
+  psUart_->u32SendEnd = u32Now_ + ((psUart_->sQueue.psHead->u32Size * U32_LAT_BYTE_TIME_NS) / 1000);
+
+  if(bTask_)
+  {
+    Lat_sResult.u32TaskStarts++;
+    Lat_sResult.u64TaskWait += u32Wait;
+    if(u32Wait > Lat_sResult.u32TaskMaxWait)
+    {
+      Lat_sResult.u32TaskMaxWait = u32Wait;
+    }
+  }
+
+  Lat_sResult.u32AllStarts++;
+  Lat_sResult.u64AllWait += u32Wait;
+  if(u32Wait > Lat_sResult.u32AllMaxWait)
+  {
+    Lat_sResult.u32AllMaxWait = u32Wait;
+  }
+
+} /* end LatStartMessage() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void LatRunUartTask(LatSchedulerType eScheduler_, u32 u32Now_)
+
+@brief One call of UartSM_Idle() with the chosen scheduler.
+*/
+static void LatRunUartTask(LatSchedulerType eScheduler_, u32 u32Now_)
+{
+  LatUartType* psUart;
+  u32 u32Pending;
+
+  if(eScheduler_ == LAT_ROUND_ROBIN)
+  {
+    psUart = &Lat_asUarts[Lat_u8CurrentUart];
+    if( (psUart->sQueue.psHead != NULL) && !psUart->bSending )
+    {
+      LatStartMessage(psUart, u32Now_, TRUE);
+    }
+
+    Lat_u8CurrentUart = (Lat_u8CurrentUart + 1) % U8_LAT_UARTS;
+    return;
+  }
+
+  u32Pending = Lat_u32PendingTx;
+  Lat_u32PendingTx = 0;
+
+  for(u8 i = 0; i < U8_LAT_UARTS; i++)
+  {
+    psUart = &Lat_asUarts[i];
+    if( (u32Pending & psUart->u32PendingFlag) && (psUart->sQueue.psHead != NULL) && !psUart->bSending )
+    {
+      LatStartMessage(psUart, u32Now_, TRUE);
+    }
+  }
+
+} /* end LatRunUartTask() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void LatFinishMessages(LatUartType* psUart_, u32 u32Until_)
+
+@brief Runs the UART's ENDTX ISR for every message that finishes before u32Until_: the message
+is retired and the next message queued is started at once.
+*/
+static void LatFinishMessages(LatUartType* psUart_, u32 u32Until_)
+{
+  u32 u32End;
+
+  while(psUart_->bSending && (psUart_->u32SendEnd <= u32Until_))
+  {
+    u32End = psUart_->u32SendEnd;
+    psUart_->bSending = FALSE;
+
+    FinishTxMessage(&psUart_->sQueue, COMPLETE);
+    psUart_->u8QueueHead = (psUart_->u8QueueHead + 1) & (U8_LAT_MAX_QUEUED - 1);
+
+    if(psUart_->sQueue.psHead != NULL)
+    {
+      LatStartMessage(psUart_, u32End, FALSE);
+    }
+  }
+
+} /* end LatFinishMessages() */
+
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn static void LatRun(LatSchedulerType eScheduler_, u32 u32Passes_, u32 u32Seed_, u32 u32Load_)
+
+@brief Runs u32Passes_ main loop passes of random traffic with eScheduler_.
+
+Each UART gets a message in a pass with the odds that keep it sending u32Load_ percent of the
+time.
+*/
+static void LatRun(LatSchedulerType eScheduler_, u32 u32Passes_, u32 u32Seed_, u32 u32Load_)
+{
+  u32 u32MeanSendTime = (((U8_LAT_MIN_MESSAGE + U8_LAT_MAX_MESSAGE) / 2) * U32_LAT_BYTE_TIME_NS) / 1000;
+  u32 u32Odds = (u32Load_ * U32_LAT_PASS_TIME * 10) / u32MeanSendTime;
+  LatUartType* psUart;
+  u32 u32PassStart;
+  u32 u32QueueTime;
+  u32 u32Size;
+
+  LatInitialize(u32Seed_);
+
+  for(u32 u32Pass = 1; u32Pass <= u32Passes_; u32Pass++)
+  {
+    u32PassStart = u32Pass * U32_LAT_PASS_TIME;
+    G_u32SystemTime1ms = u32Pass;
+
+    LatRunUartTask(eScheduler_, u32PassStart);
+
+    /* The rest of the pass: ISRs and client tasks queuing messages */
+    for(u8 i = 0; i < U8_LAT_UARTS; i++)
+    {
+      psUart = &Lat_asUarts[i];
+      if(LatRandom(1000) < u32Odds)
+      {
+        u32QueueTime = u32PassStart + LatRandom(U32_LAT_PASS_TIME);
+        u32Size = U8_LAT_MIN_MESSAGE + LatRandom(U8_LAT_MAX_MESSAGE - U8_LAT_MIN_MESSAGE + 1);
+
+        LatFinishMessages(psUart, u32QueueTime);
+        if(QueueTxMessage(&psUart->sQueue, u32Size, Lat_au8Data) == 0)
+        {
+          Lat_sResult.u32Refused++;
+        }
+        else
+        {
+          psUart->au32QueueTime[psUart->u8QueueTail] = u32QueueTime;
+          psUart->u8QueueTail = (psUart->u8QueueTail + 1) & (U8_LAT_MAX_QUEUED - 1);
+        }
+      }
+
+      LatFinishMessages(psUart, u32PassStart + U32_LAT_PASS_TIME);
+    }
+  }
+
+} /* end LatRun() */